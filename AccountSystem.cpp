@@ -1,6 +1,52 @@
 #include "AccountSystem.h"
+#include "Metrics.h"
 #include <iostream>
 
+static OperationMetric registerUserMetric("account", "register_user");
+static OperationMetric registerUserByAdminMetric("account", "register_user_by_admin");
+static OperationMetric updateUserProfileMetric("account", "update_user_profile");
+static OperationMetric loginMetric("account", "login");
+static OperationMetric logoutMetric("account", "logout");
+static OperationMetric openSessionMetric("account", "open_session");
+static OperationMetric closeSessionMetric("account", "close_session");
+static OperationMetric changePasswordMetric("account", "change_password");
+static OperationMetric resetPasswordMetric("account", "reset_password");
+static OperationMetric generateOTPMetric("account", "generate_otp");
+static OperationMetric verifyOTPMetric("account", "verify_otp");
+static OperationMetric setupTOTPMetric("account", "setup_totp");
+static OperationMetric verifyTOTPMetric("account", "verify_totp");
+static OperationMetric disableTOTPMetric("account", "disable_totp");
+static OperationMetric isTOTPEnabledMetric("account", "is_totp_enabled");
+static OperationMetric createWalletMetric("account", "create_wallet");
+static OperationMetric getWalletBalanceMetric("account", "get_wallet_balance");
+static OperationMetric getSessionWalletMetric("account", "get_session_wallet");
+static OperationMetric getTransactionHistoryMetric("account", "get_transaction_history");
+static OperationMetric getTransactionMetric("account", "get_transaction");
+static OperationMetric getTransactionStatusMetric("account", "get_transaction_status");
+static OperationMetric displayTransactionSummaryMetric("account", "display_transaction_summary");
+static OperationMetric displayTransactionDetailsMetric("account", "display_transaction_details");
+static OperationMetric getTransactionsByStatusMetric("account", "get_transactions_by_status");
+static OperationMetric transferPointsMetric("account", "transfer_points");
+static OperationMetric initiateTransferMetric("account", "initiate_transfer");
+static OperationMetric confirmTransferMetric("account", "confirm_transfer");
+static OperationMetric getAllUsersMetric("account", "get_all_users");
+static OperationMetric adminAddFundsMetric("account", "admin_add_funds");
+static OperationMetric getAllWalletsMetric("account", "get_all_wallets");
+
+const char* const AccountSystem::PROFILE_UPDATE_PURPOSE = "profile_update";
+const char* const AccountSystem::PASSWORD_CHANGE_PURPOSE = "password_change";
+const char* const AccountSystem::PASSWORD_RESET_PURPOSE = "password_reset";
+const char* const AccountSystem::ADD_FUNDS_PURPOSE = "admin_add_funds";
+
+// Purpose an OTP is issued and verified under: a profile update also tells
+// the user what they are approving
+static std::string otpPurpose(const std::string& purpose) {
+    if (purpose == AccountSystem::PROFILE_UPDATE_PURPOSE) {
+        return purpose + " - Changes to personal information";
+    }
+    return purpose;
+}
+
 AccountSystem::AccountSystem() 
     : dataManager(), authManager(dataManager), walletManager(dataManager, authManager) {
 }
@@ -12,13 +58,17 @@ void AccountSystem::start() {
         std::cout << "Warning: Failed to load existing data." << std::endl;
     }
     
+    // Saves from here on are written by the background writer, off the request path
+    dataManager.startBackgroundWriter();
+    
     std::cout << "System started successfully." << std::endl;
 }
 
 void AccountSystem::shutdown() {
     std::cout << "Shutting down Account Management System..." << std::endl;
     
-    if (!dataManager.saveData()) {
+    dataManager.stopBackgroundWriter();
+    if (!dataManager.checkpoint()) {
         std::cout << "Warning: Failed to save data." << std::endl;
     }
     
@@ -30,6 +80,8 @@ bool AccountSystem::registerUser(const std::string& username,
                                const std::string& fullName,
                                const std::string& email,
                                const std::string& phoneNumber) {
+    OperationTimer timer(registerUserMetric, true);
+    
     if (dataManager.userExists(username)) {
         std::cout << "Username already exists." << std::endl;
         return false;
@@ -38,19 +90,29 @@ bool AccountSystem::registerUser(const std::string& username,
     bool success = authManager.registerUser(username, password, fullName, email, phoneNumber);
     
     if (success) {
-        std::string walletId = walletManager.createWallet(username);
+        Id128 walletId = walletManager.createWallet(username);
         std::cout << "Wallet created for user: " << username << " with ID: " << walletId << std::endl;
         dataManager.saveData();
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::registerUserByAdmin(const std::string& username, 
                                       const std::string& fullName,
                                       const std::string& email,
                                       const std::string& phoneNumber) {
-    if (!isAdmin()) {
+    return registerUserByAdmin(authManager.getCurrentSession(), username, fullName, email, phoneNumber);
+}
+
+bool AccountSystem::registerUserByAdmin(const SessionToken& sessionToken,
+                                      const std::string& username, 
+                                      const std::string& fullName,
+                                      const std::string& email,
+                                      const std::string& phoneNumber) {
+    OperationTimer timer(registerUserByAdminMetric, true);
+    
+    if (!isAdmin(sessionToken)) {
         std::cout << "Only administrators can register new users." << std::endl;
         return false;
     }
@@ -60,14 +122,14 @@ bool AccountSystem::registerUserByAdmin(const std::string& username,
         return false;
     }
     
-    bool success = authManager.registerUserByAdmin(username, fullName, email, phoneNumber);
+    bool success = authManager.registerUserByAdmin(sessionToken, username, fullName, email, phoneNumber);
     
     if (success) {
-        std::string walletId = walletManager.createWallet(username);
+        Id128 walletId = walletManager.createWallet(username);
         std::cout << "Wallet created for user: " << username << " with ID: " << walletId << std::endl;
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::updateUserProfile(const std::string& username,
@@ -75,27 +137,38 @@ bool AccountSystem::updateUserProfile(const std::string& username,
                                     const std::string& email,
                                     const std::string& phoneNumber,
                                     const std::string& otpCode) {
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    return updateUserProfile(authManager.getCurrentSession(), username, fullName, email, phoneNumber, otpCode);
+}
+
+bool AccountSystem::updateUserProfile(const SessionToken& sessionToken,
+                                    const std::string& username,
+                                    const std::string& fullName,
+                                    const std::string& email,
+                                    const std::string& phoneNumber,
+                                    const std::string& otpCode) {
+    OperationTimer timer(updateUserProfileMetric, true);
+    
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
-    if (authManager.getCurrentUser() != username && !isAdmin()) {
+    if (!authManager.canManageUser(sessionToken, username)) {
         std::cout << "Permission denied. Only the user or an admin can update profile." << std::endl;
         return false;
     }
     
-    if (!authManager.verifyOTP(username, otpCode)) {
+    if (!authManager.verifyOTP(username, otpPurpose(PROFILE_UPDATE_PURPOSE), otpCode)) {
         std::cout << "Invalid OTP. Profile update cancelled." << std::endl;
         return false;
     }
     
-    user->setFullName(fullName);
-    user->setEmail(email);
-    user->setPhoneNumber(phoneNumber);
+    user.setFullName(fullName);
+    user.setEmail(email);
+    user.setPhoneNumber(phoneNumber);
     
-    bool success = dataManager.saveUser(*user);
+    bool success = dataManager.saveUser(user);
     if (success) {
         std::cout << "Profile for " << username << " updated successfully." << std::endl;
         dataManager.saveData();
@@ -103,17 +176,19 @@ bool AccountSystem::updateUserProfile(const std::string& username,
         std::cout << "Failed to update profile for " << username << "." << std::endl;
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::login(const std::string& username, const std::string& password) {
+    OperationTimer timer(loginMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found: " << username << std::endl;
         return false;
     }
     
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "Error retrieving user data." << std::endl;
         return false;
     }
@@ -121,12 +196,15 @@ bool AccountSystem::login(const std::string& username, const std::string& passwo
     bool success = authManager.login(username, password);
     
     if (success) {
-        user->setLastLoginDate(time(NULL));
-        dataManager.saveUser(*user);
+        // Login saved the user as well: change a fresh copy
+        if (dataManager.copyUser(username, user)) {
+            user.setLastLoginDate(time(NULL));
+            dataManager.saveUser(user);
+        }
         
         std::cout << "Login successful for user: " << username << std::endl;
         
-        if (user->getIsAutoGeneratedPassword()) {
+        if (user.getIsAutoGeneratedPassword()) {
             std::cout << "IMPORTANT: Your account is using an auto-generated password. " << std::endl;
             std::cout << "You will be required to change your password immediately." << std::endl;
         }
@@ -134,23 +212,49 @@ bool AccountSystem::login(const std::string& username, const std::string& passwo
         std::cout << "Login failed: Incorrect password for " << username << std::endl;
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 void AccountSystem::logout() {
+    OperationTimer timer(logoutMetric);
+    
     authManager.logout();
 }
 
+SessionToken AccountSystem::openSession(const std::string& username, const std::string& password) {
+    OperationTimer timer(openSessionMetric, true);
+    
+    SessionToken token = authManager.openSession(username, password);
+    timer.succeed(!token.empty());
+    return token;
+}
+
+void AccountSystem::closeSession(const SessionToken& sessionToken) {
+    OperationTimer timer(closeSessionMetric);
+    
+    authManager.closeSession(sessionToken);
+}
+
+bool AccountSystem::getSession(const SessionToken& sessionToken, Session& session) const {
+    return authManager.getSession(sessionToken, session);
+}
+
 bool AccountSystem::changePassword(const std::string& oldPassword, const std::string& newPassword, const std::string& otpCode) {
-    if (!isLoggedIn()) {
+    return changePassword(authManager.getCurrentSession(), oldPassword, newPassword, otpCode);
+}
+
+bool AccountSystem::changePassword(const SessionToken& sessionToken, const std::string& oldPassword,
+                                 const std::string& newPassword, const std::string& otpCode) {
+    OperationTimer timer(changePasswordMetric, true);
+    
+    std::string username = authManager.getSessionUser(sessionToken);
+    if (username.empty()) {
         std::cout << "Not logged in." << std::endl;
         return false;
     }
     
-    std::string username = authManager.getCurrentUser();
-    
     // Verify OTP before changing password
-    if (!authManager.verifyOTP(username, otpCode)) {
+    if (!authManager.verifyOTP(username, otpPurpose(PASSWORD_CHANGE_PURPOSE), otpCode)) {
         std::cout << "Invalid OTP. Password change cancelled." << std::endl;
         return false;
     }
@@ -158,44 +262,52 @@ bool AccountSystem::changePassword(const std::string& oldPassword, const std::st
     bool success = authManager.changePassword(username, oldPassword, newPassword);
     
     if (success) {
-        User* user = dataManager.getUser(username);
-        if (user) {
-            user->setIsAutoGeneratedPassword(false);
-            user->setIsFirstLogin(false);
-            dataManager.saveUser(*user);
+        User user;
+        if (dataManager.copyUser(username, user)) {
+            user.setIsAutoGeneratedPassword(false);
+            user.setIsFirstLogin(false);
+            dataManager.saveUser(user);
         }
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::resetPassword(const std::string& username, const std::string& otpCode) {
-    if (authManager.getCurrentUser() != username && !isAdmin()) {
+    return resetPassword(authManager.getCurrentSession(), username, otpCode);
+}
+
+bool AccountSystem::resetPassword(const SessionToken& sessionToken, const std::string& username, const std::string& otpCode) {
+    OperationTimer timer(resetPasswordMetric, true);
+    
+    if (!authManager.canManageUser(sessionToken, username)) {
         std::cout << "Permission denied." << std::endl;
         return false;
     }
     
     // Verify OTP before resetting password
-    if (!authManager.verifyOTP(username, otpCode)) {
+    if (!authManager.verifyOTP(username, otpPurpose(PASSWORD_RESET_PURPOSE), otpCode)) {
         std::cout << "Invalid OTP. Password reset cancelled." << std::endl;
         return false;
     }
     
-    bool success = authManager.resetPassword(username);
+    bool success = authManager.resetPassword(sessionToken, username);
     
     if (success) {
-        User* user = dataManager.getUser(username);
-        if (user) {
-            user->setIsAutoGeneratedPassword(true);
-            user->setIsFirstLogin(true);
-            dataManager.saveUser(*user);
+        User user;
+        if (dataManager.copyUser(username, user)) {
+            user.setIsAutoGeneratedPassword(true);
+            user.setIsFirstLogin(true);
+            dataManager.saveUser(user);
         }
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::generateOTP(const std::string& username, const std::string& purpose) {
+    OperationTimer timer(generateOTPMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
@@ -207,11 +319,7 @@ bool AccountSystem::generateOTP(const std::string& username, const std::string&
         return false;
     }
     
-    std::string enhancedPurpose = purpose;
-    
-    if (purpose == "profile_update" || purpose == "admin_profile_update") {
-        enhancedPurpose += " - Changes to personal information";
-    }
+    std::string enhancedPurpose = otpPurpose(purpose);
     
     std::cout << "--------------------------------------------" << std::endl;
     std::cout << "NOTIFICATION: An OTP has been generated for " << username << std::endl;
@@ -222,69 +330,85 @@ bool AccountSystem::generateOTP(const std::string& username, const std::string&
     
     std::cout << "--------------------------------------------" << std::endl;
     
-    return result;
+    return timer.succeed(result);
 }
 
-bool AccountSystem::verifyOTP(const std::string& username, const std::string& otpCode) {
+bool AccountSystem::verifyOTP(const std::string& username, const std::string& purpose, const std::string& otpCode) {
+    OperationTimer timer(verifyOTPMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
-    return authManager.verifyOTP(username, otpCode);
+    return timer.succeed(authManager.verifyOTP(username, otpPurpose(purpose), otpCode));
 }
 
 // TOTP (Two-Factor Authentication) methods
 
 bool AccountSystem::setupTOTP(const std::string& username) {
+    return setupTOTP(authManager.getCurrentSession(), username);
+}
+
+bool AccountSystem::setupTOTP(const SessionToken& sessionToken, const std::string& username) {
+    OperationTimer timer(setupTOTPMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
     // Only the user themselves or an admin can set up TOTP
-    if (authManager.getCurrentUser() != username && !isAdmin()) {
+    if (!authManager.canManageUser(sessionToken, username)) {
         std::cout << "Permission denied. Only the user or an admin can set up 2FA." << std::endl;
         return false;
     }
     
-    return authManager.setupTOTP(username);
+    return timer.succeed(authManager.setupTOTP(username));
 }
 
 bool AccountSystem::verifyTOTP(const std::string& username, const std::string& totpCode) {
+    OperationTimer timer(verifyTOTPMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
-    return authManager.verifyTOTP(username, totpCode);
+    return timer.succeed(authManager.verifyTOTP(username, totpCode));
 }
 
 bool AccountSystem::disableTOTP(const std::string& username) {
+    return disableTOTP(authManager.getCurrentSession(), username);
+}
+
+bool AccountSystem::disableTOTP(const SessionToken& sessionToken, const std::string& username) {
+    OperationTimer timer(disableTOTPMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
     // Only the user themselves or an admin can disable TOTP
-    if (authManager.getCurrentUser() != username && !isAdmin()) {
+    if (!authManager.canManageUser(sessionToken, username)) {
         std::cout << "Permission denied. Only the user or an admin can disable 2FA." << std::endl;
         return false;
     }
     
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "Error retrieving user data." << std::endl;
         return false;
     }
     
-    if (!user->isTOTPEnabled()) {
+    if (!user.isTOTPEnabled()) {
         std::cout << "TOTP is not enabled for this user." << std::endl;
         return false;
     }
     
-    user->enableTOTP(false);
-    bool success = dataManager.saveUser(*user);
+    user.enableTOTP(false);
+    bool success = dataManager.saveUser(user);
     
     if (success) {
         std::cout << "TOTP disabled for user: " << username << std::endl;
@@ -293,63 +417,84 @@ bool AccountSystem::disableTOTP(const std::string& username) {
         std::cout << "Failed to disable TOTP for user: " << username << std::endl;
     }
     
-    return success;
+    return timer.succeed(success);
 }
 
 bool AccountSystem::isTOTPEnabled(const std::string& username) {
+    OperationTimer timer(isTOTPEnabledMetric, true);
+    
     if (!dataManager.userExists(username)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "Error retrieving user data." << std::endl;
         return false;
     }
     
-    return user->isTOTPEnabled();
+    timer.succeed(true);
+    return user.isTOTPEnabled();
 }
 
-std::string AccountSystem::createWallet(const std::string& ownerUsername) {
+Id128 AccountSystem::createWallet(const std::string& ownerUsername) {
+    OperationTimer timer(createWalletMetric, true);
+    
     if (!dataManager.userExists(ownerUsername)) {
         std::cout << "User not found." << std::endl;
-        return "";
+        return Id128();
     }
     
-    return walletManager.createWallet(ownerUsername);
+    Id128 walletId = walletManager.createWallet(ownerUsername);
+    timer.succeed(!walletId.isNil());
+    return walletId;
 }
 
-double AccountSystem::getWalletBalance(const std::string& walletId) {
+Money AccountSystem::getWalletBalance(const Id128& walletId) {
+    OperationTimer timer(getWalletBalanceMetric);
+    
     return walletManager.getBalance(walletId);
 }
 
 Wallet* AccountSystem::getCurrentUserWallet() {
-    if (!isLoggedIn()) {
-        return NULL;
-    }
+    return getSessionWallet(authManager.getCurrentSession());
+}
+
+Wallet* AccountSystem::getSessionWallet(const SessionToken& sessionToken) {
+    OperationTimer timer(getSessionWalletMetric);
     
-    std::string username = getCurrentUser();
-    return dataManager.getWalletByOwner(username);
+    return walletManager.getSessionWallet(sessionToken);
 }
 
-std::vector<Transaction> AccountSystem::getTransactionHistory(const std::string& walletId) {
+std::vector<Transaction> AccountSystem::getTransactionHistory(const Id128& walletId) {
+    OperationTimer timer(getTransactionHistoryMetric);
+    
     return walletManager.getTransactionHistory(walletId);
 }
 
-Transaction* AccountSystem::getTransaction(const std::string& transactionId) {
-    return dataManager.getTransaction(transactionId);
+Transaction* AccountSystem::getTransaction(const Id128& transactionId) {
+    OperationTimer timer(getTransactionMetric, true);
+    
+    Transaction* transaction = dataManager.getTransaction(transactionId);
+    timer.succeed(transaction != NULL);
+    return transaction;
 }
 
-std::string AccountSystem::getTransactionStatusString(const std::string& transactionId) {
+std::string AccountSystem::getTransactionStatusString(const Id128& transactionId) {
+    OperationTimer timer(getTransactionStatusMetric, true);
+    
     Transaction* transaction = dataManager.getTransaction(transactionId);
     if (transaction) {
+        timer.succeed(true);
         return transaction->getStatusString();
     }
     return "Unknown";
 }
 
-void AccountSystem::displayTransactionSummary(const std::string& walletId) {
+void AccountSystem::displayTransactionSummary(const Id128& walletId) {
+    OperationTimer timer(displayTransactionSummaryMetric);
+    
     Wallet* wallet = dataManager.getWallet(walletId);
     if (!wallet) {
         std::cout << "Wallet not found." << std::endl;
@@ -358,11 +503,13 @@ void AccountSystem::displayTransactionSummary(const std::string& walletId) {
     
     std::vector<Transaction> transactions = getTransactionHistory(walletId);
     std::cout << "===== Transaction Summary for Wallet: " << walletId << " =====" << std::endl;
-    std::cout << "Current Balance: " << wallet->getBalance() << std::endl;
+    std::cout << "Current Balance: " << walletManager.getBalance(walletId) << std::endl;
     std::cout << "Total Transactions: " << transactions.size() << std::endl;
     
     int completed = 0, pending = 0, failed = 0, cancelled = 0;
-    double totalSent = 0.0, totalReceived = 0.0;
+    // Exact integer sums; an overflow is reported rather than wrapped
+    Money totalSent, totalReceived;
+    bool overflow = false;
     
     for (size_t i = 0; i < transactions.size(); ++i) {
         const Transaction& tx = transactions[i];
@@ -375,11 +522,11 @@ void AccountSystem::displayTransactionSummary(const std::string& walletId) {
         }
         
         if (tx.getStatus() == COMPLETED) {
-            if (tx.getSenderWalletId() == walletId) {
-                totalSent += tx.getAmount();
+            if (tx.getSenderWalletId() == walletId && !totalSent.tryAdd(tx.getAmount())) {
+                overflow = true;
             }
-            if (tx.getReceiverWalletId() == walletId) {
-                totalReceived += tx.getAmount();
+            if (tx.getReceiverWalletId() == walletId && !totalReceived.tryAdd(tx.getAmount())) {
+                overflow = true;
             }
         }
     }
@@ -390,10 +537,15 @@ void AccountSystem::displayTransactionSummary(const std::string& walletId) {
     std::cout << "Cancelled Transactions: " << cancelled << std::endl;
     std::cout << "Total Points Sent: " << totalSent << std::endl;
     std::cout << "Total Points Received: " << totalReceived << std::endl;
+    if (overflow) {
+        std::cout << "Warning: totals exceed the representable range and are incomplete." << std::endl;
+    }
     std::cout << "=================================================" << std::endl;
 }
 
-void AccountSystem::displayTransactionDetails(const std::string& transactionId) {
+void AccountSystem::displayTransactionDetails(const Id128& transactionId) {
+    OperationTimer timer(displayTransactionDetailsMetric);
+    
     Transaction* transaction = dataManager.getTransaction(transactionId);
     if (!transaction) {
         std::cout << "Transaction not found." << std::endl;
@@ -403,8 +555,8 @@ void AccountSystem::displayTransactionDetails(const std::string& transactionId)
     std::cout << "===== Transaction Details =====" << std::endl;
     std::cout << "Transaction ID: " << transaction->getTransactionId() << std::endl;
     
-    std::string senderWalletId = transaction->getSenderWalletId();
-    std::string receiverWalletId = transaction->getReceiverWalletId();
+    Id128 senderWalletId = transaction->getSenderWalletId();
+    Id128 receiverWalletId = transaction->getReceiverWalletId();
     
     Wallet* senderWallet = dataManager.getWallet(senderWalletId);
     Wallet* receiverWallet = dataManager.getWallet(receiverWalletId);
@@ -434,7 +586,9 @@ void AccountSystem::displayTransactionDetails(const std::string& transactionId)
     std::cout << "================================" << std::endl;
 }
 
-std::vector<Transaction> AccountSystem::getTransactionsByStatus(const std::string& walletId, TransactionStatus status) {
+std::vector<Transaction> AccountSystem::getTransactionsByStatus(const Id128& walletId, TransactionStatus status) {
+    OperationTimer timer(getTransactionsByStatusMetric);
+    
     std::vector<Transaction> allTransactions = getTransactionHistory(walletId);
     std::vector<Transaction> filteredTransactions;
     
@@ -447,39 +601,61 @@ std::vector<Transaction> AccountSystem::getTransactionsByStatus(const std::strin
     return filteredTransactions;
 }
 
-bool AccountSystem::transferPoints(const std::string& receiverWalletId,
-                                 double amount,
-                                 const std::string& otpCode,
-                                 const std::string& description) {
-    if (!isLoggedIn()) {
+TransferResult AccountSystem::transferPoints(const Id128& receiverWalletId,
+                                             const Money& amount,
+                                             const std::string& otpCode,
+                                             const std::string& description) {
+    return transferPoints(authManager.getCurrentSession(), receiverWalletId, amount, otpCode, description);
+}
+
+TransferResult AccountSystem::transferPoints(const SessionToken& sessionToken,
+                                             const Id128& receiverWalletId,
+                                             const Money& amount,
+                                             const std::string& otpCode,
+                                             const std::string& description) {
+    OperationTimer timer(transferPointsMetric, true);
+    
+    if (!isLoggedIn(sessionToken)) {
         std::cout << "Not logged in." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    Wallet* senderWallet = walletManager.getCurrentUserWallet();
+    Wallet* senderWallet = walletManager.getSessionWallet(sessionToken);
     if (!senderWallet) {
         std::cout << "Sender wallet not found." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    return walletManager.transferPoints(
+    TransferResult result = walletManager.transferPoints(
         senderWallet->getWalletId(),
         receiverWalletId,
         amount,
         otpCode,
         description
     );
+    
+    timer.succeed(result == TRANSFER_DONE);
+    return result;
+}
+
+bool AccountSystem::initiateTransfer(const Id128& receiverWalletId, 
+                                   const Money& amount,
+                                   const std::string& description) {
+    return initiateTransfer(authManager.getCurrentSession(), receiverWalletId, amount, description);
 }
 
-bool AccountSystem::initiateTransfer(const std::string& receiverWalletId, 
-                                   double amount,
+bool AccountSystem::initiateTransfer(const SessionToken& sessionToken,
+                                   const Id128& receiverWalletId, 
+                                   const Money& amount,
                                    const std::string& description) {
-    if (!isLoggedIn()) {
+    OperationTimer timer(initiateTransferMetric, true);
+    
+    if (!isLoggedIn(sessionToken)) {
         std::cout << "Not logged in." << std::endl;
         return false;
     }
     
-    Wallet* senderWallet = walletManager.getCurrentUserWallet();
+    Wallet* senderWallet = walletManager.getSessionWallet(sessionToken);
     if (!senderWallet) {
         std::cout << "Sender wallet not found." << std::endl;
         return false;
@@ -493,45 +669,66 @@ bool AccountSystem::initiateTransfer(const std::string& receiverWalletId,
     }
     
     // Validate sender has enough balance before proceeding
-    if (senderWallet->getBalance() < amount) {
+    if (walletManager.getBalance(senderWallet->getWalletId()) < amount) {
         std::cout << "Insufficient balance for transfer. Cannot proceed." << std::endl;
         return false;
     }
     
-    return walletManager.initiateTransfer(
+    bool success = walletManager.initiateTransfer(
         senderWallet->getWalletId(),
         receiverWalletId,
         amount,
         description
     );
+    
+    return timer.succeed(success);
 }
 
-bool AccountSystem::confirmTransfer(const std::string& receiverWalletId,
-                                  double amount,
-                                  const std::string& otpCode,
-                                  const std::string& description) {
-    if (!isLoggedIn()) {
+TransferResult AccountSystem::confirmTransfer(const Id128& receiverWalletId,
+                                              const Money& amount,
+                                              const std::string& otpCode,
+                                              const std::string& description) {
+    return confirmTransfer(authManager.getCurrentSession(), receiverWalletId, amount, otpCode, description);
+}
+
+TransferResult AccountSystem::confirmTransfer(const SessionToken& sessionToken,
+                                              const Id128& receiverWalletId,
+                                              const Money& amount,
+                                              const std::string& otpCode,
+                                              const std::string& description) {
+    OperationTimer timer(confirmTransferMetric, true);
+    
+    if (!isLoggedIn(sessionToken)) {
         std::cout << "Not logged in." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    Wallet* senderWallet = walletManager.getCurrentUserWallet();
+    Wallet* senderWallet = walletManager.getSessionWallet(sessionToken);
     if (!senderWallet) {
         std::cout << "Sender wallet not found." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    return walletManager.confirmTransfer(
+    TransferResult result = walletManager.confirmTransfer(
         senderWallet->getWalletId(),
         receiverWalletId,
         amount,
         otpCode,
         description
     );
+    
+    timer.succeed(result == TRANSFER_DONE);
+    return result;
 }
 
 std::vector<User> AccountSystem::getAllUsers() {
-    if (!isAdmin()) {
+    return getAllUsers(authManager.getCurrentSession());
+}
+
+std::vector<User> AccountSystem::getAllUsers(const SessionToken& sessionToken) {
+    OperationTimer timer(getAllUsersMetric);
+    
+    if (!isAdmin(sessionToken)) {
         std::cout << "Only administrators can view all users." << std::endl;
         return std::vector<User>();
     }
@@ -551,46 +748,73 @@ std::string AccountSystem::getCurrentUser() const {
     return authManager.getCurrentUser();
 }
 
+bool AccountSystem::isAdmin(const SessionToken& sessionToken) const {
+    return authManager.isSessionAdmin(sessionToken);
+}
+
+bool AccountSystem::isLoggedIn(const SessionToken& sessionToken) const {
+    Session session;
+    return authManager.getSession(sessionToken, session);
+}
+
+std::string AccountSystem::getSessionUser(const SessionToken& sessionToken) const {
+    return authManager.getSessionUser(sessionToken);
+}
+
 // Admin function to add funds to any wallet - only admins can use this
-bool AccountSystem::adminAddFundsToWallet(const std::string& walletId, double amount, const std::string& otpCode) {
+TransferResult AccountSystem::adminAddFundsToWallet(const Id128& walletId, const Money& amount, const std::string& otpCode) {
+    return adminAddFundsToWallet(authManager.getCurrentSession(), walletId, amount, otpCode);
+}
+
+TransferResult AccountSystem::adminAddFundsToWallet(const SessionToken& sessionToken, const Id128& walletId,
+                                                    const Money& amount, const std::string& otpCode) {
+    OperationTimer timer(adminAddFundsMetric, true);
+    
     // Check if user is logged in and is an admin
-    if (!isLoggedIn()) {
+    Session session;
+    if (!authManager.getSession(sessionToken, session)) {
         std::cout << "Not logged in." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    if (!isAdmin()) {
+    if (!session.isAdmin()) {
         std::cout << "Permission denied. Only administrators can add funds to wallets." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
     // Validate wallet exists
     Wallet* wallet = dataManager.getWallet(walletId);
     if (!wallet) {
         std::cout << "Wallet not found." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
     // Verify OTP before adding funds
-    std::string adminUsername = authManager.getCurrentUser();
-    if (!authManager.verifyOTP(adminUsername, otpCode)) {
+    std::string adminUsername = session.username;
+    if (!authManager.verifyOTP(adminUsername, otpPurpose(ADD_FUNDS_PURPOSE), otpCode)) {
         std::cout << "Invalid OTP. Adding funds cancelled." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
     // Use WalletManager to add the funds
-    bool success = walletManager.addFundsToWallet(walletId, amount);
+    TransferResult result = walletManager.addFundsToWallet(walletId, amount);
     
-    if (success) {
+    if (result != TRANSFER_REJECTED) {
         std::cout << "Successfully added " << amount << " points to wallet: " << walletId << std::endl;
-        std::cout << "New balance: " << wallet->getBalance() << " points" << std::endl;
+        std::cout << "New balance: " << walletManager.getBalance(walletId) << " points" << std::endl;
+        if (result == TRANSFER_NOT_DURABLE) {
+            std::cout << "Warning: the deposit is not yet saved to disk. Do not repeat it." << std::endl;
+        }
     } else {
         std::cout << "Failed to add funds to wallet." << std::endl;
     }
     
-    return success;
+    timer.succeed(result == TRANSFER_DONE);
+    return result;
 }
 
 std::vector<Wallet> AccountSystem::getAllWallets() {
+    OperationTimer timer(getAllWalletsMetric);
+    
     return dataManager.getAllWallets();
 } 
@@ -7,6 +7,8 @@
 #include "DataManager.h"
 #include "WalletManager.h"
 
+// Operations that depend on who is asking take a SessionToken; the overloads
+// without one act for the console session (login()/logout()).
 class AccountSystem {
 private:
     AuthManager authManager;
@@ -15,83 +17,137 @@ private:
 
 public:
     AccountSystem();
-
+    
     void start();
     void shutdown();
-
+    
     bool registerUser(const std::string& username, 
                      const std::string& password, 
                      const std::string& fullName,
                      const std::string& email,
                      const std::string& phoneNumber);
-                     
+    
     bool registerUserByAdmin(const std::string& username, 
                             const std::string& fullName,
                             const std::string& email,
                             const std::string& phoneNumber);
-                            
+    bool registerUserByAdmin(const SessionToken& sessionToken,
+                            const std::string& username, 
+                            const std::string& fullName,
+                            const std::string& email,
+                            const std::string& phoneNumber);
+    
     bool updateUserProfile(const std::string& username,
                           const std::string& fullName,
                           const std::string& email,
                           const std::string& phoneNumber,
                           const std::string& otpCode);
-                          
+    bool updateUserProfile(const SessionToken& sessionToken,
+                          const std::string& username,
+                          const std::string& fullName,
+                          const std::string& email,
+                          const std::string& phoneNumber,
+                          const std::string& otpCode);
+    
     bool login(const std::string& username, const std::string& password);
     void logout();
+    
+    // One session per client; an empty token means the login failed
+    SessionToken openSession(const std::string& username, const std::string& password);
+    void closeSession(const SessionToken& sessionToken);
+    bool getSession(const SessionToken& sessionToken, Session& session) const;
+    
     bool changePassword(const std::string& oldPassword, const std::string& newPassword, const std::string& otpCode);
+    bool changePassword(const SessionToken& sessionToken, const std::string& oldPassword,
+                       const std::string& newPassword, const std::string& otpCode);
     bool resetPassword(const std::string& username, const std::string& otpCode);
-
+    bool resetPassword(const SessionToken& sessionToken, const std::string& username, const std::string& otpCode);
+    
+    // Purposes of the OTPs that confirm account changes: each change accepts
+    // only an OTP generated for its own purpose
+    static const char* const PROFILE_UPDATE_PURPOSE;
+    static const char* const PASSWORD_CHANGE_PURPOSE;
+    static const char* const PASSWORD_RESET_PURPOSE;
+    static const char* const ADD_FUNDS_PURPOSE;
+    
     // Simple OTP methods
     bool generateOTP(const std::string& username, const std::string& purpose);
-    bool verifyOTP(const std::string& username, const std::string& otpCode);
-
+    bool verifyOTP(const std::string& username, const std::string& purpose, const std::string& otpCode);
+    
     // TOTP (Two-Factor Authentication) methods
     bool setupTOTP(const std::string& username);
+    bool setupTOTP(const SessionToken& sessionToken, const std::string& username);
     bool verifyTOTP(const std::string& username, const std::string& totpCode);
     bool disableTOTP(const std::string& username);
+    bool disableTOTP(const SessionToken& sessionToken, const std::string& username);
     bool isTOTPEnabled(const std::string& username);
-
-    std::string createWallet(const std::string& ownerUsername);
-    double getWalletBalance(const std::string& walletId);
+    
+    Id128 createWallet(const std::string& ownerUsername);
+    Money getWalletBalance(const Id128& walletId);
     Wallet* getCurrentUserWallet();
-    std::vector<Transaction> getTransactionHistory(const std::string& walletId);
+    Wallet* getSessionWallet(const SessionToken& sessionToken);
+    std::vector<Transaction> getTransactionHistory(const Id128& walletId);
     
     // Transaction status related methods
-    Transaction* getTransaction(const std::string& transactionId);
-    std::string getTransactionStatusString(const std::string& transactionId);
+    Transaction* getTransaction(const Id128& transactionId);
+    std::string getTransactionStatusString(const Id128& transactionId);
     
     // Transaction reporting methods
-    void displayTransactionSummary(const std::string& walletId);
-    void displayTransactionDetails(const std::string& transactionId);
+    void displayTransactionSummary(const Id128& walletId);
+    void displayTransactionDetails(const Id128& transactionId);
     
     // Filter transactions by status
-    std::vector<Transaction> getTransactionsByStatus(const std::string& walletId, TransactionStatus status);
+    std::vector<Transaction> getTransactionsByStatus(const Id128& walletId, TransactionStatus status);
     
     // Admin function to add funds to any wallet
-    bool adminAddFundsToWallet(const std::string& walletId, double amount, const std::string& otpCode);
+    TransferResult adminAddFundsToWallet(const Id128& walletId, const Money& amount, const std::string& otpCode);
+    TransferResult adminAddFundsToWallet(const SessionToken& sessionToken, const Id128& walletId,
+                                         const Money& amount, const std::string& otpCode);
     
     // Original single-step transfer method
-    bool transferPoints(const std::string& receiverWalletId,
-                       double amount,
-                       const std::string& otpCode,
-                       const std::string& description = "");
-                       
+    TransferResult transferPoints(const Id128& receiverWalletId,
+                                  const Money& amount,
+                                  const std::string& otpCode,
+                                  const std::string& description = "");
+    TransferResult transferPoints(const SessionToken& sessionToken,
+                                  const Id128& receiverWalletId,
+                                  const Money& amount,
+                                  const std::string& otpCode,
+                                  const std::string& description = "");
+    
     // New two-phase OTP transfer methods
-    bool initiateTransfer(const std::string& receiverWalletId, 
-                         double amount,
+    bool initiateTransfer(const Id128& receiverWalletId, 
+                         const Money& amount,
                          const std::string& description = "");
-                         
-    bool confirmTransfer(const std::string& receiverWalletId,
-                        double amount,
-                        const std::string& otpCode,
-                        const std::string& description = "");
-
+    bool initiateTransfer(const SessionToken& sessionToken,
+                         const Id128& receiverWalletId, 
+                         const Money& amount,
+                         const std::string& description = "");
+    
+    TransferResult confirmTransfer(const Id128& receiverWalletId,
+                                   const Money& amount,
+                                   const std::string& otpCode,
+                                   const std::string& description = "");
+    TransferResult confirmTransfer(const SessionToken& sessionToken,
+                                   const Id128& receiverWalletId,
+                                   const Money& amount,
+                                   const std::string& otpCode,
+                                   const std::string& description = "");
+    
     std::vector<User> getAllUsers();
+    std::vector<User> getAllUsers(const SessionToken& sessionToken);
     std::vector<Wallet> getAllWallets();
     bool isAdmin() const;
     bool isLoggedIn() const;
     std::string getCurrentUser() const;
     
+    // Cached in the session: no user lookup
+    bool isAdmin(const SessionToken& sessionToken) const;
+    bool isLoggedIn(const SessionToken& sessionToken) const;
+    std::string getSessionUser(const SessionToken& sessionToken) const;
+    
+    AuthManager& getAuthManager() { return authManager; }
+    
     // Getter for DataManager - non-const version
     DataManager& getDataManager() { return dataManager; }
     
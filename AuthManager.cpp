@@ -1,4 +1,5 @@
 #include "AuthManager.h"
+#include "SecureRandom.h"
 #include <ctime>
 #include <cstdlib>
 #include <sstream>
@@ -26,17 +27,7 @@ OTP::OTP(const std::string& targetUser, const std::string& purpose, int validity
     digits(6),
     timeInterval(30) {
     
-    unsigned int seed = static_cast<unsigned int>(time(NULL));
-    seed ^= (seed << 13);
-    seed ^= (seed >> 17);
-    seed ^= (seed << 5);
-    srand(seed);
-    
-    int randomCode = 100000 + (rand() % 900000);
-    
-    std::stringstream ss;
-    ss << randomCode;
-    code = ss.str();
+    code = SecureRandom::digits(digits);
     
     expirationTime = time(NULL) + validityInMinutes * 60;
     
@@ -60,6 +51,10 @@ OTP::OTP(const std::string& targetUser, const std::string& purpose,
     
     expirationTime = time(NULL) + validityInMinutes * 60;
     
+    // The key pads are hashed here once, not for every code
+    std::vector<char> key = decodeBase32(secretKey);
+    secretState = HmacSha1(key.empty() ? NULL : &key[0], key.size());
+    
     // Generate the initial TOTP code
     generateNewCode();
 }
@@ -89,20 +84,13 @@ bool OTP::isValid() const {
     return time(NULL) < expirationTime;
 }
 
+time_t OTP::getExpirationTime() const {
+    return expirationTime;
+}
+
 // Generate a random base32 string for use as secret key
 std::string OTP::generateRandomBase32(size_t length) const {
-    std::string result;
-    unsigned int seed = static_cast<unsigned int>(time(NULL));
-    seed ^= (seed << 13);
-    seed ^= (seed >> 17);
-    seed ^= (seed << 5);
-    srand(seed);
-    
-    for (size_t i = 0; i < length; ++i) {
-        result += BASE32_CHARS[rand() % BASE32_CHARS.length()];
-    }
-    
-    return result;
+    return SecureRandom::fromAlphabet(BASE32_CHARS, length);
 }
 
 // Static method to generate a new secret key
@@ -164,91 +152,29 @@ std::vector<char> OTP::decodeBase32(const std::string& base32) const {
     return result;
 }
 
-// Convert an integer to bytes
-std::vector<char> OTP::toBytes(unsigned long value) const {
-    std::vector<char> result(8, 0);
-    
-    for (int i = 7; i >= 0; --i) {
-        result[i] = static_cast<char>(value & 0xFF);
-        value >>= 8;
-    }
-    
-    return result;
-}
-
-// Simple implementation of SHA1 for HMAC
-// NOTE: This is a simplified version for demonstration purposes
-// In a real application, use a proper cryptographic library
-std::vector<char> OTP::hmacSha1(const std::vector<char>& key, const std::vector<char>& message) const {
-    const size_t BLOCK_SIZE = 64;
-    const size_t HASH_SIZE = 20;
-    
-    // Prepare key
-    std::vector<char> blockSizedKey;
-    if (key.size() > BLOCK_SIZE) {
-        // If key is longer than block size, hash it
-        // For simplicity, we'll just truncate it in this example
-        blockSizedKey.assign(key.begin(), key.begin() + BLOCK_SIZE);
-    } else {
-        blockSizedKey = key;
-        // Pad with zeros to block size
-        blockSizedKey.resize(BLOCK_SIZE, 0);
-    }
-    
-    // Prepare inner and outer padding
-    std::vector<char> iPad(BLOCK_SIZE, 0x36);
-    std::vector<char> oPad(BLOCK_SIZE, 0x5c);
-    
-    // XOR key with pads
-    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-        iPad[i] ^= blockSizedKey[i];
-        oPad[i] ^= blockSizedKey[i];
-    }
-    
-    // Concatenate iPad with message
-    std::vector<char> innerData = iPad;
-    innerData.insert(innerData.end(), message.begin(), message.end());
-    
-    // Hash innerData (simplified SHA1)
-    std::vector<char> innerHash(HASH_SIZE, 0);
-    for (size_t i = 0; i < innerData.size(); ++i) {
-        innerHash[i % HASH_SIZE] ^= innerData[i];
-    }
-    
-    // Concatenate oPad with innerHash
-    std::vector<char> outerData = oPad;
-    outerData.insert(outerData.end(), innerHash.begin(), innerHash.end());
-    
-    // Hash outerData (simplified SHA1)
-    std::vector<char> result(HASH_SIZE, 0);
-    for (size_t i = 0; i < outerData.size(); ++i) {
-        result[i % HASH_SIZE] ^= outerData[i];
-    }
-    
-    return result;
-}
-
 // Dynamic truncation as defined in RFC 4226
-unsigned long OTP::dynamicTruncate(const std::vector<char>& hmacResult) const {
-    int offset = hmacResult[hmacResult.size() - 1] & 0x0F;
+unsigned long OTP::dynamicTruncate(const uint8_t* hmacResult) const {
+    int offset = hmacResult[Sha1::DIGEST_SIZE - 1] & 0x0F;
     
     unsigned long p = 0;
-    p |= (hmacResult[offset] & 0x7F) << 24;
-    p |= (hmacResult[offset + 1] & 0xFF) << 16;
-    p |= (hmacResult[offset + 2] & 0xFF) << 8;
-    p |= (hmacResult[offset + 3] & 0xFF);
+    p |= static_cast<unsigned long>(hmacResult[offset] & 0x7F) << 24;
+    p |= static_cast<unsigned long>(hmacResult[offset + 1]) << 16;
+    p |= static_cast<unsigned long>(hmacResult[offset + 2]) << 8;
+    p |= static_cast<unsigned long>(hmacResult[offset + 3]);
     
     return p;
 }
 
-// Generate TOTP code for a specific timestamp
-std::string OTP::generateTOTP(time_t timestamp) const {
-    unsigned long counter = timestamp / timeInterval;
-    std::vector<char> message = toBytes(counter);
-    std::vector<char> key = decodeBase32(secretKey);
-    std::vector<char> hash = hmacSha1(key, message);
+unsigned long OTP::codeForStep(uint64_t step) const {
+    // The counter is an 8-byte big-endian integer
+    uint8_t message[8];
+    for (int i = 7; i >= 0; --i) {
+        message[i] = static_cast<uint8_t>(step & 0xFF);
+        step >>= 8;
+    }
     
-    unsigned long truncatedHash = dynamicTruncate(hash);
+    uint8_t hash[Sha1::DIGEST_SIZE];
+    secretState.compute(message, sizeof(message), hash);
     
     // Calculate 10^digits without using pow
     unsigned long powerOfTen = 1;
@@ -256,7 +182,12 @@ std::string OTP::generateTOTP(time_t timestamp) const {
         powerOfTen *= 10;
     }
     
-    unsigned long code = truncatedHash % powerOfTen;
+    return dynamicTruncate(hash) % powerOfTen;
+}
+
+// Generate TOTP code for a specific timestamp
+std::string OTP::generateTOTP(time_t timestamp) const {
+    unsigned long code = codeForStep(static_cast<uint64_t>(timestamp) / timeInterval);
     
     std::stringstream ss;
     ss << std::setw(digits) << std::setfill('0') << code;
@@ -265,14 +196,26 @@ std::string OTP::generateTOTP(time_t timestamp) const {
 
 // Verify a TOTP code
 bool OTP::verify(const std::string& otpCode, size_t validWindow) const {
-    time_t currentTime = time(NULL);
+    return verifyAt(otpCode, time(NULL), validWindow);
+}
+
+bool OTP::verifyAt(const std::string& otpCode, time_t timestamp, size_t validWindow) const {
+    // Parsed once and compared as a number at each step, instead of formatting every candidate
+    if (otpCode.length() != digits) {
+        return false;
+    }
+    unsigned long submitted = 0;
+    for (size_t i = 0; i < otpCode.length(); ++i) {
+        if (otpCode[i] < '0' || otpCode[i] > '9') {
+            return false;
+        }
+        submitted = submitted * 10 + (otpCode[i] - '0');
+    }
     
     // Check within the window (before and after current time)
+    uint64_t currentStep = static_cast<uint64_t>(timestamp) / timeInterval;
     for (int i = -static_cast<int>(validWindow); i <= static_cast<int>(validWindow); ++i) {
-        time_t checkTime = currentTime + i * timeInterval;
-        std::string expectedCode = generateTOTP(checkTime);
-        
-        if (expectedCode == otpCode) {
+        if (codeForStep(currentStep + i) == submitted) {
             return true;
         }
     }
@@ -281,7 +224,7 @@ bool OTP::verify(const std::string& otpCode, size_t validWindow) const {
 }
 
 AuthManager::AuthManager(DataManager& dm) 
-    : currentLoggedInUser(""), dataManager(dm) {
+    : currentSession(""), dataManager(dm) {
 }
 
 std::string AuthManager::hashPassword(const std::string& password) const {
@@ -298,15 +241,7 @@ std::string AuthManager::hashPassword(const std::string& password) const {
 std::string AuthManager::generateRandomPassword(int length) const {
     const std::string chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!@#$%^&*";
     
-    srand(static_cast<unsigned int>(time(NULL) ^ (time(NULL) >> 16)));
-    
-    std::string password;
-    for (int i = 0; i < length; i++) {
-        int pos = rand() % chars.size();
-        password += chars[pos];
-    }
-    
-    return password;
+    return SecureRandom::fromAlphabet(chars, length > 0 ? static_cast<size_t>(length) : 0);
 }
 
 bool AuthManager::registerUser(const std::string& username, 
@@ -333,10 +268,9 @@ bool AuthManager::registerUser(const std::string& username,
         newUser.setIsFirstLogin(true);
     }
     
-    bool success = dataManager.saveUser(newUser);
+    bool success = dataManager.saveUser(newUser) && dataManager.commit(DURABILITY_BUFFERED);
     
     if (success) {
-        dataManager.saveData();
         std::cout << "User registered: " << username << std::endl;
         
         if (passwordWasGenerated) {
@@ -353,7 +287,15 @@ bool AuthManager::registerUserByAdmin(const std::string& username,
                                     const std::string& fullName,
                                     const std::string& email,
                                     const std::string& phoneNumber) {
-    if (!isAdmin()) {
+    return registerUserByAdmin(currentSession, username, fullName, email, phoneNumber);
+}
+
+bool AuthManager::registerUserByAdmin(const SessionToken& sessionToken,
+                                    const std::string& username, 
+                                    const std::string& fullName,
+                                    const std::string& email,
+                                    const std::string& phoneNumber) {
+    if (!isSessionAdmin(sessionToken)) {
         std::cout << "Only administrators can register new users." << std::endl;
         return false;
     }
@@ -364,20 +306,17 @@ bool AuthManager::registerUserByAdmin(const std::string& username,
 }
 
 bool AuthManager::login(const std::string& username, const std::string& password) {
-    std::string hashedPassword = hashPassword(password);
-    
-    User* user = dataManager.getUser(username);
-    if (!user || user->getPasswordHash() != hashedPassword) {
+    SessionToken sessionToken = openSession(username, password);
+    if (sessionToken.empty()) {
         return false;
     }
     
-    currentLoggedInUser = username;
-    
-    user->setLastLoginDate(time(NULL));
-    dataManager.saveUser(*user);
-    dataManager.saveData();
+    // The console has one session at a time
+    sessionManager.endSession(currentSession);
+    currentSession = sessionToken;
     
-    if (user->getIsAutoGeneratedPassword()) {
+    User user;
+    if (dataManager.copyUser(username, user) && user.getIsAutoGeneratedPassword()) {
         std::cout << "WARNING: You are using an auto-generated password. ";
         std::cout << "Please change your password for security reasons." << std::endl;
     }
@@ -386,7 +325,48 @@ bool AuthManager::login(const std::string& username, const std::string& password
 }
 
 void AuthManager::logout() {
-    currentLoggedInUser = "";
+    closeSession(currentSession);
+    currentSession = "";
+}
+
+SessionToken AuthManager::openSession(const std::string& username, const std::string& password) {
+    std::string hashedPassword = hashPassword(password);
+    
+    User user;
+    if (!dataManager.copyUser(username, user) || user.getPasswordHash() != hashedPassword) {
+        return SessionToken();
+    }
+    
+    user.setLastLoginDate(time(NULL));
+    dataManager.saveUser(user);
+    dataManager.saveData();
+    
+    // Role and wallet are cached in the session, so later checks need no lookups
+    Wallet* wallet = dataManager.getWalletByOwner(username);
+    SessionToken sessionToken = sessionManager.createSession(username, user.getRole(),
+                                                             wallet ? wallet->getWalletId() : Id128());
+    if (sessionToken.empty()) {
+        std::cerr << "Cannot create a session: no system random source" << std::endl;
+    }
+    return sessionToken;
+}
+
+void AuthManager::closeSession(const SessionToken& sessionToken) {
+    if (!sessionToken.empty()) {
+        sessionManager.endSession(sessionToken);
+    }
+}
+
+bool AuthManager::getSession(const SessionToken& sessionToken, Session& session) const {
+    return sessionManager.getSession(sessionToken, session);
+}
+
+SessionToken AuthManager::getCurrentSession() const {
+    return currentSession;
+}
+
+SessionManager& AuthManager::getSessionManager() {
+    return sessionManager;
 }
 
 bool AuthManager::changePassword(const std::string& username, 
@@ -394,35 +374,44 @@ bool AuthManager::changePassword(const std::string& username,
                                const std::string& newPassword) {
     std::string hashedOldPassword = hashPassword(oldPassword);
     
-    User* user = dataManager.getUser(username);
-    if (!user || user->getPasswordHash() != hashedOldPassword) {
+    User user;
+    if (!dataManager.copyUser(username, user) || user.getPasswordHash() != hashedOldPassword) {
         std::cout << "Old password is incorrect." << std::endl;
         return false;
     }
     
     std::string hashedNewPassword = hashPassword(newPassword);
-    user->setPasswordHash(hashedNewPassword);
+    user.setPasswordHash(hashedNewPassword);
     
-    if (user->getIsAutoGeneratedPassword()) {
-        user->setIsAutoGeneratedPassword(false);
-        user->setIsFirstLogin(false);
+    bool wasAutoGenerated = user.getIsAutoGeneratedPassword();
+    if (wasAutoGenerated) {
+        user.setIsAutoGeneratedPassword(false);
+        user.setIsFirstLogin(false);
+    }
+    
+    // Written before the user is told
+    bool success = dataManager.saveUser(user) && dataManager.commit(DURABILITY_BUFFERED);
+    if (!success) {
+        std::cout << "Failed to save the new password." << std::endl;
+    } else if (wasAutoGenerated) {
         std::cout << "Password updated successfully. Your account now has a custom password." << std::endl;
     } else {
         std::cout << "Password updated successfully." << std::endl;
     }
-    
-    bool success = dataManager.saveUser(*user);
-    dataManager.saveData(); // Ensure data is written to file immediately
     return success;
 }
 
 bool AuthManager::resetPassword(const std::string& username) {
-    if (currentLoggedInUser != username && !isAdmin()) {
+    return resetPassword(currentSession, username);
+}
+
+bool AuthManager::resetPassword(const SessionToken& sessionToken, const std::string& username) {
+    if (!canManageUser(sessionToken, username)) {
         return false;
     }
     
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
@@ -430,12 +419,12 @@ bool AuthManager::resetPassword(const std::string& username) {
     std::string tempPassword = generateRandomPassword();
     std::string hashedTempPassword = hashPassword(tempPassword);
     
-    user->setPasswordHash(hashedTempPassword);
-    user->setIsAutoGeneratedPassword(true);
-    user->setIsFirstLogin(true);
+    user.setPasswordHash(hashedTempPassword);
+    user.setIsAutoGeneratedPassword(true);
+    user.setIsFirstLogin(true);
     
-    bool success = dataManager.saveUser(*user);
-    dataManager.saveData(); // Ensure data is written to file immediately
+    // Written before the user is told
+    bool success = dataManager.saveUser(user) && dataManager.commit(DURABILITY_BUFFERED);
     if (success) {
         std::cout << "Password reset. Temporary password: " << tempPassword << std::endl;
     }
@@ -446,63 +435,73 @@ bool AuthManager::resetPassword(const std::string& username) {
 bool AuthManager::generateOTP(const std::string& username, const std::string& purpose) {
     OTP otp(username, purpose);
     
-    activeOTPs[username] = otp;
+    // Kept alongside the user's other pending OTPs, not in place of them
+    otpStore.add(username, purpose, otp.getCode(), otp.getExpirationTime());
     
     std::cout << "OTP generated for " << username << ": " << otp.getCode() << std::endl;
     
     return true;
 }
 
-bool AuthManager::verifyOTP(const std::string& username, const std::string& otpCode) {
-    std::map<std::string, OTP>::iterator it = activeOTPs.find(username);
-    if (it == activeOTPs.end()) {
-        std::cout << "No active OTP found for " << username << std::endl;
-        return false;
-    }
-    
-    OTP& otp = it->second;
-    
-    if (!otp.isValid()) {
-        std::cout << "OTP expired" << std::endl;
-        activeOTPs.erase(it);
-        return false;
-    }
-    
-    if (otp.getCode() != otpCode) {
-        std::cout << "Invalid OTP" << std::endl;
-        return false;
+bool AuthManager::verifyOTP(const std::string& username, const std::string& purpose, const std::string& otpCode) {
+    switch (otpStore.consume(username, purpose, otpCode)) {
+        case OTP_ACCEPTED:
+            return true;
+        case OTP_NO_CHALLENGE:
+            std::cout << "No active OTP found for " << username << std::endl;
+            return false;
+        case OTP_EXPIRED:
+            std::cout << "OTP expired" << std::endl;
+            return false;
+        default:
+            std::cout << "Invalid OTP" << std::endl;
+            return false;
     }
-    
-    activeOTPs.erase(it);
-    
-    return true;
+}
+
+bool AuthManager::peekOTP(const std::string& username, std::string& otpCode) const {
+    return otpStore.peekNewest(username, otpCode);
 }
 
 std::string AuthManager::getCurrentUser() const {
-    return currentLoggedInUser;
+    return getSessionUser(currentSession);
 }
 
 bool AuthManager::isLoggedIn() const {
-    return !currentLoggedInUser.empty();
+    Session session;
+    return getSession(currentSession, session);
 }
 
 bool AuthManager::isAdmin() const {
-    if (!isLoggedIn()) {
-        return false;
+    return isSessionAdmin(currentSession);
+}
+
+std::string AuthManager::getSessionUser(const SessionToken& sessionToken) const {
+    Session session;
+    if (!getSession(sessionToken, session)) {
+        return "";
     }
-    
-    User* user = dataManager.getUser(currentLoggedInUser);
-    if (!user) {
+    return session.username;
+}
+
+bool AuthManager::isSessionAdmin(const SessionToken& sessionToken) const {
+    // Role cached at login: no user lookup
+    Session session;
+    return getSession(sessionToken, session) && session.isAdmin();
+}
+
+bool AuthManager::canManageUser(const SessionToken& sessionToken, const std::string& username) const {
+    Session session;
+    if (!getSession(sessionToken, session)) {
         return false;
     }
-    
-    return user->isAdmin();
+    return session.username == username || session.isAdmin();
 }
 
 // Add the new TOTP methods to AuthManager
 bool AuthManager::setupTOTP(const std::string& username) {
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
@@ -511,10 +510,9 @@ bool AuthManager::setupTOTP(const std::string& username) {
     std::string secretKey = OTP::generateSecretKey(16);
     
     // Store the secret key with the user
-    user->setTOTPSecret(secretKey);
+    user.setTOTPSecret(secretKey);
     
-    bool success = dataManager.saveUser(*user);
-    dataManager.saveData();
+    bool success = dataManager.saveUser(user) && dataManager.commit(DURABILITY_BUFFERED);
     
     if (success) {
         std::cout << "TOTP set up for user: " << username << std::endl;
@@ -530,20 +528,29 @@ bool AuthManager::setupTOTP(const std::string& username) {
 }
 
 bool AuthManager::verifyTOTP(const std::string& username, const std::string& totpCode) {
-    User* user = dataManager.getUser(username);
-    if (!user) {
+    User user;
+    if (!dataManager.copyUser(username, user)) {
         std::cout << "User not found." << std::endl;
         return false;
     }
     
-    std::string secretKey = user->getTOTPSecret();
+    std::string secretKey = user.getTOTPSecret();
     if (secretKey.empty()) {
         std::cout << "TOTP not set up for this user." << std::endl;
         return false;
     }
     
-    OTP totp(username, "verification", secretKey);
-    bool isValid = totp.verify(totpCode);
+    bool isValid;
+    {
+        ScopedLock guard(totpLock);
+        std::map<std::string, OTP>::iterator it = totpStates.find(username);
+        if (it == totpStates.end() || it->second.getSecretKey() != secretKey) {
+            // First use of this secret: derive its key state once
+            it = totpStates.insert(std::make_pair(username, OTP())).first;
+            it->second = OTP(username, "verification", secretKey);
+        }
+        isValid = it->second.verify(totpCode);
+    }
     
     if (isValid) {
         std::cout << "TOTP verification successful." << std::endl;
@@ -7,6 +7,9 @@
 #include <ctime>
 #include "DataManager.h"
 #include "User.h"
+#include "SessionManager.h"
+#include "Sha1.h"
+#include "OtpStore.h"
 
 // OTP Implementation based on RFC 4226 (HOTP) and RFC 6238 (TOTP)
 // Modified to be C++98 compatible
@@ -26,11 +29,8 @@ private:
     // Convert a string to base32 encoding
     std::string toBase32(const std::string& input) const;
     
-    // Generate HMAC-SHA1 (simplified version without OpenSSL)
-    std::vector<char> hmacSha1(const std::vector<char>& key, const std::vector<char>& message) const;
-    
-    // Convert an integer to bytes
-    std::vector<char> toBytes(unsigned long value) const;
+    // HMAC key state of the decoded secret, derived once per OTP object
+    HmacSha1 secretState;
     
     // Generate a random base32 string
     std::string generateRandomBase32(size_t length) const;
@@ -38,11 +38,11 @@ private:
     // Decode a base32 string
     std::vector<char> decodeBase32(const std::string& base32) const;
     
-    // Generate TOTP code
-    std::string generateTOTP(time_t timestamp) const;
+    // HOTP value (RFC 4226) of a time step, before formatting
+    unsigned long codeForStep(uint64_t step) const;
     
     // Dynamic truncation as defined in RFC 4226
-    unsigned long dynamicTruncate(const std::vector<char>& hmacResult) const;
+    unsigned long dynamicTruncate(const uint8_t* hmacResult) const;
 
 public:
     // Default constructor needed for std::map
@@ -55,15 +55,20 @@ public:
     OTP(const std::string& targetUser, const std::string& purpose, 
         const std::string& secretKey, size_t digits = 6, size_t timeInterval = 30,
         int validityInMinutes = 5);
-
+    
     std::string getCode() const;
     std::string getTargetUser() const;
     std::string getPurpose() const;
     std::string getSecretKey() const;
     bool isValid() const;
+    time_t getExpirationTime() const;
     
     // Verify TOTP code
     bool verify(const std::string& otpCode, size_t validWindow = 1) const;
+    bool verifyAt(const std::string& otpCode, time_t timestamp, size_t validWindow = 1) const;
+    
+    // Generate TOTP code
+    std::string generateTOTP(time_t timestamp) const;
     
     // Generate a new TOTP code
     void generateNewCode();
@@ -72,10 +77,16 @@ public:
     static std::string generateSecretKey(size_t length = 16);
 };
 
+// Authentication and sessions. Each client holds a SessionToken; the
+// console's own session is kept here so the single-user API (login(),
+// getCurrentUser(), isAdmin(), ...) keeps working on top of it.
 class AuthManager {
 private:
-    std::string currentLoggedInUser;
-    std::map<std::string, OTP> activeOTPs;
+    SessionToken currentSession;
+    mutable SessionManager sessionManager;
+    OtpStore otpStore;
+    std::map<std::string, OTP> totpStates;   // Per user, for the secret it was built from
+    Mutex totpLock;                          // Guards totpStates
     DataManager& dataManager;
     
     std::string hashPassword(const std::string& password) const;
@@ -84,7 +95,7 @@ private:
 
 public:
     AuthManager(DataManager& dm);
-
+    
     bool registerUser(const std::string& username, 
                      const std::string& password, 
                      const std::string& fullName,
@@ -92,24 +103,41 @@ public:
                      const std::string& phoneNumber,
                      UserRole role = REGULAR,
                      bool isAutoGenerated = false);
-                     
+    
     bool registerUserByAdmin(const std::string& username, 
                             const std::string& fullName,
                             const std::string& email,
                             const std::string& phoneNumber);
-
+    bool registerUserByAdmin(const SessionToken& sessionToken,
+                            const std::string& username, 
+                            const std::string& fullName,
+                            const std::string& email,
+                            const std::string& phoneNumber);
+    
+    // Console login: replaces the console session
     bool login(const std::string& username, const std::string& password);
     void logout();
-
+    
+    // Session per client; an empty token means the credentials were wrong
+    SessionToken openSession(const std::string& username, const std::string& password);
+    void closeSession(const SessionToken& sessionToken);
+    bool getSession(const SessionToken& sessionToken, Session& session) const;
+    SessionToken getCurrentSession() const;
+    SessionManager& getSessionManager();
+    
     bool changePassword(const std::string& username, 
                        const std::string& oldPassword, 
                        const std::string& newPassword);
-                       
+    
     bool resetPassword(const std::string& username);
-
+    bool resetPassword(const SessionToken& sessionToken, const std::string& username);
+    
     // Enhanced OTP methods
     bool generateOTP(const std::string& username, const std::string& purpose);
-    bool verifyOTP(const std::string& username, const std::string& otpCode);
+    // Only an OTP generated for exactly this purpose matches
+    bool verifyOTP(const std::string& username, const std::string& purpose, const std::string& otpCode);
+    // Pending OTP code of a user, left unused (for local load-test clients)
+    bool peekOTP(const std::string& username, std::string& otpCode) const;
     
     // Setup TOTP for a user (for 2FA)
     bool setupTOTP(const std::string& username);
@@ -120,6 +148,12 @@ public:
     std::string getCurrentUser() const;
     bool isLoggedIn() const;
     bool isAdmin() const;
+    
+    // Empty / false for an unknown or expired session
+    std::string getSessionUser(const SessionToken& sessionToken) const;
+    bool isSessionAdmin(const SessionToken& sessionToken) const;
+    // The session belongs to username or to an administrator
+    bool canManageUser(const SessionToken& sessionToken, const std::string& username) const;
 };
 
 #endif 
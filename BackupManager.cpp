@@ -0,0 +1,455 @@
+#include "BackupManager.h"
+#include "MappedFile.h"
+#include "FileUtils.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <cstdio>
+
+// Chunk size bounds: cut points are content-defined between these limits
+static const size_t MIN_CHUNK_SIZE = 2 * 1024;
+static const size_t MAX_CHUNK_SIZE = 64 * 1024;
+// Low 13 bits of the rolling hash zero -> ~8 KB average chunk
+static const uint64_t CHUNK_BOUNDARY_MASK = 0x1FFF;
+
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+// Second hash seeded differently so chunk names are 128 bits wide
+static const uint64_t FNV_ALTERNATE_BASIS = 0x9E3779B97F4A7C15ULL;
+
+// Gear table for the rolling hash, filled once with splitmix64 output
+static const uint64_t* gearTable() {
+    static uint64_t table[256];
+    static bool initialized = false;
+    
+    if (!initialized) {
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        for (int i = 0; i < 256; ++i) {
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            table[i] = z ^ (z >> 31);
+        }
+        initialized = true;
+    }
+    return table;
+}
+
+// Length of the next chunk starting at data
+static size_t nextChunkLength(const char* data, size_t available) {
+    if (available <= MIN_CHUNK_SIZE) {
+        return available;
+    }
+    
+    const uint64_t* gear = gearTable();
+    size_t limit = available < MAX_CHUNK_SIZE ? available : MAX_CHUNK_SIZE;
+    uint64_t hash = 0;
+    
+    for (size_t i = 0; i < limit; ++i) {
+        hash = (hash << 1) + gear[static_cast<unsigned char>(data[i])];
+        if (i + 1 >= MIN_CHUNK_SIZE && (hash & CHUNK_BOUNDARY_MASK) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+static std::string toHex(uint64_t value) {
+    const char* hex_chars = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        result[i] = hex_chars[value & 0xF];
+        value >>= 4;
+    }
+    return result;
+}
+
+// Content address of a chunk: two FNV-1a hashes plus the length
+static std::string chunkName(const char* data, size_t length) {
+    uint64_t first = FNV_OFFSET_BASIS;
+    uint64_t second = FNV_ALTERNATE_BASIS;
+    
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char byte = static_cast<unsigned char>(data[i]);
+        first = (first ^ byte) * FNV_PRIME;
+        second = (second ^ byte) * FNV_PRIME;
+    }
+    
+    std::ostringstream name;
+    name << toHex(first) << toHex(second) << "-" << length;
+    return name.str();
+}
+
+BackupManager::BackupManager(const std::string& directory) : backupDir(directory) {}
+
+std::string BackupManager::chunkPath(const std::string& chunkName) const {
+    return backupDir + "chunks/" + chunkName;
+}
+
+std::string BackupManager::manifestPath(const std::string& id) const {
+    return backupDir + "backup_" + id + ".manifest";
+}
+
+std::string BackupManager::indexPath() const {
+    return backupDir + "index.txt";
+}
+
+std::vector<BackupManager::BackupEntry> BackupManager::readIndex() const {
+    std::vector<BackupEntry> entries;
+    std::ifstream file(indexPath().c_str());
+    
+    BackupEntry entry;
+    long long createdAt;
+    while (file >> entry.id >> createdAt) {
+        entry.createdAt = static_cast<time_t>(createdAt);
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+bool BackupManager::writeIndex(const std::vector<BackupEntry>& entries) const {
+    std::ostringstream content;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        content << entries[i].id << " " << static_cast<long long>(entries[i].createdAt) << "\n";
+    }
+    
+    size_t systemCalls = 0;
+    if (!writeFileSynced(indexPath(), std::vector<std::string>(1, content.str()), systemCalls)) {
+        std::cerr << "Failed to write backup index" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BackupManager::readManifestBody(const std::string& id, std::string& body) const {
+    std::ifstream file(manifestPath(id).c_str());
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    std::string header;
+    std::getline(file, header);
+    
+    std::ostringstream rest;
+    rest << file.rdbuf();
+    body = rest.str();
+    return true;
+}
+
+bool BackupManager::readManifest(const std::string& id, std::vector<ManifestFile>& files) const {
+    std::ifstream file(manifestPath(id).c_str());
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    std::string header;
+    std::getline(file, header);
+    if (header.compare(0, 7, "backup ") != 0) {
+        return false;
+    }
+    
+    std::string kind;
+    while (file >> kind) {
+        ManifestFile entry;
+        if (kind == "absent") {
+            entry.present = false;
+            entry.size = 0;
+            if (!(file >> entry.path)) {
+                return false;
+            }
+        } else if (kind == "file") {
+            size_t chunkCount;
+            entry.present = true;
+            if (!(file >> entry.path >> entry.size >> chunkCount)) {
+                return false;
+            }
+            
+            entry.chunks.resize(chunkCount);
+            for (size_t i = 0; i < chunkCount; ++i) {
+                if (!(file >> entry.chunks[i])) {
+                    return false;
+                }
+            }
+        } else {
+            return false;
+        }
+        files.push_back(entry);
+    }
+    return true;
+}
+
+bool BackupManager::storeChunk(const std::string& chunkName, const char* data, size_t length) {
+    std::string path = chunkPath(chunkName);
+    
+    // Chunks are immutable: one stored under this name already holds these bytes
+    if (fileExists(path)) {
+        return true;
+    }
+    
+    // Synced before the rename: a manifest must never name a chunk a crash can tear
+    size_t systemCalls = 0;
+    if (!writeFileSynced(path, std::vector<std::string>(1, std::string(data, length)), systemCalls)) {
+        return false;
+    }
+    
+    lastStats.bytesWritten += length;
+    lastStats.chunksWritten++;
+    return true;
+}
+
+bool BackupManager::appendFile(const std::string& path, std::string& body) {
+    if (!fileExists(path)) {
+        body += "absent " + path + "\n";
+        return true;
+    }
+    
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to read " << path << " for backup" << std::endl;
+        return false;
+    }
+    
+    const char* data = file.getData();
+    size_t size = file.getSize();
+    std::vector<std::string> chunks;
+    
+    for (size_t offset = 0; offset < size; ) {
+        size_t length = nextChunkLength(data + offset, size - offset);
+        std::string name = chunkName(data + offset, length);
+        
+        if (!storeChunk(name, data + offset, length)) {
+            std::cerr << "Failed to store backup chunk " << name << std::endl;
+            return false;
+        }
+        
+        chunks.push_back(name);
+        offset += length;
+    }
+    
+    lastStats.bytesScanned += size;
+    lastStats.chunksTotal += chunks.size();
+    
+    std::ostringstream entry;
+    entry << "file " << path << " " << size << " " << chunks.size() << "\n";
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        entry << chunks[i] << "\n";
+    }
+    body += entry.str();
+    return true;
+}
+
+std::string BackupManager::createBackup(const std::vector<std::string>& files) {
+    lastStats = BackupStats();
+    
+    if (!createDirectory(backupDir + "chunks")) {
+        std::cerr << "Failed to create backup directory" << std::endl;
+        return "";
+    }
+    
+    std::string body;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!appendFile(files[i], body)) {
+            return "";
+        }
+    }
+    
+    std::vector<BackupEntry> entries = readIndex();
+    
+    // Nothing changed since the newest backup: it already describes this state
+    if (!entries.empty()) {
+        std::string previous;
+        if (readManifestBody(entries.back().id, previous) && previous == body) {
+            return entries.back().id;
+        }
+    }
+    
+    time_t now = time(NULL);
+    tm* now_tm = localtime(&now);
+    char timestamp[20];
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", now_tm);
+    
+    // Several backups within one second get a numeric suffix
+    std::string id = timestamp;
+    for (int suffix = 2; hasBackup(id); ++suffix) {
+        std::ostringstream candidate;
+        candidate << timestamp << "_" << suffix;
+        id = candidate.str();
+    }
+    
+    std::ostringstream manifest;
+    manifest << "backup " << id << " " << static_cast<long long>(now) << "\n" << body;
+    size_t systemCalls = 0;
+    if (!writeFileSynced(manifestPath(id), std::vector<std::string>(1, manifest.str()), systemCalls)) {
+        std::cerr << "Failed to write backup manifest" << std::endl;
+        return "";
+    }
+    
+    BackupEntry entry;
+    entry.id = id;
+    entry.createdAt = now;
+    entries.push_back(entry);
+    if (!writeIndex(entries)) {
+        return "";
+    }
+    
+    prune();
+    return id;
+}
+
+bool BackupManager::restoreFile(const ManifestFile& file) const {
+    if (!file.present) {
+        removeFile(file.path);
+        return true;
+    }
+    
+    std::string tempPath = file.path + ".tmp";
+    std::ofstream output(tempPath.c_str(), std::ios::binary);
+    if (!output.is_open()) {
+        return false;
+    }
+    
+    uint64_t written = 0;
+    for (size_t i = 0; i < file.chunks.size(); ++i) {
+        MappedFile chunk;
+        if (!chunk.open(chunkPath(file.chunks[i]))) {
+            std::cerr << "Missing backup chunk " << file.chunks[i] << std::endl;
+            output.close();
+            removeFile(tempPath);
+            return false;
+        }
+        output.write(chunk.getData(), static_cast<std::streamsize>(chunk.getSize()));
+        written += chunk.getSize();
+    }
+    output.close();
+    
+    if (!output || written != file.size || !syncFile(tempPath) || !replaceFile(tempPath, file.path)) {
+        removeFile(tempPath);
+        return false;
+    }
+    return true;
+}
+
+bool BackupManager::restoreBackup(const std::string& id) const {
+    std::vector<ManifestFile> files;
+    if (!readManifest(id, files)) {
+        std::cerr << "Backup " << id << " not found or damaged" << std::endl;
+        return false;
+    }
+    
+    // Check every chunk first so a broken backup leaves the data untouched
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (size_t j = 0; j < files[i].chunks.size(); ++j) {
+            if (!fileExists(chunkPath(files[i].chunks[j]))) {
+                std::cerr << "Missing backup chunk " << files[i].chunks[j] << std::endl;
+                return false;
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!restoreFile(files[i])) {
+            std::cerr << "Failed to restore " << files[i].path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BackupManager::hasBackup(const std::string& id) const {
+    return fileExists(manifestPath(id));
+}
+
+std::vector<std::string> BackupManager::listBackups() const {
+    std::vector<BackupEntry> entries = readIndex();
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ids.push_back(entries[i].id);
+    }
+    return ids;
+}
+
+size_t BackupManager::prune() {
+    std::vector<BackupEntry> entries = readIndex();
+    if (entries.size() <= retention.keepRecent) {
+        return 0;
+    }
+    
+    // Walk newest first: the first backup seen in an hour or day is its newest
+    std::vector<bool> keep(entries.size(), false);
+    std::set<long long> hours;
+    std::set<long long> days;
+    for (size_t rank = 0; rank < entries.size(); ++rank) {
+        size_t i = entries.size() - 1 - rank;
+        long long createdAt = static_cast<long long>(entries[i].createdAt);
+        
+        if (rank < retention.keepRecent) {
+            keep[i] = true;
+        }
+        if (hours.size() < retention.keepHourly && hours.insert(createdAt / 3600).second) {
+            keep[i] = true;
+        }
+        if (days.size() < retention.keepDaily && days.insert(createdAt / 86400).second) {
+            keep[i] = true;
+        }
+    }
+    
+    std::vector<BackupEntry> kept;
+    std::vector<BackupEntry> dropped;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (keep[i]) {
+            kept.push_back(entries[i]);
+        } else {
+            dropped.push_back(entries[i]);
+        }
+    }
+    if (dropped.empty()) {
+        return 0;
+    }
+    
+    // Chunks still referenced by a kept backup must survive
+    std::set<std::string> liveChunks;
+    for (size_t i = 0; i < kept.size(); ++i) {
+        std::vector<ManifestFile> files;
+        if (!readManifest(kept[i].id, files)) {
+            std::cerr << "Backup " << kept[i].id << " unreadable; skipping prune" << std::endl;
+            return 0;
+        }
+        for (size_t j = 0; j < files.size(); ++j) {
+            liveChunks.insert(files[j].chunks.begin(), files[j].chunks.end());
+        }
+    }
+    
+    // Update the index first: a crash mid-prune leaves orphans, never dangling entries
+    if (!writeIndex(kept)) {
+        return 0;
+    }
+    
+    for (size_t i = 0; i < dropped.size(); ++i) {
+        std::vector<ManifestFile> files;
+        if (readManifest(dropped[i].id, files)) {
+            for (size_t j = 0; j < files.size(); ++j) {
+                for (size_t k = 0; k < files[j].chunks.size(); ++k) {
+                    if (liveChunks.find(files[j].chunks[k]) == liveChunks.end()) {
+                        removeFile(chunkPath(files[j].chunks[k]));
+                    }
+                }
+            }
+        }
+        removeFile(manifestPath(dropped[i].id));
+    }
+    return dropped.size();
+}
+
+void BackupManager::setRetention(const BackupRetention& policy) {
+    retention = policy;
+}
+
+BackupRetention BackupManager::getRetention() const {
+    return retention;
+}
+
+BackupStats BackupManager::getLastBackupStats() const {
+    return lastStats;
+}
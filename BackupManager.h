@@ -0,0 +1,94 @@
+#ifndef BACKUP_MANAGER_H
+#define BACKUP_MANAGER_H
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+// How many backups prune() keeps
+struct BackupRetention {
+    size_t keepRecent;   // Newest backups kept unconditionally
+    size_t keepHourly;   // Plus the newest backup of each of the last N hours
+    size_t keepDaily;    // Plus the newest backup of each of the last N days
+    
+    BackupRetention() : keepRecent(10), keepHourly(24), keepDaily(30) {}
+};
+
+// Bytes read and written by the last createBackup()
+struct BackupStats {
+    uint64_t bytesScanned;
+    uint64_t bytesWritten;
+    size_t chunksTotal;
+    size_t chunksWritten;
+    
+    BackupStats() : bytesScanned(0), bytesWritten(0), chunksTotal(0), chunksWritten(0) {}
+};
+
+// Incremental, deduplicated backups.
+//
+// Files are split into content-defined chunks (a rolling hash picks the cut
+// points, so an insertion only changes the chunks around it). Each chunk is
+// stored once under chunks/ by content hash; a backup is just a manifest
+// listing the chunks of every file, so it costs roughly the size of the delta.
+//
+//   <dir>/chunks/<hash>          chunk contents
+//   <dir>/backup_<id>.manifest   files and chunk lists of one backup
+//   <dir>/index.txt              "<id> <time>" per backup, oldest first
+class BackupManager {
+private:
+    struct BackupEntry {
+        std::string id;
+        time_t createdAt;
+    };
+    
+    struct ManifestFile {
+        std::string path;
+        bool present;
+        uint64_t size;
+        std::vector<std::string> chunks;
+    };
+    
+    std::string backupDir;
+    BackupRetention retention;
+    BackupStats lastStats;
+    
+    std::string chunkPath(const std::string& chunkName) const;
+    std::string manifestPath(const std::string& id) const;
+    std::string indexPath() const;
+    
+    std::vector<BackupEntry> readIndex() const;
+    bool writeIndex(const std::vector<BackupEntry>& entries) const;
+    
+    // Manifest body without the header line, so identical states compare equal
+    bool readManifestBody(const std::string& id, std::string& body) const;
+    bool readManifest(const std::string& id, std::vector<ManifestFile>& files) const;
+    
+    // Chunk one file, store the chunks not seen before and describe it in body
+    bool appendFile(const std::string& path, std::string& body);
+    bool storeChunk(const std::string& chunkName, const char* data, size_t length);
+    bool restoreFile(const ManifestFile& file) const;
+
+public:
+    explicit BackupManager(const std::string& directory);
+    
+    // Back up the given files (missing files are recorded as absent).
+    // Returns the backup id, or an empty string on failure.
+    std::string createBackup(const std::vector<std::string>& files);
+    
+    // Rewrite every file listed in the backup's manifest
+    bool restoreBackup(const std::string& id) const;
+    bool hasBackup(const std::string& id) const;
+    
+    // Backup ids, oldest first
+    std::vector<std::string> listBackups() const;
+    
+    // Drop backups outside the retention policy and the chunks only they used
+    size_t prune();
+    
+    void setRetention(const BackupRetention& policy);
+    BackupRetention getRetention() const;
+    BackupStats getLastBackupStats() const;
+};
+
+#endif
@@ -0,0 +1,318 @@
+#include "BatchRunner.h"
+#include "Clock.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// Failures beyond this many are only counted
+static const size_t MAX_REPORTED_FAILURES = 20;
+
+struct BatchCommand {
+    size_t line;
+    size_t repeat;
+    std::string name;
+    std::vector<std::string> args;
+    std::string description;    // transfer only
+};
+
+struct CommandStats {
+    std::vector<uint64_t> latencies;    // Microseconds
+    size_t failed;
+    
+    CommandStats() : failed(0) {}
+};
+
+// Arguments each command takes before the free-form rest of the line
+static int expectedArguments(const std::string& name) {
+    if (name == "register") return 5;
+    if (name == "login") return 2;
+    if (name == "otp") return 1;
+    if (name == "deposit" || name == "transfer") return 2;
+    if (name == "logout" || name == "balance" || name == "history") return 0;
+    return -1;
+}
+
+static bool isValidWallet(const std::string& text) {
+    Id128 id;
+    return (text.size() > 1 && text[0] == '@') || Id128::fromString(text, id);
+}
+
+static bool parseCommand(const std::string& text, BatchCommand& command, std::string& error) {
+    std::istringstream in(text);
+    in >> command.name;
+    
+    command.repeat = 1;
+    if (command.name == "repeat") {
+        long count = 0;
+        if (!(in >> count) || count <= 0) {
+            error = "repeat needs a positive count";
+            return false;
+        }
+        command.repeat = static_cast<size_t>(count);
+        if (!(in >> command.name)) {
+            error = "repeat needs a command";
+            return false;
+        }
+    }
+    
+    int argumentCount = expectedArguments(command.name);
+    if (argumentCount < 0) {
+        error = "unknown command '" + command.name + "'";
+        return false;
+    }
+    
+    std::string argument;
+    for (int i = 0; i < argumentCount; ++i) {
+        if (!(in >> argument)) {
+            error = command.name + " needs more arguments";
+            return false;
+        }
+        command.args.push_back(argument);
+    }
+    
+    std::getline(in, command.description);
+    size_t start = command.description.find_first_not_of(" \t");
+    command.description = start == std::string::npos ? "" : command.description.substr(start);
+    if (!command.description.empty() && command.name != "transfer") {
+        error = "too many arguments for " + command.name;
+        return false;
+    }
+    
+    if (command.name == "deposit" || command.name == "transfer") {
+        Money amount;
+        if (!isValidWallet(command.args[0])) {
+            error = "invalid wallet '" + command.args[0] + "'";
+            return false;
+        }
+        if (!Money::parse(command.args[1], amount)) {
+            error = "invalid amount '" + command.args[1] + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+// The logged-in user of the script
+class BatchSession {
+private:
+    AccountSystem& system;
+    SessionToken token;
+    std::string username;
+    
+    bool resolveWallet(const std::string& text, Id128& walletId, std::string& error) {
+        if (text[0] != '@') {
+            return Id128::fromString(text, walletId);
+        }
+        Wallet* wallet = system.getDataManager().getWalletByOwner(text.substr(1));
+        if (!wallet) {
+            error = "no wallet for " + text.substr(1);
+            return false;
+        }
+        walletId = wallet->getWalletId();
+        return true;
+    }
+    
+    bool takeOTP(std::string& otpCode) {
+        return system.getAuthManager().peekOTP(username, otpCode);
+    }
+    
+    // Applied but not on disk is a failure to report, never to retry: the points have moved
+    static bool transferred(TransferResult result, std::string& error) {
+        if (result == TRANSFER_NOT_DURABLE) {
+            error = "applied but not written to disk";
+        }
+        return result == TRANSFER_DONE;
+    }
+
+public:
+    explicit BatchSession(AccountSystem& system) : system(system) {}
+    
+    ~BatchSession() {
+        if (!token.empty()) {
+            system.closeSession(token);
+        }
+    }
+    
+    bool execute(const BatchCommand& command, std::string& error) {
+        const std::vector<std::string>& args = command.args;
+        
+        if (command.name == "register") {
+            return system.registerUser(args[0], args[1], args[2], args[3], args[4]);
+        }
+        if (command.name == "login") {
+            if (!token.empty()) {
+                system.closeSession(token);
+            }
+            token = system.openSession(args[0], args[1]);
+            username = token.empty() ? "" : args[0];
+            return !token.empty();
+        }
+        
+        if (token.empty()) {
+            error = "not logged in";
+            return false;
+        }
+        
+        if (command.name == "logout") {
+            system.closeSession(token);
+            token.clear();
+            username.clear();
+            return true;
+        }
+        if (command.name == "otp") {
+            return system.generateOTP(username, args[0]);
+        }
+        if (command.name == "balance" || command.name == "history") {
+            Wallet* wallet = system.getSessionWallet(token);
+            if (!wallet) {
+                error = "no wallet";
+                return false;
+            }
+            if (command.name == "balance") {
+                system.getWalletBalance(wallet->getWalletId());
+            } else {
+                system.getTransactionHistory(wallet->getWalletId());
+            }
+            return true;
+        }
+        
+        Id128 walletId;
+        Money amount;
+        std::string otpCode;
+        if (!resolveWallet(args[0], walletId, error) || !Money::parse(args[1], amount)) {
+            return false;
+        }
+        
+        if (command.name == "deposit") {
+            return system.generateOTP(username, AccountSystem::ADD_FUNDS_PURPOSE) && takeOTP(otpCode) &&
+                   transferred(system.adminAddFundsToWallet(token, walletId, amount, otpCode), error);
+        }
+        return system.initiateTransfer(token, walletId, amount, command.description) && takeOTP(otpCode) &&
+               transferred(system.confirmTransfer(token, walletId, amount, otpCode, command.description), error);
+    }
+};
+
+// Last non-empty line an operation printed: usually why it failed
+static std::string lastLine(const std::string& output) {
+    size_t end = output.find_last_not_of("\r\n");
+    if (end == std::string::npos) {
+        return "";
+    }
+    size_t start = output.rfind('\n', end);
+    start = start == std::string::npos ? 0 : start + 1;
+    return output.substr(start, end - start + 1);
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+int runBatch(AccountSystem& system, const std::string& scriptPath) {
+    std::ifstream script(scriptPath.c_str());
+    if (!script) {
+        std::cerr << "Cannot open batch file: " << scriptPath << std::endl;
+        return 1;
+    }
+    
+    // Parse everything first so a typo does not leave a half-run script behind
+    std::vector<BatchCommand> commands;
+    std::string text;
+    size_t lineNumber = 0;
+    bool parsed = true;
+    while (std::getline(script, text)) {
+        ++lineNumber;
+        if (!text.empty() && text[text.size() - 1] == '\r') {
+            text.erase(text.size() - 1);
+        }
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string::npos || text[start] == '#') {
+            continue;
+        }
+        
+        BatchCommand command;
+        std::string error;
+        command.line = lineNumber;
+        if (!parseCommand(text, command, error)) {
+            std::cerr << scriptPath << ":" << lineNumber << ": " << error << std::endl;
+            parsed = false;
+            continue;
+        }
+        commands.push_back(command);
+    }
+    if (!parsed) {
+        return 1;
+    }
+    
+    BatchSession session(system);
+    std::map<std::string, CommandStats> stats;
+    size_t executed = 0;
+    size_t failed = 0;
+    
+    // The operations report to std::cout; keep it for failure messages instead of the screen
+    std::ostringstream captured;
+    std::streambuf* console = std::cout.rdbuf(captured.rdbuf());
+    
+    uint64_t batchStart = monotonicMicros();
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const BatchCommand& command = commands[i];
+        CommandStats& commandStats = stats[command.name];
+        commandStats.latencies.reserve(commandStats.latencies.size() + command.repeat);
+        
+        for (size_t run = 0; run < command.repeat; ++run) {
+            std::string error;
+            captured.str("");
+            uint64_t start = monotonicMicros();
+            bool success = session.execute(command, error);
+            commandStats.latencies.push_back(monotonicMicros() - start);
+            ++executed;
+            
+            if (!success) {
+                ++commandStats.failed;
+                if (++failed <= MAX_REPORTED_FAILURES) {
+                    std::cerr << scriptPath << ":" << command.line << ": " << command.name << " failed: "
+                              << (error.empty() ? lastLine(captured.str()) : error) << std::endl;
+                }
+            }
+        }
+    }
+    uint64_t elapsed = monotonicMicros() - batchStart;
+    std::cout.rdbuf(console);
+    
+    if (failed > MAX_REPORTED_FAILURES) {
+        std::cerr << "... " << failed - MAX_REPORTED_FAILURES << " more failures" << std::endl;
+    }
+    
+    std::cout << std::left << std::setw(10) << "command"
+              << std::right << std::setw(10) << "count"
+              << std::setw(10) << "failed"
+              << std::setw(12) << "mean (us)"
+              << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p99 (us)"
+              << std::setw(12) << "max (us)" << std::endl;
+    for (std::map<std::string, CommandStats>::iterator it = stats.begin(); it != stats.end(); ++it) {
+        std::vector<uint64_t>& latencies = it->second.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        uint64_t total = 0;
+        for (size_t i = 0; i < latencies.size(); ++i) {
+            total += latencies[i];
+        }
+        std::cout << std::left << std::setw(10) << it->first
+                  << std::right << std::setw(10) << latencies.size()
+                  << std::setw(10) << it->second.failed
+                  << std::setw(12) << total / latencies.size()
+                  << std::setw(12) << percentile(latencies, 0.50)
+                  << std::setw(12) << percentile(latencies, 0.99)
+                  << std::setw(12) << latencies.back() << std::endl;
+    }
+    
+    double seconds = elapsed / 1000000.0;
+    std::cout << executed << " commands (" << failed << " failed) in "
+              << std::fixed << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(0) << (seconds > 0 ? executed / seconds : 0) << " commands/s" << std::endl;
+    
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <string>
+#include "AccountSystem.h"
+
+// Replays a script of account operations without the console UI.
+//
+// One command per line; blank lines and lines starting with '#' are skipped.
+// Arguments are separated by whitespace, except the transfer description,
+// which is the rest of the line. A wallet is given by its ID or as @username
+// for the wallet that user owns when the command runs.
+//
+//   register <username> <password> <fullName> <email> <phone>
+//   login <username> <password>
+//   logout
+//   otp <purpose>
+//   deposit <wallet> <amount>                  admin deposit
+//   transfer <wallet> <amount> [description]   two-step transfer
+//   balance
+//   history
+//   repeat <count> <command...>
+//
+// OTPs for deposits and transfers are generated and confirmed automatically.
+// The console output of the operations is suppressed; at the end the latency
+// of each command and the overall throughput are printed. Returns 0 if the
+// script parsed and every command succeeded.
+int runBatch(AccountSystem& system, const std::string& scriptPath);
+
+#endif
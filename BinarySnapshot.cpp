@@ -0,0 +1,408 @@
+#include "BinarySnapshot.h"
+#include "MappedFile.h"
+#include "FileUtils.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+static const char SNAPSHOT_MAGIC[8] = { 'A', 'M', 'S', 'N', 'A', 'P', '\0', '\0' };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Every section must stay 8-byte aligned inside the mapped file
+typedef char UserRecordIsAligned[(sizeof(BinarySnapshot::UserRecord) % 8 == 0) ? 1 : -1];
+typedef char WalletRecordIsAligned[(sizeof(BinarySnapshot::WalletRecord) % 8 == 0) ? 1 : -1];
+typedef char TransactionRecordIsAligned[(sizeof(BinarySnapshot::TransactionRecord) % 8 == 0) ? 1 : -1];
+typedef char HeaderIsAligned[(sizeof(BinarySnapshot::SnapshotHeader) % 8 == 0) ? 1 : -1];
+
+// Version 1 layout, where wallet and transaction IDs were heap strings; read for migration only
+static const uint32_t STRING_ID_VERSION = 1;
+// Last version that stored balances and amounts as doubles
+static const uint32_t DOUBLE_AMOUNT_VERSION = 2;
+
+struct WalletRecordV1 {
+    BinarySnapshot::StringRef walletId;
+    BinarySnapshot::StringRef ownerUsername;
+    double balance;
+    uint64_t historyStart;
+    uint64_t historyCount;
+};
+
+struct TransactionRecordV1 {
+    BinarySnapshot::StringRef transactionId;
+    BinarySnapshot::StringRef senderWalletId;
+    BinarySnapshot::StringRef receiverWalletId;
+    BinarySnapshot::StringRef description;
+    double amount;
+    int64_t timestamp;
+    uint32_t status;
+    uint32_t reserved;
+};
+
+static BinarySnapshot::IdRecord toIdRecord(const Id128& id) {
+    BinarySnapshot::IdRecord record;
+    record.high = id.getHigh();
+    record.low = id.getLow();
+    return record;
+}
+
+static Id128 fromIdRecord(const BinarySnapshot::IdRecord& record) {
+    return Id128(record.high, record.low);
+}
+
+// Amount fields hold minor units, or the bits of a double in versions up to 2
+static Money readAmount(int64_t field, bool doubleAmounts) {
+    if (!doubleAmounts) {
+        return Money::fromMinorUnits(field);
+    }
+    
+    double value;
+    memcpy(&value, &field, sizeof(value));
+    Money money;
+    Money::fromDouble(value, money);
+    return money;
+}
+
+static Money readAmount(double field) {
+    Money money;
+    Money::fromDouble(field, money);
+    return money;
+}
+
+// String heap that stores each distinct string once (owners and descriptions repeat)
+class StringHeap {
+private:
+    std::string bytes;
+    std::map<std::string, BinarySnapshot::StringRef> offsets;
+
+public:
+    BinarySnapshot::StringRef add(const std::string& value) {
+        std::map<std::string, BinarySnapshot::StringRef>::const_iterator it = offsets.find(value);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+        
+        BinarySnapshot::StringRef ref;
+        ref.offset = static_cast<uint32_t>(bytes.size());
+        ref.length = static_cast<uint32_t>(value.size());
+        bytes.append(value);
+        offsets[value] = ref;
+        return ref;
+    }
+    
+    const std::string& getBytes() const {
+        return bytes;
+    }
+};
+
+bool BinarySnapshot::write(const std::string& path,
+                           const std::map<std::string, User>& users,
+                           const std::map<Id128, Wallet>& wallets,
+                           const std::map<Id128, Transaction>& transactions) {
+    StringHeap heap;
+    
+    std::vector<UserRecord> userRecords;
+    userRecords.reserve(users.size());
+    for (std::map<std::string, User>::const_iterator it = users.begin(); it != users.end(); ++it) {
+        const User& user = it->second;
+        UserRecord record;
+        memset(&record, 0, sizeof(record));
+        record.username = heap.add(user.getUsername());
+        record.passwordHash = heap.add(user.getPasswordHash());
+        record.fullName = heap.add(user.getFullName());
+        record.email = heap.add(user.getEmail());
+        record.phoneNumber = heap.add(user.getPhoneNumber());
+        record.totpSecret = heap.add(user.getTOTPSecret());
+        record.creationDate = static_cast<int64_t>(user.getCreationDate());
+        record.lastLoginDate = static_cast<int64_t>(user.getLastLoginDate());
+        record.role = static_cast<uint8_t>(user.getRole());
+        record.isAutoGeneratedPassword = user.getIsAutoGeneratedPassword() ? 1 : 0;
+        record.isFirstLogin = user.getIsFirstLogin() ? 1 : 0;
+        record.totpEnabled = user.isTOTPEnabled() ? 1 : 0;
+        userRecords.push_back(record);
+    }
+    
+    std::vector<WalletRecord> walletRecords;
+    std::vector<IdRecord> historyIds;
+    walletRecords.reserve(wallets.size());
+    for (std::map<Id128, Wallet>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
+        const Wallet& wallet = it->second;
+        const std::vector<Id128>& history = wallet.getTransactionHistory();
+        
+        WalletRecord record;
+        memset(&record, 0, sizeof(record));
+        record.walletId = toIdRecord(wallet.getWalletId());
+        record.ownerUsername = heap.add(wallet.getOwnerUsername());
+        record.balance = wallet.getBalance().getMinorUnits();
+        record.historyStart = historyIds.size();
+        record.historyCount = history.size();
+        for (size_t i = 0; i < history.size(); ++i) {
+            historyIds.push_back(toIdRecord(history[i]));
+        }
+        walletRecords.push_back(record);
+    }
+    
+    std::vector<TransactionRecord> transactionRecords;
+    transactionRecords.reserve(transactions.size());
+    for (std::map<Id128, Transaction>::const_iterator it = transactions.begin(); it != transactions.end(); ++it) {
+        const Transaction& transaction = it->second;
+        TransactionRecord record;
+        memset(&record, 0, sizeof(record));
+        record.transactionId = toIdRecord(transaction.getTransactionId());
+        record.senderWalletId = toIdRecord(transaction.getSenderWalletId());
+        record.receiverWalletId = toIdRecord(transaction.getReceiverWalletId());
+        record.description = heap.add(transaction.getDescription());
+        record.amount = transaction.getAmount().getMinorUnits();
+        record.timestamp = static_cast<int64_t>(transaction.getTimestamp());
+        record.status = static_cast<uint32_t>(transaction.getStatus());
+        transactionRecords.push_back(record);
+    }
+    
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = FORMAT_VERSION;
+    header.byteOrderMark = BYTE_ORDER_MARK;
+    header.userCount = userRecords.size();
+    header.walletCount = walletRecords.size();
+    header.transactionCount = transactionRecords.size();
+    header.historyCount = historyIds.size();
+    header.userOffset = sizeof(SnapshotHeader);
+    header.walletOffset = header.userOffset + header.userCount * sizeof(UserRecord);
+    header.transactionOffset = header.walletOffset + header.walletCount * sizeof(WalletRecord);
+    header.historyOffset = header.transactionOffset + header.transactionCount * sizeof(TransactionRecord);
+    header.heapOffset = header.historyOffset + header.historyCount * sizeof(IdRecord);
+    header.heapSize = heap.getBytes().size();
+    
+    // Write next to the target and rename, so a crash never leaves a half-written snapshot
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Cannot write snapshot: " << tempPath << std::endl;
+            return false;
+        }
+        
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!userRecords.empty()) {
+            out.write(reinterpret_cast<const char*>(&userRecords[0]), userRecords.size() * sizeof(UserRecord));
+        }
+        if (!walletRecords.empty()) {
+            out.write(reinterpret_cast<const char*>(&walletRecords[0]), walletRecords.size() * sizeof(WalletRecord));
+        }
+        if (!transactionRecords.empty()) {
+            out.write(reinterpret_cast<const char*>(&transactionRecords[0]),
+                      transactionRecords.size() * sizeof(TransactionRecord));
+        }
+        if (!historyIds.empty()) {
+            out.write(reinterpret_cast<const char*>(&historyIds[0]), historyIds.size() * sizeof(IdRecord));
+        }
+        out.write(heap.getBytes().data(), heap.getBytes().size());
+        
+        out.flush();
+        if (!out.good()) {
+            std::cerr << "Failed writing snapshot: " << tempPath << std::endl;
+            return false;
+        }
+    }
+    
+    // On disk before the rename, so a checkpoint never truncates the journal ahead of it
+    if (!syncFile(tempPath)) {
+        std::cerr << "Cannot sync snapshot: " << tempPath << std::endl;
+        return false;
+    }
+    return replaceFile(tempPath, path);
+}
+
+// Copies strings out of the mapped heap; a bad reference marks the whole snapshot invalid
+class HeapReader {
+private:
+    const char* heap;
+    uint64_t heapSize;
+    bool valid;
+
+public:
+    HeapReader(const char* heap, uint64_t heapSize) : heap(heap), heapSize(heapSize), valid(true) {}
+    
+    std::string get(const BinarySnapshot::StringRef& ref) {
+        if (static_cast<uint64_t>(ref.offset) + ref.length > heapSize) {
+            valid = false;
+            return std::string();
+        }
+        return std::string(heap + ref.offset, ref.length);
+    }
+    
+    bool isValid() const {
+        return valid;
+    }
+};
+
+// Checks that count records of recordSize bytes starting at offset fit in the file
+static bool sectionFits(uint64_t offset, uint64_t count, size_t recordSize, size_t fileSize) {
+    if (offset > fileSize) {
+        return false;
+    }
+    return count <= (fileSize - offset) / recordSize;
+}
+
+bool BinarySnapshot::read(const std::string& path,
+                          std::map<std::string, User>& users,
+                          std::map<Id128, Wallet>& wallets,
+                          std::map<Id128, Transaction>& transactions) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    
+    const char* base = file.getData();
+    size_t size = file.getSize();
+    if (size < sizeof(SnapshotHeader)) {
+        std::cerr << "Snapshot is truncated: " << path << std::endl;
+        return false;
+    }
+    
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byteOrderMark != BYTE_ORDER_MARK) {
+        std::cerr << "Not a snapshot file: " << path << std::endl;
+        return false;
+    }
+    if (header.version < STRING_ID_VERSION || header.version > FORMAT_VERSION) {
+        std::cerr << "Unsupported snapshot version " << header.version << std::endl;
+        return false;
+    }
+    
+    bool stringIds = header.version == STRING_ID_VERSION;
+    bool doubleAmounts = header.version <= DOUBLE_AMOUNT_VERSION;
+    size_t walletRecordSize = stringIds ? sizeof(WalletRecordV1) : sizeof(WalletRecord);
+    size_t transactionRecordSize = stringIds ? sizeof(TransactionRecordV1) : sizeof(TransactionRecord);
+    size_t historyRecordSize = stringIds ? sizeof(StringRef) : sizeof(IdRecord);
+    
+    if (!sectionFits(header.userOffset, header.userCount, sizeof(UserRecord), size) ||
+        !sectionFits(header.walletOffset, header.walletCount, walletRecordSize, size) ||
+        !sectionFits(header.transactionOffset, header.transactionCount, transactionRecordSize, size) ||
+        !sectionFits(header.historyOffset, header.historyCount, historyRecordSize, size) ||
+        !sectionFits(header.heapOffset, header.heapSize, 1, size)) {
+        std::cerr << "Snapshot sections out of range: " << path << std::endl;
+        return false;
+    }
+    
+    HeapReader strings(base + header.heapOffset, header.heapSize);
+    bool valid = true;
+    
+    users.clear();
+    wallets.clear();
+    transactions.clear();
+    
+    for (uint64_t i = 0; i < header.userCount && valid && strings.isValid(); ++i) {
+        UserRecord record;
+        memcpy(&record, base + header.userOffset + i * sizeof(UserRecord), sizeof(record));
+        
+        User user(strings.get(record.username),
+                  strings.get(record.passwordHash),
+                  strings.get(record.fullName),
+                  strings.get(record.email),
+                  strings.get(record.phoneNumber),
+                  record.role == ADMIN ? ADMIN : REGULAR);
+        user.setIsAutoGeneratedPassword(record.isAutoGeneratedPassword != 0);
+        user.setIsFirstLogin(record.isFirstLogin != 0);
+        user.setCreationDate(static_cast<time_t>(record.creationDate));
+        user.setLastLoginDate(static_cast<time_t>(record.lastLoginDate));
+        user.setTOTPSecret(strings.get(record.totpSecret));
+        user.enableTOTP(record.totpEnabled != 0);
+        
+        // Records were written in key order, so appending at the end is O(1)
+        users.insert(users.end(), std::make_pair(user.getUsername(), user));
+    }
+    
+    const char* historyBase = base + header.historyOffset;
+    for (uint64_t i = 0; i < header.walletCount && valid && strings.isValid(); ++i) {
+        const char* recordBase = base + header.walletOffset + i * walletRecordSize;
+        Wallet wallet;
+        uint64_t historyStart;
+        uint64_t historyCount;
+        
+        if (stringIds) {
+            WalletRecordV1 record;
+            memcpy(&record, recordBase, sizeof(record));
+            wallet = Wallet(Id128::parse(strings.get(record.walletId)), strings.get(record.ownerUsername), readAmount(record.balance));
+            historyStart = record.historyStart;
+            historyCount = record.historyCount;
+        } else {
+            WalletRecord record;
+            memcpy(&record, recordBase, sizeof(record));
+            wallet = Wallet(fromIdRecord(record.walletId), strings.get(record.ownerUsername),
+                            readAmount(record.balance, doubleAmounts));
+            historyStart = record.historyStart;
+            historyCount = record.historyCount;
+        }
+        
+        if (historyStart > header.historyCount || historyCount > header.historyCount - historyStart) {
+            valid = false;
+            break;
+        }
+        
+        for (uint64_t h = 0; h < historyCount; ++h) {
+            const char* historyRecord = historyBase + (historyStart + h) * historyRecordSize;
+            if (stringIds) {
+                StringRef ref;
+                memcpy(&ref, historyRecord, sizeof(ref));
+                wallet.addTransactionToHistory(Id128::parse(strings.get(ref)));
+            } else {
+                IdRecord id;
+                memcpy(&id, historyRecord, sizeof(id));
+                wallet.addTransactionToHistory(fromIdRecord(id));
+            }
+        }
+        
+        // Version 1 was ordered by ID text, which is not Id128 order: let the map place it
+        if (!wallet.getWalletId().isNil()) {
+            wallets.insert(stringIds ? wallets.lower_bound(wallet.getWalletId()) : wallets.end(),
+                           std::make_pair(wallet.getWalletId(), wallet));
+        }
+    }
+    
+    for (uint64_t i = 0; i < header.transactionCount && valid && strings.isValid(); ++i) {
+        const char* recordBase = base + header.transactionOffset + i * transactionRecordSize;
+        Transaction transaction;
+        
+        if (stringIds) {
+            TransactionRecordV1 record;
+            memcpy(&record, recordBase, sizeof(record));
+            transaction = Transaction(Id128::parse(strings.get(record.transactionId)),
+                                      Id128::parse(strings.get(record.senderWalletId)),
+                                      Id128::parse(strings.get(record.receiverWalletId)),
+                                      readAmount(record.amount),
+                                      strings.get(record.description));
+            transaction.setStatus(static_cast<TransactionStatus>(record.status));
+            transaction.setTimestamp(static_cast<time_t>(record.timestamp));
+        } else {
+            TransactionRecord record;
+            memcpy(&record, recordBase, sizeof(record));
+            transaction = Transaction(fromIdRecord(record.transactionId),
+                                      fromIdRecord(record.senderWalletId),
+                                      fromIdRecord(record.receiverWalletId),
+                                      readAmount(record.amount, doubleAmounts),
+                                      strings.get(record.description));
+            transaction.setStatus(static_cast<TransactionStatus>(record.status));
+            transaction.setTimestamp(static_cast<time_t>(record.timestamp));
+        }
+        
+        if (!transaction.getTransactionId().isNil()) {
+            transactions.insert(stringIds ? transactions.lower_bound(transaction.getTransactionId()) : transactions.end(),
+                                std::make_pair(transaction.getTransactionId(), transaction));
+        }
+    }
+    
+    if (!valid || !strings.isValid()) {
+        std::cerr << "Snapshot contains invalid string references: " << path << std::endl;
+        users.clear();
+        wallets.clear();
+        transactions.clear();
+        return false;
+    }
+    
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef BINARY_SNAPSHOT_H
+#define BINARY_SNAPSHOT_H
+
+#include <string>
+#include <map>
+#include <stdint.h>
+#include "User.h"
+#include "Wallet.h"
+
+// Versioned binary snapshot of all users, wallets and transactions.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//   SnapshotHeader
+//   UserRecord[userCount]
+//   WalletRecord[walletCount]
+//   TransactionRecord[transactionCount]
+//   IdRecord[historyCount]         wallet transaction histories, indexed by WalletRecord
+//   string heap                    deduplicated bytes referenced by every StringRef
+//
+// Records are fixed width, so loading is a walk over the mapped file without
+// any per-field parsing. Older files are still read: version 1 stored IDs as
+// strings and versions 1-2 stored amounts as doubles.
+class BinarySnapshot {
+public:
+    static const uint32_t FORMAT_VERSION = 3;
+    
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+    
+    struct IdRecord {
+        uint64_t high;
+        uint64_t low;
+    };
+    
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        uint64_t userCount;
+        uint64_t walletCount;
+        uint64_t transactionCount;
+        uint64_t historyCount;
+        uint64_t userOffset;
+        uint64_t walletOffset;
+        uint64_t transactionOffset;
+        uint64_t historyOffset;
+        uint64_t heapOffset;
+        uint64_t heapSize;
+    };
+    
+    struct UserRecord {
+        StringRef username;
+        StringRef passwordHash;
+        StringRef fullName;
+        StringRef email;
+        StringRef phoneNumber;
+        StringRef totpSecret;
+        int64_t creationDate;
+        int64_t lastLoginDate;
+        uint8_t role;
+        uint8_t isAutoGeneratedPassword;
+        uint8_t isFirstLogin;
+        uint8_t totpEnabled;
+        uint8_t reserved[4];
+    };
+    
+    struct WalletRecord {
+        IdRecord walletId;
+        StringRef ownerUsername;
+        int64_t balance;    // Minor units (Money)
+        uint64_t historyStart;
+        uint64_t historyCount;
+    };
+    
+    struct TransactionRecord {
+        IdRecord transactionId;
+        IdRecord senderWalletId;
+        IdRecord receiverWalletId;
+        StringRef description;
+        int64_t amount;     // Minor units (Money)
+        int64_t timestamp;
+        uint32_t status;
+        uint32_t reserved;
+    };
+    
+    static bool write(const std::string& path,
+                      const std::map<std::string, User>& users,
+                      const std::map<Id128, Wallet>& wallets,
+                      const std::map<Id128, Transaction>& transactions);
+    
+    // Replaces the contents of the three maps; returns false if the file is missing or invalid
+    static bool read(const std::string& path,
+                     std::map<std::string, User>& users,
+                     std::map<Id128, Wallet>& wallets,
+                     std::map<Id128, Transaction>& transactions);
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+// Wall-clock time since the Unix epoch with sub-second resolution
+uint64_t currentTimeMillis();
+uint64_t currentTimeMicros();
+
+// Monotonic time for measuring intervals (arbitrary origin)
+uint64_t monotonicMicros();
+uint64_t monotonicNanos();
+
+#endif
@@ -0,0 +1,292 @@
+#include "CsvBench.h"
+#include "DataManager.h"
+#include "MappedFile.h"
+#include "FileUtils.h"
+#include "Clock.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+static const char* BENCH_CSV_DIR = "data/bench/csv/";
+static const uint64_t GENERATOR_SEED = 0x9E3779B97F4A7C15ULL;
+static const time_t FIRST_TIMESTAMP = 1704067200;   // 2024-01-01 UTC
+static const size_t TRANSACTIONS_PER_WALLET = 10;
+static const size_t MIN_WALLETS = 16;
+static const int RUNS = 3;
+
+// xorshift64*: the same seed always produces the same files
+struct CsvBenchRandom {
+    uint64_t state;
+    
+    explicit CsvBenchRandom(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+// The parsers as they were before CsvScanner: a stringstream per line and a
+// std::string per field, numbers read with atol/atoi
+static bool streamParseUser(const std::string& line, User& user) {
+    std::stringstream ss(line);
+    std::string username, passwordHash, fullName, email, phoneNumber, roleStr;
+    std::string isAutoGenStr, isFirstLoginStr, creationDateStr, lastLoginDateStr;
+    
+    std::getline(ss, username, ',');
+    std::getline(ss, passwordHash, ',');
+    std::getline(ss, fullName, ',');
+    std::getline(ss, email, ',');
+    std::getline(ss, phoneNumber, ',');
+    std::getline(ss, roleStr, ',');
+    std::getline(ss, isAutoGenStr, ',');
+    std::getline(ss, isFirstLoginStr, ',');
+    std::getline(ss, creationDateStr, ',');
+    std::getline(ss, lastLoginDateStr, ',');
+    
+    if (username.empty()) {
+        return false;
+    }
+    
+    user = User(username, passwordHash, fullName, email, phoneNumber, roleStr == "1" ? ADMIN : REGULAR);
+    user.setIsAutoGeneratedPassword(isAutoGenStr == "1");
+    user.setIsFirstLogin(isFirstLoginStr == "1");
+    user.setCreationDate(atol(creationDateStr.c_str()));
+    user.setLastLoginDate(atol(lastLoginDateStr.c_str()));
+    return true;
+}
+
+static bool streamParseWallet(const std::string& line, Wallet& wallet) {
+    std::stringstream ss(line);
+    std::string walletIdStr, ownerUsername, balanceStr;
+    
+    std::getline(ss, walletIdStr, ',');
+    std::getline(ss, ownerUsername, ',');
+    std::getline(ss, balanceStr, ',');
+    
+    Id128 walletId;
+    if (!Id128::fromString(walletIdStr, walletId)) {
+        return false;
+    }
+    
+    Money balance;
+    Money::parse(balanceStr, balance);
+    wallet = Wallet(walletId, ownerUsername, balance);
+    
+    std::string transactionIdStr;
+    while (std::getline(ss, transactionIdStr, ',')) {
+        Id128 transactionId;
+        if (Id128::fromString(transactionIdStr, transactionId)) {
+            wallet.addTransactionToHistory(transactionId);
+        }
+    }
+    return true;
+}
+
+static bool streamParseTransaction(const std::string& line, Transaction& transaction) {
+    std::stringstream ss(line);
+    std::string transactionIdStr, senderWalletIdStr, receiverWalletIdStr, amountStr;
+    std::string timestampStr, isSuccessfulStr, statusStr, description;
+    
+    std::getline(ss, transactionIdStr, ',');
+    std::getline(ss, senderWalletIdStr, ',');
+    std::getline(ss, receiverWalletIdStr, ',');
+    std::getline(ss, amountStr, ',');
+    std::getline(ss, timestampStr, ',');
+    std::getline(ss, isSuccessfulStr, ',');
+    std::getline(ss, statusStr, ',');
+    std::getline(ss, description);
+    
+    Id128 transactionId;
+    if (!Id128::fromString(transactionIdStr, transactionId)) {
+        return false;
+    }
+    
+    Money amount;
+    Money::parse(amountStr, amount);
+    
+    transaction = Transaction(transactionId, Id128::parse(senderWalletIdStr), Id128::parse(receiverWalletIdStr),
+                              amount, description);
+    transaction.setIsSuccessful(isSuccessfulStr == "1");
+    transaction.setTimestamp(atol(timestampStr.c_str()));
+    if (!statusStr.empty()) {
+        transaction.setStatus(static_cast<TransactionStatus>(atoi(statusStr.c_str())));
+    }
+    return true;
+}
+
+template <typename Record>
+static void parseWithStream(const std::string& path, bool (*parse)(const std::string&, Record&),
+                            std::vector<Record>& records) {
+    std::ifstream file(path.c_str());
+    std::string line;
+    Record record;
+    while (std::getline(file, line)) {
+        if (parse(line, record)) {
+            records.push_back(record);
+        }
+    }
+}
+
+template <typename Record>
+static void parseWithScanner(const std::string& path, bool (*parse)(const char*, const char*, Record&),
+                             std::vector<Record>& records) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return;
+    }
+    
+    const char* end = file.getData() + file.getSize();
+    Record record;
+    for (const char* lineStart = file.getData(); lineStart < end; ) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char* contentEnd = (lineEnd > lineStart && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+        if (parse(lineStart, contentEnd, record)) {
+            records.push_back(record);
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
+static void report(const char* parser, size_t bytes, size_t records, uint64_t nanos) {
+    double seconds = nanos / 1e9;
+    std::cout << "    " << std::left << std::setw(9) << parser << std::right << std::fixed
+              << std::setw(9) << std::setprecision(1) << bytes / seconds / (1024.0 * 1024.0) << " MB/s"
+              << std::setw(12) << static_cast<uint64_t>(records / seconds) << " records/s"
+              << std::setw(10) << std::setprecision(3) << seconds << " s" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+// Times both parsers on one file; false if they disagree on any record
+template <typename Record>
+static bool benchFile(const char* name, bool (*streamParse)(const std::string&, Record&),
+                      bool (*scanParse)(const char*, const char*, Record&),
+                      std::string (*format)(const Record&)) {
+    std::string path = std::string(BENCH_CSV_DIR) + name;
+    size_t bytes = 0;
+    {
+        MappedFile file;
+        if (file.open(path)) {
+            bytes = file.getSize();
+        }
+    }
+    
+    std::vector<Record> streamRecords, scanRecords;
+    uint64_t streamBest = 0, scanBest = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        streamRecords.clear();
+        uint64_t started = monotonicNanos();
+        parseWithStream(path, streamParse, streamRecords);
+        uint64_t elapsed = monotonicNanos() - started;
+        streamBest = (run == 0 || elapsed < streamBest) ? elapsed : streamBest;
+        
+        scanRecords.clear();
+        started = monotonicNanos();
+        parseWithScanner(path, scanParse, scanRecords);
+        elapsed = monotonicNanos() - started;
+        scanBest = (run == 0 || elapsed < scanBest) ? elapsed : scanBest;
+    }
+    
+    std::cout << "  " << name << " (" << bytes / 1024 << " KiB, " << scanRecords.size() << " records):" << std::endl;
+    report("stream", bytes, streamRecords.size(), streamBest);
+    report("scanner", bytes, scanRecords.size(), scanBest);
+    std::cout << "    " << std::fixed << std::setprecision(2)
+              << static_cast<double>(streamBest) / (scanBest > 0 ? scanBest : 1) << "x faster" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    
+    bool same = streamRecords.size() == scanRecords.size();
+    for (size_t i = 0; same && i < scanRecords.size(); ++i) {
+        same = format(streamRecords[i]) == format(scanRecords[i]);
+    }
+    if (!same) {
+        std::cout << "    the parsers produced different records" << std::endl;
+    }
+    return same;
+}
+
+static bool generateFiles(size_t transactionCount) {
+    static const char* DESCRIPTIONS[] = { "Payment", "Refund", "Groceries", "Rent, March", "Gift", "Invoice 2024" };
+    CsvBenchRandom random(GENERATOR_SEED);
+    size_t walletCount = std::max(MIN_WALLETS, transactionCount / TRANSACTIONS_PER_WALLET);
+    
+    std::ofstream userFile((std::string(BENCH_CSV_DIR) + "users.txt").c_str());
+    std::ofstream walletFile((std::string(BENCH_CSV_DIR) + "wallets.txt").c_str());
+    std::ofstream transactionFile((std::string(BENCH_CSV_DIR) + "transactions.txt").c_str());
+    if (!userFile.is_open() || !walletFile.is_open() || !transactionFile.is_open()) {
+        std::cerr << "Cannot create the benchmark files in " << BENCH_CSV_DIR << std::endl;
+        return false;
+    }
+    
+    std::vector<Wallet> wallets;
+    wallets.reserve(walletCount);
+    for (size_t i = 0; i < walletCount; ++i) {
+        std::ostringstream username, passwordHash, phone;
+        username << "bench" << i;
+        passwordHash << std::hex << random.next();
+        phone << "09" << (10000000 + i % 90000000);
+        User user(username.str(), passwordHash.str(), "Bench User " + username.str().substr(5),
+                  username.str() + "@example.com", phone.str());
+        user.setCreationDate(FIRST_TIMESTAMP + static_cast<time_t>(i));
+        user.setLastLoginDate(FIRST_TIMESTAMP + static_cast<time_t>(i + random.next() % 86400));
+        userFile << formatUserRecord(user) << '\n';
+        
+        wallets.push_back(Wallet(Id128(random.next(), random.next()), username.str(),
+                                 Money::fromMinorUnits(static_cast<int64_t>(random.next() % 100000000))));
+    }
+    
+    time_t timestamp = FIRST_TIMESTAMP;
+    for (size_t i = 0; i < transactionCount; ++i) {
+        timestamp += static_cast<time_t>(random.next() % 3);
+        size_t sender = random.next() % walletCount;
+        size_t receiver = (sender + 1 + random.next() % (walletCount - 1)) % walletCount;
+        
+        Transaction transaction(Id128(random.next(), random.next()), wallets[sender].getWalletId(),
+                                wallets[receiver].getWalletId(),
+                                Money::fromMinorUnits(100 + static_cast<int64_t>(random.next() % 500000)),
+                                DESCRIPTIONS[random.next() % (sizeof(DESCRIPTIONS) / sizeof(DESCRIPTIONS[0]))]);
+        transaction.setTimestamp(timestamp);
+        transaction.setStatus(COMPLETED);
+        transactionFile << formatTransactionRecord(transaction) << '\n';
+        
+        wallets[sender].addTransactionToHistory(transaction.getTransactionId());
+        wallets[receiver].addTransactionToHistory(transaction.getTransactionId());
+    }
+    
+    for (size_t i = 0; i < wallets.size(); ++i) {
+        walletFile << formatWalletRecord(wallets[i]) << '\n';
+    }
+    return userFile.good() && walletFile.good() && transactionFile.good();
+}
+
+int runCsvBenchmark(size_t transactionCount) {
+    removeDirectoryTree(BENCH_CSV_DIR);
+    if (!createDirectory(BENCH_CSV_DIR)) {
+        std::cerr << "Cannot create " << BENCH_CSV_DIR << std::endl;
+        return 1;
+    }
+    
+    std::cerr << "CSV benchmark: generating " << transactionCount << " transactions in " << BENCH_CSV_DIR << std::endl;
+    bool generated = generateFiles(transactionCount);
+    
+    bool same = generated;
+    if (generated) {
+        std::cout << "Text data file parsing, best of " << RUNS << " runs:" << std::endl;
+        same = benchFile<User>("users.txt", streamParseUser, parseUserRecord, formatUserRecord) && same;
+        same = benchFile<Wallet>("wallets.txt", streamParseWallet, parseWalletRecord, formatWalletRecord) && same;
+        same = benchFile<Transaction>("transactions.txt", streamParseTransaction, parseTransactionRecord,
+                                      formatTransactionRecord) && same;
+    }
+    
+    removeDirectoryTree(BENCH_CSV_DIR);
+    return same ? 0 : 1;
+}
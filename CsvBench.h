@@ -0,0 +1,17 @@
+#ifndef CSV_BENCH_H
+#define CSV_BENCH_H
+
+#include <cstddef>
+
+// Text data file parsing benchmark on generated files in data/bench/csv/.
+//
+// Writes users.txt, wallets.txt and transactions.txt holding transactionCount
+// transactions between about a tenth as many wallets, then parses each file
+// twice: with the previous parser (std::getline from an ifstream, a
+// stringstream per line and a std::string per field) and with the one
+// loadData() uses now (memory-mapped file, lines and fields found with
+// memchr by CsvScanner). Prints MB/s and records/s for both, best of three
+// runs, and checks that both produced the same records. Returns 0 if they did.
+int runCsvBenchmark(size_t transactionCount);
+
+#endif
@@ -0,0 +1,72 @@
+#include "CsvScanner.h"
+#include <cstring>
+
+static const uint64_t MAX_INT64_MAGNITUDE = 0x7FFFFFFFFFFFFFFFULL;
+
+bool CsvField::equals(const char* text) const {
+    size_t length = std::strlen(text);
+    return size() == length && std::memcmp(begin, text, length) == 0;
+}
+
+CsvScanner::CsvScanner(const char* begin, const char* end)
+    : position(begin), end(end), exhausted(false) {
+}
+
+bool CsvScanner::next(CsvField& field) {
+    if (exhausted) {
+        field = CsvField();
+        return false;
+    }
+    
+    const char* comma = static_cast<const char*>(std::memchr(position, ',', end - position));
+    field.begin = position;
+    if (comma) {
+        field.end = comma;
+        position = comma + 1;
+    } else {
+        field.end = end;
+        position = end;
+        exhausted = true;
+    }
+    return true;
+}
+
+bool CsvScanner::rest(CsvField& field) {
+    if (exhausted) {
+        field = CsvField();
+        return false;
+    }
+    
+    field.begin = position;
+    field.end = end;
+    position = end;
+    exhausted = true;
+    return true;
+}
+
+const char* parseInteger(const char* begin, const char* end, int64_t& value) {
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    
+    // Accumulated as a magnitude so that INT64_MIN still fits
+    const uint64_t limit = negative ? MAX_INT64_MAGNITUDE + 1 : MAX_INT64_MAGNITUDE;
+    const char* digitsStart = p;
+    uint64_t magnitude = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        unsigned digit = static_cast<unsigned>(*p - '0');
+        if (magnitude > (limit - digit) / 10) {
+            return begin;
+        }
+        magnitude = magnitude * 10 + digit;
+    }
+    if (p == digitsStart) {
+        return begin;
+    }
+    
+    value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return p;
+}
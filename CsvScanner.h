@@ -0,0 +1,44 @@
+#ifndef CSV_SCANNER_H
+#define CSV_SCANNER_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// One field of a data-file line; [begin, end) points into the caller's buffer
+struct CsvField {
+    const char* begin;
+    const char* end;
+    
+    CsvField() : begin(0), end(0) {}
+    
+    bool empty() const { return begin == end; }
+    size_t size() const { return static_cast<size_t>(end - begin); }
+    bool equals(const char* text) const;
+    std::string toString() const { return std::string(begin, end); }
+};
+
+// Splits one line of a data file at its commas without copying anything.
+// Fields asked for past the end of the line come back empty, as they did
+// from std::getline, so short legacy lines keep parsing the same way.
+class CsvScanner {
+private:
+    const char* position;
+    const char* end;
+    bool exhausted;
+
+public:
+    CsvScanner(const char* begin, const char* end);
+    
+    // Next comma-separated field; false (with an empty field) once the line is used up
+    bool next(CsvField& field);
+    // Everything left on the line, commas included (transaction descriptions)
+    bool rest(CsvField& field);
+};
+
+// Reads an optionally signed decimal integer at the start of [begin, end) the
+// way std::from_chars does: returns the first character not consumed, or
+// begin (with value unchanged) if there is no number or it overflows.
+const char* parseInteger(const char* begin, const char* end, int64_t& value);
+
+#endif
@@ -1,95 +1,394 @@
 #include "DataManager.h"
+#include "BinarySnapshot.h"
+#include "CsvScanner.h"
+#include "MappedFile.h"
+#include "FileUtils.h"
+#include "IdGenerator.h"
+#include "Metrics.h"
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <cstdlib>
+#include <cstdio>
 #include <ctime>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
 #include <sys/stat.h>
 
-// Hàm tạo thư mục tương thích với C++98
-bool createDirectory(const std::string& path) {
-    #ifdef _WIN32
-    return system(("mkdir " + path + " 2> nul").c_str()) == 0;
-    #else
-    return system(("mkdir -p " + path + " 2> /dev/null").c_str()) == 0;
-    #endif
+// Record formatting shared by the data files and the journal. Fields are
+// appended to the caller's buffer, so a whole file is built without a
+// temporary string or stream per record.
+static void appendInteger(std::string& out, int64_t value) {
+    // Digits are produced right to left
+    char digits[24];
+    size_t count = 0;
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do {
+        digits[count++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    
+    if (value < 0) {
+        out += '-';
+    }
+    while (count > 0) {
+        out += digits[--count];
+    }
 }
 
-// Hàm kiểm tra file tồn tại tương thích với C++98
-bool fileExists(const std::string& filename) {
-    std::ifstream file(filename.c_str());
-    return file.good();
+static void appendId(std::string& out, const Id128& id) {
+    char buffer[Id128::TEXT_LENGTH];
+    out.append(buffer, id.format(buffer));
 }
 
-// Hàm sao chép file tương thích với C++98
-bool copyFile(const std::string& src, const std::string& dest) {
-    std::ifstream source(src.c_str(), std::ios::binary);
-    if (!source) return false;
-    
-    std::ofstream destination(dest.c_str(), std::ios::binary);
-    if (!destination) return false;
+static void appendMoney(std::string& out, const Money& money) {
+    char buffer[32];
+    out.append(buffer, money.format(buffer));
+}
+
+static void appendUserRecord(std::string& out, const User& user) {
+    out += user.getUsername();
+    out += ',';
+    out += user.getPasswordHash();
+    out += ',';
+    out += user.getFullName();
+    out += ',';
+    out += user.getEmail();
+    out += ',';
+    out += user.getPhoneNumber();
+    out += (user.getRole() == ADMIN) ? ",1," : ",0,";
+    out += user.getIsAutoGeneratedPassword() ? "1," : "0,";
+    out += user.getIsFirstLogin() ? "1," : "0,";
+    appendInteger(out, static_cast<int64_t>(user.getCreationDate()));
+    out += ',';
+    appendInteger(out, static_cast<int64_t>(user.getLastLoginDate()));
+}
+
+static void appendWalletRecord(std::string& out, const Wallet& wallet) {
+    appendId(out, wallet.getWalletId());
+    out += ',';
+    out += wallet.getOwnerUsername();
+    out += ',';
+    appendMoney(out, wallet.getBalance());
     
-    destination << source.rdbuf();
-    return source && destination;
+    const std::vector<Id128>& history = wallet.getTransactionHistory();
+    for (size_t i = 0; i < history.size(); ++i) {
+        out += ',';
+        appendId(out, history[i]);
+    }
 }
 
-DataManager::DataManager() :
-    USER_DATA_FILE("data/users.txt"),
-    WALLET_DATA_FILE("data/wallets.txt"),
-    TRANSACTION_DATA_FILE("data/transactions.txt"),
-    BACKUP_DIR("data/backups/") {
-    loadData();
+static void appendTransactionRecord(std::string& out, const Transaction& transaction) {
+    appendId(out, transaction.getTransactionId());
+    out += ',';
+    appendId(out, transaction.getSenderWalletId());
+    out += ',';
+    appendId(out, transaction.getReceiverWalletId());
+    out += ',';
+    appendMoney(out, transaction.getAmount());
+    out += ',';
+    appendInteger(out, static_cast<int64_t>(transaction.getTimestamp()));
+    out += transaction.getIsSuccessful() ? ",1," : ",0,";
+    appendInteger(out, static_cast<int>(transaction.getStatus()));
+    out += ',';
+    out += transaction.getDescription();
 }
 
-DataManager::~DataManager() {
-    saveData();
+std::string formatUserRecord(const User& user) {
+    std::string out;
+    appendUserRecord(out, user);
+    return out;
+}
+
+std::string formatWalletRecord(const Wallet& wallet) {
+    std::string out;
+    appendWalletRecord(out, wallet);
+    return out;
+}
+
+std::string formatTransactionRecord(const Transaction& transaction) {
+    std::string out;
+    appendTransactionRecord(out, transaction);
+    return out;
+}
+
+// atol semantics: the leading number of the field, 0 if there is none
+static time_t fieldTime(const CsvField& field) {
+    int64_t value = 0;
+    parseInteger(field.begin, field.end, value);
+    return static_cast<time_t>(value);
+}
+
+bool parseUserRecord(const char* begin, const char* end, User& user) {
+    CsvScanner scanner(begin, end);
+    CsvField username, passwordHash, fullName, email, phoneNumber, role;
+    CsvField isAutoGenerated, isFirstLogin, creationDate, lastLoginDate;
+    
+    scanner.next(username);
+    scanner.next(passwordHash);
+    scanner.next(fullName);
+    scanner.next(email);
+    scanner.next(phoneNumber);
+    scanner.next(role);
+    scanner.next(isAutoGenerated);
+    scanner.next(isFirstLogin);
+    scanner.next(creationDate);
+    scanner.next(lastLoginDate);
+    
+    if (username.empty()) {
+        return false;
+    }
+    
+    user = User(username.toString(), passwordHash.toString(), fullName.toString(),
+                email.toString(), phoneNumber.toString(), role.equals("1") ? ADMIN : REGULAR);
+    user.setIsAutoGeneratedPassword(isAutoGenerated.equals("1"));
+    user.setIsFirstLogin(isFirstLogin.equals("1"));
+    user.setCreationDate(fieldTime(creationDate));
+    user.setLastLoginDate(fieldTime(lastLoginDate));
+    return true;
 }
 
-std::string DataManager::generateUniqueId() const {
-    // Sử dụng rand() thay vì random device để tương thích với C++98
-    srand(static_cast<unsigned int>(time(NULL)));
+bool parseWalletRecord(const char* begin, const char* end, Wallet& wallet) {
+    CsvScanner scanner(begin, end);
+    CsvField walletIdField, ownerUsername, balanceField;
+    
+    scanner.next(walletIdField);
+    scanner.next(ownerUsername);
+    scanner.next(balanceField);
+    
+    Id128 walletId;
+    if (!Id128::fromString(walletIdField.begin, walletIdField.end, walletId)) {
+        return false;
+    }
     
-    const char* hex_chars = "0123456789abcdef";
+    // Exact decimal parse; also reads legacy values such as "1e+006"
+    Money balance;
+    Money::parse(balanceField.begin, balanceField.end, balance);
+    wallet = Wallet(walletId, ownerUsername.toString(), balance);
     
-    std::string uuid;
-    for (int i = 0; i < 32; ++i) {
-        if (i == 8 || i == 12 || i == 16 || i == 20) {
-            uuid += "-";
+    CsvField transactionIdField;
+    while (scanner.next(transactionIdField)) {
+        Id128 transactionId;
+        if (Id128::fromString(transactionIdField.begin, transactionIdField.end, transactionId)) {
+            wallet.addTransactionToHistory(transactionId);
         }
-        uuid += hex_chars[rand() % 16];
+    }
+    return true;
+}
+
+bool parseTransactionRecord(const char* begin, const char* end, Transaction& transaction) {
+    CsvScanner scanner(begin, end);
+    CsvField transactionIdField, senderWalletId, receiverWalletId, amountField;
+    CsvField timestamp, isSuccessful, status, description;
+    
+    scanner.next(transactionIdField);
+    scanner.next(senderWalletId);
+    scanner.next(receiverWalletId);
+    scanner.next(amountField);
+    scanner.next(timestamp);
+    scanner.next(isSuccessful);
+    scanner.next(status);
+    scanner.rest(description);
+    
+    Id128 transactionId;
+    if (!Id128::fromString(transactionIdField.begin, transactionIdField.end, transactionId)) {
+        return false;
+    }
+    
+    Money amount;
+    Money::parse(amountField.begin, amountField.end, amount);
+    
+    // Unreadable wallet IDs stay nil, as Id128::parse leaves them
+    Id128 sender, receiver;
+    Id128::fromString(senderWalletId.begin, senderWalletId.end, sender);
+    Id128::fromString(receiverWalletId.begin, receiverWalletId.end, receiver);
+    
+    transaction = Transaction(transactionId, sender, receiver, amount, description.toString());
+    transaction.setIsSuccessful(isSuccessful.equals("1"));
+    transaction.setTimestamp(fieldTime(timestamp));
+    
+    // Set transaction status if available
+    if (!status.empty()) {
+        int64_t statusValue = 0;
+        parseInteger(status.begin, status.end, statusValue);
+        transaction.setStatus(static_cast<TransactionStatus>(statusValue));
+    }
+    return true;
+}
+
+DataManager::DataManager(const std::string& dataDirectory) :
+    DATA_DIR(dataDirectory),
+    USER_DATA_FILE(dataDirectory + "users.txt"),
+    WALLET_DATA_FILE(dataDirectory + "wallets.txt"),
+    TRANSACTION_DATA_FILE(dataDirectory + "transactions.txt"),
+    JOURNAL_FILE(dataDirectory + "journal.txt"),
+    SNAPSHOT_FILE(dataDirectory + "snapshot.bin"),
+    FORMAT_FILE(dataDirectory + "format.txt"),
+    BACKUP_DIR(dataDirectory + "backups/"),
+    SEGMENT_DIR(dataDirectory + "segments/"),
+    hotMonthsFrom(0),
+    hasColdSegments(false),
+    persistenceMode(JOURNALED),
+    snapshotFormat(TEXT_SNAPSHOT),
+    journalRecords(0),
+    journalUnsynced(false),
+    journalTorn(false),
+    flushCount(0),
+    backupManager(BACKUP_DIR),
+    transactionSegments(SEGMENT_DIR),
+    segmented(false),
+    persistenceLock(true),
+    writerRunning(false),
+    writerStopping(false),
+    flushWanted(false),
+    flushIntervalMillis(DEFAULT_FLUSH_INTERVAL_MILLIS),
+    requestedSequence(0),
+    syncRequestedSequence(0),
+    attemptedSequence(0),
+    flushedSequence(0),
+    syncedSequence(0) {
+    snapshotFormat = readStoredFormat();
+    loadData();
+}
+
+DataManager::~DataManager() {
+    stopBackgroundWriter();
+    
+    ScopedLock persistence(persistenceLock);
+    
+    if (persistenceMode == IN_MEMORY) {
+        return;
     }
     
-    return uuid;
+    if (persistenceMode == JOURNALED) {
+        // Fold the journal back in if anything was written since the last checkpoint
+        if (hasDirtyRecords() || journalRecords > 0) {
+            checkpoint();
+        }
+    } else if (hasDirtyRecords()) {
+        saveData();
+    }
+}
+
+static OperationMetric loadMetric("datamanager", "load");
+static OperationMetric saveMetric("datamanager", "save");
+static OperationMetric checkpointMetric("datamanager", "checkpoint");
+static OperationMetric backupMetric("datamanager", "backup");
+static OperationMetric restoreMetric("datamanager", "restore");
+static OperationMetric flushWaitMetric("datamanager", "flush_wait");
+
+static Gauge& userRecords = MetricsRegistry::instance().gauge(
+    "datamanager_records", "type=\"users\"", "Records held in memory");
+static Gauge& walletRecords = MetricsRegistry::instance().gauge(
+    "datamanager_records", "type=\"wallets\"", "Records held in memory");
+static Gauge& transactionRecords = MetricsRegistry::instance().gauge(
+    "datamanager_records", "type=\"transactions\"", "Records held in memory");
+static Gauge& journalRecordsGauge = MetricsRegistry::instance().gauge(
+    "datamanager_journal_records", "", "Records in the journal since the last checkpoint");
+static Counter& usersFlushed = MetricsRegistry::instance().counter(
+    "datamanager_records_written_total", "type=\"users\"", "Records written by saves and checkpoints");
+static Counter& walletsFlushed = MetricsRegistry::instance().counter(
+    "datamanager_records_written_total", "type=\"wallets\"", "Records written by saves and checkpoints");
+static Counter& transactionsFlushed = MetricsRegistry::instance().counter(
+    "datamanager_records_written_total", "type=\"transactions\"", "Records written by saves and checkpoints");
+static Counter& dataFileBytes = MetricsRegistry::instance().counter(
+    "datamanager_data_file_bytes_written_total", "", "Bytes of text data files rewritten");
+static Counter& dataFileSystemCalls = MetricsRegistry::instance().counter(
+    "datamanager_data_file_syscalls_total", "", "Open, write, sync, close and rename calls rewriting text data files");
+static Counter& segmentsCompacted = MetricsRegistry::instance().counter(
+    "datamanager_segments_compacted_total", "", "Cold transaction segments compressed by compactSegments()");
+static Counter& bufferedCommitFailures = MetricsRegistry::instance().counter(
+    "datamanager_commit_failures_total", "durability=\"buffered\"", "Commits whose changes did not reach the durability asked for");
+static Counter& fsyncCommitFailures = MetricsRegistry::instance().counter(
+    "datamanager_commit_failures_total", "durability=\"fsync\"", "Commits whose changes did not reach the durability asked for");
+static Counter& journalSyncCount = MetricsRegistry::instance().counter(
+    "datamanager_journal_syncs_total", "", "fsyncs of the journal, each shared by every DURABILITY_FSYNC commit waiting on it");
+
+Id128 DataManager::generateUniqueId() const {
+    // Time-ordered and unique across threads, unlike srand(time(NULL)) + rand()
+    return IdGenerator::next();
+}
+
+// Everything needed to rebuild the current state, journal and segments included
+std::vector<std::string> DataManager::backupFiles() const {
+    std::vector<std::string> files;
+    files.push_back(USER_DATA_FILE);
+    files.push_back(WALLET_DATA_FILE);
+    files.push_back(TRANSACTION_DATA_FILE);
+    files.push_back(SNAPSHOT_FILE);
+    files.push_back(FORMAT_FILE);
+    files.push_back(JOURNAL_FILE);
+    std::vector<std::string> segmentFiles = transactionSegments.listFiles();
+    files.insert(files.end(), segmentFiles.begin(), segmentFiles.end());
+    return files;
 }
 
 bool DataManager::createBackup() {
-    time_t now = time(NULL);
-    tm* now_tm = localtime(&now);
-    char timestamp[20];
-    strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", now_tm);
+    OperationTimer timer(backupMetric, true);
     
-    createDirectory(BACKUP_DIR);
+    ScopedLock persistence(persistenceLock);
     
-    std::string userBackup = BACKUP_DIR + "users_" + timestamp + ".txt";
-    std::string walletBackup = BACKUP_DIR + "wallets_" + timestamp + ".txt";
-    std::string transactionBackup = BACKUP_DIR + "transactions_" + timestamp + ".txt";
+    if (backupManager.createBackup(backupFiles()).empty()) {
+        std::cerr << "Backup failed" << std::endl;
+        return false;
+    }
+    return timer.succeed(true);
+}
+
+bool DataManager::restoreFromBackup(const std::string& backupId) {
+    OperationTimer timer(restoreMetric, true);
     
-    try {
-        copyFile(USER_DATA_FILE, userBackup);
-        copyFile(WALLET_DATA_FILE, walletBackup);
-        copyFile(TRANSACTION_DATA_FILE, transactionBackup);
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Backup failed: " << e.what() << std::endl;
+    ScopedLock persistence(persistenceLock);
+    
+    if (!backupManager.hasBackup(backupId)) {
+        return timer.succeed(restoreLegacyBackup(backupId));
+    }
+    
+    // Put every pending change on disk first: the state being replaced is then
+    // whole in its own backup, and nothing dirty is left to overwrite the restore
+    if (!checkpoint()) {
+        std::cerr << "Restoration aborted: pending changes could not be saved" << std::endl;
+        return false;
+    }
+    std::string currentId = backupManager.createBackup(backupFiles());
+    if (currentId.empty()) {
+        std::cerr << "Restoration aborted: the current state could not be backed up" << std::endl;
+        return false;
+    }
+    
+    // The backup carries its own journal; stop appending to the current one
+    // (appendToJournal() reopens it if the restore has to be rolled back)
+    journal.close();
+    
+    createDirectory(SEGMENT_DIR);
+    if (!backupManager.restoreBackup(backupId)) {
+        std::cerr << "Restoration failed" << std::endl;
+        // Files already replaced are put back to match the state still in memory
+        if (!backupManager.restoreBackup(currentId)) {
+            std::cerr << "Could not roll back to backup " << currentId << std::endl;
+        }
         return false;
     }
+    
+    snapshotFormat = readStoredFormat();
+    return timer.succeed(loadData());
+}
+
+std::vector<std::string> DataManager::listBackups() const {
+    return backupManager.listBackups();
+}
+
+BackupManager& DataManager::getBackupManager() {
+    return backupManager;
 }
 
-bool DataManager::restoreFromBackup(const std::string& backupTimestamp) {
+// Backups written before the incremental format: one full copy per file
+bool DataManager::restoreLegacyBackup(const std::string& backupTimestamp) {
     std::string userBackup = BACKUP_DIR + "users_" + backupTimestamp + ".txt";
     std::string walletBackup = BACKUP_DIR + "wallets_" + backupTimestamp + ".txt";
     std::string transactionBackup = BACKUP_DIR + "transactions_" + backupTimestamp + ".txt";
+    std::string snapshotBackup = BACKUP_DIR + "snapshot_" + backupTimestamp + ".bin";
+    std::string formatBackup = BACKUP_DIR + "format_" + backupTimestamp + ".txt";
     
     if (!fileExists(userBackup) || 
         !fileExists(walletBackup) || 
@@ -104,7 +403,17 @@ bool DataManager::restoreFromBackup(const std::string& backupTimestamp) {
         copyFile(userBackup, USER_DATA_FILE);
         copyFile(walletBackup, WALLET_DATA_FILE);
         copyFile(transactionBackup, TRANSACTION_DATA_FILE);
+        if (fileExists(formatBackup)) {
+            copyFile(snapshotBackup, SNAPSHOT_FILE);
+            copyFile(formatBackup, FORMAT_FILE);
+        } else {
+            // Backups taken before the binary format existed are always text
+            std::remove(FORMAT_FILE.c_str());
+        }
         
+        // The journal belongs to the state being replaced
+        resetJournal();
+        snapshotFormat = readStoredFormat();
         loadData();
         
         return true;
@@ -114,21 +423,439 @@ bool DataManager::restoreFromBackup(const std::string& backupTimestamp) {
     }
 }
 
+bool DataManager::appendToJournal(const std::string& records, size_t recordCount) {
+    if (!journal.is_open()) {
+        journal.open(JOURNAL_FILE.c_str(), std::ios::app);
+        if (!journal.is_open()) {
+            std::cerr << "Cannot open journal: " << JOURNAL_FILE << std::endl;
+            return false;
+        }
+    }
+    
+    // End a partial line left behind, so replay drops it instead of the batch's first record
+    if (journalTorn) {
+        journal.put('\n');
+    }
+    
+    // One write and one flush for the whole batch
+    journal.write(records.data(), records.size());
+    journal.flush();
+    if (!journal.good()) {
+        // A failed stream stays failed: the next append reopens the file instead
+        std::cerr << "Cannot write journal: " << JOURNAL_FILE << std::endl;
+        journal.close();
+        journal.clear();
+        journalTorn = true;
+        return false;
+    }
+    
+    journalTorn = false;
+    journalRecords += recordCount;
+    journalUnsynced = true;
+    journalRecordsGauge.set(journalRecords);
+    return true;
+}
+
+bool DataManager::syncJournal() {
+    if (!journal.is_open() || !journal.good()) {
+        return false;
+    }
+    
+    // std::ofstream does not expose its handle; fsync reaches its writes through the path
+    if (!syncFile(JOURNAL_FILE)) {
+        std::cerr << "Cannot sync journal: " << JOURNAL_FILE << std::endl;
+        return false;
+    }
+    
+    journalUnsynced = false;
+    ++lastFlushStats.journalSyncs;
+    ++totalFlushStats.journalSyncs;
+    journalSyncCount.add();
+    return true;
+}
+
+bool DataManager::hasDirtyRecords() const {
+    ScopedLock dirty(dirtyLock);
+    return !dirtyUsers.empty() || !deletedUsers.empty() ||
+           !dirtyWallets.empty() || !dirtyTransactions.empty();
+}
+
+void DataManager::clearDirtyRecords() {
+    ScopedLock dirty(dirtyLock);
+    dirtyUsers.clear();
+    deletedUsers.clear();
+    dirtyWallets.clear();
+    dirtyTransactions.clear();
+}
+
+void DataManager::remarkDirtyRecords(const std::set<std::string>& flushedUsers,
+                                     const std::set<std::string>& flushedDeletions,
+                                     const std::set<Id128>& flushedWallets,
+                                     const std::set<Id128>& flushedTransactions) {
+    ScopedLock dirty(dirtyLock);
+    dirtyUsers.insert(flushedUsers.begin(), flushedUsers.end());
+    dirtyWallets.insert(flushedWallets.begin(), flushedWallets.end());
+    dirtyTransactions.insert(flushedTransactions.begin(), flushedTransactions.end());
+    // A user saved again since its deletion was taken out is no longer deleted
+    for (std::set<std::string>::const_iterator it = flushedDeletions.begin(); it != flushedDeletions.end(); ++it) {
+        if (dirtyUsers.find(*it) == dirtyUsers.end()) {
+            deletedUsers.insert(*it);
+        }
+    }
+}
+
+size_t DataManager::pendingRecordCount() const {
+    ScopedLock dirty(dirtyLock);
+    return dirtyUsers.size() + deletedUsers.size() + dirtyWallets.size() + dirtyTransactions.size();
+}
+
+void DataManager::markWalletDirty(const Id128& walletId) {
+    ScopedLock dirty(dirtyLock);
+    dirtyWallets.insert(walletId);
+}
+
+void DataManager::recordFlush(const FlushStats& stats) {
+    ++flushCount;
+    lastFlushStats = stats;
+    totalFlushStats.usersWritten += stats.usersWritten;
+    totalFlushStats.usersDeleted += stats.usersDeleted;
+    totalFlushStats.walletsWritten += stats.walletsWritten;
+    totalFlushStats.transactionsWritten += stats.transactionsWritten;
+    totalFlushStats.filesRewritten += stats.filesRewritten;
+    totalFlushStats.bytesWritten += stats.bytesWritten;
+    totalFlushStats.fileSystemCalls += stats.fileSystemCalls;
+    
+    usersFlushed.add(stats.usersWritten);
+    walletsFlushed.add(stats.walletsWritten);
+    transactionsFlushed.add(stats.transactionsWritten);
+    dataFileBytes.add(stats.bytesWritten);
+    dataFileSystemCalls.add(stats.fileSystemCalls);
+}
+
+bool DataManager::flushDirtyToJournal() {
+    // Each dirty key is written once, however many times it changed since the last flush
+    std::string batch;
+    FlushStats stats;
+    std::set<std::string> flushedUsers, flushedDeletions;
+    std::set<Id128> flushedWallets, flushedTransactions;
+    
+    {
+        // Formatting with every stripe held gives a cut between transfers, never through one;
+        // the write itself happens after the stripes are released
+        AllStripesLock allWallets(walletLocks);
+        ReadLock store(storeLock);
+        ScopedLock dirty(dirtyLock);
+        flushedUsers.swap(dirtyUsers);
+        flushedDeletions.swap(deletedUsers);
+        flushedWallets.swap(dirtyWallets);
+        flushedTransactions.swap(dirtyTransactions);
+        
+        for (std::set<std::string>::const_iterator it = flushedDeletions.begin(); it != flushedDeletions.end(); ++it) {
+            batch += "D,";
+            batch += *it;
+            batch += '\n';
+            ++stats.usersDeleted;
+        }
+        
+        for (std::set<std::string>::const_iterator it = flushedUsers.begin(); it != flushedUsers.end(); ++it) {
+            std::map<std::string, User>::const_iterator user = users.find(*it);
+            if (user != users.end()) {
+                batch += "U,";
+                appendUserRecord(batch, user->second);
+                batch += '\n';
+                ++stats.usersWritten;
+            }
+        }
+        
+        for (std::set<Id128>::const_iterator it = flushedWallets.begin(); it != flushedWallets.end(); ++it) {
+            std::map<Id128, Wallet>::const_iterator wallet = wallets.find(*it);
+            if (wallet != wallets.end()) {
+                batch += "W,";
+                appendWalletRecord(batch, wallet->second);
+                batch += '\n';
+                ++stats.walletsWritten;
+            }
+        }
+        
+        for (std::set<Id128>::const_iterator it = flushedTransactions.begin(); it != flushedTransactions.end(); ++it) {
+            std::map<Id128, Transaction>::const_iterator transaction = transactions.find(*it);
+            if (transaction != transactions.end()) {
+                batch += "T,";
+                appendTransactionRecord(batch, transaction->second);
+                batch += '\n';
+                ++stats.transactionsWritten;
+            }
+        }
+    }
+    
+    if (!appendToJournal(batch, stats.totalRecords())) {
+        // Mark the keys again so the next flush retries them
+        remarkDirtyRecords(flushedUsers, flushedDeletions, flushedWallets, flushedTransactions);
+        return false;
+    }
+    
+    recordFlush(stats);
+    return true;
+}
+
+bool DataManager::flushDirtyToDataFiles() {
+    {
+        // The files are written from a frozen store: no wallet or map can change meanwhile
+        AllStripesLock allWallets(walletLocks);
+        ReadLock store(storeLock);
+        
+        // Taken out under dirtyLock, as in flushDirtyToJournal(): saveWallet() marks
+        // wallets with only a read lock on the store
+        FlushStats stats;
+        std::set<std::string> flushedUsers, flushedDeletions;
+        std::set<Id128> flushedWallets, flushedTransactions;
+        {
+            ScopedLock dirty(dirtyLock);
+            flushedUsers.swap(dirtyUsers);
+            flushedDeletions.swap(deletedUsers);
+            flushedWallets.swap(dirtyWallets);
+            flushedTransactions.swap(dirtyTransactions);
+        }
+        bool usersChanged = !flushedUsers.empty() || !flushedDeletions.empty();
+        bool walletsChanged = !flushedWallets.empty();
+        bool transactionsChanged = !flushedTransactions.empty();
+        
+        bool written = false;
+        if (segmented && snapshotFormat == TEXT_SNAPSHOT && readStoredFormat() == TEXT_SNAPSHOT) {
+            // Text snapshot: one file per record type and one per changed month, so
+            // only the changed files are rewritten
+            written = writeTextFiles(stats, usersChanged, walletsChanged, transactionsChanged);
+            stats.filesRewritten += (usersChanged ? 1 : 0) + (walletsChanged ? 1 : 0) + (transactionsChanged ? 1 : 0);
+        } else {
+            // The binary snapshot (or a pending format or layout switch) needs a full write
+            written = writeDataFiles(stats);
+            stats.filesRewritten += 1;
+            transactionsChanged = true;
+        }
+        
+        if (!written) {
+            remarkDirtyRecords(flushedUsers, flushedDeletions, flushedWallets, flushedTransactions);
+            return false;
+        }
+        
+        stats.usersWritten = usersChanged ? users.size() : 0;
+        stats.walletsWritten = walletsChanged ? wallets.size() : 0;
+        stats.transactionsWritten += transactionsChanged ? unorderedTransactions.size() : 0;
+        stats.usersDeleted = flushedDeletions.size();
+        
+        resetJournal();
+        recordFlush(stats);
+    }
+    
+    // Backed up once the stripes and the store are released, so transfers do
+    // not wait for the chunking and the backup's writes
+    createBackup();
+    return true;
+}
+
+size_t DataManager::getFlushCount() const {
+    ScopedLock persistence(persistenceLock);
+    return flushCount;
+}
+
+FlushStats DataManager::getLastFlushStats() const {
+    ScopedLock persistence(persistenceLock);
+    return lastFlushStats;
+}
+
+FlushStats DataManager::getTotalFlushStats() const {
+    ScopedLock persistence(persistenceLock);
+    return totalFlushStats;
+}
+
+// Whether a transaction sorts by time within the transactions map
+static bool hasTimeOrderedId(const Transaction& transaction) {
+    const Id128 transactionId = transaction.getTransactionId();
+    return IdGenerator::isTimeOrdered(transactionId) &&
+           static_cast<time_t>(IdGenerator::timestampMillis(transactionId) / 1000) == transaction.getTimestamp();
+}
+
+// Month of the segment a transaction is stored in; false for the rest (legacy random IDs)
+static bool segmentMonthOf(const Transaction& transaction, int& month) {
+    if (!hasTimeOrderedId(transaction)) {
+        return false;
+    }
+    month = TransactionSegments::monthOf(static_cast<int64_t>(IdGenerator::timestampMillis(transaction.getTransactionId())));
+    return true;
+}
+
+bool DataManager::replayJournal() {
+    std::ifstream journalFile(JOURNAL_FILE.c_str());
+    if (!journalFile.is_open()) {
+        return true;
+    }
+    
+    std::set<int> months;
+    std::string line;
+    while (std::getline(journalFile, line)) {
+        // A last line without its newline is a torn write from a crash; drop it
+        if (journalFile.eof()) {
+            journalTorn = !line.empty();
+            break;
+        }
+        
+        if (line.size() < 2 || line[1] != ',') {
+            continue;
+        }
+        
+        const char* record = line.data() + 2;
+        const char* recordEnd = line.data() + line.size();
+        switch (line[0]) {
+            case 'U': {
+                User user;
+                if (parseUserRecord(record, recordEnd, user)) {
+                    users[user.getUsername()] = user;
+                }
+                break;
+            }
+            case 'D':
+                users.erase(std::string(record, recordEnd));
+                break;
+            case 'W': {
+                Wallet wallet;
+                if (parseWalletRecord(record, recordEnd, wallet)) {
+                    wallets[wallet.getWalletId()] = wallet;
+                }
+                break;
+            }
+            case 'T': {
+                Transaction transaction;
+                if (parseTransactionRecord(record, recordEnd, transaction)) {
+                    // A newer copy than the segment holds, which the next checkpoint rewrites
+                    std::map<Id128, Transaction>::iterator existing = transactions.find(transaction.getTransactionId());
+                    int month;
+                    if (existing != transactions.end() && segmentMonthOf(existing->second, month)) {
+                        months.insert(month);
+                    }
+                    if (segmentMonthOf(transaction, month)) {
+                        months.insert(month);
+                    }
+                    transactions[transaction.getTransactionId()] = transaction;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        ++journalRecords;
+    }
+    
+    ScopedLock dirty(dirtyLock);
+    changedMonths.insert(months.begin(), months.end());
+    return true;
+}
+
+void DataManager::resetJournal() {
+    if (journal.is_open()) {
+        journal.close();
+    }
+    
+    // Truncate the journal: everything in it is now part of the data files
+    journal.clear();
+    journal.open(JOURNAL_FILE.c_str(), std::ios::trunc);
+    journalRecords = 0;
+    journalUnsynced = false;
+    journalTorn = false;
+    journalRecordsGauge.set(0);
+}
+
+void DataManager::setPersistenceMode(PersistenceMode mode) {
+    ScopedLock persistence(persistenceLock);
+    persistenceMode = mode;
+}
+
+PersistenceMode DataManager::getPersistenceMode() const {
+    ScopedLock persistence(persistenceLock);
+    return persistenceMode;
+}
+
+void DataManager::setSnapshotFormat(SnapshotFormat format) {
+    ScopedLock persistence(persistenceLock);
+    snapshotFormat = format;
+}
+
+SnapshotFormat DataManager::getSnapshotFormat() const {
+    ScopedLock persistence(persistenceLock);
+    return snapshotFormat;
+}
+
+SnapshotFormat DataManager::readStoredFormat() const {
+    std::ifstream formatFile(FORMAT_FILE.c_str());
+    std::string format;
+    if (formatFile >> format && format == "binary") {
+        return BINARY_SNAPSHOT;
+    }
+    return TEXT_SNAPSHOT;
+}
+
+// A second word, "segments", once the snapshot leaves segmented transactions out
+bool DataManager::readStoredSegmented() const {
+    std::ifstream formatFile(FORMAT_FILE.c_str());
+    std::string format, layout;
+    return formatFile >> format >> layout && layout == "segments";
+}
+
+bool DataManager::writeFormatFile(SnapshotFormat format, bool withSegments) {
+    std::vector<std::string> buffers(1, format == BINARY_SNAPSHOT ? "binary\n" : "text\n");
+    if (withSegments) {
+        buffers[0] += "segments\n";
+    }
+    size_t systemCalls = 0;
+    return writeFileSynced(FORMAT_FILE, buffers, systemCalls);
+}
+
+bool DataManager::convertTextToBinary() {
+    ScopedLock persistence(persistenceLock);
+    
+    if (readStoredFormat() == BINARY_SNAPSHOT) {
+        std::cerr << "Data is already stored as a binary snapshot." << std::endl;
+        return false;
+    }
+    
+    // Text files plus the journal give the current state; the checkpoint writes it as binary
+    if (!loadData()) {
+        return false;
+    }
+    
+    snapshotFormat = BINARY_SNAPSHOT;
+    return checkpoint();
+}
+
 bool DataManager::saveUser(const User& user) {
+    WriteLock store(storeLock);
     users[user.getUsername()] = user;
+    
+    ScopedLock dirty(dirtyLock);
+    deletedUsers.erase(user.getUsername());
+    dirtyUsers.insert(user.getUsername());
     return true;
 }
 
 bool DataManager::deleteUser(const std::string& username) {
+    WriteLock store(storeLock);
     std::map<std::string, User>::iterator it = users.find(username);
     if (it != users.end()) {
         users.erase(it);
+        {
+            ScopedLock dirty(dirtyLock);
+            dirtyUsers.erase(username);
+            deletedUsers.insert(username);
+        }
+        
+        // The wallets stay in the ledger but no longer belong to a live account
+        ownerWallets.erase(username);
         return true;
     }
     return false;
 }
 
 User* DataManager::getUser(const std::string& username) {
+    ReadLock store(storeLock);
     std::map<std::string, User>::iterator it = users.find(username);
     if (it != users.end()) {
         return &(it->second);
@@ -138,6 +865,7 @@ User* DataManager::getUser(const std::string& username) {
 
 // Add const version of getUser
 const User* DataManager::getUser(const std::string& username) const {
+    ReadLock store(storeLock);
     std::map<std::string, User>::const_iterator it = users.find(username);
     if (it != users.end()) {
         return &(it->second);
@@ -145,7 +873,18 @@ const User* DataManager::getUser(const std::string& username) const {
     return NULL;
 }
 
+bool DataManager::copyUser(const std::string& username, User& user) const {
+    ReadLock store(storeLock);
+    std::map<std::string, User>::const_iterator it = users.find(username);
+    if (it == users.end()) {
+        return false;
+    }
+    user = it->second;
+    return true;
+}
+
 std::vector<User> DataManager::getAllUsers() const {
+    ReadLock store(storeLock);
     std::vector<User> userList;
     for (std::map<std::string, User>::const_iterator it = users.begin(); it != users.end(); ++it) {
         userList.push_back(it->second);
@@ -154,21 +893,26 @@ std::vector<User> DataManager::getAllUsers() const {
 }
 
 bool DataManager::userExists(const std::string& username) const {
+    ReadLock store(storeLock);
     return users.find(username) != users.end();
 }
 
-std::string DataManager::createWallet(const std::string& ownerUsername) {
-    std::string walletId = generateUniqueId();
+Id128 DataManager::createWallet(const std::string& ownerUsername) {
+    Id128 walletId = generateUniqueId();
     
     Wallet wallet(walletId, ownerUsername);
     
+    WriteLock store(storeLock);
     wallets[walletId] = wallet;
+    indexWallet(ownerUsername, walletId);
+    markWalletDirty(walletId);
     
     return walletId;
 }
 
-Wallet* DataManager::getWallet(const std::string& walletId) {
-    std::map<std::string, Wallet>::iterator it = wallets.find(walletId);
+Wallet* DataManager::getWallet(const Id128& walletId) {
+    ReadLock store(storeLock);
+    std::map<Id128, Wallet>::iterator it = wallets.find(walletId);
     if (it != wallets.end()) {
         return &(it->second);
     }
@@ -176,225 +920,959 @@ Wallet* DataManager::getWallet(const std::string& walletId) {
 }
 
 Wallet* DataManager::getWalletByOwner(const std::string& username) {
-    for (std::map<std::string, Wallet>::iterator it = wallets.begin(); it != wallets.end(); ++it) {
-        if (it->second.getOwnerUsername() == username) {
-            return &(it->second);
+    ReadLock store(storeLock);
+    std::map<std::string, std::vector<Id128> >::const_iterator indexed = ownerWallets.find(username);
+    if (indexed == ownerWallets.end() || indexed->second.empty()) {
+        return NULL;
+    }
+    
+    std::map<Id128, Wallet>::iterator it = wallets.find(indexed->second.front());
+    return it != wallets.end() ? &(it->second) : NULL;
+}
+
+std::vector<Wallet*> DataManager::getWalletsByOwner(const std::string& username) {
+    std::vector<Wallet*> ownedWallets;
+    
+    ReadLock store(storeLock);
+    std::map<std::string, std::vector<Id128> >::const_iterator indexed = ownerWallets.find(username);
+    if (indexed != ownerWallets.end()) {
+        for (size_t i = 0; i < indexed->second.size(); ++i) {
+            std::map<Id128, Wallet>::iterator it = wallets.find(indexed->second[i]);
+            if (it != wallets.end()) {
+                ownedWallets.push_back(&(it->second));
+            }
         }
     }
-    return NULL;
+    
+    return ownedWallets;
 }
 
 bool DataManager::saveWallet(const Wallet& wallet) {
+    {
+        // Changed in place through getWallet(): the stripe already guards it, only mark it
+        ReadLock store(storeLock);
+        std::map<Id128, Wallet>::iterator it = wallets.find(wallet.getWalletId());
+        if (it != wallets.end() && &(it->second) == &wallet) {
+            markWalletDirty(wallet.getWalletId());
+            return true;
+        }
+    }
+    
+    WriteLock store(storeLock);
+    std::map<Id128, Wallet>::iterator it = wallets.find(wallet.getWalletId());
+    if (it == wallets.end()) {
+        indexWallet(wallet.getOwnerUsername(), wallet.getWalletId());
+    } else if (it->second.getOwnerUsername() != wallet.getOwnerUsername()) {
+        unindexWallet(it->second.getOwnerUsername(), wallet.getWalletId());
+        indexWallet(wallet.getOwnerUsername(), wallet.getWalletId());
+    }
+    
     wallets[wallet.getWalletId()] = wallet;
+    markWalletDirty(wallet.getWalletId());
     return true;
 }
 
-std::string DataManager::createTransaction(const std::string& senderWalletId, 
-                                         const std::string& receiverWalletId,
-                                         double amount,
-                                         const std::string& description) {
-    std::string transactionId = generateUniqueId();
-    
-    Transaction transaction(transactionId, senderWalletId, receiverWalletId, amount, description);
-    
-    transactions[transactionId] = transaction;
-    
-    return transactionId;
+LockStripes& DataManager::getWalletLocks() {
+    return walletLocks;
 }
 
-Transaction* DataManager::getTransaction(const std::string& transactionId) {
-    std::map<std::string, Transaction>::iterator it = transactions.find(transactionId);
-    if (it != transactions.end()) {
-        return &(it->second);
+void DataManager::indexWallet(const std::string& ownerUsername, const Id128& walletId) {
+    ownerWallets[ownerUsername].push_back(walletId);
+}
+
+void DataManager::unindexWallet(const std::string& ownerUsername, const Id128& walletId) {
+    std::map<std::string, std::vector<Id128> >::iterator indexed = ownerWallets.find(ownerUsername);
+    if (indexed == ownerWallets.end()) {
+        return;
+    }
+    
+    std::vector<Id128>& walletIds = indexed->second;
+    walletIds.erase(std::remove(walletIds.begin(), walletIds.end(), walletId), walletIds.end());
+    if (walletIds.empty()) {
+        ownerWallets.erase(indexed);
     }
-    return NULL;
 }
 
-std::vector<Transaction> DataManager::getTransactionsByWallet(const std::string& walletId) const {
-    std::vector<Transaction> walletTransactions;
+void DataManager::rebuildWalletIndex() {
+    ownerWallets.clear();
     
-    for (std::map<std::string, Transaction>::const_iterator it = transactions.begin(); it != transactions.end(); ++it) {
-        const Transaction& transaction = it->second;
-        if (transaction.getSenderWalletId() == walletId || 
-            transaction.getReceiverWalletId() == walletId) {
-            walletTransactions.push_back(transaction);
+    for (std::map<Id128, Wallet>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
+        // Wallets of deleted accounts are not reachable by owner (see deleteUser)
+        if (users.find(it->second.getOwnerUsername()) != users.end()) {
+            indexWallet(it->second.getOwnerUsername(), it->first);
         }
     }
-    
-    return walletTransactions;
 }
 
-bool DataManager::saveTransaction(const Transaction& transaction) {
-    transactions[transaction.getTransactionId()] = transaction;
-    return true;
+Id128 DataManager::createTransaction(const Id128& senderWalletId, 
+                                   const Id128& receiverWalletId,
+                                   const Money& amount,
+                                   const std::string& description) {
+    return createTransaction(senderWalletId, receiverWalletId, amount, description, PENDING);
 }
 
-bool DataManager::loadData() {
-    users.clear();
-    wallets.clear();
-    transactions.clear();
+Id128 DataManager::createTransaction(const Id128& senderWalletId, 
+                                   const Id128& receiverWalletId,
+                                   const Money& amount,
+                                   const std::string& description,
+                                   TransactionStatus status) {
+    Id128 transactionId = generateUniqueId();
     
-    createDirectory("data");
+    Transaction transaction(transactionId, senderWalletId, receiverWalletId, amount, description);
+    transaction.setStatus(status);
+    // Same instant as the ID, so ID order and timestamp order agree
+    transaction.setTimestamp(static_cast<time_t>(IdGenerator::timestampMillis(transactionId) / 1000));
     
-    try {
-        std::ifstream userFile(USER_DATA_FILE.c_str());
-        if (userFile.is_open()) {
-            std::string line;
-            while (std::getline(userFile, line)) {
-                std::stringstream ss(line);
-                std::string username, passwordHash, fullName, email, phoneNumber, roleStr;
-                std::string isAutoGenStr, isFirstLoginStr, creationDateStr, lastLoginDateStr;
-                
-                std::getline(ss, username, ',');
-                std::getline(ss, passwordHash, ',');
-                std::getline(ss, fullName, ',');
-                std::getline(ss, email, ',');
-                std::getline(ss, phoneNumber, ',');
-                std::getline(ss, roleStr, ',');
-                std::getline(ss, isAutoGenStr, ',');
-                std::getline(ss, isFirstLoginStr, ',');
-                std::getline(ss, creationDateStr, ',');
-                std::getline(ss, lastLoginDateStr, ',');
-                
-                UserRole role = (roleStr == "1") ? ADMIN : REGULAR;
-                
-                User user(username, passwordHash, fullName, email, phoneNumber, role);
-                user.setIsAutoGeneratedPassword(isAutoGenStr == "1");
-                user.setIsFirstLogin(isFirstLoginStr == "1");
-                
-                // Sử dụng atol thay vì stoll
-                time_t creationDate = atol(creationDateStr.c_str());
-                time_t lastLoginDate = atol(lastLoginDateStr.c_str());
-                
-                user.setLastLoginDate(lastLoginDate);
-                
-                users[username] = user;
+    WriteLock store(storeLock);
+    // A new, unique key: insert at the end hint without a second lookup
+    transactions.insert(transactions.end(), std::make_pair(transactionId, transaction));
+    indexTransaction(transaction);
+    
+    ScopedLock dirty(dirtyLock);
+    dirtyTransactions.insert(transactionId);
+    changedMonths.insert(TransactionSegments::monthOf(static_cast<int64_t>(IdGenerator::timestampMillis(transactionId))));
+    return transactionId;
+}
+
+Transaction* DataManager::getTransaction(const Id128& transactionId) {
+    int month;
+    {
+        ReadLock store(storeLock);
+        std::map<Id128, Transaction>::iterator it = transactions.find(transactionId);
+        if (it != transactions.end()) {
+            return &(it->second);
+        }
+        
+        // Only a time-ordered ID names the segment that could hold it
+        if (!hasColdSegments || !IdGenerator::isTimeOrdered(transactionId)) {
+            return NULL;
+        }
+        month = TransactionSegments::monthOf(static_cast<int64_t>(IdGenerator::timestampMillis(transactionId)));
+        if (month >= hotMonthsFrom) {
+            return NULL;
+        }
+    }
+    return loadColdTransaction(transactionId, month);
+}
+
+Transaction* DataManager::loadColdTransaction(const Id128& transactionId, int month) {
+    Transaction transaction;
+    {
+        ScopedLock persistence(persistenceLock);
+        const TransactionSegments::ColdSegment* segment = transactionSegments.getColdSegment(month);
+        if (!segment) {
+            return NULL;
+        }
+        std::map<Id128, Transaction>::const_iterator found = segment->transactions.find(transactionId);
+        if (found == segment->transactions.end()) {
+            return NULL;
+        }
+        transaction = found->second;
+    }
+    
+    // Kept in memory from now on, so the pointer stays valid like any other
+    WriteLock store(storeLock);
+    std::pair<std::map<Id128, Transaction>::iterator, bool> inserted =
+        transactions.insert(std::make_pair(transactionId, transaction));
+    if (inserted.second) {
+        indexTransaction(transaction);
+    }
+    return &inserted.first->second;
+}
+
+// Orders query results by time, then ID
+static bool transactionTimeLess(const Transaction& left, const Transaction& right) {
+    if (left.getTimestamp() != right.getTimestamp()) {
+        return left.getTimestamp() < right.getTimestamp();
+    }
+    return left.getTransactionId() < right.getTransactionId();
+}
+
+static bool isTimeSorted(const std::vector<Transaction>& found) {
+    for (size_t i = 1; i < found.size(); ++i) {
+        if (transactionTimeLess(found[i], found[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Drops the transactions that also have a copy in memory, which is the newer one
+static void removeResident(std::vector<Transaction>& found, const std::map<Id128, Transaction>& resident) {
+    size_t kept = 0;
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (resident.find(found[i].getTransactionId()) == resident.end()) {
+            found[kept++] = found[i];
+        }
+    }
+    found.resize(kept);
+}
+
+// Months of cold segments with transactions of the wallet, failed ones
+// included (those are not in its history); the caller holds the persistence lock
+std::set<int> DataManager::coldMonthsOf(const Id128& walletId) const {
+    int coldBefore;
+    {
+        ReadLock store(storeLock);
+        coldBefore = hasColdSegments ? hotMonthsFrom : 0;
+    }
+    return transactionSegments.monthsWithWallet(walletId, coldBefore);
+}
+
+std::vector<Transaction> DataManager::getTransactionsByWallet(const Id128& walletId) const {
+    std::vector<Transaction> walletTransactionList;
+    
+    std::set<int> coldMonths;
+    bool coldSegments;
+    {
+        ReadLock store(storeLock);
+        coldSegments = hasColdSegments;
+    }
+    if (coldSegments) {
+        ScopedLock persistence(persistenceLock);
+        coldMonths = coldMonthsOf(walletId);
+        for (std::set<int>::const_iterator month = coldMonths.begin(); month != coldMonths.end(); ++month) {
+            const TransactionSegments::ColdSegment* segment = transactionSegments.getColdSegment(*month);
+            if (!segment) {
+                continue;
             }
-            userFile.close();
-        }
-        
-        std::ifstream walletFile(WALLET_DATA_FILE.c_str());
-        if (walletFile.is_open()) {
-            std::string line;
-            while (std::getline(walletFile, line)) {
-                std::stringstream ss(line);
-                std::string walletId, ownerUsername, balanceStr;
-                
-                std::getline(ss, walletId, ',');
-                std::getline(ss, ownerUsername, ',');
-                std::getline(ss, balanceStr, ',');
-                
-                // Sử dụng atof thay vì stod
-                double balance = atof(balanceStr.c_str());
-                
-                Wallet wallet(walletId, ownerUsername, balance);
-                
-                std::string transactionId;
-                while (std::getline(ss, transactionId, ',')) {
-                    if (!transactionId.empty()) {
-                        wallet.addTransactionToHistory(transactionId);
-                    }
-                }
-                
-                wallets[walletId] = wallet;
+            std::map<Id128, std::vector<Id128> >::const_iterator ids = segment->walletTransactions.find(walletId);
+            if (ids == segment->walletTransactions.end()) {
+                continue;
+            }
+            for (std::vector<Id128>::const_iterator id = ids->second.begin(); id != ids->second.end(); ++id) {
+                walletTransactionList.push_back(segment->transactions.find(*id)->second);
             }
-            walletFile.close();
-        }
-        
-        std::ifstream transactionFile(TRANSACTION_DATA_FILE.c_str());
-        if (transactionFile.is_open()) {
-            std::string line;
-            while (std::getline(transactionFile, line)) {
-                std::stringstream ss(line);
-                std::string transactionId, senderWalletId, receiverWalletId, amountStr;
-                std::string timestampStr, isSuccessfulStr, statusStr, description;
-                
-                std::getline(ss, transactionId, ',');
-                std::getline(ss, senderWalletId, ',');
-                std::getline(ss, receiverWalletId, ',');
-                std::getline(ss, amountStr, ',');
-                std::getline(ss, timestampStr, ',');
-                std::getline(ss, isSuccessfulStr, ',');
-                std::getline(ss, statusStr, ',');
-                std::getline(ss, description);
-                
-                // Sử dụng atof thay vì stod
-                double amount = atof(amountStr.c_str());
-                
-                Transaction transaction(transactionId, senderWalletId, receiverWalletId, amount, description);
-                transaction.setIsSuccessful(isSuccessfulStr == "1");
-                
-                // Set transaction status if available
-                if (!statusStr.empty()) {
-                    int statusValue = atoi(statusStr.c_str());
-                    transaction.setStatus(static_cast<TransactionStatus>(statusValue));
+        }
+    }
+    
+    ReadLock store(storeLock);
+    removeResident(walletTransactionList, transactions);
+    
+    std::map<Id128, TransactionList>::const_iterator indexed = walletTransactions.find(walletId);
+    if (indexed != walletTransactions.end()) {
+        const TransactionList& entries = indexed->second;
+        walletTransactionList.reserve(walletTransactionList.size() + entries.size());
+        for (TransactionList::const_iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+            std::map<Id128, Transaction>::const_iterator it = transactions.find(entry->second);
+            if (it != transactions.end()) {
+                walletTransactionList.push_back(it->second);
+            }
+        }
+    }
+    
+    // Each month's list is oldest first, so the merge is usually in order already
+    if (!coldMonths.empty() && !isTimeSorted(walletTransactionList)) {
+        std::sort(walletTransactionList.begin(), walletTransactionList.end(), transactionTimeLess);
+    }
+    return walletTransactionList;
+}
+
+std::vector<Transaction> DataManager::getTransactionsInRange(time_t from, time_t to) const {
+    std::vector<Transaction> rangeTransactions;
+    if (from >= to) {
+        return rangeTransactions;
+    }
+    
+    int coldBefore;
+    {
+        ReadLock store(storeLock);
+        coldBefore = hasColdSegments ? hotMonthsFrom : 0;
+    }
+    if (coldBefore > 0 && to > 0) {
+        // Cold months in the range, read one at a time
+        int64_t fromMillis = from > 0 ? static_cast<int64_t>(from) * 1000 : 0;
+        int64_t toMillis = static_cast<int64_t>(to) * 1000;
+        int lastMonth = std::min(TransactionSegments::monthOf(toMillis - 1), coldBefore - 1);
+        
+        ScopedLock persistence(persistenceLock);
+        const std::map<int, TransactionSegments::Segment>& segments = transactionSegments.getSegments();
+        std::vector<int> months;
+        for (std::map<int, TransactionSegments::Segment>::const_iterator it =
+                 segments.lower_bound(TransactionSegments::monthOf(fromMillis));
+             it != segments.end() && it->first <= lastMonth; ++it) {
+            months.push_back(it->first);
+        }
+        
+        for (size_t i = 0; i < months.size(); ++i) {
+            const TransactionSegments::ColdSegment* segment = transactionSegments.getColdSegment(months[i]);
+            if (!segment) {
+                continue;
+            }
+            std::map<Id128, Transaction>::const_iterator it =
+                segment->transactions.lower_bound(IdGenerator::lowerBound(static_cast<uint64_t>(fromMillis)));
+            std::map<Id128, Transaction>::const_iterator end =
+                segment->transactions.lower_bound(IdGenerator::lowerBound(static_cast<uint64_t>(toMillis)));
+            for (; it != end; ++it) {
+                rangeTransactions.push_back(it->second);
+            }
+        }
+    }
+    
+    ReadLock store(storeLock);
+    removeResident(rangeTransactions, transactions);
+    
+    // Time-ordered IDs in [from, to) form one contiguous run of the map
+    std::map<Id128, Transaction>::const_iterator it =
+        transactions.lower_bound(IdGenerator::lowerBound(static_cast<uint64_t>(from) * 1000));
+    std::map<Id128, Transaction>::const_iterator end =
+        transactions.lower_bound(IdGenerator::lowerBound(static_cast<uint64_t>(to) * 1000));
+    for (; it != end; ++it) {
+        // Legacy random IDs can fall inside the run by chance; they are checked below
+        if (unorderedTransactions.find(it->first) == unorderedTransactions.end()) {
+            rangeTransactions.push_back(it->second);
+        }
+    }
+    
+    for (std::set<Id128>::const_iterator id = unorderedTransactions.begin(); id != unorderedTransactions.end(); ++id) {
+        std::map<Id128, Transaction>::const_iterator found = transactions.find(*id);
+        if (found != transactions.end() &&
+            found->second.getTimestamp() >= from && found->second.getTimestamp() < to) {
+            rangeTransactions.push_back(found->second);
+        }
+    }
+    
+    std::sort(rangeTransactions.begin(), rangeTransactions.end(), transactionTimeLess);
+    return rangeTransactions;
+}
+
+bool DataManager::saveTransaction(const Transaction& transaction) {
+    std::set<int> months;
+    int month;
+    if (segmentMonthOf(transaction, month)) {
+        months.insert(month);
+    }
+    
+    WriteLock store(storeLock);
+    std::map<Id128, Transaction>::iterator it = transactions.find(transaction.getTransactionId());
+    // Moving out of a segment rewrites the one it leaves as well
+    if (it != transactions.end() && segmentMonthOf(it->second, month)) {
+        months.insert(month);
+    }
+    if (it == transactions.end()) {
+        indexTransaction(transaction);
+    } else if (it->second.getSenderWalletId() != transaction.getSenderWalletId() ||
+               it->second.getReceiverWalletId() != transaction.getReceiverWalletId() ||
+               it->second.getTimestamp() != transaction.getTimestamp()) {
+        unindexTransaction(it->second);
+        indexTransaction(transaction);
+    }
+    
+    transactions[transaction.getTransactionId()] = transaction;
+    
+    ScopedLock dirty(dirtyLock);
+    dirtyTransactions.insert(transaction.getTransactionId());
+    changedMonths.insert(months.begin(), months.end());
+    return true;
+}
+
+void DataManager::indexTransaction(const Transaction& transaction) {
+    std::pair<time_t, Id128> entry(transaction.getTimestamp(), transaction.getTransactionId());
+    
+    if (!hasTimeOrderedId(transaction)) {
+        unorderedTransactions.insert(transaction.getTransactionId());
+    }
+    
+    // Self-transfers are listed once
+    Id128 walletIds[2] = { transaction.getSenderWalletId(), transaction.getReceiverWalletId() };
+    int walletCount = walletIds[0] == walletIds[1] ? 1 : 2;
+    
+    for (int i = 0; i < walletCount; ++i) {
+        TransactionList& entries = walletTransactions[walletIds[i]];
+        // New transactions are the newest, so this is almost always an append
+        if (entries.empty() || !(entry < entries.back())) {
+            entries.push_back(entry);
+        } else {
+            entries.insert(std::upper_bound(entries.begin(), entries.end(), entry), entry);
+        }
+    }
+}
+
+void DataManager::unindexTransaction(const Transaction& transaction) {
+    std::pair<time_t, Id128> entry(transaction.getTimestamp(), transaction.getTransactionId());
+    Id128 walletIds[2] = { transaction.getSenderWalletId(), transaction.getReceiverWalletId() };
+    
+    unorderedTransactions.erase(transaction.getTransactionId());
+    
+    for (int i = 0; i < 2; ++i) {
+        std::map<Id128, TransactionList>::iterator indexed = walletTransactions.find(walletIds[i]);
+        if (indexed == walletTransactions.end()) {
+            continue;
+        }
+        
+        TransactionList& entries = indexed->second;
+        TransactionList::iterator found = std::lower_bound(entries.begin(), entries.end(), entry);
+        if (found != entries.end() && *found == entry) {
+            entries.erase(found);
+        }
+        if (entries.empty()) {
+            walletTransactions.erase(indexed);
+        }
+    }
+}
+
+void DataManager::rebuildTransactionIndexThread(void* manager) {
+    static_cast<DataManager*>(manager)->rebuildTransactionIndex();
+}
+
+void DataManager::rebuildTransactionIndex() {
+    walletTransactions.clear();
+    unorderedTransactions.clear();
+    
+    // Append everything, then sort each wallet's list once
+    for (std::map<Id128, Transaction>::const_iterator it = transactions.begin(); it != transactions.end(); ++it) {
+        const Transaction& transaction = it->second;
+        std::pair<time_t, Id128> entry(transaction.getTimestamp(), transaction.getTransactionId());
+        
+        if (!hasTimeOrderedId(transaction)) {
+            unorderedTransactions.insert(transaction.getTransactionId());
+        }
+        
+        walletTransactions[transaction.getSenderWalletId()].push_back(entry);
+        if (transaction.getReceiverWalletId() != transaction.getSenderWalletId()) {
+            walletTransactions[transaction.getReceiverWalletId()].push_back(entry);
+        }
+    }
+    
+    for (std::map<Id128, TransactionList>::iterator it = walletTransactions.begin(); it != walletTransactions.end(); ++it) {
+        std::sort(it->second.begin(), it->second.end());
+    }
+}
+
+bool DataManager::loadData() {
+    OperationTimer timer(loadMetric, true);
+    
+    ScopedLock persistence(persistenceLock);
+    AllStripesLock allWallets(walletLocks);
+    WriteLock store(storeLock);
+    
+    users.clear();
+    wallets.clear();
+    transactions.clear();
+    walletTransactions.clear();
+    unorderedTransactions.clear();
+    ownerWallets.clear();
+    
+    createDirectory(DATA_DIR);
+    
+    if (journal.is_open()) {
+        journal.close();
+    }
+    journal.clear();
+    journalRecords = 0;
+    journalUnsynced = false;
+    journalTorn = false;
+    clearDirtyRecords();
+    {
+        ScopedLock dirty(dirtyLock);
+        changedMonths.clear();
+    }
+    
+    // Segments from before the snapshot was last written without them (a
+    // restore, or a crash while first splitting it) are ignored until the
+    // next checkpoint replaces them
+    segmented = readStoredSegmented();
+    transactionSegments.clear();
+    if (segmented && !transactionSegments.load()) {
+        std::cerr << "Failed to read the transaction segment manifest" << std::endl;
+        return false;
+    }
+    
+    // Until the snapshot has been split, every month is in memory
+    int64_t nowMillis = static_cast<int64_t>(time(NULL)) * 1000;
+    hotMonthsFrom = segmented ? TransactionSegments::monthOf(nowMillis) - HOT_SEGMENT_MONTHS + 1 : 0;
+    const std::map<int, TransactionSegments::Segment>& segments = transactionSegments.getSegments();
+    hasColdSegments = !segments.empty() && segments.begin()->first < hotMonthsFrom;
+    
+    try {
+        bool loaded = true;
+        if (readStoredFormat() == BINARY_SNAPSHOT) {
+            loaded = BinarySnapshot::read(SNAPSHOT_FILE, users, wallets, transactions);
+        } else {
+            loaded = loadTextFiles();
+        }
+        
+        if (!loaded) {
+            std::cerr << "Failed to read data snapshot" << std::endl;
+            return false;
+        }
+        
+        if (!loadHotSegments()) {
+            std::cerr << "Failed to read transaction segments" << std::endl;
+            return false;
+        }
+        
+        // Apply mutations made after the last checkpoint
+        replayJournal();
+        
+        if (!segmented) {
+            // The next checkpoint writes every month as a segment
+            std::set<int> months;
+            int month;
+            for (std::map<Id128, Transaction>::const_iterator it = transactions.begin(); it != transactions.end(); ++it) {
+                if (segmentMonthOf(it->second, month)) {
+                    months.insert(month);
                 }
-                
-                transactions[transactionId] = transaction;
             }
-            transactionFile.close();
+            ScopedLock dirty(dirtyLock);
+            changedMonths.insert(months.begin(), months.end());
         }
         
-        return true;
+        // The two indexes read different maps: build them side by side
+        Thread transactionIndexer;
+        if (!transactionIndexer.start(rebuildTransactionIndexThread, this)) {
+            rebuildTransactionIndex();
+        }
+        rebuildWalletIndex();
+        transactionIndexer.join();
+        
+        userRecords.set(users.size());
+        walletRecords.set(wallets.size());
+        transactionRecords.set(transactions.size());
+        journalRecordsGauge.set(journalRecords);
+        return timer.succeed(true);
     } catch (const std::exception& e) {
         std::cerr << "Error loading data: " << e.what() << std::endl;
         return false;
     }
 }
 
-bool DataManager::saveData() {
-    try {
-        createBackup();
-        
-        std::ofstream userFile(USER_DATA_FILE.c_str());
-        if (userFile.is_open()) {
-            for (std::map<std::string, User>::const_iterator it = users.begin(); it != users.end(); ++it) {
-                const User& user = it->second;
-                userFile << user.getUsername() << ","
-                         << user.getPasswordHash() << ","
-                         << user.getFullName() << ","
-                         << user.getEmail() << ","
-                         << user.getPhoneNumber() << ","
-                         << (user.getRole() == ADMIN ? "1" : "0") << ","
-                         << (user.getIsAutoGeneratedPassword() ? "1" : "0") << ","
-                         << (user.getIsFirstLogin() ? "1" : "0") << ","
-                         << user.getCreationDate() << ","
-                         << user.getLastLoginDate() << std::endl;
+// A data file is split for parallel parsing only into ranges at least this large
+static const size_t MIN_PARSE_RANGE_BYTES = 256 * 1024;
+
+// Lines [begin, end) of a mapped data file and the records parsed from them
+template <typename Record>
+struct ParseRange {
+    const char* begin;
+    const char* end;
+    bool (*parse)(const char* begin, const char* end, Record& record);
+    std::vector<Record> records;
+};
+
+template <typename Record>
+static void parseRange(void* argument) {
+    ParseRange<Record>& range = *static_cast<ParseRange<Record>*>(argument);
+    Record record;
+    
+    for (const char* lineStart = range.begin; lineStart < range.end; ) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', range.end - lineStart));
+        if (!lineEnd) {
+            lineEnd = range.end;
+        }
+        // Files written in text mode on Windows end their lines with \r\n
+        const char* contentEnd = (lineEnd > lineStart && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+        
+        if (range.parse(lineStart, contentEnd, record)) {
+            range.records.push_back(record);
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
+// Splits a file into about rangeCount ranges, each starting at the beginning of a line
+template <typename Record>
+static void splitIntoRanges(const char* data, size_t size, size_t rangeCount,
+                            bool (*parse)(const char*, const char*, Record&),
+                            std::vector<ParseRange<Record> >& ranges) {
+    const char* end = data + size;
+    
+    const char* start = data;
+    for (size_t i = 1; i <= rangeCount && start < end; ++i) {
+        const char* cut = (i == rangeCount) ? end : data + size / rangeCount * i;
+        if (cut < start) {
+            cut = start;
+        }
+        if (cut < end) {
+            // Move the cut past the end of the line it falls in
+            const char* newline = static_cast<const char*>(std::memchr(cut, '\n', end - cut));
+            cut = newline ? newline + 1 : end;
+        }
+        
+        ParseRange<Record> range;
+        range.begin = start;
+        range.end = cut;
+        range.parse = parse;
+        ranges.push_back(range);
+        start = cut;
+    }
+}
+
+// Ranges for a file of fileBytes out of totalBytes, given threadCount threads in all
+static size_t rangeCountFor(size_t fileBytes, size_t totalBytes, size_t threadCount) {
+    if (fileBytes == 0) {
+        return 0;
+    }
+    size_t byShare = static_cast<size_t>(static_cast<double>(threadCount) * fileBytes / totalBytes);
+    size_t bySize = fileBytes / MIN_PARSE_RANGE_BYTES;
+    return std::max<size_t>(1, std::min(byShare, bySize));
+}
+
+typedef std::pair<ThreadFunction, void*> ParallelJob;
+
+// Runs every job on a thread of its own (the first on the calling thread) and waits for all
+static void runInParallel(const std::vector<ParallelJob>& jobs) {
+    if (jobs.empty()) {
+        return;
+    }
+    
+    // Thread is not copyable, so the threads live in a plain array
+    Thread* threads = new Thread[jobs.size()];
+    for (size_t i = 1; i < jobs.size(); ++i) {
+        if (!threads[i].start(jobs[i].first, jobs[i].second)) {
+            jobs[i].first(jobs[i].second);
+        }
+    }
+    jobs[0].first(jobs[0].second);
+    for (size_t i = 1; i < jobs.size(); ++i) {
+        threads[i].join();
+    }
+    delete[] threads;
+}
+
+template <typename Record>
+static void addParseJobs(std::vector<ParseRange<Record> >& ranges, std::vector<ParallelJob>& jobs) {
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        jobs.push_back(ParallelJob(parseRange<Record>, &ranges[i]));
+    }
+}
+
+static std::string userKey(const User& user) {
+    return user.getUsername();
+}
+
+static Id128 walletKey(const Wallet& wallet) {
+    return wallet.getWalletId();
+}
+
+static Id128 transactionKey(const Transaction& transaction) {
+    return transaction.getTransactionId();
+}
+
+// Moves the parsed records of one file into its map
+template <typename Key, typename Record>
+struct MergeJob {
+    std::vector<ParseRange<Record> >* ranges;
+    std::map<Key, Record>* target;
+    Key (*keyOf)(const Record& record);
+};
+
+template <typename Key, typename Record>
+static void mergeRecords(void* argument) {
+    MergeJob<Key, Record>& job = *static_cast<MergeJob<Key, Record>*>(argument);
+    std::map<Key, Record>& target = *job.target;
+    
+    // In file order, so a later line for the same key still wins. Checkpoints
+    // write the files in key order, which makes the end an exact hint.
+    for (size_t i = 0; i < job.ranges->size(); ++i) {
+        std::vector<Record>& records = (*job.ranges)[i].records;
+        for (size_t j = 0; j < records.size(); ++j) {
+            size_t before = target.size();
+            typename std::map<Key, Record>::iterator it =
+                target.insert(target.end(), std::make_pair(job.keyOf(records[j]), records[j]));
+            if (target.size() == before) {
+                it->second = records[j];
             }
-            userFile.close();
-        }
-        
-        std::ofstream walletFile(WALLET_DATA_FILE.c_str());
-        if (walletFile.is_open()) {
-            for (std::map<std::string, Wallet>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
-                const Wallet& wallet = it->second;
-                walletFile << wallet.getWalletId() << ","
-                          << wallet.getOwnerUsername() << ","
-                          << wallet.getBalance();
-                
-                const std::vector<std::string>& history = wallet.getTransactionHistory();
-                for (size_t i = 0; i < history.size(); ++i) {
-                    walletFile << "," << history[i];
-                }
-                walletFile << std::endl;
+        }
+        std::vector<Record>().swap(records);
+    }
+}
+
+bool DataManager::loadTextFiles() {
+    // Mapped so that every range is parsed in place; a missing file has no records
+    MappedFile userFile, walletFile, transactionFile;
+    userFile.open(USER_DATA_FILE);
+    walletFile.open(WALLET_DATA_FILE);
+    transactionFile.open(TRANSACTION_DATA_FILE);
+    
+    // The files are independent until the indexes are built: all of them are
+    // parsed at once, with the threads shared out by size
+    size_t totalBytes = userFile.getSize() + walletFile.getSize() + transactionFile.getSize();
+    size_t threadCount = hardwareConcurrency();
+    
+    std::vector<ParseRange<User> > userRanges;
+    std::vector<ParseRange<Wallet> > walletRanges;
+    std::vector<ParseRange<Transaction> > transactionRanges;
+    splitIntoRanges(userFile.getData(), userFile.getSize(), rangeCountFor(userFile.getSize(), totalBytes, threadCount),
+                    parseUserRecord, userRanges);
+    splitIntoRanges(walletFile.getData(), walletFile.getSize(), rangeCountFor(walletFile.getSize(), totalBytes, threadCount),
+                    parseWalletRecord, walletRanges);
+    splitIntoRanges(transactionFile.getData(), transactionFile.getSize(), rangeCountFor(transactionFile.getSize(), totalBytes, threadCount),
+                    parseTransactionRecord, transactionRanges);
+    
+    std::vector<ParallelJob> jobs;
+    addParseJobs(transactionRanges, jobs);
+    addParseJobs(walletRanges, jobs);
+    addParseJobs(userRanges, jobs);
+    runInParallel(jobs);
+    
+    // One map per file, so the three merges run side by side as well
+    MergeJob<std::string, User> userMerge = { &userRanges, &users, userKey };
+    MergeJob<Id128, Wallet> walletMerge = { &walletRanges, &wallets, walletKey };
+    MergeJob<Id128, Transaction> transactionMerge = { &transactionRanges, &transactions, transactionKey };
+    
+    jobs.clear();
+    jobs.push_back(ParallelJob(mergeRecords<Id128, Transaction>, &transactionMerge));
+    jobs.push_back(ParallelJob(mergeRecords<Id128, Wallet>, &walletMerge));
+    jobs.push_back(ParallelJob(mergeRecords<std::string, User>, &userMerge));
+    runInParallel(jobs);
+    
+    return true;
+}
+
+bool DataManager::loadHotSegments() {
+    std::vector<int> months;
+    const std::map<int, TransactionSegments::Segment>& segments = transactionSegments.getSegments();
+    size_t totalBytes = 0;
+    for (std::map<int, TransactionSegments::Segment>::const_iterator it = segments.lower_bound(hotMonthsFrom);
+         it != segments.end(); ++it) {
+        months.push_back(it->first);
+    }
+    if (months.empty()) {
+        return true;
+    }
+    
+    // Reader is not copyable, so the readers live in a plain array
+    TransactionSegments::Reader* readers = new TransactionSegments::Reader[months.size()];
+    for (size_t i = 0; i < months.size(); ++i) {
+        if (!transactionSegments.openSegment(months[i], readers[i])) {
+            std::cerr << "Cannot read transaction segment " << TransactionSegments::monthName(months[i]) << std::endl;
+            delete[] readers;
+            return false;
+        }
+        totalBytes += readers[i].getSize();
+    }
+    
+    // Parsed like the data files, with the threads shared out by size
+    size_t threadCount = hardwareConcurrency();
+    std::vector<ParseRange<Transaction> > ranges;
+    for (size_t i = 0; i < months.size(); ++i) {
+        splitIntoRanges(readers[i].getData(), readers[i].getSize(),
+                        rangeCountFor(readers[i].getSize(), totalBytes, threadCount),
+                        parseTransactionRecord, ranges);
+    }
+    
+    std::vector<ParallelJob> jobs;
+    addParseJobs(ranges, jobs);
+    runInParallel(jobs);
+    
+    MergeJob<Id128, Transaction> merge = { &ranges, &transactions, transactionKey };
+    mergeRecords<Id128, Transaction>(&merge);
+    
+    delete[] readers;
+    return true;
+}
+
+// Records per formatting chunk, at least: smaller maps are formatted on one thread
+static const size_t MIN_FORMAT_CHUNK_RECORDS = 16384;
+
+// Records [begin, end) of one map, formatted as data-file lines into a buffer of their own
+template <typename Key, typename Record>
+struct FormatChunk {
+    typename std::map<Key, Record>::const_iterator begin;
+    typename std::map<Key, Record>::const_iterator end;
+    void (*append)(std::string& out, const Record& record);
+    std::string buffer;
+};
+
+template <typename Key, typename Record>
+static void formatChunk(void* argument) {
+    FormatChunk<Key, Record>& chunk = *static_cast<FormatChunk<Key, Record>*>(argument);
+    for (typename std::map<Key, Record>::const_iterator it = chunk.begin; it != chunk.end; ++it) {
+        chunk.append(chunk.buffer, it->second);
+        chunk.buffer += '\n';
+    }
+}
+
+// Splits a map into about threadCount chunks of consecutive records
+template <typename Key, typename Record>
+static void splitIntoChunks(const std::map<Key, Record>& records, size_t threadCount,
+                            void (*append)(std::string&, const Record&),
+                            std::vector<FormatChunk<Key, Record> >& chunks) {
+    size_t chunkCount = std::max<size_t>(1, std::min(threadCount, records.size() / MIN_FORMAT_CHUNK_RECORDS));
+    size_t perChunk = (records.size() + chunkCount - 1) / chunkCount;
+    
+    typename std::map<Key, Record>::const_iterator it = records.begin();
+    while (it != records.end()) {
+        FormatChunk<Key, Record> chunk;
+        chunk.begin = it;
+        chunk.append = append;
+        for (size_t i = 0; i < perChunk && it != records.end(); ++i) {
+            ++it;
+        }
+        chunk.end = it;
+        chunks.push_back(chunk);
+    }
+}
+
+template <typename Key, typename Record>
+static void addFormatJobs(std::vector<FormatChunk<Key, Record> >& chunks, std::vector<ParallelJob>& jobs) {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        jobs.push_back(ParallelJob(formatChunk<Key, Record>, &chunks[i]));
+    }
+}
+
+// Writes the chunks' buffers as one file, in order, and releases them
+template <typename Key, typename Record>
+static bool writeChunks(const std::string& path, std::vector<FormatChunk<Key, Record> >& chunks, FlushStats& stats) {
+    std::vector<std::string> buffers(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        buffers[i].swap(chunks[i].buffer);
+        stats.bytesWritten += buffers[i].size();
+    }
+    
+    if (!writeFileSynced(path, buffers, stats.fileSystemCalls)) {
+        std::cerr << "Error saving data: cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// One month's transactions [begin, end), less the IDs in skip, formatted as its segment
+struct SegmentJob {
+    int month;
+    std::map<Id128, Transaction>::const_iterator begin;
+    std::map<Id128, Transaction>::const_iterator end;
+    const std::set<Id128>* skip;
+    // A cold month's stored records with the resident ones laid over them
+    std::map<Id128, Transaction> merged;
+    std::string buffer;
+    size_t records;
+    std::set<Id128> wallets;
+};
+
+static void formatSegment(void* argument) {
+    SegmentJob& job = *static_cast<SegmentJob*>(argument);
+    for (std::map<Id128, Transaction>::const_iterator it = job.begin; it != job.end; ++it) {
+        if (job.skip->find(it->first) == job.skip->end()) {
+            appendTransactionRecord(job.buffer, it->second);
+            job.buffer += '\n';
+            ++job.records;
+            job.wallets.insert(it->second.getSenderWalletId());
+            job.wallets.insert(it->second.getReceiverWalletId());
+        }
+    }
+}
+
+bool DataManager::writeSegments(FlushStats& stats) {
+    std::set<int> months;
+    {
+        ScopedLock dirty(dirtyLock);
+        months.swap(changedMonths);
+    }
+    if (months.empty()) {
+        return true;
+    }
+    
+    // Filled in place: a job's iterators may point into its own merged map
+    std::vector<SegmentJob> jobs(months.size());
+    std::vector<ParallelJob> formatJobs;
+    size_t index = 0;
+    for (std::set<int>::const_iterator month = months.begin(); month != months.end(); ++month, ++index) {
+        SegmentJob& job = jobs[index];
+        job.month = *month;
+        job.skip = &unorderedTransactions;
+        job.records = 0;
+        
+        Id128 first = IdGenerator::lowerBound(static_cast<uint64_t>(TransactionSegments::monthStartMillis(*month)));
+        Id128 last = IdGenerator::lowerBound(static_cast<uint64_t>(TransactionSegments::monthStartMillis(*month + 1)));
+        job.begin = transactions.lower_bound(first);
+        job.end = transactions.lower_bound(last);
+        
+        // Only part of a cold month is in memory
+        if (*month < hotMonthsFrom && transactionSegments.hasSegment(*month)) {
+            const TransactionSegments::ColdSegment* stored = transactionSegments.getColdSegment(*month);
+            if (!stored) {
+                ScopedLock dirty(dirtyLock);
+                changedMonths.insert(months.begin(), months.end());
+                return false;
             }
-            walletFile.close();
-        }
-        
-        std::ofstream transactionFile(TRANSACTION_DATA_FILE.c_str());
-        if (transactionFile.is_open()) {
-            for (std::map<std::string, Transaction>::const_iterator it = transactions.begin(); it != transactions.end(); ++it) {
-                const Transaction& transaction = it->second;
-                transactionFile << transaction.getTransactionId() << ","
-                               << transaction.getSenderWalletId() << ","
-                               << transaction.getReceiverWalletId() << ","
-                               << transaction.getAmount() << ","
-                               << transaction.getTimestamp() << ","
-                               << (transaction.getIsSuccessful() ? "1" : "0") << ","
-                               << static_cast<int>(transaction.getStatus()) << ","
-                               << transaction.getDescription() << std::endl;
+            job.merged = stored->transactions;
+            for (std::map<Id128, Transaction>::const_iterator it = job.begin; it != job.end; ++it) {
+                job.merged[it->first] = it->second;
+            }
+            // A stored transaction whose timestamp no longer matches its ID moved out
+            for (std::set<Id128>::const_iterator id = unorderedTransactions.lower_bound(first);
+                 id != unorderedTransactions.end() && *id < last; ++id) {
+                job.merged.erase(*id);
+            }
+            job.begin = job.merged.begin();
+            job.end = job.merged.end();
+        }
+        formatJobs.push_back(ParallelJob(formatSegment, &job));
+    }
+    runInParallel(formatJobs);
+    
+    bool written = true;
+    for (size_t i = 0; i < jobs.size() && written; ++i) {
+        std::vector<std::string> buffers(1);
+        buffers[0].swap(jobs[i].buffer);
+        written = transactionSegments.writeSegment(jobs[i].month, buffers, jobs[i].records, jobs[i].wallets,
+                                                   stats.fileSystemCalls);
+        stats.bytesWritten += buffers[0].size();
+        stats.transactionsWritten += jobs[i].records;
+        stats.filesRewritten += jobs[i].records > 0 ? 2 : 0;   // The segment and its wallet list
+    }
+    
+    if (!written || !transactionSegments.writeManifest(stats.fileSystemCalls)) {
+        // Rewritten in full by the next checkpoint
+        ScopedLock dirty(dirtyLock);
+        changedMonths.insert(months.begin(), months.end());
+        return false;
+    }
+    return true;
+}
+
+void DataManager::collectUnsegmented(std::map<Id128, Transaction>& unsegmented) const {
+    for (std::set<Id128>::const_iterator id = unorderedTransactions.begin(); id != unorderedTransactions.end(); ++id) {
+        std::map<Id128, Transaction>::const_iterator found = transactions.find(*id);
+        if (found != transactions.end()) {
+            unsegmented.insert(unsegmented.end(), *found);
+        }
+    }
+}
+
+bool DataManager::writeTextFiles(FlushStats& stats, bool writeUsers, bool writeWallets, bool writeTransactions) {
+    try {
+        // Time-ordered transactions go to their segments; transactions.txt keeps the rest
+        std::map<Id128, Transaction> unsegmented;
+        if (writeTransactions) {
+            if (!writeSegments(stats)) {
+                return false;
             }
-            transactionFile.close();
+            collectUnsegmented(unsegmented);
+        }
+        
+        // The caller holds the store still, so every chunk of every file is
+        // formatted at once, each on its own thread into its own buffer
+        size_t threadCount = hardwareConcurrency();
+        std::vector<FormatChunk<std::string, User> > userChunks;
+        std::vector<FormatChunk<Id128, Wallet> > walletChunks;
+        std::vector<FormatChunk<Id128, Transaction> > transactionChunks;
+        if (writeUsers) {
+            splitIntoChunks(users, threadCount, appendUserRecord, userChunks);
+        }
+        if (writeWallets) {
+            splitIntoChunks(wallets, threadCount, appendWalletRecord, walletChunks);
+        }
+        if (writeTransactions) {
+            splitIntoChunks(unsegmented, threadCount, appendTransactionRecord, transactionChunks);
+        }
+        
+        std::vector<ParallelJob> jobs;
+        addFormatJobs(transactionChunks, jobs);
+        addFormatJobs(walletChunks, jobs);
+        addFormatJobs(userChunks, jobs);
+        runInParallel(jobs);
+        
+        // Then each file goes to disk in one pass with a single sync
+        if (writeUsers && !writeChunks(USER_DATA_FILE, userChunks, stats)) {
+            return false;
+        }
+        if (writeWallets && !writeChunks(WALLET_DATA_FILE, walletChunks, stats)) {
+            return false;
+        }
+        if (writeTransactions && !writeChunks(TRANSACTION_DATA_FILE, transactionChunks, stats)) {
+            return false;
         }
         
         return true;
@@ -404,10 +1882,320 @@ bool DataManager::saveData() {
     }
 }
 
+bool DataManager::writeDataFiles(FlushStats& stats) {
+    // The first full write splits the snapshot: every month gets its segment
+    // (changedMonths has them all) before format.txt says the snapshot no
+    // longer holds them. Until the snapshot is replaced, both copies load.
+    if (!segmented) {
+        transactionSegments.removeAll();
+    }
+    if (!writeSegments(stats)) {
+        return false;
+    }
+    if (!segmented) {
+        if (!writeFormatFile(readStoredFormat(), true)) {
+            return false;
+        }
+        segmented = true;
+    }
+    
+    bool written = false;
+    if (snapshotFormat == BINARY_SNAPSHOT) {
+        std::map<Id128, Transaction> unsegmented;
+        collectUnsegmented(unsegmented);
+        written = BinarySnapshot::write(SNAPSHOT_FILE, users, wallets, unsegmented);
+    } else {
+        written = writeTextFiles(stats);
+    }
+    
+    if (!written) {
+        return false;
+    }
+    
+    // Only switch the authoritative format once the new snapshot is fully written
+    return writeFormatFile(snapshotFormat, true);
+}
+
+bool DataManager::checkpoint() {
+    OperationTimer timer(checkpointMetric, true);
+    
+    ScopedLock persistence(persistenceLock);
+    if (persistenceMode == IN_MEMORY) {
+        return timer.succeed(true);
+    }
+    
+    FlushStats stats;
+    {
+        // Every stripe held: the snapshot is a state between transfers
+        AllStripesLock allWallets(walletLocks);
+        ReadLock store(storeLock);
+        
+        if (!writeDataFiles(stats)) {
+            // Keep the journal: it is still needed to recover the unsaved changes
+            return false;
+        }
+        
+        stats.usersWritten = users.size();
+        {
+            ScopedLock dirty(dirtyLock);
+            stats.usersDeleted = deletedUsers.size();
+        }
+        stats.walletsWritten = wallets.size();
+        stats.transactionsWritten += unorderedTransactions.size();
+        userRecords.set(users.size());
+        walletRecords.set(wallets.size());
+        transactionRecords.set(transactions.size());
+        stats.filesRewritten += (snapshotFormat == BINARY_SNAPSHOT) ? 1 : 3;
+        
+        clearDirtyRecords();
+        resetJournal();
+        recordFlush(stats);
+    }
+    
+    // As in flushDirtyToDataFiles(): outside the stripes and the store lock
+    createBackup();
+    return timer.succeed(true);
+}
+
+bool DataManager::saveData() {
+    if (isBackgroundWriterRunning()) {
+        return commit(DURABILITY_NONE);
+    }
+    return flushNow(false);
+}
+
+bool DataManager::flushNow(bool sync) {
+    OperationTimer timer(saveMetric, true);
+    
+    ScopedLock persistence(persistenceLock);
+    
+    if (persistenceMode == IN_MEMORY) {
+        return timer.succeed(true);
+    }
+    
+    if (persistenceMode == JOURNALED) {
+        // Only the records changed since the last flush go to the journal
+        if (hasDirtyRecords() && !flushDirtyToJournal()) {
+            return false;
+        }
+        
+        // Fold the journal into the data files once it grows large (they are synced as written)
+        if (journalRecords >= JOURNAL_CHECKPOINT_THRESHOLD) {
+            return timer.succeed(checkpoint());
+        }
+        
+        // One fsync for however many records, and commits, the flush covered
+        if (sync && journalUnsynced) {
+            return timer.succeed(syncJournal());
+        }
+        return timer.succeed(true);
+    }
+    
+    if (!hasDirtyRecords()) {
+        return timer.succeed(true);
+    }
+    
+    // Records still in the journal (from journaled mode) need a full rewrite
+    if (journalRecords > 0) {
+        return timer.succeed(checkpoint());
+    }
+    return timer.succeed(flushDirtyToDataFiles());
+}
+
+bool DataManager::startBackgroundWriter(uint32_t intervalMillis) {
+    ScopedLock writer(writerLock);
+    if (writerRunning) {
+        return true;
+    }
+    
+    flushIntervalMillis = intervalMillis > 0 ? intervalMillis : 1;
+    writerStopping = false;
+    flushWanted = false;
+    if (!writerThread.start(writerThreadMain, this)) {
+        std::cerr << "Cannot start the background writer; saving on the calling thread" << std::endl;
+        return false;
+    }
+    writerRunning = true;
+    return true;
+}
+
+void DataManager::stopBackgroundWriter() {
+    {
+        ScopedLock writer(writerLock);
+        if (!writerRunning) {
+            return;
+        }
+        writerStopping = true;
+        writerWake.notifyOne();
+    }
+    
+    writerThread.join();
+    
+    ScopedLock writer(writerLock);
+    writerRunning = false;
+    writerStopping = false;
+    flushFinished.notifyAll();
+}
+
+bool DataManager::isBackgroundWriterRunning() const {
+    ScopedLock writer(writerLock);
+    return writerRunning;
+}
+
+FlushTicket DataManager::requestFlush(Durability durability) {
+    // Counted first: the dirty-set lock is never taken inside writerLock
+    size_t pending = pendingRecordCount();
+    FlushTicket ticket;
+    ticket.durability = durability;
+    {
+        ScopedLock writer(writerLock);
+        if (writerRunning) {
+            ticket.sequence = ++requestedSequence;
+            if (durability == DURABILITY_FSYNC) {
+                syncRequestedSequence = ticket.sequence;
+            }
+            if (pending >= FLUSH_BATCH_RECORDS) {
+                flushWanted = true;
+                writerWake.notifyOne();
+            }
+            return ticket;
+        }
+    }
+    
+    // No writer: flush here, so the ticket is redeemed before it is returned
+    bool sync = durability == DURABILITY_FSYNC;
+    bool flushed = flushNow(sync);
+    ScopedLock writer(writerLock);
+    ticket.sequence = ++requestedSequence;
+    attemptedSequence = ticket.sequence;
+    if (flushed) {
+        flushedSequence = ticket.sequence;
+        if (sync) {
+            syncedSequence = ticket.sequence;
+        }
+    }
+    return ticket;
+}
+
+bool DataManager::waitForFlush(const FlushTicket& ticket) {
+    if (ticket.durability == DURABILITY_NONE) {
+        return true;
+    }
+    
+    OperationTimer timer(flushWaitMetric, true);
+    
+    ScopedLock writer(writerLock);
+    if (writerRunning && attemptedSequence < ticket.sequence) {
+        // Do not wait out the interval; whoever else is waiting rides the same flush
+        flushWanted = true;
+        writerWake.notifyOne();
+    }
+    while (writerRunning && attemptedSequence < ticket.sequence) {
+        flushFinished.wait(writerLock);
+    }
+    
+    // The flush that covered an fsync ticket synced the journal unless it failed
+    uint64_t reached = ticket.durability == DURABILITY_FSYNC ? syncedSequence : flushedSequence;
+    return timer.succeed(reached >= ticket.sequence);
+}
+
+bool DataManager::commit(Durability durability) {
+    if (waitForFlush(requestFlush(durability))) {
+        return true;
+    }
+    (durability == DURABILITY_FSYNC ? fsyncCommitFailures : bufferedCommitFailures).add();
+    return false;
+}
+
+bool DataManager::compactSegments() {
+    ScopedLock persistence(persistenceLock);
+    if (persistenceMode == IN_MEMORY || !segmented) {
+        return true;
+    }
+    
+    // Months before the hot ones are closed: only lookups read them
+    int64_t nowMillis = static_cast<int64_t>(time(NULL)) * 1000;
+    int closedBefore = TransactionSegments::monthOf(nowMillis) - HOT_SEGMENT_MONTHS + 1;
+    std::vector<int> months;
+    const std::map<int, TransactionSegments::Segment>& segments = transactionSegments.getSegments();
+    for (std::map<int, TransactionSegments::Segment>::const_iterator it = segments.begin();
+         it != segments.end() && it->first < closedBefore; ++it) {
+        if (!it->second.compressed) {
+            months.push_back(it->first);
+        }
+    }
+    
+    bool compacted = true;
+    for (size_t i = 0; i < months.size(); ++i) {
+        size_t textBytes = 0, compressedBytes = 0;
+        if (!transactionSegments.compact(months[i], textBytes, compressedBytes)) {
+            compacted = false;
+        } else if (compressedBytes < textBytes) {
+            segmentsCompacted.add();
+        }
+    }
+    return compacted;
+}
+
+void DataManager::writerThreadMain(void* manager) {
+    static_cast<DataManager*>(manager)->runWriter();
+}
+
+void DataManager::runWriter() {
+    // Months that have gone cold since the last run are compressed first
+    compactSegments();
+    
+    writerLock.lock();
+    for (;;) {
+        if (!writerStopping && !flushWanted) {
+            writerWake.waitFor(writerLock, flushIntervalMillis);
+        }
+        flushWanted = false;
+        
+        // Every ticket handed out so far is covered by this flush; a failed one is retried.
+        // If any of them asked for an fsync, the flush syncs the journal once for all of them.
+        uint64_t target = requestedSequence;
+        bool sync = syncRequestedSequence > syncedSequence;
+        bool noTickets = target == attemptedSequence && flushedSequence == attemptedSequence && !sync;
+        writerLock.unlock();
+        
+        // Records changed without a commit (a saveUser() on its own) are written on the
+        // interval too. Checked outside writerLock, which is never held around dirtyLock.
+        if (noTickets && !hasDirtyRecords()) {
+            writerLock.lock();
+            if (writerStopping) {
+                break;
+            }
+            continue;
+        }
+        
+        bool flushed = flushNow(sync);
+        writerLock.lock();
+        
+        attemptedSequence = target;
+        if (flushed) {
+            flushedSequence = target;
+            if (sync) {
+                syncedSequence = target;
+            }
+        }
+        flushFinished.notifyAll();
+        
+        // The last changes stay dirty for the shutdown checkpoint rather than retrying forever
+        if (writerStopping && !flushed) {
+            break;
+        }
+    }
+    writerLock.unlock();
+}
+
 std::vector<Wallet> DataManager::getAllWallets() const {
     std::vector<Wallet> result;
     
-    for (std::map<std::string, Wallet>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
+    AllStripesLock allWallets(walletLocks);
+    ReadLock store(storeLock);
+    result.reserve(wallets.size());
+    for (std::map<Id128, Wallet>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
         result.push_back(it->second);
     }
     
@@ -4,51 +4,321 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <fstream>
+#include <utility>
+#include <ctime>
 #include "User.h"
 #include "Wallet.h"
+#include "BackupManager.h"
+#include "TransactionSegments.h"
+#include "Threading.h"
+#include "LockStripes.h"
 
+// How saveData() makes changes durable
+enum PersistenceMode {
+    FULL_REWRITE,   // Rewrite every data file on each save
+    JOURNALED,      // Append each mutation to the journal, rewrite files only on checkpoint
+    IN_MEMORY       // Never write: scratch stores for stress runs and benchmarks
+};
+
+// Which on-disk snapshot is authoritative (the journal is replayed on top of either)
+enum SnapshotFormat {
+    TEXT_SNAPSHOT,   // users.txt, wallets.txt, transactions.txt
+    BINARY_SNAPSHOT  // snapshot.bin, memory-mapped on load
+};
+
+// What a commit guarantees once it returns
+enum Durability {
+    DURABILITY_NONE,      // Nothing: written by the next flush, lost if the process dies first
+    DURABILITY_BUFFERED,  // In the journal (operating system cache): survives a process crash
+    DURABILITY_FSYNC      // Journal synced to disk: survives a power loss
+};
+
+// Records touched by a flush, and what rewriting the text data files cost
+struct FlushStats {
+    size_t usersWritten;
+    size_t usersDeleted;
+    size_t walletsWritten;
+    size_t transactionsWritten;
+    size_t filesRewritten;
+    size_t bytesWritten;     // Text data files only
+    size_t fileSystemCalls;  // Open, write, sync, close and rename calls for them
+    size_t journalSyncs;     // fsyncs of the journal for DURABILITY_FSYNC commits
+    
+    FlushStats() : usersWritten(0), usersDeleted(0), walletsWritten(0), transactionsWritten(0), filesRewritten(0),
+                   bytesWritten(0), fileSystemCalls(0), journalSyncs(0) {}
+    
+    size_t totalRecords() const {
+        return usersWritten + usersDeleted + walletsWritten + transactionsWritten;
+    }
+};
+
+// Redeemed with DataManager::waitForFlush(); sequences only increase
+struct FlushTicket {
+    uint64_t sequence;
+    Durability durability;
+    
+    FlushTicket() : sequence(0), durability(DURABILITY_NONE) {}
+};
+
+// One line of users.txt, wallets.txt or transactions.txt (also the body of a
+// journal record). Parsing reads the line in place, without its newline, and
+// returns false for lines that hold no record.
+std::string formatUserRecord(const User& user);
+std::string formatWalletRecord(const Wallet& wallet);
+std::string formatTransactionRecord(const Transaction& transaction);
+bool parseUserRecord(const char* begin, const char* end, User& user);
+bool parseWalletRecord(const char* begin, const char* end, Wallet& wallet);
+bool parseTransactionRecord(const char* begin, const char* end, Transaction& transaction);
+
+// Transactions with time-ordered IDs are stored in monthly segments (see
+// TransactionSegments); transactions.txt or snapshot.bin keep the rest. Only
+// the last HOT_SEGMENT_MONTHS months are loaded; older ones are read when a
+// lookup, wallet history or range query reaches them.
+//
+// Thread safety: lookups may run concurrently with updates to other wallets.
+//   - A wallet's contents are guarded by its stripe in getWalletLocks(); hold it
+//     while reading or changing a Wallet obtained by pointer, and until the
+//     change has been passed to saveWallet().
+//   - The maps and indexes are guarded internally; returned pointers stay valid
+//     until loadData() or restoreFromBackup(), which need a quiescent store.
+//   - saveData() and the other persistence calls are serialized internally.
+//   - Cold segments are read under the persistence lock: transaction queries
+//     that reach one wait for a flush in progress, and must not be made while
+//     holding a wallet stripe.
+// Lock order: persistence, wallet stripes, store, dirty sets.
 class DataManager {
 private:
+    const std::string DATA_DIR;
     const std::string USER_DATA_FILE;
     const std::string WALLET_DATA_FILE;
     const std::string TRANSACTION_DATA_FILE;
+    const std::string JOURNAL_FILE;
+    const std::string SNAPSHOT_FILE;
+    const std::string FORMAT_FILE;
     const std::string BACKUP_DIR;
+    const std::string SEGMENT_DIR;
+    
+    // Journal records after which saveData() folds the journal back into the data files
+    static const size_t JOURNAL_CHECKPOINT_THRESHOLD = 1000;
+    
+    // Months of transaction segments kept in memory, the current one included
+    static const int HOT_SEGMENT_MONTHS = 3;
     
     std::map<std::string, User> users;
-    std::map<std::string, Wallet> wallets;
-    std::map<std::string, Transaction> transactions;
+    std::map<Id128, Wallet> wallets;
+    std::map<Id128, Transaction> transactions;
     
-    bool createBackup();
-    bool restoreFromBackup(const std::string& backupTimestamp);
-    std::string generateUniqueId() const;
+    // Wallet ID -> (timestamp, transaction ID) of every transaction it sent or received, oldest first
+    typedef std::vector<std::pair<time_t, Id128> > TransactionList;
+    std::map<Id128, TransactionList> walletTransactions;
+    
+    // Transactions whose ID does not encode their timestamp (legacy random IDs)
+    std::set<Id128> unorderedTransactions;
+    
+    // Owner username -> IDs of the wallets they own, in creation order
+    std::map<std::string, std::vector<Id128> > ownerWallets;
+    
+    // Months from hotMonthsFrom on are loaded in full; older segments are cold
+    // and their transactions are in the map only once looked up or changed
+    int hotMonthsFrom;
+    bool hasColdSegments;
+    
+    PersistenceMode persistenceMode;
+    SnapshotFormat snapshotFormat;
+    std::ofstream journal;
+    size_t journalRecords;
+    bool journalUnsynced;            // Appended to since the last fsync
+    bool journalTorn;                // Ends in a partial line, from a failed write or a crash
+    
+    // Keys changed since the last flush
+    std::set<std::string> dirtyUsers;
+    std::set<std::string> deletedUsers;
+    std::set<Id128> dirtyWallets;
+    std::set<Id128> dirtyTransactions;
+    // Segments to rewrite at the next checkpoint
+    std::set<int> changedMonths;
+    
+    size_t flushCount;
+    FlushStats lastFlushStats;
+    FlushStats totalFlushStats;
+    
+    BackupManager backupManager;
+    // Mutable: const queries fill its cache of cold months
+    mutable TransactionSegments transactionSegments;
+    bool segmented;                  // The stored snapshot leaves segmented transactions out
+    
+    mutable LockStripes walletLocks;
+    mutable RWLock storeLock;        // Maps, indexes, users and transactions
+    mutable Mutex dirtyLock;         // The dirty-key sets
+    mutable Mutex persistenceLock;   // Recursive: journal, data files, flush counters
+    
+    // Background writer, see startBackgroundWriter()
+    static const size_t FLUSH_BATCH_RECORDS = 1024;
+    Thread writerThread;
+    mutable Mutex writerLock;         // Tickets and writer state; taken last, never held while flushing
+    ConditionVariable writerWake;     // A flush is wanted before the interval ends, or the writer should stop
+    ConditionVariable flushFinished;
+    bool writerRunning;
+    bool writerStopping;
+    bool flushWanted;
+    uint32_t flushIntervalMillis;
+    uint64_t requestedSequence;       // Last ticket handed out
+    uint64_t syncRequestedSequence;   // Last DURABILITY_FSYNC ticket handed out
+    uint64_t attemptedSequence;       // Covered by the last flush, successful or not
+    uint64_t flushedSequence;         // Covered by the last successful flush
+    uint64_t syncedSequence;          // Covered by the last successful flush that synced the journal
+    
+    bool restoreLegacyBackup(const std::string& backupTimestamp);
+    std::vector<std::string> backupFiles() const;
+    Id128 generateUniqueId() const;
+    
+    // Write-ahead journal helpers
+    bool appendToJournal(const std::string& records, size_t recordCount);
+    bool syncJournal();
+    bool replayJournal();
+    void resetJournal();
+    bool writeDataFiles(FlushStats& stats);
+    
+    // Snapshot helpers
+    SnapshotFormat readStoredFormat() const;
+    bool readStoredSegmented() const;
+    bool writeFormatFile(SnapshotFormat format, bool withSegments);
+    bool loadTextFiles();
+    bool writeTextFiles(FlushStats& stats, bool writeUsers = true, bool writeWallets = true, bool writeTransactions = true);
+    
+    // Segment helpers
+    bool loadHotSegments();
+    bool writeSegments(FlushStats& stats);
+    void collectUnsegmented(std::map<Id128, Transaction>& unsegmented) const;
+    std::set<int> coldMonthsOf(const Id128& walletId) const;   // Under the persistence lock
+    Transaction* loadColdTransaction(const Id128& transactionId, int month);
+    
+    // Wallet -> transactions index helpers (also track unorderedTransactions)
+    void indexTransaction(const Transaction& transaction);
+    void unindexTransaction(const Transaction& transaction);
+    void rebuildTransactionIndex();
+    static void rebuildTransactionIndexThread(void* manager);
+    
+    // Owner -> wallets index helpers
+    void indexWallet(const std::string& ownerUsername, const Id128& walletId);
+    void unindexWallet(const std::string& ownerUsername, const Id128& walletId);
+    void rebuildWalletIndex();
+    
+    // Dirty-record flush helpers
+    bool hasDirtyRecords() const;
+    void markWalletDirty(const Id128& walletId);
+    bool flushDirtyToJournal();
+    bool flushDirtyToDataFiles();
+    void clearDirtyRecords();
+    // Mark a failed flush's records dirty again, unless changed meanwhile
+    void remarkDirtyRecords(const std::set<std::string>& flushedUsers, const std::set<std::string>& flushedDeletions,
+                            const std::set<Id128>& flushedWallets, const std::set<Id128>& flushedTransactions);
+    size_t pendingRecordCount() const;
+    void recordFlush(const FlushStats& stats);
+    
+    // Writes the changes now, on the calling thread; sync also fsyncs the journal
+    bool flushNow(bool sync);
+    static void writerThreadMain(void* manager);
+    void runWriter();
 
 public:
-    DataManager();
+    static const uint32_t DEFAULT_FLUSH_INTERVAL_MILLIS = 50;
+    
+    // All files live under dataDirectory (which ends with a separator)
+    explicit DataManager(const std::string& dataDirectory = "data/");
     ~DataManager();
     
     bool saveUser(const User& user);
     bool deleteUser(const std::string& username);
     User* getUser(const std::string& username);
     const User* getUser(const std::string& username) const;
+    // Consistent copy of a user, taken under the store lock; change users
+    // through a copy and saveUser(), never through getUser()'s pointer
+    bool copyUser(const std::string& username, User& user) const;
     std::vector<User> getAllUsers() const;
     bool userExists(const std::string& username) const;
     
-    std::string createWallet(const std::string& ownerUsername);
-    Wallet* getWallet(const std::string& walletId);
+    Id128 createWallet(const std::string& ownerUsername);
+    Wallet* getWallet(const Id128& walletId);
     Wallet* getWalletByOwner(const std::string& username);
+    std::vector<Wallet*> getWalletsByOwner(const std::string& username);
+    // Consistent copy of every wallet
     std::vector<Wallet> getAllWallets() const;
+    // Caller holds the wallet's stripe
     bool saveWallet(const Wallet& wallet);
+    LockStripes& getWalletLocks();
     
-    std::string createTransaction(const std::string& senderWalletId, 
-                                 const std::string& receiverWalletId,
-                                 double amount,
-                                 const std::string& description = "");
-    Transaction* getTransaction(const std::string& transactionId);
-    std::vector<Transaction> getTransactionsByWallet(const std::string& walletId) const;
+    Id128 createTransaction(const Id128& senderWalletId, 
+                            const Id128& receiverWalletId,
+                            const Money& amount,
+                            const std::string& description = "");
+    // Created with its final status, so it is never changed after it becomes visible
+    Id128 createTransaction(const Id128& senderWalletId, 
+                            const Id128& receiverWalletId,
+                            const Money& amount,
+                            const std::string& description,
+                            TransactionStatus status);
+    Transaction* getTransaction(const Id128& transactionId);
+    std::vector<Transaction> getTransactionsByWallet(const Id128& walletId) const;
+    // Transactions with timestamp in [from, to), oldest first
+    std::vector<Transaction> getTransactionsInRange(time_t from, time_t to) const;
     bool saveTransaction(const Transaction& transaction);
     
     bool loadData();
+    // Persists the changes made so far. While the background writer runs this
+    // is commit(DURABILITY_NONE); otherwise they are written before it returns.
     bool saveData();
+    
+    // Background writer: once started, saveData() no longer writes on the
+    // caller's thread. A writer thread flushes the changed records (and
+    // checkpoints the journal when due) every intervalMillis, or as soon as
+    // FLUSH_BATCH_RECORDS are pending or a caller waits on a ticket; records
+    // changed several times in between are written once.
+    bool startBackgroundWriter(uint32_t intervalMillis = DEFAULT_FLUSH_INTERVAL_MILLIS);
+    // Flushes what is still pending, then stops the thread
+    void stopBackgroundWriter();
+    bool isBackgroundWriterRunning() const;
+    
+    // Ticket covering every change made so far (flushed at once if no writer runs)
+    FlushTicket requestFlush(Durability durability = DURABILITY_BUFFERED);
+    // Blocks until the ticket's changes are as durable as it asked; false if
+    // that flush failed. Waiters that arrive together share one flush, and
+    // one fsync however many of them asked for DURABILITY_FSYNC (group commit).
+    bool waitForFlush(const FlushTicket& ticket);
+    // requestFlush() and waitForFlush() in one; failures are counted in the metrics
+    bool commit(Durability durability);
+    
+    // Rewrite all data files from memory and truncate the journal
+    bool checkpoint();
+    
+    // LZ77-compress the text segments of cold months; the background writer
+    // runs it once when it starts
+    bool compactSegments();
+    
+    void setPersistenceMode(PersistenceMode mode);
+    PersistenceMode getPersistenceMode() const;
+    
+    // Format written by the next checkpoint; it becomes authoritative once written
+    void setSnapshotFormat(SnapshotFormat format);
+    SnapshotFormat getSnapshotFormat() const;
+    
+    // Build snapshot.bin from the text files (and journal) and make it authoritative
+    bool convertTextToBinary();
+    
+    // Snapshot the data files and journal into a new backup
+    bool createBackup();
+    
+    // Restore a backup id from listBackups(), or a timestamp of an old full-copy backup
+    bool restoreFromBackup(const std::string& backupId);
+    std::vector<std::string> listBackups() const;
+    BackupManager& getBackupManager();
+    
+    // Flush counters: the most recent flush and the sum over all flushes
+    size_t getFlushCount() const;
+    FlushStats getLastFlushStats() const;
+    FlushStats getTotalFlushStats() const;
 };
 
 #endif
\ No newline at end of file
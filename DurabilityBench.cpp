@@ -0,0 +1,212 @@
+#include "DurabilityBench.h"
+#include "DataManager.h"
+#include "Threading.h"
+#include "FileUtils.h"
+#include "Clock.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+static const char* BENCH_DURABILITY_DIR = "data/bench/durability/";
+static const size_t CONCURRENT_CLIENTS = 8;
+
+// One client: deposits into its own wallet and commits each deposit
+struct DurabilityClient {
+    DataManager* store;
+    Id128 walletId;
+    Durability durability;
+    size_t commits;
+    size_t failed;
+    std::vector<uint64_t> latencies;
+};
+
+static const char* durabilityName(Durability durability) {
+    switch (durability) {
+        case DURABILITY_NONE:
+            return "none";
+        case DURABILITY_BUFFERED:
+            return "buffered";
+        default:
+            return "fsync";
+    }
+}
+
+static void runClient(void* argument) {
+    DurabilityClient& client = *static_cast<DurabilityClient*>(argument);
+    DataManager& store = *client.store;
+    Wallet* wallet = store.getWallet(client.walletId);
+    Money amount = Money::fromPoints(1);
+    
+    for (size_t i = 0; i < client.commits; ++i) {
+        uint64_t start = monotonicMicros();
+        {
+            // The same steps as an admin deposit, at the durability under test
+            StripeLock walletLock(store.getWalletLocks(), client.walletId);
+            wallet->addPoints(amount);
+            Id128 transactionId = store.createTransaction(Id128::systemWallet(), client.walletId, amount,
+                                                          "Durability bench", COMPLETED);
+            wallet->addTransactionToHistory(transactionId);
+            store.saveWallet(*wallet);
+        }
+        if (!store.commit(client.durability)) {
+            ++client.failed;
+        }
+        client.latencies.push_back(monotonicMicros() - start);
+    }
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+static std::string clientName(size_t index) {
+    std::ostringstream name;
+    name << "durability" << index;
+    return name.str();
+}
+
+// One level with clientCount clients, on a fresh store so the rounds do not slow each other down
+static bool runRound(Durability durability, size_t clientCount, size_t commitsPerClient) {
+    removeDirectoryTree(BENCH_DURABILITY_DIR);
+    
+    std::vector<DurabilityClient> clients(clientCount);
+    uint64_t elapsed = 0;
+    size_t flushes = 0;
+    FlushStats flushed;
+    {
+        DataManager store(BENCH_DURABILITY_DIR);
+        store.setPersistenceMode(JOURNALED);
+        for (size_t i = 0; i < clientCount; ++i) {
+            DurabilityClient& client = clients[i];
+            client.store = &store;
+            client.walletId = store.createWallet(clientName(i));
+            client.durability = durability;
+            client.commits = commitsPerClient;
+            client.failed = 0;
+            client.latencies.reserve(commitsPerClient);
+        }
+        store.checkpoint();
+        
+        size_t flushesBefore = store.getFlushCount();
+        FlushStats before = store.getTotalFlushStats();
+        store.startBackgroundWriter();
+        
+        // Thread is not copyable, so the threads live in a plain array
+        Thread* threads = new Thread[clientCount];
+        uint64_t start = monotonicMicros();
+        for (size_t i = 0; i < clientCount; ++i) {
+            threads[i].start(runClient, &clients[i]);
+        }
+        for (size_t i = 0; i < clientCount; ++i) {
+            threads[i].join();
+        }
+        elapsed = monotonicMicros() - start;
+        delete[] threads;
+        
+        // Commits at DURABILITY_NONE returned before their records were written; write them now, off the clock
+        store.stopBackgroundWriter();
+        
+        FlushStats after = store.getTotalFlushStats();
+        flushes = store.getFlushCount() - flushesBefore;
+        flushed.journalSyncs = after.journalSyncs - before.journalSyncs;
+        flushed.filesRewritten = after.filesRewritten - before.filesRewritten;
+    }
+    removeDirectoryTree(BENCH_DURABILITY_DIR);
+    
+    std::vector<uint64_t> latencies;
+    size_t failed = 0;
+    for (size_t i = 0; i < clientCount; ++i) {
+        latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+        failed += clients[i].failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    
+    double seconds = elapsed / 1000000.0;
+    std::cout << "  " << std::left << std::setw(9) << durabilityName(durability) << std::right
+              << std::setw(2) << clientCount << (clientCount == 1 ? " client:  " : " clients: ")
+              << std::fixed << std::setprecision(0) << std::setw(9) << (seconds > 0 ? latencies.size() / seconds : 0)
+              << " commits/s, p50 " << std::setw(6) << percentile(latencies, 0.50)
+              << " us, p99 " << std::setw(6) << percentile(latencies, 0.99)
+              << " us, " << flushes << " flushes, " << flushed.journalSyncs << " journal fsyncs";
+    if (flushed.journalSyncs > 0) {
+        std::cout << " (" << std::setprecision(1) << static_cast<double>(latencies.size()) / flushed.journalSyncs
+                  << " commits each)";
+    }
+    if (flushed.filesRewritten > 0) {
+        std::cout << ", " << flushed.filesRewritten << " data files rewritten";
+    }
+    if (failed > 0) {
+        std::cout << ", " << failed << " FAILED";
+    }
+    std::cout << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    return failed == 0;
+}
+
+#ifdef __linux__
+// A failed journal write must not wedge the journal: the commit that hit it fails,
+// the next one writes the change after all, and a reload replays it
+static bool checkJournalWriteFailure() {
+    removeDirectoryTree(BENCH_DURABILITY_DIR);
+    std::string journalPath = std::string(BENCH_DURABILITY_DIR) + "journal.txt";
+    
+    Id128 walletId;
+    bool failedFirst = false;
+    bool committedAfter = false;
+    {
+        DataManager store(BENCH_DURABILITY_DIR);
+        store.setPersistenceMode(JOURNALED);
+        walletId = store.createWallet("journalfailure");
+        
+        // Every write to /dev/full fails with ENOSPC
+        if (symlink("/dev/full", journalPath.c_str()) == 0) {
+            failedFirst = !store.commit(DURABILITY_BUFFERED);
+            removeFile(journalPath);
+            committedAfter = store.commit(DURABILITY_BUFFERED);
+        }
+        
+        // No checkpoint on the way out: the change has to come back from the journal
+        store.setPersistenceMode(IN_MEMORY);
+    }
+    
+    bool replayed = false;
+    {
+        DataManager store(BENCH_DURABILITY_DIR);
+        replayed = store.getWallet(walletId) != NULL;
+        store.setPersistenceMode(IN_MEMORY);
+    }
+    removeDirectoryTree(BENCH_DURABILITY_DIR);
+    
+    bool passed = failedFirst && committedAfter && replayed;
+    std::cout << "  journal write failure: " << (failedFirst ? "commit failed" : "commit NOT failed")
+              << ", " << (committedAfter ? "next commit written" : "next commit FAILED")
+              << ", " << (replayed ? "replayed" : "NOT replayed") << (passed ? "" : " FAILED") << std::endl;
+    return passed;
+}
+#endif
+
+int runDurabilityBenchmark(size_t commitsPerClient) {
+    if (commitsPerClient == 0) {
+        std::cerr << "The durability benchmark needs at least one commit per client" << std::endl;
+        return 1;
+    }
+    
+    static const Durability LEVELS[] = { DURABILITY_NONE, DURABILITY_BUFFERED, DURABILITY_FSYNC };
+    std::cout << "Commit durability, " << commitsPerClient << " deposits per client, writer interval "
+              << DataManager::DEFAULT_FLUSH_INTERVAL_MILLIS << " ms:" << std::endl;
+    
+    bool succeeded = true;
+    for (size_t i = 0; i < sizeof(LEVELS) / sizeof(LEVELS[0]); ++i) {
+        succeeded = runRound(LEVELS[i], 1, commitsPerClient) && succeeded;
+        succeeded = runRound(LEVELS[i], CONCURRENT_CLIENTS, commitsPerClient) && succeeded;
+    }
+    #ifdef __linux__
+    succeeded = checkJournalWriteFailure() && succeeded;
+    #endif
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef DURABILITY_BENCH_H
+#define DURABILITY_BENCH_H
+
+#include <cstddef>
+
+// Commit throughput against durability, on a scratch journaled store in
+// data/bench/durability/ with the background writer running.
+//
+// Each client thread owns one wallet and makes commitsPerClient deposits to
+// it, committing each one at the level under test: DURABILITY_NONE,
+// DURABILITY_BUFFERED and DURABILITY_FSYNC, with one client and with several.
+// Prints commits/s, latency percentiles, and how many flushes and journal
+// fsyncs the commits took (several concurrent fsync commits share one group
+// commit). On Linux it then checks that a commit whose journal write fails
+// (the journal pointed at /dev/full) does not stop the next one from being
+// written. Returns 0 if every commit succeeded and the check passed.
+int runDurabilityBenchmark(size_t commitsPerClient);
+
+#endif
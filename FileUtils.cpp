@@ -0,0 +1,250 @@
+#include "FileUtils.h"
+#include <fstream>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+// Hàm tạo thư mục tương thích với C++98
+bool createDirectory(const std::string& path) {
+    // Create each parent in turn, like "mkdir -p"
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\') {
+            continue;
+        }
+        
+        std::string prefix = path.substr(0, i);
+        #ifdef _WIN32
+        int result = _mkdir(prefix.c_str());
+        #else
+        int result = mkdir(prefix.c_str(), 0755);
+        #endif
+        if (result != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hàm kiểm tra file tồn tại tương thích với C++98
+bool fileExists(const std::string& filename) {
+    std::ifstream file(filename.c_str());
+    return file.good();
+}
+
+// Hàm sao chép file tương thích với C++98
+bool copyFile(const std::string& src, const std::string& dest) {
+    std::ifstream source(src.c_str(), std::ios::binary);
+    if (!source) return false;
+    
+    std::ofstream destination(dest.c_str(), std::ios::binary);
+    if (!destination) return false;
+    
+    destination << source.rdbuf();
+    return source && destination;
+}
+
+bool replaceFile(const std::string& source, const std::string& destination) {
+    #ifdef _WIN32
+    // One atomic replace: removing the destination first would leave a window
+    // in which a crash finds neither file
+    return MoveFileExA(source.c_str(), destination.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    #else
+    return std::rename(source.c_str(), destination.c_str()) == 0;
+    #endif
+}
+
+bool writeFileSynced(const std::string& path, const std::vector<std::string>& buffers, size_t& systemCalls) {
+    std::string tempPath = path + ".tmp";
+    bool written = true;
+    
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    ++systemCalls;
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    for (size_t i = 0; i < buffers.size() && written; ++i) {
+        const char* data = buffers[i].data();
+        size_t remaining = buffers[i].size();
+        while (remaining > 0 && written) {
+            DWORD chunk = remaining > 0x40000000 ? 0x40000000 : static_cast<DWORD>(remaining);
+            DWORD count = 0;
+            written = WriteFile(file, data, chunk, &count, NULL) != 0;
+            ++systemCalls;
+            data += count;
+            remaining -= count;
+        }
+    }
+    written = written && FlushFileBuffers(file) != 0;
+    written = CloseHandle(file) != 0 && written;
+    systemCalls += 2;
+    #else
+    int file = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ++systemCalls;
+    if (file < 0) {
+        return false;
+    }
+    
+    // Gathered writes straight from the buffers; a short write resumes where it stopped
+    size_t next = 0;
+    size_t offset = 0;
+    while (next < buffers.size() && written) {
+        struct iovec pieces[64];
+        int count = 0;
+        for (size_t i = next; i < buffers.size() && count < static_cast<int>(sizeof(pieces) / sizeof(pieces[0])); ++i) {
+            size_t skip = (i == next) ? offset : 0;
+            if (buffers[i].size() > skip) {
+                pieces[count].iov_base = const_cast<char*>(buffers[i].data() + skip);
+                pieces[count].iov_len = buffers[i].size() - skip;
+                ++count;
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+        
+        ssize_t result = writev(file, pieces, count);
+        ++systemCalls;
+        if (result <= 0) {
+            written = result < 0 && errno == EINTR;
+            continue;
+        }
+        
+        size_t advanced = static_cast<size_t>(result);
+        while (next < buffers.size() && offset + advanced >= buffers[next].size()) {
+            advanced -= buffers[next].size() - offset;
+            offset = 0;
+            ++next;
+        }
+        offset += advanced;
+    }
+    written = written && fsync(file) == 0;
+    written = close(file) == 0 && written;
+    systemCalls += 2;
+    #endif
+    
+    if (!written) {
+        removeFile(tempPath);
+        return false;
+    }
+    ++systemCalls;
+    if (!replaceFile(tempPath, path)) {
+        return false;
+    }
+    
+    #ifndef _WIN32
+    // The rename itself is durable only once the directory entry is synced
+    size_t separator = path.find_last_of('/');
+    std::string directoryPath = separator == std::string::npos ? "." : path.substr(0, separator + 1);
+    int directory = open(directoryPath.c_str(), O_RDONLY);
+    ++systemCalls;
+    if (directory >= 0) {
+        fsync(directory);
+        close(directory);
+        systemCalls += 2;
+    }
+    #endif
+    return true;
+}
+
+bool syncFile(const std::string& path) {
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return synced;
+    #else
+    // fsync applies to the file, whichever descriptor wrote the data
+    int file = open(path.c_str(), O_WRONLY);
+    if (file < 0) {
+        return false;
+    }
+    bool synced = fsync(file) == 0;
+    close(file);
+    return synced;
+    #endif
+}
+
+bool removeFile(const std::string& path) {
+    return std::remove(path.c_str()) == 0;
+}
+
+bool removeDirectory(const std::string& path) {
+    #ifdef _WIN32
+    return _rmdir(path.c_str()) == 0;
+    #else
+    return rmdir(path.c_str()) == 0;
+    #endif
+}
+
+bool removeDirectoryTree(const std::string& path) {
+    std::string prefix = path;
+    if (!prefix.empty() && prefix[prefix.size() - 1] != '/' && prefix[prefix.size() - 1] != '\\') {
+        prefix += '/';
+    }
+    
+    // Collect the entries first: removing while enumerating is not portable
+    std::vector<std::string> files;
+    std::vector<std::string> directories;
+    #ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((prefix + "*").c_str(), &entry);
+    if (search == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        std::string name = entry.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            directories.push_back(prefix + name);
+        } else {
+            files.push_back(prefix + name);
+        }
+    } while (FindNextFileA(search, &entry));
+    FindClose(search);
+    #else
+    DIR* directory = opendir(prefix.c_str());
+    if (!directory) {
+        return false;
+    }
+    while (dirent* entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        struct stat info;
+        if (lstat((prefix + name).c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            directories.push_back(prefix + name);
+        } else {
+            files.push_back(prefix + name);
+        }
+    }
+    closedir(directory);
+    #endif
+    
+    bool removed = true;
+    for (size_t i = 0; i < files.size(); ++i) {
+        removed = removeFile(files[i]) && removed;
+    }
+    for (size_t i = 0; i < directories.size(); ++i) {
+        removed = removeDirectoryTree(directories[i]) && removed;
+    }
+    return removeDirectory(path) && removed;
+}
@@ -0,0 +1,36 @@
+#ifndef FILE_UTILS_H
+#define FILE_UTILS_H
+
+#include <string>
+#include <vector>
+
+// Các hàm thao tác file dùng chung, tương thích với C++98
+
+// Create a directory and any missing parents
+bool createDirectory(const std::string& path);
+
+bool fileExists(const std::string& filename);
+bool copyFile(const std::string& src, const std::string& dest);
+
+// Rename source over destination in one step (also when destination exists on Windows)
+bool replaceFile(const std::string& source, const std::string& destination);
+
+// Write the buffers, in order, to path + ".tmp" in one pass, flush it to disk
+// and rename it over path (then sync the directory, on POSIX): a crash leaves
+// the old file or the new one, never a torn one. The open, write, sync, close
+// and rename calls made are added to systemCalls.
+bool writeFileSynced(const std::string& path, const std::vector<std::string>& buffers, size_t& systemCalls);
+
+// Flush what has been written to an existing file down to the disk (fsync),
+// for files written through a stream that does not expose its handle
+bool syncFile(const std::string& path);
+
+bool removeFile(const std::string& path);
+
+// Remove an empty directory
+bool removeDirectory(const std::string& path);
+
+// Remove a directory and everything below it
+bool removeDirectoryTree(const std::string& path);
+
+#endif
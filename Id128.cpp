@@ -0,0 +1,135 @@
+#include "Id128.h"
+#include <cstring>
+
+static const char* SYSTEM_WALLET_TEXT = "SYSTEM";
+
+// Value 1 is never produced by the generator: it is the nil ID with one bit set
+static const uint64_t SYSTEM_WALLET_LOW = 1;
+
+// Value of each byte as a hex digit, -1 if it is not one; wallet lines hold thousands of digits
+static const signed char HEX_VALUES[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static inline int hexValue(char c) {
+    return HEX_VALUES[static_cast<unsigned char>(c)];
+}
+
+Id128::Id128() : high(0), low(0) {}
+
+Id128::Id128(uint64_t high, uint64_t low) : high(high), low(low) {}
+
+Id128 Id128::systemWallet() {
+    return Id128(0, SYSTEM_WALLET_LOW);
+}
+
+bool Id128::fromString(const char* begin, const char* end, Id128& id) {
+    size_t length = static_cast<size_t>(end - begin);
+    if (length == std::strlen(SYSTEM_WALLET_TEXT) && std::memcmp(begin, SYSTEM_WALLET_TEXT, length) == 0) {
+        id = systemWallet();
+        return true;
+    }
+    
+    uint64_t parts[2] = { 0, 0 };
+    int digits = 0;
+    for (const char* p = begin; p < end; ++p) {
+        if (*p == '-') {
+            continue;
+        }
+        
+        int value = hexValue(*p);
+        if (value < 0 || digits >= 32) {
+            return false;
+        }
+        parts[digits / 16] = (parts[digits / 16] << 4) | static_cast<uint64_t>(value);
+        ++digits;
+    }
+    
+    if (digits != 32) {
+        return false;
+    }
+    
+    id = Id128(parts[0], parts[1]);
+    return true;
+}
+
+bool Id128::fromString(const std::string& text, Id128& id) {
+    return fromString(text.data(), text.data() + text.size(), id);
+}
+
+Id128 Id128::parse(const std::string& text) {
+    Id128 id;
+    if (!fromString(text, id)) {
+        return Id128();
+    }
+    return id;
+}
+
+size_t Id128::format(char* buffer) const {
+    if (*this == systemWallet()) {
+        size_t length = std::strlen(SYSTEM_WALLET_TEXT);
+        std::memcpy(buffer, SYSTEM_WALLET_TEXT, length);
+        return length;
+    }
+    
+    const char* hex_chars = "0123456789abcdef";
+    int digit = 0;
+    for (size_t i = 0; i < TEXT_LENGTH; ++i) {
+        // Dashes after 8, 12, 16 and 20 digits
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            buffer[i] = '-';
+            continue;
+        }
+        
+        uint64_t part = digit < 16 ? high : low;
+        int shift = (15 - digit % 16) * 4;
+        buffer[i] = hex_chars[(part >> shift) & 0xF];
+        ++digit;
+    }
+    return TEXT_LENGTH;
+}
+
+std::string Id128::toString() const {
+    char buffer[TEXT_LENGTH];
+    size_t length = format(buffer);
+    return std::string(buffer, length);
+}
+
+bool Id128::isNil() const {
+    return high == 0 && low == 0;
+}
+
+uint64_t Id128::getHigh() const {
+    return high;
+}
+
+uint64_t Id128::getLow() const {
+    return low;
+}
+
+size_t Id128::hash() const {
+    // splitmix64 finalizer over both halves
+    uint64_t z = high ^ (low + 0x9E3779B97F4A7C15ULL + (high << 6) + (high >> 2));
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return static_cast<size_t>(z ^ (z >> 31));
+}
+
+std::ostream& operator<<(std::ostream& out, const Id128& id) {
+    return out << id.toString();
+}
@@ -0,0 +1,59 @@
+#ifndef ID128_H
+#define ID128_H
+
+#include <string>
+#include <ostream>
+#include <cstddef>
+#include <stdint.h>
+
+// 16-byte identifier for wallets and transactions.
+// Stored and compared as two integers; the 36-character text form
+// (8-4-4-4-12 hex digits) is only produced at the file and UI edges.
+class Id128 {
+private:
+    uint64_t high;
+    uint64_t low;
+
+public:
+    Id128();
+    Id128(uint64_t high, uint64_t low);
+    
+    // Sender of admin deposits, written as "SYSTEM" in the data files
+    static Id128 systemWallet();
+    
+    // Accepts 32 hex digits with or without dashes, or "SYSTEM"
+    static bool fromString(const char* begin, const char* end, Id128& id);
+    static bool fromString(const std::string& text, Id128& id);
+    // Nil ID if the text is not a valid ID
+    static Id128 parse(const std::string& text);
+    
+    // Length of the dashed text form
+    static const size_t TEXT_LENGTH = 36;
+    
+    std::string toString() const;
+    // Writes toString() into buffer (at least TEXT_LENGTH bytes, not terminated); returns the length
+    size_t format(char* buffer) const;
+    
+    bool isNil() const;
+    uint64_t getHigh() const;
+    uint64_t getLow() const;
+    
+    // Well-mixed hash of all 128 bits
+    size_t hash() const;
+    
+    bool operator==(const Id128& other) const {
+        return high == other.high && low == other.low;
+    }
+    
+    bool operator!=(const Id128& other) const {
+        return !(*this == other);
+    }
+    
+    bool operator<(const Id128& other) const {
+        return high < other.high || (high == other.high && low < other.low);
+    }
+};
+
+std::ostream& operator<<(std::ostream& out, const Id128& id);
+
+#endif
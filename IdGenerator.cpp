@@ -0,0 +1,75 @@
+#include "IdGenerator.h"
+#include "Clock.h"
+
+static const uint64_t VERSION_BITS = 0x7000;
+static const uint64_t VARIANT_BITS = 0x8000000000000000ULL;
+static const uint64_t TIMESTAMP_MASK = 0xFFFFFFFFFFFFULL;
+static const uint32_t THREAD_TAG_MASK = 0xFFFF;
+static const uint64_t RANDOM_MASK = 0x3FFFFFF;
+
+// Per-thread generator state; zero-initialized, set up on first use
+struct GeneratorState {
+    bool initialized;
+    uint32_t threadTag;
+    uint32_t sequence;
+    uint64_t lastMillis;
+    uint64_t randomState;
+};
+
+static __thread GeneratorState generatorState;
+static uint32_t nextThreadTag = 0;
+
+// xorshift64*: fast, and only used for the low bits that break ties between processes
+static uint64_t nextRandom(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+Id128 IdGenerator::next() {
+    GeneratorState& state = generatorState;
+    
+    if (!state.initialized) {
+        state.threadTag = __sync_fetch_and_add(&nextThreadTag, 1) & THREAD_TAG_MASK;
+        state.randomState = currentTimeMicros() ^ (monotonicMicros() << 20) ^
+                            (static_cast<uint64_t>(state.threadTag) << 48) ^
+                            static_cast<uint64_t>(reinterpret_cast<size_t>(&state));
+        if (state.randomState == 0) {
+            state.randomState = 0x9E3779B97F4A7C15ULL;
+        }
+        state.initialized = true;
+    }
+    
+    uint64_t now = currentTimeMillis();
+    if (now > state.lastMillis) {
+        state.lastMillis = now;
+        state.sequence = 0;
+    } else if (++state.sequence == 0) {
+        // 2^32 IDs within one millisecond (or a clock step backwards): borrow the next one
+        ++state.lastMillis;
+    }
+    
+    return compose(state.lastMillis, state.sequence, state.threadTag, nextRandom(state.randomState));
+}
+
+Id128 IdGenerator::compose(uint64_t timestampMillis, uint32_t sequence, uint32_t threadTag, uint64_t random) {
+    uint64_t high = ((timestampMillis & TIMESTAMP_MASK) << 16) | VERSION_BITS | ((sequence >> 20) & 0xFFF);
+    uint64_t low = VARIANT_BITS |
+                   (static_cast<uint64_t>(sequence & 0xFFFFF) << 42) |
+                   (static_cast<uint64_t>(threadTag & THREAD_TAG_MASK) << 26) |
+                   (random & RANDOM_MASK);
+    return Id128(high, low);
+}
+
+bool IdGenerator::isTimeOrdered(const Id128& id) {
+    return ((id.getHigh() >> 12) & 0xF) == 7 && (id.getLow() >> 62) == 2;
+}
+
+uint64_t IdGenerator::timestampMillis(const Id128& id) {
+    return id.getHigh() >> 16;
+}
+
+Id128 IdGenerator::lowerBound(uint64_t timestampMillis) {
+    return Id128((timestampMillis & TIMESTAMP_MASK) << 16, 0);
+}
@@ -0,0 +1,102 @@
+#include "LockStripes.h"
+
+LockStripes::LockStripes(size_t stripeCount)
+    : stripes(new Stripe[stripeCount > 0 ? stripeCount : 1]), count(stripeCount > 0 ? stripeCount : 1) {}
+
+LockStripes::~LockStripes() {
+    delete[] stripes;
+}
+
+size_t LockStripes::stripeFor(const Id128& id) const {
+    return id.hash() % count;
+}
+
+size_t LockStripes::getStripeCount() const {
+    return count;
+}
+
+void LockStripes::lockStripe(size_t stripe) {
+    Stripe& entry = stripes[stripe];
+    bool contended = !entry.mutex.tryLock();
+    if (contended) {
+        entry.mutex.lock();
+        ++entry.contended;
+    }
+    ++entry.acquisitions;
+}
+
+void LockStripes::unlockStripe(size_t stripe) {
+    stripes[stripe].mutex.unlock();
+}
+
+void LockStripes::lockAll() {
+    for (size_t i = 0; i < count; ++i) {
+        lockStripe(i);
+    }
+}
+
+void LockStripes::unlockAll() {
+    for (size_t i = count; i > 0; --i) {
+        stripes[i - 1].mutex.unlock();
+    }
+}
+
+StripeStatistics LockStripes::getStatistics() const {
+    StripeStatistics statistics;
+    for (size_t i = 0; i < count; ++i) {
+        ScopedLock lock(stripes[i].mutex);
+        statistics.acquisitions += stripes[i].acquisitions;
+        statistics.contended += stripes[i].contended;
+        if (stripes[i].acquisitions > statistics.busiestAcquisitions) {
+            statistics.busiestStripe = i;
+            statistics.busiestAcquisitions = stripes[i].acquisitions;
+        }
+    }
+    return statistics;
+}
+
+void LockStripes::resetStatistics() {
+    for (size_t i = 0; i < count; ++i) {
+        ScopedLock lock(stripes[i].mutex);
+        stripes[i].acquisitions = 0;
+        stripes[i].contended = 0;
+    }
+}
+
+StripeLock::StripeLock(LockStripes& locks, const Id128& id)
+    : locks(locks), stripe(locks.stripeFor(id)) {
+    locks.lockStripe(stripe);
+}
+
+StripeLock::~StripeLock() {
+    locks.unlockStripe(stripe);
+}
+
+StripePairLock::StripePairLock(LockStripes& locks, const Id128& firstId, const Id128& secondId)
+    : locks(locks), first(locks.stripeFor(firstId)), second(locks.stripeFor(secondId)) {
+    if (second < first) {
+        size_t swapped = first;
+        first = second;
+        second = swapped;
+    }
+    
+    locks.lockStripe(first);
+    if (second != first) {
+        locks.lockStripe(second);
+    }
+}
+
+StripePairLock::~StripePairLock() {
+    if (second != first) {
+        locks.unlockStripe(second);
+    }
+    locks.unlockStripe(first);
+}
+
+AllStripesLock::AllStripesLock(LockStripes& locks) : locks(locks) {
+    locks.lockAll();
+}
+
+AllStripesLock::~AllStripesLock() {
+    locks.unlockAll();
+}
@@ -0,0 +1,102 @@
+#ifndef LOCK_STRIPES_H
+#define LOCK_STRIPES_H
+
+#include <cstddef>
+#include <stdint.h>
+#include "Id128.h"
+#include "Threading.h"
+
+// Lock traffic since construction or the last resetStatistics()
+struct StripeStatistics {
+    uint64_t acquisitions;
+    uint64_t contended;          // Acquisitions that had to wait for another holder
+    size_t busiestStripe;
+    uint64_t busiestAcquisitions;
+    
+    StripeStatistics() : acquisitions(0), contended(0), busiestStripe(0), busiestAcquisitions(0) {}
+};
+
+// A fixed set of mutexes shared by all wallets: a wallet is guarded by
+// stripe hash(id) % count. Locks are always taken in ascending stripe
+// order, so two transfers over the same wallets can never deadlock.
+class LockStripes {
+private:
+    // The counters are only touched while the stripe is held, so they need no atomics
+    struct Stripe {
+        Mutex mutex;
+        uint64_t acquisitions;
+        uint64_t contended;
+        
+        Stripe() : acquisitions(0), contended(0) {}
+    };
+    
+    Stripe* stripes;
+    size_t count;
+    
+    LockStripes(const LockStripes&);
+    LockStripes& operator=(const LockStripes&);
+
+public:
+    static const size_t DEFAULT_STRIPE_COUNT = 256;
+    
+    explicit LockStripes(size_t stripeCount = DEFAULT_STRIPE_COUNT);
+    ~LockStripes();
+    
+    size_t stripeFor(const Id128& id) const;
+    size_t getStripeCount() const;
+    
+    void lockStripe(size_t stripe);
+    void unlockStripe(size_t stripe);
+    
+    // Every stripe, in order: stops all wallet updates for a consistent view
+    void lockAll();
+    void unlockAll();
+    
+    // Each stripe is briefly locked to read or clear its counters
+    StripeStatistics getStatistics() const;
+    void resetStatistics();
+};
+
+// Holds the stripe of one wallet
+class StripeLock {
+private:
+    LockStripes& locks;
+    size_t stripe;
+    
+    StripeLock(const StripeLock&);
+    StripeLock& operator=(const StripeLock&);
+
+public:
+    StripeLock(LockStripes& locks, const Id128& id);
+    ~StripeLock();
+};
+
+// Holds the stripes of two wallets, taken in stripe order (once if they share one)
+class StripePairLock {
+private:
+    LockStripes& locks;
+    size_t first;
+    size_t second;
+    
+    StripePairLock(const StripePairLock&);
+    StripePairLock& operator=(const StripePairLock&);
+
+public:
+    StripePairLock(LockStripes& locks, const Id128& firstId, const Id128& secondId);
+    ~StripePairLock();
+};
+
+// Holds every stripe
+class AllStripesLock {
+private:
+    LockStripes& locks;
+    
+    AllStripesLock(const AllStripesLock&);
+    AllStripesLock& operator=(const AllStripesLock&);
+
+public:
+    explicit AllStripesLock(LockStripes& locks);
+    ~AllStripesLock();
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "Lz77.h"
+#include <vector>
+#include <cstring>
+
+static const char MAGIC[4] = { 'L', 'Z', '7', '7' };
+static const size_t HEADER_SIZE = 12;
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 16;
+static const unsigned LENGTH_MORE = 15;
+
+static uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static size_t hashOf(uint32_t value) {
+    // Fibonacci hashing: the top HASH_BITS bits of the product
+    return static_cast<size_t>((value * 2654435761U) >> (32 - HASH_BITS));
+}
+
+// The part of a length that does not fit its 4-bit token field
+static void appendLength(std::string& out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out += static_cast<char>(255);
+    }
+    out += static_cast<char>(length);
+}
+
+static void appendSequence(std::string& out, const char* literals, size_t literalCount,
+                           size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+    unsigned token = (literalCount < LENGTH_MORE ? static_cast<unsigned>(literalCount) : LENGTH_MORE) << 4;
+    token |= matchCode < LENGTH_MORE ? static_cast<unsigned>(matchCode) : LENGTH_MORE;
+    out += static_cast<char>(token);
+    
+    if (literalCount >= LENGTH_MORE) {
+        appendLength(out, literalCount - LENGTH_MORE);
+    }
+    out.append(literals, literalCount);
+    
+    // The last sequence is literals only
+    if (matchLength == 0) {
+        return;
+    }
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (matchCode >= LENGTH_MORE) {
+        appendLength(out, matchCode - LENGTH_MORE);
+    }
+}
+
+std::string Lz77::compress(const char* data, size_t size) {
+    std::string out;
+    out.reserve(HEADER_SIZE + size / 2);
+    out.append(MAGIC, sizeof(MAGIC));
+    for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>((static_cast<uint64_t>(size) >> (8 * i)) & 0xFF);
+    }
+    
+    // Position + 1 of the last four bytes seen with each hash (0: none yet)
+    std::vector<uint32_t> table(static_cast<size_t>(1) << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + MIN_MATCH <= size) {
+        size_t slot = hashOf(read32(data + position));
+        size_t candidate = table[slot];
+        table[slot] = static_cast<uint32_t>(position + 1);
+        
+        if (candidate == 0 || position + 1 - candidate > MAX_OFFSET ||
+            std::memcmp(data + candidate - 1, data + position, MIN_MATCH) != 0) {
+            ++position;
+            continue;
+        }
+        
+        size_t matchStart = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (position + length < size && data[matchStart + length] == data[position + length]) {
+            ++length;
+        }
+        
+        appendSequence(out, data + anchor, position - anchor, position - matchStart, length);
+        position += length;
+        anchor = position;
+    }
+    
+    appendSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+// Adds the bytes of 255 that follow a saturated token field; false past the end
+static bool readLength(const unsigned char*& p, const unsigned char* end, size_t& length) {
+    for (;;) {
+        if (p >= end) {
+            return false;
+        }
+        unsigned char byte = *p++;
+        length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+
+bool Lz77::decompress(const char* data, size_t size, std::string& output) {
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    
+    uint64_t expected = 0;
+    for (int i = 0; i < 8; ++i) {
+        expected |= static_cast<uint64_t>(static_cast<unsigned char>(data[4 + i])) << (8 * i);
+    }
+    
+    output.clear();
+    output.reserve(static_cast<size_t>(expected));
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data) + HEADER_SIZE;
+    const unsigned char* end = reinterpret_cast<const unsigned char*>(data) + size;
+    for (;;) {
+        if (p >= end) {
+            return false;
+        }
+        unsigned token = *p++;
+        
+        size_t literalCount = token >> 4;
+        if (literalCount == LENGTH_MORE && !readLength(p, end, literalCount)) {
+            return false;
+        }
+        if (literalCount > static_cast<size_t>(end - p)) {
+            return false;
+        }
+        output.append(reinterpret_cast<const char*>(p), literalCount);
+        p += literalCount;
+        
+        if (p == end) {
+            return output.size() == expected;
+        }
+        
+        if (end - p < 2) {
+            return false;
+        }
+        size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+        p += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == LENGTH_MORE && !readLength(p, end, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > output.size() || output.size() + matchLength > expected) {
+            return false;
+        }
+        
+        // Byte by byte: a match may overlap the bytes it is producing
+        size_t from = output.size() - offset;
+        for (size_t i = 0; i < matchLength; ++i) {
+            output += output[from + i];
+        }
+    }
+}
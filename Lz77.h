@@ -0,0 +1,30 @@
+#ifndef LZ77_H
+#define LZ77_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// Byte-oriented LZ77 codec for closed transaction segments.
+//
+// Layout:
+//   "LZ77" magic, uncompressed size (8 bytes, little-endian)
+//   sequences until the data ends, each:
+//     token            high 4 bits literal count, low 4 bits match length - 4
+//                      (15 in either: more length follows, in bytes of 255
+//                      until one is smaller)
+//     literals
+//     match offset     2 bytes little-endian, 1..65535 back into the output
+//                      (absent after the last literals)
+//
+// Matches are found through a hash of the next four bytes, one candidate per
+// hash, so compression is a single pass. Data-file lines repeat their wallet
+// IDs, timestamps and descriptions, which is what it catches.
+class Lz77 {
+public:
+    static std::string compress(const char* data, size_t size);
+    // False (output unspecified) if the data is not a complete, valid stream
+    static bool decompress(const char* data, size_t size, std::string& output);
+};
+
+#endif
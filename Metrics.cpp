@@ -0,0 +1,422 @@
+#include "Metrics.h"
+#include "Clock.h"
+#include "FileUtils.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// The owning thread is the only writer of a shard cell, so a relaxed load and
+// store (no locked instruction) is enough; readers see a value at most one
+// update old.
+static inline void bump(uint64_t& cell, uint64_t amount) {
+    __atomic_store_n(&cell, __atomic_load_n(&cell, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t readCell(const uint64_t& cell) {
+    return __atomic_load_n(&cell, __ATOMIC_RELAXED);
+}
+
+// Histogram cells: count, sum, then the buckets
+static const size_t HISTOGRAM_COUNT_CELL = 0;
+static const size_t HISTOGRAM_SUM_CELL = 1;
+static const size_t HISTOGRAM_FIRST_BUCKET = 2;
+
+struct MetricsRegistry::ThreadShard {
+    uint64_t counters[MAX_COUNTERS];
+    uint64_t* histograms[MAX_HISTOGRAMS];   // Allocated on the thread's first record
+    
+    ThreadShard() {
+        std::memset(counters, 0, sizeof(counters));
+        std::memset(histograms, 0, sizeof(histograms));
+    }
+};
+
+Counter::Counter(MetricsRegistry& registry, size_t slot) : registry(registry), slot(slot) {}
+
+void Counter::add(uint64_t amount) {
+    if (slot < MetricsRegistry::MAX_COUNTERS) {
+        bump(registry.threadShard().counters[slot], amount);
+    }
+}
+
+uint64_t Counter::value() const {
+    return registry.sumCounter(slot);
+}
+
+Gauge::Gauge() : current(0) {}
+
+void Gauge::set(int64_t value) {
+    __atomic_store_n(&current, value, __ATOMIC_RELAXED);
+}
+
+void Gauge::add(int64_t delta) {
+    __atomic_fetch_add(&current, delta, __ATOMIC_RELAXED);
+}
+
+int64_t Gauge::value() const {
+    return __atomic_load_n(&current, __ATOMIC_RELAXED);
+}
+
+uint64_t HistogramSnapshot::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return LatencyHistogram::bucketUpperBound(i);
+        }
+    }
+    return LatencyHistogram::bucketUpperBound(buckets.size() - 1);
+}
+
+LatencyHistogram::LatencyHistogram(MetricsRegistry& registry, size_t slot) : registry(registry), slot(slot) {}
+
+size_t LatencyHistogram::bucketFor(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    unsigned exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    // The leading bit and the SUB_BUCKET_BITS below it pick the bucket
+    uint64_t mantissa = value >> (exponent - SUB_BUCKET_BITS);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + static_cast<size_t>(mantissa - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned exponent = static_cast<unsigned>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+    uint64_t mantissa = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    return (mantissa << shift) + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    if (slot >= MetricsRegistry::MAX_HISTOGRAMS) {
+        return;
+    }
+    
+    MetricsRegistry::ThreadShard& shard = registry.threadShard();
+    uint64_t* cells = shard.histograms[slot];
+    if (!cells) {
+        cells = new uint64_t[HISTOGRAM_FIRST_BUCKET + BUCKET_COUNT]();
+        // Published with release so a reader never sees the cells before they are zeroed
+        __atomic_store_n(&shard.histograms[slot], cells, __ATOMIC_RELEASE);
+    }
+    
+    bump(cells[HISTOGRAM_COUNT_CELL], 1);
+    bump(cells[HISTOGRAM_SUM_CELL], nanoseconds);
+    bump(cells[HISTOGRAM_FIRST_BUCKET + bucketFor(nanoseconds)], 1);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    return registry.sumHistogram(slot);
+}
+
+MetricsRegistry::MetricsRegistry() : nextCounterSlot(0), nextHistogramSlot(0) {}
+
+MetricsRegistry::~MetricsRegistry() {
+    for (std::map<std::string, Family>::iterator family = families.begin(); family != families.end(); ++family) {
+        for (std::map<std::string, void*>::iterator it = family->second.series.begin();
+             it != family->second.series.end(); ++it) {
+            if (family->second.type == COUNTER) {
+                delete static_cast<Counter*>(it->second);
+            } else if (family->second.type == GAUGE) {
+                delete static_cast<Gauge*>(it->second);
+            } else {
+                delete static_cast<LatencyHistogram*>(it->second);
+            }
+        }
+    }
+    // Shards are left alone: threads may still be recording during static destruction
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::ThreadShard& MetricsRegistry::threadShard() {
+    static __thread ThreadShard* currentShard = NULL;
+    if (!currentShard) {
+        ThreadShard* shard = new ThreadShard();
+        ScopedLock guard(lock);
+        shards.push_back(shard);
+        currentShard = shard;
+    }
+    return *currentShard;
+}
+
+uint64_t MetricsRegistry::sumCounter(size_t slot) const {
+    if (slot >= MAX_COUNTERS) {
+        return 0;
+    }
+    uint64_t total = 0;
+    ScopedLock guard(lock);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        total += readCell(shards[i]->counters[slot]);
+    }
+    return total;
+}
+
+HistogramSnapshot MetricsRegistry::sumHistogram(size_t slot) const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.assign(LatencyHistogram::BUCKET_COUNT, 0);
+    if (slot >= MAX_HISTOGRAMS) {
+        return snapshot;
+    }
+    
+    ScopedLock guard(lock);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const uint64_t* cells = __atomic_load_n(&shards[i]->histograms[slot], __ATOMIC_ACQUIRE);
+        if (!cells) {
+            continue;
+        }
+        snapshot.count += readCell(cells[HISTOGRAM_COUNT_CELL]);
+        snapshot.sum += readCell(cells[HISTOGRAM_SUM_CELL]);
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+            snapshot.buckets[bucket] += readCell(cells[HISTOGRAM_FIRST_BUCKET + bucket]);
+        }
+    }
+    return snapshot;
+}
+
+void* MetricsRegistry::find(const std::string& family, const std::string& labels, MetricType type,
+                            const std::string& help, Family*& entry) {
+    std::map<std::string, Family>::iterator it = families.find(family);
+    if (it == families.end()) {
+        it = families.insert(std::make_pair(family, Family())).first;
+        it->second.help = help;
+        it->second.type = type;
+    } else if (it->second.type != type) {
+        std::cerr << "Metric " << family << " registered with two different types" << std::endl;
+    }
+    entry = &it->second;
+    
+    std::map<std::string, void*>::iterator series = entry->series.find(labels);
+    return series == entry->series.end() ? NULL : series->second;
+}
+
+Counter& MetricsRegistry::counter(const std::string& family, const std::string& labels, const std::string& help) {
+    ScopedLock guard(lock);
+    Family* entry;
+    void* existing = find(family, labels, COUNTER, help, entry);
+    if (existing && entry->type == COUNTER) {
+        return *static_cast<Counter*>(existing);
+    }
+    Counter* metric = new Counter(*this, nextCounterSlot++);
+    if (entry->type == COUNTER) {
+        entry->series[labels] = metric;
+    }
+    return *metric;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& family, const std::string& labels, const std::string& help) {
+    ScopedLock guard(lock);
+    Family* entry;
+    void* existing = find(family, labels, GAUGE, help, entry);
+    if (existing && entry->type == GAUGE) {
+        return *static_cast<Gauge*>(existing);
+    }
+    Gauge* metric = new Gauge();
+    if (entry->type == GAUGE) {
+        entry->series[labels] = metric;
+    }
+    return *metric;
+}
+
+LatencyHistogram& MetricsRegistry::histogram(const std::string& family, const std::string& labels,
+                                             const std::string& help) {
+    ScopedLock guard(lock);
+    Family* entry;
+    void* existing = find(family, labels, HISTOGRAM, help, entry);
+    if (existing && entry->type == HISTOGRAM) {
+        return *static_cast<LatencyHistogram*>(existing);
+    }
+    LatencyHistogram* metric = new LatencyHistogram(*this, nextHistogramSlot++);
+    if (entry->type == HISTOGRAM) {
+        entry->series[labels] = metric;
+    }
+    return *metric;
+}
+
+// name{labels} or name{labels,extra}
+static std::string seriesName(const std::string& name, const std::string& labels, const std::string& extra = "") {
+    if (labels.empty() && extra.empty()) {
+        return name;
+    }
+    return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+
+std::string MetricsRegistry::exportPrometheus() const {
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char* QUANTILE_LABELS[] = { "quantile=\"0.5\"", "quantile=\"0.9\"", "quantile=\"0.99\"", "quantile=\"0.999\"" };
+    
+    // Copy the series under the lock; the values are summed outside it
+    std::vector<std::pair<std::string, Family> > snapshot;
+    {
+        ScopedLock guard(lock);
+        snapshot.assign(families.begin(), families.end());
+    }
+    
+    std::ostringstream out;
+    out << std::setprecision(9);
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        const std::string& name = snapshot[i].first;
+        const Family& family = snapshot[i].second;
+        static const char* TYPE_NAMES[] = { "counter", "gauge", "summary" };
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << TYPE_NAMES[family.type] << "\n";
+        
+        for (std::map<std::string, void*>::const_iterator it = family.series.begin(); it != family.series.end(); ++it) {
+            const std::string& labels = it->first;
+            if (family.type == COUNTER) {
+                out << seriesName(name, labels) << " " << static_cast<Counter*>(it->second)->value() << "\n";
+            } else if (family.type == GAUGE) {
+                out << seriesName(name, labels) << " " << static_cast<Gauge*>(it->second)->value() << "\n";
+            } else {
+                HistogramSnapshot histogram = static_cast<LatencyHistogram*>(it->second)->snapshot();
+                for (size_t q = 0; q < sizeof(QUANTILES) / sizeof(QUANTILES[0]); ++q) {
+                    out << seriesName(name, labels, QUANTILE_LABELS[q]) << " "
+                        << histogram.percentile(QUANTILES[q]) / 1e9 << "\n";
+                }
+                out << seriesName(name + "_sum", labels) << " " << histogram.sum / 1e9 << "\n";
+                out << seriesName(name + "_count", labels) << " " << histogram.count << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+OperationMetric::OperationMetric(const std::string& subsystem, const std::string& operation)
+    : latency(MetricsRegistry::instance().histogram(subsystem + "_operation_duration_seconds",
+                                                    "operation=\"" + operation + "\"",
+                                                    "Time taken by " + subsystem + " operations")),
+      failures(MetricsRegistry::instance().counter(subsystem + "_operation_failures_total",
+                                                   "operation=\"" + operation + "\"",
+                                                   "Calls to " + subsystem + " operations that failed")) {}
+
+OperationTimer::OperationTimer(OperationMetric& metric, bool checked)
+    : metric(metric), start(monotonicNanos()), failed(checked) {}
+
+OperationTimer::~OperationTimer() {
+    metric.latency.record(monotonicNanos() - start);
+    if (failed) {
+        metric.failures.add();
+    }
+}
+
+bool OperationTimer::succeed(bool result) {
+    failed = !result;
+    return result;
+}
+
+MetricsExporter::MetricsExporter() : intervalMillis(0), stopping(false) {}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const std::string& exportTarget, uint32_t interval) {
+    if (thread.isRunning()) {
+        return false;
+    }
+    target = exportTarget;
+    intervalMillis = interval > 0 ? interval : 1;
+    stopping = false;
+    return thread.start(threadMain, this);
+}
+
+void MetricsExporter::stop() {
+    if (!thread.isRunning()) {
+        return;
+    }
+    {
+        ScopedLock guard(lock);
+        stopping = true;
+    }
+    wake.notifyAll();
+    thread.join();
+    exportNow();
+}
+
+void MetricsExporter::threadMain(void* argument) {
+    static_cast<MetricsExporter*>(argument)->run();
+}
+
+void MetricsExporter::run() {
+    lock.lock();
+    while (!stopping) {
+        // Only stop() notifies; a spurious wakeup just exports early
+        wake.waitFor(lock, intervalMillis);
+        if (stopping) {
+            break;
+        }
+        lock.unlock();
+        exportNow();
+        lock.lock();
+    }
+    lock.unlock();
+}
+
+bool MetricsExporter::exportNow() {
+    std::string text = MetricsRegistry::instance().exportPrometheus();
+    
+    if (target.compare(0, 5, "unix:") == 0) {
+#ifdef _WIN32
+        std::cerr << "Metrics export to a Unix socket is not supported on Windows" << std::endl;
+        return false;
+#else
+        std::string path = target.substr(5);
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        bool sent = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        for (size_t offset = 0; sent && offset < text.size(); ) {
+            ssize_t written = send(fd, text.data() + offset, text.size() - offset, MSG_NOSIGNAL);
+            sent = written > 0;
+            offset += sent ? static_cast<size_t>(written) : 0;
+        }
+        close(fd);
+        return sent;
+#endif
+    }
+    
+    // Written aside and renamed, so a collector never reads half a dump
+    std::string temporary = target + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        file << text;
+        if (!file) {
+            std::cerr << "Failed to write metrics to " << target << std::endl;
+            return false;
+        }
+    }
+    return replaceFile(temporary, target);
+}
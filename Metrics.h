@@ -0,0 +1,188 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "Threading.h"
+
+class MetricsRegistry;
+
+// Monotonically increasing count
+class Counter {
+private:
+    MetricsRegistry& registry;
+    size_t slot;
+    
+    friend class MetricsRegistry;
+    Counter(MetricsRegistry& registry, size_t slot);
+
+public:
+    void add(uint64_t amount = 1);
+    uint64_t value() const;
+};
+
+// Current level of something; one shared value, since a level cannot be summed per thread
+class Gauge {
+private:
+    int64_t current;
+
+public:
+    Gauge();
+    
+    void set(int64_t value);
+    void add(int64_t delta);
+    int64_t value() const;
+};
+
+// Merged view of a histogram at one point in time
+struct HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    std::vector<uint64_t> buckets;
+    
+    HistogramSnapshot() : count(0), sum(0) {}
+    
+    // Upper bound of the bucket holding that share of the recorded values
+    uint64_t percentile(double fraction) const;
+};
+
+// Log-linear (HDR-style) histogram: every power of two is split into
+// SUB_BUCKETS linear buckets, so any value is kept within 12.5% from 1 ns up
+// to about 18 minutes, in a fixed 312 buckets.
+class LatencyHistogram {
+private:
+    MetricsRegistry& registry;
+    size_t slot;
+    
+    friend class MetricsRegistry;
+    LatencyHistogram(MetricsRegistry& registry, size_t slot);
+
+public:
+    static const unsigned SUB_BUCKET_BITS = 3;
+    static const uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const unsigned MAX_EXPONENT = 40;
+    static const size_t BUCKET_COUNT = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+    
+    static size_t bucketFor(uint64_t value);
+    static uint64_t bucketUpperBound(size_t bucket);
+    
+    void record(uint64_t nanoseconds);
+    HistogramSnapshot snapshot() const;
+};
+
+// Process-wide set of named metrics.
+//
+// Counters and histograms are recorded into a shard owned by the calling
+// thread, with plain (relaxed atomic) stores and no lock, and only summed
+// when they are read. Shards of threads that have exited stay registered,
+// so nothing they recorded is lost. Metrics live as long as the process.
+class MetricsRegistry {
+private:
+    enum MetricType { COUNTER, GAUGE, HISTOGRAM };
+    
+    struct Family {
+        std::string help;
+        MetricType type;
+        std::map<std::string, void*> series;   // Label set -> metric
+    };
+    
+    struct ThreadShard;
+    
+    // Per-thread slots; metrics registered beyond these are accepted but not recorded
+    static const size_t MAX_COUNTERS = 256;
+    static const size_t MAX_HISTOGRAMS = 128;
+    
+    mutable Mutex lock;
+    std::map<std::string, Family> families;
+    std::vector<ThreadShard*> shards;
+    size_t nextCounterSlot;
+    size_t nextHistogramSlot;
+    
+    MetricsRegistry();
+    ~MetricsRegistry();
+    MetricsRegistry(const MetricsRegistry&);
+    MetricsRegistry& operator=(const MetricsRegistry&);
+    
+    void* find(const std::string& family, const std::string& labels, MetricType type,
+               const std::string& help, Family*& entry);
+    
+    friend class Counter;
+    friend class LatencyHistogram;
+    ThreadShard& threadShard();
+    uint64_t sumCounter(size_t slot) const;
+    HistogramSnapshot sumHistogram(size_t slot) const;
+
+public:
+    static MetricsRegistry& instance();
+    
+    // Labels are written as in the exposition format, e.g. operation="login".
+    // Asking again for the same family and labels returns the same metric.
+    Counter& counter(const std::string& family, const std::string& labels, const std::string& help);
+    Gauge& gauge(const std::string& family, const std::string& labels, const std::string& help);
+    LatencyHistogram& histogram(const std::string& family, const std::string& labels, const std::string& help);
+    
+    // Every metric in the Prometheus text exposition format; histograms as
+    // summaries in seconds with the 0.5, 0.9, 0.99 and 0.999 quantiles
+    std::string exportPrometheus() const;
+};
+
+// Latency and failures of one named operation:
+//   <subsystem>_operation_duration_seconds{operation="..."}
+//   <subsystem>_operation_failures_total{operation="..."}
+struct OperationMetric {
+    LatencyHistogram& latency;
+    Counter& failures;
+    
+    OperationMetric(const std::string& subsystem, const std::string& operation);
+};
+
+// Times one call of an operation. A checked timer counts the call as failed
+// unless it ends with `return timer.succeed(true-ish result)`, so early
+// error returns need no changes.
+class OperationTimer {
+private:
+    OperationMetric& metric;
+    uint64_t start;
+    bool failed;
+    
+    OperationTimer(const OperationTimer&);
+    OperationTimer& operator=(const OperationTimer&);
+
+public:
+    explicit OperationTimer(OperationMetric& metric, bool checked = false);
+    ~OperationTimer();
+    
+    bool succeed(bool result);
+};
+
+// Writes exportPrometheus() to a target on an interval from a background thread.
+// The target is a file path (replaced atomically, for a textfile collector) or
+// "unix:<path>" to send each dump to a listening Unix domain socket.
+class MetricsExporter {
+private:
+    std::string target;
+    uint32_t intervalMillis;
+    Thread thread;
+    Mutex lock;
+    ConditionVariable wake;
+    bool stopping;
+    
+    MetricsExporter(const MetricsExporter&);
+    MetricsExporter& operator=(const MetricsExporter&);
+    
+    static void threadMain(void* argument);
+    void run();
+
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+    
+    bool start(const std::string& target, uint32_t intervalMillis);
+    // Stops the thread and writes a final dump
+    void stop();
+    bool exportNow();
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "Money.h"
+#include <istream>
+#include <ostream>
+#include <cstring>
+
+static const int64_t MAX_MINOR_UNITS = 0x7FFFFFFFFFFFFFFFLL;
+static const int64_t MIN_MINOR_UNITS = -MAX_MINOR_UNITS - 1;
+static const uint64_t MAX_MANTISSA = 0xFFFFFFFFFFFFFFFFULL;
+// Exponents beyond this cannot produce an in-range, non-zero amount
+static const int MAX_EXPONENT = 400;
+
+static const uint64_t POWERS_OF_TEN[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+Money::Money() : minorUnits(0) {}
+
+Money Money::fromMinorUnits(int64_t minorUnits) {
+    Money money;
+    money.minorUnits = minorUnits;
+    return money;
+}
+
+Money Money::fromPoints(int64_t points) {
+    if (points > MAX_MINOR_UNITS / MINOR_UNITS_PER_POINT) {
+        return fromMinorUnits(MAX_MINOR_UNITS);
+    }
+    if (points < MIN_MINOR_UNITS / MINOR_UNITS_PER_POINT) {
+        return fromMinorUnits(MIN_MINOR_UNITS);
+    }
+    return fromMinorUnits(points * MINOR_UNITS_PER_POINT);
+}
+
+bool Money::fromDouble(double value, Money& money) {
+    double scaled = value * MINOR_UNITS_PER_POINT;
+    // Also rejects NaN, for which every comparison is false
+    if (!(scaled > -9.2e18 && scaled < 9.2e18)) {
+        return false;
+    }
+    
+    money.minorUnits = static_cast<int64_t>(scaled + (scaled >= 0 ? 0.5 : -0.5));
+    return true;
+}
+
+bool Money::parse(const char* begin, const char* end, Money& money) {
+    while (begin < end && isSpace(*begin)) ++begin;
+    while (end > begin && isSpace(*(end - 1))) --end;
+    
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    
+    // Mantissa digits; fraction digits that no longer fit are dropped
+    uint64_t mantissa = 0;
+    int fractionDigits = 0;
+    int digitCount = 0;
+    bool inFraction = false;
+    for (; p < end; ++p) {
+        if (*p == '.' && !inFraction) {
+            inFraction = true;
+            continue;
+        }
+        if (!isDigit(*p)) {
+            break;
+        }
+        
+        ++digitCount;
+        unsigned digit = static_cast<unsigned>(*p - '0');
+        if (mantissa > (MAX_MANTISSA - digit) / 10) {
+            if (!inFraction) {
+                return false;
+            }
+            continue;
+        }
+        mantissa = mantissa * 10 + digit;
+        if (inFraction) {
+            ++fractionDigits;
+        }
+    }
+    if (digitCount == 0) {
+        return false;
+    }
+    
+    int exponent = 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        if (p == end || !isDigit(*p)) {
+            return false;
+        }
+        for (; p < end && isDigit(*p); ++p) {
+            if (exponent < MAX_EXPONENT) {
+                exponent = exponent * 10 + (*p - '0');
+            }
+        }
+        if (negativeExponent) {
+            exponent = -exponent;
+        }
+    }
+    if (p != end) {
+        return false;
+    }
+    
+    // Value in minor units is mantissa * 10^shift
+    int shift = exponent - fractionDigits + 2;
+    uint64_t magnitude;
+    if (mantissa == 0) {
+        magnitude = 0;
+    } else if (shift >= 0) {
+        if (shift > 19 || mantissa > MAX_MANTISSA / POWERS_OF_TEN[shift]) {
+            return false;
+        }
+        magnitude = mantissa * POWERS_OF_TEN[shift];
+    } else if (-shift > 19) {
+        magnitude = 0;
+    } else {
+        uint64_t divisor = POWERS_OF_TEN[-shift];
+        magnitude = mantissa / divisor;
+        if (mantissa % divisor >= (divisor + 1) / 2) {
+            ++magnitude;
+        }
+    }
+    
+    if (magnitude > static_cast<uint64_t>(MAX_MINOR_UNITS)) {
+        return false;
+    }
+    
+    int64_t value = static_cast<int64_t>(magnitude);
+    money.minorUnits = negative ? -value : value;
+    return true;
+}
+
+bool Money::parse(const std::string& text, Money& money) {
+    return parse(text.data(), text.data() + text.size(), money);
+}
+
+int64_t Money::getMinorUnits() const {
+    return minorUnits;
+}
+
+double Money::toDouble() const {
+    return static_cast<double>(minorUnits) / MINOR_UNITS_PER_POINT;
+}
+
+size_t Money::format(char* buffer) const {
+    bool negative = minorUnits < 0;
+    uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(minorUnits) : static_cast<uint64_t>(minorUnits);
+    uint64_t points = magnitude / MINOR_UNITS_PER_POINT;
+    unsigned cents = static_cast<unsigned>(magnitude % MINOR_UNITS_PER_POINT);
+    
+    // Digits are produced right to left
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + points % 10);
+        points /= 10;
+    } while (points > 0);
+    
+    size_t length = 0;
+    if (negative) {
+        buffer[length++] = '-';
+    }
+    while (count > 0) {
+        buffer[length++] = digits[--count];
+    }
+    if (cents != 0) {
+        buffer[length++] = '.';
+        buffer[length++] = static_cast<char>('0' + cents / 10);
+        buffer[length++] = static_cast<char>('0' + cents % 10);
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+std::string Money::toString() const {
+    char buffer[32];
+    size_t length = format(buffer);
+    return std::string(buffer, length);
+}
+
+bool Money::isZero() const {
+    return minorUnits == 0;
+}
+
+bool Money::isPositive() const {
+    return minorUnits > 0;
+}
+
+bool Money::isNegative() const {
+    return minorUnits < 0;
+}
+
+bool Money::tryAdd(const Money& amount) {
+    if ((amount.minorUnits > 0 && minorUnits > MAX_MINOR_UNITS - amount.minorUnits) ||
+        (amount.minorUnits < 0 && minorUnits < MIN_MINOR_UNITS - amount.minorUnits)) {
+        return false;
+    }
+    minorUnits += amount.minorUnits;
+    return true;
+}
+
+bool Money::trySubtract(const Money& amount) {
+    if ((amount.minorUnits < 0 && minorUnits > MAX_MINOR_UNITS + amount.minorUnits) ||
+        (amount.minorUnits > 0 && minorUnits < MIN_MINOR_UNITS + amount.minorUnits)) {
+        return false;
+    }
+    minorUnits -= amount.minorUnits;
+    return true;
+}
+
+std::ostream& operator<<(std::ostream& out, const Money& money) {
+    return out << money.toString();
+}
+
+std::istream& operator>>(std::istream& in, Money& money) {
+    std::string token;
+    if (in >> token) {
+        if (!Money::parse(token, money)) {
+            in.setstate(std::ios::failbit);
+        }
+    }
+    return in;
+}
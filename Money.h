@@ -0,0 +1,60 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <string>
+#include <iosfwd>
+#include <stdint.h>
+
+// Exact amount of points stored as an integer number of minor units
+// (1 point = 100 minor units). Arithmetic is checked: tryAdd/trySubtract
+// refuse to overflow instead of wrapping or losing precision.
+class Money {
+private:
+    int64_t minorUnits;
+
+public:
+    static const int64_t MINOR_UNITS_PER_POINT = 100;
+    
+    Money();
+    
+    static Money fromMinorUnits(int64_t minorUnits);
+    // Saturates at the largest or smallest amount instead of overflowing
+    static Money fromPoints(int64_t points);
+    // Rounds to the nearest minor unit; false if out of range
+    static bool fromDouble(double value, Money& money);
+    
+    // Parses "123", "-4.5", "0.25" and legacy exponent forms such as "1e+006".
+    // Digits beyond the second decimal are rounded half away from zero.
+    // Leaves money unchanged and returns false on malformed or out-of-range input.
+    static bool parse(const char* begin, const char* end, Money& money);
+    static bool parse(const std::string& text, Money& money);
+    
+    int64_t getMinorUnits() const;
+    double toDouble() const;
+    
+    // "1000", "12.50", "-0.05": whole amounts are printed without decimals
+    std::string toString() const;
+    // Writes toString() into buffer (at least 24 bytes); returns the length
+    size_t format(char* buffer) const;
+    
+    bool isZero() const;
+    bool isPositive() const;
+    bool isNegative() const;
+    
+    // Return false and leave the value unchanged on overflow
+    bool tryAdd(const Money& amount);
+    bool trySubtract(const Money& amount);
+    
+    bool operator==(const Money& other) const { return minorUnits == other.minorUnits; }
+    bool operator!=(const Money& other) const { return minorUnits != other.minorUnits; }
+    bool operator<(const Money& other) const { return minorUnits < other.minorUnits; }
+    bool operator<=(const Money& other) const { return minorUnits <= other.minorUnits; }
+    bool operator>(const Money& other) const { return minorUnits > other.minorUnits; }
+    bool operator>=(const Money& other) const { return minorUnits >= other.minorUnits; }
+};
+
+std::ostream& operator<<(std::ostream& out, const Money& money);
+// Reads one whitespace-delimited token; sets failbit if it is not an amount
+std::istream& operator>>(std::istream& in, Money& money);
+
+#endif
@@ -0,0 +1,158 @@
+#include "OtpStore.h"
+#include <algorithm>
+
+OtpStore::OtpStore(size_t maxPerUser)
+    : maxPerUser(maxPerUser > 0 ? maxPerUser : 1), nextChallengeId(0) {
+}
+
+OtpStore::Shard& OtpStore::shardFor(const std::string& username) const {
+    // FNV-1a, as for session tokens
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < username.size(); ++i) {
+        hash ^= static_cast<unsigned char>(username[i]);
+        hash *= 16777619u;
+    }
+    return shards[hash % SHARD_COUNT];
+}
+
+bool OtpStore::evictExpired(Shard& shard, time_t now, const std::string& username) {
+    bool userEvicted = false;
+    
+    while (!shard.expiries.empty() && shard.expiries.front().expiresAt <= now) {
+        Expiry expiry = shard.expiries.front();
+        std::pop_heap(shard.expiries.begin(), shard.expiries.end(), LaterExpiry());
+        shard.expiries.pop_back();
+        
+        std::map<std::string, std::vector<OtpChallenge> >::iterator user = shard.challenges.find(expiry.username);
+        if (user == shard.challenges.end()) {
+            continue;
+        }
+        
+        std::vector<OtpChallenge>& pending = user->second;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (pending[i].challengeId == expiry.challengeId) {
+                pending.erase(pending.begin() + i);
+                --shard.liveCount;
+                userEvicted = userEvicted || expiry.username == username;
+                break;
+            }
+        }
+        if (pending.empty()) {
+            shard.challenges.erase(user);
+        }
+    }
+    
+    return userEvicted;
+}
+
+void OtpStore::rebuildExpiries(Shard& shard) {
+    shard.expiries.clear();
+    for (std::map<std::string, std::vector<OtpChallenge> >::const_iterator user = shard.challenges.begin();
+         user != shard.challenges.end(); ++user) {
+        for (size_t i = 0; i < user->second.size(); ++i) {
+            Expiry expiry;
+            expiry.expiresAt = user->second[i].expiresAt;
+            expiry.username = user->first;
+            expiry.challengeId = user->second[i].challengeId;
+            shard.expiries.push_back(expiry);
+        }
+    }
+    std::make_heap(shard.expiries.begin(), shard.expiries.end(), LaterExpiry());
+}
+
+uint64_t OtpStore::add(const std::string& username, const std::string& purpose,
+                       const std::string& code, time_t expiresAt) {
+    OtpChallenge challenge;
+    challenge.challengeId = __sync_add_and_fetch(&nextChallengeId, 1);
+    challenge.purpose = purpose;
+    challenge.code = code;
+    challenge.expiresAt = expiresAt;
+    
+    Shard& shard = shardFor(username);
+    ScopedLock lock(shard.lock);
+    evictExpired(shard, time(NULL));
+    
+    std::vector<OtpChallenge>& pending = shard.challenges[username];
+    if (pending.size() >= maxPerUser) {
+        // Its heap entry goes stale and is skipped when it comes due
+        pending.erase(pending.begin());
+        --shard.liveCount;
+    }
+    pending.push_back(challenge);
+    ++shard.liveCount;
+    
+    Expiry expiry;
+    expiry.expiresAt = expiresAt;
+    expiry.username = username;
+    expiry.challengeId = challenge.challengeId;
+    shard.expiries.push_back(expiry);
+    std::push_heap(shard.expiries.begin(), shard.expiries.end(), LaterExpiry());
+    
+    if (shard.expiries.size() > 2 * shard.liveCount + STALE_EXPIRY_SLACK) {
+        rebuildExpiries(shard);
+    }
+    
+    return challenge.challengeId;
+}
+
+OtpCheck OtpStore::consume(const std::string& username, const std::string& purpose, const std::string& code) {
+    Shard& shard = shardFor(username);
+    ScopedLock lock(shard.lock);
+    bool expired = evictExpired(shard, time(NULL), username);
+    
+    std::map<std::string, std::vector<OtpChallenge> >::iterator user = shard.challenges.find(username);
+    if (user == shard.challenges.end()) {
+        return expired ? OTP_EXPIRED : OTP_NO_CHALLENGE;
+    }
+    
+    std::vector<OtpChallenge>& pending = user->second;
+    bool purposePending = purpose.empty();
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (!purpose.empty() && pending[i].purpose != purpose) {
+            continue;
+        }
+        purposePending = true;
+        if (pending[i].code == code) {
+            pending.erase(pending.begin() + i);
+            --shard.liveCount;
+            if (pending.empty()) {
+                shard.challenges.erase(user);
+            }
+            return OTP_ACCEPTED;
+        }
+    }
+    
+    if (!purposePending) {
+        return expired ? OTP_EXPIRED : OTP_NO_CHALLENGE;
+    }
+    return OTP_MISMATCH;
+}
+
+bool OtpStore::peekNewest(const std::string& username, std::string& code) const {
+    Shard& shard = shardFor(username);
+    ScopedLock lock(shard.lock);
+    
+    std::map<std::string, std::vector<OtpChallenge> >::const_iterator user = shard.challenges.find(username);
+    if (user == shard.challenges.end()) {
+        return false;
+    }
+    
+    const std::vector<OtpChallenge>& pending = user->second;
+    time_t now = time(NULL);
+    for (size_t i = pending.size(); i > 0; --i) {
+        if (pending[i - 1].expiresAt > now) {
+            code = pending[i - 1].code;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t OtpStore::getPendingCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        ScopedLock lock(shards[i].lock);
+        count += shards[i].liveCount;
+    }
+    return count;
+}
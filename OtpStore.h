@@ -0,0 +1,96 @@
+#ifndef OTP_STORE_H
+#define OTP_STORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <stdint.h>
+#include "Threading.h"
+
+// A pending one-time code, identified by (user, purpose, challengeId)
+struct OtpChallenge {
+    uint64_t challengeId;
+    std::string purpose;
+    std::string code;
+    time_t expiresAt;
+    
+    OtpChallenge() : challengeId(0), expiresAt(0) {}
+};
+
+enum OtpCheck {
+    OTP_ACCEPTED,       // Matched and consumed
+    OTP_NO_CHALLENGE,   // Nothing pending for the user (and purpose)
+    OTP_EXPIRED,        // The user's pending codes had expired
+    OTP_MISMATCH        // Pending, but no code matched
+};
+
+// Pending OTP challenges of all users.
+//
+// A user can hold several challenges at once (a transfer OTP no longer
+// replaces a profile-update one); past maxPerUser the oldest is dropped.
+// Users are spread over independently locked shards, and each shard keeps a
+// min-heap of expiry times so expired challenges are evicted in deadline
+// order as the shard is used, without scanning. Heap entries of challenges
+// that were consumed or dropped early are skipped when they come due, and
+// the heap is rebuilt once they outnumber the live ones, so memory stays
+// proportional to the pending challenges.
+class OtpStore {
+private:
+    static const size_t SHARD_COUNT = 16;
+    static const size_t STALE_EXPIRY_SLACK = 64;
+    
+    struct Expiry {
+        time_t expiresAt;
+        std::string username;
+        uint64_t challengeId;
+    };
+    
+    // Orders the heap so the earliest expiry is on top
+    struct LaterExpiry {
+        bool operator()(const Expiry& left, const Expiry& right) const {
+            return left.expiresAt > right.expiresAt;
+        }
+    };
+    
+    struct Shard {
+        Mutex lock;
+        std::map<std::string, std::vector<OtpChallenge> > challenges;   // Per user, oldest first
+        std::vector<Expiry> expiries;
+        size_t liveCount;
+        
+        Shard() : liveCount(0) {}
+    };
+    
+    mutable Shard shards[SHARD_COUNT];
+    size_t maxPerUser;
+    uint64_t nextChallengeId;
+    
+    OtpStore(const OtpStore&);
+    OtpStore& operator=(const OtpStore&);
+    
+    Shard& shardFor(const std::string& username) const;
+    // Caller holds the shard lock; true if one of username's challenges was evicted
+    bool evictExpired(Shard& shard, time_t now, const std::string& username = "");
+    static void rebuildExpiries(Shard& shard);
+
+public:
+    static const size_t DEFAULT_MAX_PER_USER = 8;
+    
+    explicit OtpStore(size_t maxPerUser = DEFAULT_MAX_PER_USER);
+    
+    // Returns the new challenge's ID
+    uint64_t add(const std::string& username, const std::string& purpose,
+                 const std::string& code, time_t expiresAt);
+    
+    // Consumes the user's pending challenge with this code. With a purpose,
+    // only a challenge issued for exactly that purpose can match.
+    OtpCheck consume(const std::string& username, const std::string& purpose, const std::string& code);
+    
+    // Newest pending code of a user, left in place (for local load-test clients)
+    bool peekNewest(const std::string& username, std::string& code) const;
+    
+    size_t getPendingCount() const;
+};
+
+#endif
@@ -0,0 +1,371 @@
+#include "PersistenceBench.h"
+#include "DataManager.h"
+#include "IdGenerator.h"
+#include "FileUtils.h"
+#include "Clock.h"
+#include <iostream>
+#include <sstream>
+#include <ctime>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601
+#endif
+#define PSAPI_VERSION 2   // GetProcessMemoryInfo from kernel32, no psapi.lib
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static const char* BENCH_DATA_DIR = "data/bench/";
+static const uint64_t GENERATOR_SEED = 0x2545F4914F6CDD1DULL;
+static const time_t FIRST_TIMESTAMP = 1704067200;   // 2024-01-01 UTC
+static const size_t TRANSACTIONS_PER_WALLET = 10;
+static const size_t MIN_WALLETS = 16;
+static const size_t DEPOSIT_INTERVAL = 20;          // Every 20th transaction is an admin deposit
+static const size_t FAILED_INTERVAL = 50;           // Every 50th transfer fails
+static const time_t FAILED_BACKDATE = 31 * 86400;   // and is dated a month earlier
+static const size_t WALLET_QUERIES = 10000;
+static const size_t INCREMENTAL_SAVES = 200;
+
+// xorshift64*: the same seed always produces the same store
+struct BenchRandom {
+    uint64_t state;
+    
+    explicit BenchRandom(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    
+    // Cube of a uniform draw: the first 1% of indexes take about a fifth of
+    // the picks, the first 10% almost half
+    size_t skewed(size_t count) {
+        double unit = (next() >> 11) * (1.0 / 9007199254740992.0);
+        size_t index = static_cast<size_t>(count * unit * unit * unit);
+        return index < count ? index : count - 1;
+    }
+};
+
+struct PhaseResult {
+    std::string name;
+    size_t operations;
+    uint64_t micros;
+    std::vector<uint64_t> latencies;   // Per operation, when the phase runs many
+    size_t peakResidentBytes;
+    size_t bytesWritten;               // Text data files rewritten by the phase
+    size_t systemCalls;                // File system calls made rewriting them
+    bool succeeded;
+    
+    PhaseResult() : operations(0), micros(0), peakResidentBytes(0), bytesWritten(0), systemCalls(0), succeeded(true) {}
+};
+
+// High-water mark of the process's resident memory
+static size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static std::string benchUsername(size_t index) {
+    std::ostringstream name;
+    name << "bench" << index;
+    return name.str();
+}
+
+static void finishPhase(PhaseResult& phase, uint64_t start) {
+    phase.micros = monotonicMicros() - start;
+    phase.peakResidentBytes = peakResidentBytes();
+    std::cerr << "  " << phase.name << ": " << phase.micros / 1000 << " ms"
+              << (phase.succeeded ? "" : " (FAILED)") << std::endl;
+}
+
+// Users, wallets and transactions straight into the store; wallet IDs are returned in index order,
+// with how many transactions each one takes part in
+static void generateStore(DataManager& store, size_t transactionCount, std::vector<Id128>& wallets,
+                          std::vector<size_t>& walletTransactionCounts) {
+    static const char* DESCRIPTIONS[] = { "Payment", "Refund", "Groceries", "Rent share", "Gift", "Invoice 2024" };
+    BenchRandom random(GENERATOR_SEED);
+    size_t walletCount = std::max(MIN_WALLETS, transactionCount / TRANSACTIONS_PER_WALLET);
+    uint64_t firstMillis = static_cast<uint64_t>(FIRST_TIMESTAMP) * 1000;
+    
+    wallets.reserve(walletCount);
+    for (size_t i = 0; i < walletCount; ++i) {
+        std::string username = benchUsername(i);
+        std::ostringstream passwordHash, phone;
+        passwordHash << std::hex << random.next();
+        phone << "09" << (10000000 + i % 90000000);
+        store.saveUser(User(username, passwordHash.str(), "Bench User " + username.substr(5),
+                            username + "@example.com", phone.str()));
+        
+        Id128 walletId = IdGenerator::compose(firstMillis + i, static_cast<uint32_t>(i), 0, random.next());
+        store.saveWallet(Wallet(walletId, username, Money::fromPoints(1000)));
+        wallets.push_back(walletId);
+    }
+    walletTransactionCounts.assign(walletCount, 0);
+    
+    // Timestamps advance by 0-2 s, so a transaction's ID and timestamp agree like real ones
+    time_t timestamp = FIRST_TIMESTAMP + static_cast<time_t>(walletCount / 1000 + 1);
+    for (size_t i = 0; i < transactionCount; ++i) {
+        timestamp += static_cast<time_t>(random.next() % 3);
+        uint64_t millisPart = random.next() % 1000;
+        uint64_t idRandom = random.next();
+        
+        size_t receiver = random.skewed(walletCount);
+        Id128 senderId = Id128::systemWallet();
+        if (i % DEPOSIT_INTERVAL != 0) {
+            size_t sender = random.skewed(walletCount);
+            if (sender == receiver) {
+                sender = (sender + 1) % walletCount;
+            }
+            senderId = wallets[sender];
+            walletTransactionCounts[sender]++;
+        }
+        walletTransactionCounts[receiver]++;
+        
+        // A failed transfer is alone in its month, where no history lists it:
+        // only the segment itself can say which wallets it involves
+        bool failed = senderId != Id128::systemWallet() && i % FAILED_INTERVAL == 1;
+        time_t transactionTime = failed ? timestamp - FAILED_BACKDATE : timestamp;
+        uint64_t millis = static_cast<uint64_t>(transactionTime) * 1000 + millisPart;
+        Id128 transactionId = IdGenerator::compose(millis, static_cast<uint32_t>(i), 1, idRandom);
+        
+        Transaction transaction(transactionId, senderId, wallets[receiver],
+                                Money::fromMinorUnits(100 + static_cast<int64_t>(random.next() % 500000)),
+                                senderId == Id128::systemWallet() ? "Admin deposit" :
+                                DESCRIPTIONS[random.next() % (sizeof(DESCRIPTIONS) / sizeof(DESCRIPTIONS[0]))]);
+        transaction.setTimestamp(transactionTime);
+        transaction.setStatus(failed ? FAILED : COMPLETED);
+        transaction.setIsSuccessful(!failed);
+        store.saveTransaction(transaction);
+        
+        // Like executeTransfer: a failed transfer is in neither wallet's history
+        if (failed) {
+            continue;
+        }
+        
+        // Single-threaded: nothing else touches the wallets, so no stripe is taken
+        if (senderId != Id128::systemWallet()) {
+            store.getWallet(senderId)->addTransactionToHistory(transactionId);
+        }
+        store.getWallet(wallets[receiver])->addTransactionToHistory(transactionId);
+    }
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    return sorted.empty() ? 0 : sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+static void printJson(const std::vector<PhaseResult>& phases, size_t users, size_t wallets, size_t transactions) {
+    std::cout << "{\n"
+              << "  \"benchmark\": \"persistence\",\n"
+              << "  \"seed\": \"0x" << std::hex << GENERATOR_SEED << std::dec << "\",\n"
+              << "  \"users\": " << users << ",\n"
+              << "  \"wallets\": " << wallets << ",\n"
+              << "  \"transactions\": " << transactions << ",\n"
+              << "  \"phases\": [\n";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const PhaseResult& phase = phases[i];
+        double seconds = phase.micros / 1000000.0;
+        std::cout << "    {\"name\": \"" << phase.name << "\""
+                  << ", \"ok\": " << (phase.succeeded ? "true" : "false")
+                  << ", \"operations\": " << phase.operations
+                  << ", \"seconds\": " << seconds
+                  << ", \"per_second\": " << (seconds > 0 ? phase.operations / seconds : 0);
+        if (!phase.latencies.empty()) {
+            std::vector<uint64_t> sorted(phase.latencies);
+            std::sort(sorted.begin(), sorted.end());
+            std::cout << ", \"p50_us\": " << percentile(sorted, 0.50)
+                      << ", \"p99_us\": " << percentile(sorted, 0.99)
+                      << ", \"max_us\": " << sorted.back();
+        }
+        if (phase.systemCalls > 0) {
+            std::cout << ", \"bytes_written\": " << phase.bytesWritten
+                      << ", \"syscalls\": " << phase.systemCalls;
+        }
+        std::cout << ", \"peak_rss_bytes\": " << phase.peakResidentBytes << "}"
+                  << (i + 1 < phases.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+}
+
+int runPersistenceBenchmark(size_t transactionCount) {
+    std::vector<PhaseResult> phases;
+    std::vector<Id128> wallets;
+    std::vector<size_t> walletTransactionCounts;
+    size_t recordCount = 0;
+    
+    removeDirectoryTree(BENCH_DATA_DIR);
+    std::cerr << "Persistence benchmark: " << transactionCount << " transactions in " << BENCH_DATA_DIR << std::endl;
+    
+    {
+        DataManager store(BENCH_DATA_DIR);
+        
+        PhaseResult generate;
+        generate.name = "generate";
+        uint64_t start = monotonicMicros();
+        generateStore(store, transactionCount, wallets, walletTransactionCounts);
+        recordCount = 2 * wallets.size() + transactionCount;
+        generate.operations = recordCount;
+        finishPhase(generate, start);
+        phases.push_back(generate);
+        
+        PhaseResult save;
+        save.name = "save";
+        save.operations = recordCount;
+        start = monotonicMicros();
+        save.succeeded = store.checkpoint();
+        finishPhase(save, start);
+        save.bytesWritten = store.getLastFlushStats().bytesWritten;
+        save.systemCalls = store.getLastFlushStats().fileSystemCalls;
+        phases.push_back(save);
+        
+        // Everything is on disk; the destructor must not write again
+        store.setPersistenceMode(IN_MEMORY);
+    }
+    
+    {
+        // Users, wallets and the hot months; older months stay on disk
+        DataManager store(BENCH_DATA_DIR);
+        
+        PhaseResult loadHot;
+        loadHot.name = "load_hot";
+        loadHot.operations = 2 * wallets.size();
+        uint64_t start = monotonicMicros();
+        loadHot.succeeded = store.loadData();
+        finishPhase(loadHot, start);
+        phases.push_back(loadHot);
+        
+        // Every transaction, the cold months read from their segments
+        PhaseResult loadCold;
+        loadCold.name = "load_cold";
+        loadCold.operations = transactionCount;
+        start = monotonicMicros();
+        size_t found = store.getTransactionsInRange(0, time(NULL) + 86400).size();
+        if (found != transactionCount) {
+            std::cerr << "  " << found << " of " << transactionCount << " transactions read back" << std::endl;
+            loadCold.succeeded = false;
+        }
+        finishPhase(loadCold, start);
+        phases.push_back(loadCold);
+        
+        store.setPersistenceMode(IN_MEMORY);
+    }
+    
+    {
+        // A fresh store, so the queries find the cold months still unread
+        DataManager store(BENCH_DATA_DIR);
+        bool reloaded = store.loadData();
+        
+        // Drawn from the same skew as the traffic, so hot wallets are queried most
+        BenchRandom random(GENERATOR_SEED ^ 0xA5A5A5A5A5A5A5A5ULL);
+        PhaseResult query;
+        query.name = "wallet_query";
+        query.succeeded = reloaded;
+        query.operations = WALLET_QUERIES;
+        query.latencies.reserve(WALLET_QUERIES);
+        size_t returned = 0;
+        size_t incomplete = 0;
+        uint64_t start = monotonicMicros();
+        for (size_t i = 0; i < WALLET_QUERIES; ++i) {
+            size_t wallet = random.skewed(wallets.size());
+            uint64_t queryStart = monotonicMicros();
+            size_t found = store.getTransactionsByWallet(wallets[wallet]).size();
+            query.latencies.push_back(monotonicMicros() - queryStart);
+            
+            // Failed transfers are in no history, and months this old are cold: they
+            // still have to be found
+            returned += found;
+            if (found != walletTransactionCounts[wallet]) {
+                ++incomplete;
+            }
+        }
+        if (incomplete > 0) {
+            std::cerr << "  " << incomplete << " wallet queries missed transactions" << std::endl;
+            query.succeeded = false;
+        }
+        finishPhase(query, start);
+        phases.push_back(query);
+        std::cerr << "  (" << returned / WALLET_QUERIES << " transactions per query on average)" << std::endl;
+        
+        // One transfer's records per save: what each journaled saveData() costs
+        PhaseResult incremental;
+        incremental.name = "save_incremental";
+        incremental.operations = INCREMENTAL_SAVES;
+        incremental.latencies.reserve(INCREMENTAL_SAVES);
+        start = monotonicMicros();
+        for (size_t i = 0; i < INCREMENTAL_SAVES; ++i) {
+            size_t sender = random.skewed(wallets.size());
+            size_t receiver = (sender + 1 + random.skewed(wallets.size() - 1)) % wallets.size();
+            Money amount = Money::fromMinorUnits(1);
+            
+            Wallet* senderWallet = store.getWallet(wallets[sender]);
+            Wallet* receiverWallet = store.getWallet(wallets[receiver]);
+            if (!senderWallet || !receiverWallet || !senderWallet->deductPoints(amount)) {
+                incremental.succeeded = false;
+                continue;
+            }
+            receiverWallet->addPoints(amount);
+            Id128 transactionId = store.createTransaction(wallets[sender], wallets[receiver], amount, "Bench", COMPLETED);
+            senderWallet->addTransactionToHistory(transactionId);
+            receiverWallet->addTransactionToHistory(transactionId);
+            store.saveWallet(*senderWallet);
+            store.saveWallet(*receiverWallet);
+            
+            uint64_t saveStart = monotonicMicros();
+            incremental.succeeded = store.saveData() && incremental.succeeded;
+            incremental.latencies.push_back(monotonicMicros() - saveStart);
+        }
+        finishPhase(incremental, start);
+        phases.push_back(incremental);
+        
+        PhaseResult backup;
+        backup.name = "backup";
+        backup.operations = recordCount;
+        start = monotonicMicros();
+        backup.succeeded = store.createBackup();
+        finishPhase(backup, start);
+        phases.push_back(backup);
+        
+        // Nothing changed since: every chunk is already stored
+        PhaseResult unchanged;
+        unchanged.name = "backup_unchanged";
+        unchanged.operations = recordCount;
+        start = monotonicMicros();
+        unchanged.succeeded = store.createBackup();
+        finishPhase(unchanged, start);
+        phases.push_back(unchanged);
+        
+        store.setPersistenceMode(IN_MEMORY);
+    }
+    
+    removeDirectoryTree(BENCH_DATA_DIR);
+    printJson(phases, wallets.size(), wallets.size(), transactionCount);
+    
+    for (size_t i = 0; i < phases.size(); ++i) {
+        if (!phases[i].succeeded) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef PERSISTENCE_BENCH_H
+#define PERSISTENCE_BENCH_H
+
+#include <cstddef>
+
+// Persistence benchmark on a generated store in data/bench/ (data/ itself is not touched).
+//
+// A fixed-seed generator creates transactionCount transactions between about a
+// tenth as many wallets, one user each. Senders and receivers are skewed: a
+// few hot wallets take a large share of the traffic and the rest form a long
+// tail. Every 50th transfer fails, is dated a month earlier and, as in the
+// wallet manager, stays out of the wallet histories. The store is then
+// checkpointed and loaded back: load_hot times loadData() (users, wallets and
+// the hot months), load_cold the reading of every older month from its
+// segment. A fresh store is then queried per wallet (each query must return
+// every transaction of the wallet, failed ones included), saved after single
+// transfers and backed up. Each phase's throughput, latency percentiles (where
+// it runs many operations) and the peak resident set so far are printed as
+// JSON on stdout, with the bytes and file system calls of the checkpoint;
+// progress goes to stderr.
+// Returns 0 if every phase succeeded.
+int runPersistenceBenchmark(size_t transactionCount);
+
+#endif
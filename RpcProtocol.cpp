@@ -0,0 +1,95 @@
+#include "RpcProtocol.h"
+
+static void appendUint16(std::string& out, uint32_t value) {
+    out += static_cast<char>((value >> 8) & 0xFF);
+    out += static_cast<char>(value & 0xFF);
+}
+
+static void appendUint32(std::string& out, uint32_t value) {
+    out += static_cast<char>((value >> 24) & 0xFF);
+    out += static_cast<char>((value >> 16) & 0xFF);
+    out += static_cast<char>((value >> 8) & 0xFF);
+    out += static_cast<char>(value & 0xFF);
+}
+
+static uint32_t readUint16(const unsigned char* data) {
+    return (static_cast<uint32_t>(data[0]) << 8) | data[1];
+}
+
+static uint32_t readUint32(const unsigned char* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+bool RpcCodec::encode(const RpcMessage& message, std::string& out) {
+    if (message.fields.size() > 0xFFFF) {
+        return false;
+    }
+    
+    size_t length = 7;
+    for (size_t i = 0; i < message.fields.size(); ++i) {
+        if (message.fields[i].size() > 0xFFFF) {
+            return false;
+        }
+        length += 2 + message.fields[i].size();
+    }
+    if (length > MAX_FRAME_SIZE) {
+        return false;
+    }
+    
+    out.reserve(out.size() + 4 + length);
+    appendUint32(out, static_cast<uint32_t>(length));
+    out += static_cast<char>(message.code);
+    appendUint32(out, message.requestId);
+    appendUint16(out, static_cast<uint32_t>(message.fields.size()));
+    for (size_t i = 0; i < message.fields.size(); ++i) {
+        appendUint16(out, static_cast<uint32_t>(message.fields[i].size()));
+        out += message.fields[i];
+    }
+    return true;
+}
+
+int RpcCodec::decode(const std::string& buffer, size_t& offset, RpcMessage& message) {
+    if (buffer.size() - offset < 4) {
+        return 0;
+    }
+    
+    const unsigned char* frame = reinterpret_cast<const unsigned char*>(buffer.data() + offset);
+    uint32_t length = readUint32(frame);
+    if (length < 7 || length > MAX_FRAME_SIZE) {
+        return -1;
+    }
+    if (buffer.size() - offset - 4 < length) {
+        return 0;
+    }
+    
+    const unsigned char* data = frame + 4;
+    const unsigned char* end = data + length;
+    message.code = data[0];
+    message.requestId = readUint32(data + 1);
+    uint32_t fieldCount = readUint16(data + 5);
+    data += 7;
+    
+    message.fields.clear();
+    message.fields.reserve(fieldCount);
+    for (uint32_t i = 0; i < fieldCount; ++i) {
+        if (end - data < 2) {
+            return -1;
+        }
+        uint32_t fieldLength = readUint16(data);
+        data += 2;
+        if (static_cast<uint32_t>(end - data) < fieldLength) {
+            return -1;
+        }
+        message.fields.push_back(std::string(reinterpret_cast<const char*>(data), fieldLength));
+        data += fieldLength;
+    }
+    
+    // Trailing bytes inside a frame mean the two sides disagree on the format
+    if (data != end) {
+        return -1;
+    }
+    
+    offset += 4 + length;
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef RPC_PROTOCOL_H
+#define RPC_PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Wire format of the local RPC server (all integers big-endian):
+//
+//   frame     uint32 length, then `length` bytes of message
+//   message   uint8 code, uint32 requestId, uint16 fieldCount, fields
+//   field     uint16 length, then the bytes
+//
+// In a request the code is an RpcOpcode, in a response an RpcStatus. The
+// requestId is chosen by the client and echoed back, so a client may pipeline
+// requests and match the responses, which can arrive out of order. Every
+// field is text: IDs in their 36-character form, amounts as decimal points.
+enum RpcOpcode {
+    RPC_PING = 0,               // -> (none)
+    RPC_LOGIN = 1,              // username, password -> token, role, walletId
+    RPC_LOGOUT = 2,             // token -> (none)
+    RPC_BALANCE = 3,            // token -> walletId, balance
+    RPC_INITIATE_TRANSFER = 4,  // token, receiverWalletId, amount, description -> [otp]
+    RPC_CONFIRM_TRANSFER = 5,   // token, receiverWalletId, amount, otp, description -> (none)
+    RPC_HISTORY = 6,            // token, [limit] -> 7 fields per transaction, newest first
+    RPC_REQUEST_OTP = 7,        // token, purpose -> [otp]
+    RPC_ADMIN_DEPOSIT = 8       // token, walletId, amount, otp (purpose admin_add_funds) -> balance
+};
+
+enum RpcStatus {
+    RPC_OK = 0,
+    RPC_FAILED = 1,        // The operation was refused; field 0 says why
+    RPC_UNAUTHORIZED = 2,  // Unknown or expired session, or wrong credentials
+    RPC_BAD_REQUEST = 3,   // Unknown opcode or malformed fields
+    RPC_NOT_DURABLE = 4    // Applied, but not yet written to disk: do not retry it
+};
+
+struct RpcMessage {
+    uint8_t code;
+    uint32_t requestId;
+    std::vector<std::string> fields;
+    
+    RpcMessage() : code(0), requestId(0) {}
+};
+
+class RpcCodec {
+public:
+    // Larger frames are treated as a protocol error
+    static const uint32_t MAX_FRAME_SIZE = 1024 * 1024;
+    
+    // Append one frame holding message to out
+    static bool encode(const RpcMessage& message, std::string& out);
+    
+    // Decode the frame starting at buffer[offset]. Returns 1 and advances
+    // offset past it, 0 if the frame is not complete yet, -1 if it is malformed.
+    static int decode(const std::string& buffer, size_t& offset, RpcMessage& message);
+};
+
+#endif
@@ -0,0 +1,651 @@
+#include "RpcServer.h"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstring>
+#endif
+
+static const size_t DEFAULT_HISTORY_LIMIT = 50;
+
+static void setFailure(RpcMessage& response, RpcStatus status, const std::string& reason) {
+    response.code = status;
+    response.fields.clear();
+    response.fields.push_back(reason);
+}
+
+RpcServer::RpcServer(AccountSystem& system, const RpcServerConfig& config)
+    : system(system), config(config), listenFd(-1), epollFd(-1), wakeFd(-1),
+      stopRequested(false), nextConnectionId(1), workersStopping(false) {}
+
+RpcServer::~RpcServer() {
+    closeSockets();
+}
+
+void RpcServer::execute(const RpcMessage& request, RpcMessage& response) {
+    response.code = RPC_OK;
+    response.fields.clear();
+    
+    if (request.code == RPC_PING) {
+        return;
+    }
+    
+    if (request.code == RPC_LOGIN) {
+        if (request.fields.size() != 2) {
+            setFailure(response, RPC_BAD_REQUEST, "Expected username and password");
+            return;
+        }
+        SessionToken token = system.openSession(request.fields[0], request.fields[1]);
+        Session session;
+        if (token.empty() || !system.getSession(token, session)) {
+            setFailure(response, RPC_UNAUTHORIZED, "Invalid username or password");
+            return;
+        }
+        response.fields.push_back(token);
+        response.fields.push_back(session.isAdmin() ? "admin" : "user");
+        response.fields.push_back(session.walletId.isNil() ? "" : session.walletId.toString());
+        return;
+    }
+    
+    // Everything else runs on behalf of a session
+    if (request.fields.empty()) {
+        setFailure(response, RPC_BAD_REQUEST, "Missing session token");
+        return;
+    }
+    const SessionToken& token = request.fields[0];
+    if (!system.isLoggedIn(token)) {
+        setFailure(response, RPC_UNAUTHORIZED, "Unknown or expired session");
+        return;
+    }
+    
+    switch (request.code) {
+        case RPC_LOGOUT: {
+            system.closeSession(token);
+            return;
+        }
+        
+        case RPC_BALANCE: {
+            Wallet* wallet = system.getSessionWallet(token);
+            if (!wallet) {
+                setFailure(response, RPC_FAILED, "No wallet found");
+                return;
+            }
+            Id128 walletId = wallet->getWalletId();
+            response.fields.push_back(walletId.toString());
+            response.fields.push_back(system.getWalletBalance(walletId).toString());
+            return;
+        }
+        
+        case RPC_REQUEST_OTP: {
+            if (request.fields.size() != 2) {
+                setFailure(response, RPC_BAD_REQUEST, "Expected token and purpose");
+                return;
+            }
+            std::string username = system.getSessionUser(token);
+            if (!system.generateOTP(username, request.fields[1])) {
+                setFailure(response, RPC_FAILED, "Could not generate OTP");
+                return;
+            }
+            std::string otpCode;
+            if (config.exposeOtp && system.getAuthManager().peekOTP(username, otpCode)) {
+                response.fields.push_back(otpCode);
+            }
+            return;
+        }
+        
+        case RPC_INITIATE_TRANSFER:
+        case RPC_CONFIRM_TRANSFER: {
+            bool confirming = request.code == RPC_CONFIRM_TRANSFER;
+            if (request.fields.size() != (confirming ? 5u : 4u)) {
+                setFailure(response, RPC_BAD_REQUEST, "Wrong number of fields");
+                return;
+            }
+            Id128 receiverWalletId;
+            Money amount;
+            if (!Id128::fromString(request.fields[1], receiverWalletId) ||
+                !Money::parse(request.fields[2], amount)) {
+                setFailure(response, RPC_BAD_REQUEST, "Invalid wallet ID or amount");
+                return;
+            }
+            
+            if (confirming) {
+                TransferResult result = system.confirmTransfer(token, receiverWalletId, amount,
+                                                               request.fields[3], request.fields[4]);
+                if (result == TRANSFER_REJECTED) {
+                    setFailure(response, RPC_FAILED, "Transfer failed");
+                } else if (result == TRANSFER_NOT_DURABLE) {
+                    setFailure(response, RPC_NOT_DURABLE, "Transfer applied but not yet written to disk");
+                }
+                return;
+            }
+            
+            if (!system.initiateTransfer(token, receiverWalletId, amount, request.fields[3])) {
+                setFailure(response, RPC_FAILED, "Transfer could not be initiated");
+                return;
+            }
+            std::string otpCode;
+            if (config.exposeOtp &&
+                system.getAuthManager().peekOTP(system.getSessionUser(token), otpCode)) {
+                response.fields.push_back(otpCode);
+            }
+            return;
+        }
+        
+        case RPC_HISTORY: {
+            size_t limit = DEFAULT_HISTORY_LIMIT;
+            if (request.fields.size() > 2) {
+                setFailure(response, RPC_BAD_REQUEST, "Expected token and optional limit");
+                return;
+            }
+            if (request.fields.size() == 2) {
+                char* end = NULL;
+                unsigned long value = std::strtoul(request.fields[1].c_str(), &end, 10);
+                if (request.fields[1].empty() || *end != '\0') {
+                    setFailure(response, RPC_BAD_REQUEST, "Invalid limit");
+                    return;
+                }
+                limit = static_cast<size_t>(value);
+            }
+            
+            Wallet* wallet = system.getSessionWallet(token);
+            if (!wallet) {
+                setFailure(response, RPC_FAILED, "No wallet found");
+                return;
+            }
+            std::vector<Transaction> transactions = system.getTransactionHistory(wallet->getWalletId());
+            
+            // Stored oldest first
+            size_t count = 0;
+            for (std::vector<Transaction>::reverse_iterator it = transactions.rbegin();
+                 it != transactions.rend() && count < limit; ++it, ++count) {
+                std::ostringstream timestamp;
+                timestamp << it->getTimestamp();
+                response.fields.push_back(it->getTransactionId().toString());
+                response.fields.push_back(it->getSenderWalletId().toString());
+                response.fields.push_back(it->getReceiverWalletId().toString());
+                response.fields.push_back(it->getAmount().toString());
+                response.fields.push_back(timestamp.str());
+                response.fields.push_back(it->getStatusString());
+                response.fields.push_back(it->getDescription());
+            }
+            return;
+        }
+        
+        case RPC_ADMIN_DEPOSIT: {
+            if (request.fields.size() != 4) {
+                setFailure(response, RPC_BAD_REQUEST, "Expected token, wallet ID, amount and OTP");
+                return;
+            }
+            Id128 walletId;
+            Money amount;
+            if (!Id128::fromString(request.fields[1], walletId) ||
+                !Money::parse(request.fields[2], amount)) {
+                setFailure(response, RPC_BAD_REQUEST, "Invalid wallet ID or amount");
+                return;
+            }
+            TransferResult result = system.adminAddFundsToWallet(token, walletId, amount, request.fields[3]);
+            if (result == TRANSFER_REJECTED) {
+                setFailure(response, RPC_FAILED, "Deposit failed");
+                return;
+            }
+            if (result == TRANSFER_NOT_DURABLE) {
+                setFailure(response, RPC_NOT_DURABLE, "Deposit applied but not yet written to disk");
+                return;
+            }
+            response.fields.push_back(system.getWalletBalance(walletId).toString());
+            return;
+        }
+        
+        default:
+            setFailure(response, RPC_BAD_REQUEST, "Unknown opcode");
+            return;
+    }
+}
+
+#ifdef __linux__
+
+static const int MAX_EVENTS = 64;
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+// Written by the signal handler; the loop checks it after every wakeup
+static volatile sig_atomic_t signalStop = 0;
+static int signalWakeFd = -1;
+
+static void handleStopSignal(int) {
+    signalStop = 1;
+    if (signalWakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(signalWakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    ssize_t ignored = write(fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+bool RpcServer::openSocket() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (config.socketPath.empty() || config.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << config.socketPath << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, config.socketPath.c_str());
+    
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    
+    // A socket file left behind by an earlier run would make bind fail
+    unlink(config.socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << config.socketPath << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        std::cerr << "Cannot set up event loop: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+        return false;
+    }
+    event.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void RpcServer::closeSockets() {
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->first);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(config.socketPath.c_str());
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+    if (wakeFd >= 0) {
+        if (signalWakeFd == wakeFd) {
+            signalWakeFd = -1;
+        }
+        close(wakeFd);
+        wakeFd = -1;
+    }
+}
+
+void RpcServer::acceptConnections() {
+    for (;;) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        
+        Connection& connection = connections[fd];
+        connection.fd = fd;
+        connection.id = nextConnectionId++;
+        connection.inputOffset = 0;
+        connection.outputOffset = 0;
+        connection.pendingRequests = 0;
+        connection.readPaused = false;
+        connection.events = EPOLLIN;
+        connectionFds[connection.id] = fd;
+    }
+}
+
+bool RpcServer::readConnection(Connection& connection) {
+    char buffer[READ_CHUNK_SIZE];
+    for (;;) {
+        ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            connection.input.append(buffer, static_cast<size_t>(received));
+            if (static_cast<size_t>(received) < sizeof(buffer)) {
+                break;
+            }
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            // Peer closed or failed: responses still in flight are dropped
+            closeConnection(connection.fd);
+            return false;
+        }
+    }
+    return parseRequests(connection);
+}
+
+bool RpcServer::parseRequests(Connection& connection) {
+    size_t parsed = 0;
+    while (connection.pendingRequests < MAX_PENDING_REQUESTS) {
+        Job job;
+        int result = RpcCodec::decode(connection.input, connection.inputOffset, job.request);
+        if (result == 0) {
+            break;
+        }
+        if (result < 0) {
+            std::cerr << "Malformed RPC frame; closing connection " << connection.id << std::endl;
+            closeConnection(connection.fd);
+            return false;
+        }
+        
+        job.connectionId = connection.id;
+        {
+            ScopedLock lock(jobLock);
+            jobs.push_back(job);
+        }
+        ++connection.pendingRequests;
+        ++parsed;
+    }
+    if (parsed == 1) {
+        jobReady.notifyOne();
+    } else if (parsed > 1) {
+        jobReady.notifyAll();
+    }
+    
+    // Drop consumed bytes once they are the bulk of the buffer
+    if (connection.inputOffset > 0 && connection.inputOffset * 2 >= connection.input.size()) {
+        connection.input.erase(0, connection.inputOffset);
+        connection.inputOffset = 0;
+    }
+    
+    connection.readPaused = connection.pendingRequests >= MAX_PENDING_REQUESTS;
+    return updateInterest(connection);
+}
+
+bool RpcServer::flushConnection(Connection& connection) {
+    while (connection.outputOffset < connection.output.size()) {
+        ssize_t sent = send(connection.fd,
+                            connection.output.data() + connection.outputOffset,
+                            connection.output.size() - connection.outputOffset,
+                            MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.outputOffset += static_cast<size_t>(sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeConnection(connection.fd);
+            return false;
+        }
+    }
+    
+    if (connection.outputOffset == connection.output.size()) {
+        connection.output.clear();
+        connection.outputOffset = 0;
+    }
+    return updateInterest(connection);
+}
+
+bool RpcServer::updateInterest(Connection& connection) {
+    uint32_t wanted = 0;
+    if (!connection.readPaused) {
+        wanted |= EPOLLIN;
+    }
+    if (connection.outputOffset < connection.output.size()) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted == connection.events) {
+        return true;
+    }
+    
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = wanted;
+    event.data.fd = connection.fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event) != 0) {
+        closeConnection(connection.fd);
+        return false;
+    }
+    connection.events = wanted;
+    return true;
+}
+
+void RpcServer::closeConnection(int fd) {
+    std::map<int, Connection>::iterator it = connections.find(fd);
+    if (it == connections.end()) {
+        return;
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    connectionFds.erase(it->second.id);
+    connections.erase(it);
+}
+
+void RpcServer::deliverCompletions() {
+    std::vector<Completion> ready;
+    {
+        ScopedLock lock(completionLock);
+        ready.swap(completions);
+    }
+    
+    // Queue every response first, then write each touched connection once
+    std::map<int, bool> touched;
+    for (size_t i = 0; i < ready.size(); ++i) {
+        std::map<uint64_t, int>::iterator fdIt = connectionFds.find(ready[i].connectionId);
+        if (fdIt == connectionFds.end()) {
+            continue;   // Closed while the request was running
+        }
+        Connection& connection = connections[fdIt->second];
+        connection.output += ready[i].frame;
+        --connection.pendingRequests;
+        touched[connection.fd] = true;
+    }
+    
+    for (std::map<int, bool>::iterator it = touched.begin(); it != touched.end(); ++it) {
+        std::map<int, Connection>::iterator connIt = connections.find(it->first);
+        if (connIt == connections.end()) {
+            continue;
+        }
+        Connection& connection = connIt->second;
+        if (connection.readPaused && connection.pendingRequests < MAX_PENDING_REQUESTS) {
+            // Requests already buffered go first; reading resumes once they fit
+            if (!parseRequests(connection)) {
+                continue;
+            }
+        }
+        flushConnection(connection);
+    }
+}
+
+void RpcServer::workerMain(void* argument) {
+    static_cast<RpcServer*>(argument)->runWorker();
+}
+
+void RpcServer::runWorker() {
+    for (;;) {
+        Job job;
+        {
+            ScopedLock lock(jobLock);
+            while (jobs.empty() && !workersStopping) {
+                jobReady.wait(jobLock);
+            }
+            if (jobs.empty()) {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        
+        RpcMessage response;
+        response.requestId = job.request.requestId;
+        try {
+            execute(job.request, response);
+        } catch (const std::exception& e) {
+            setFailure(response, RPC_FAILED, std::string("Internal error: ") + e.what());
+        }
+        
+        Completion completion;
+        completion.connectionId = job.connectionId;
+        if (!RpcCodec::encode(response, completion.frame)) {
+            setFailure(response, RPC_FAILED, "Response too large");
+            completion.frame.clear();
+            RpcCodec::encode(response, completion.frame);
+        }
+        
+        {
+            ScopedLock lock(completionLock);
+            completions.push_back(completion);
+        }
+        wake(wakeFd);
+    }
+}
+
+bool RpcServer::run() {
+    if (!openSocket()) {
+        closeSockets();
+        return false;
+    }
+    
+    size_t workerCount = config.workerCount > 0 ? config.workerCount : hardwareConcurrency();
+    std::vector<Thread*> workers;
+    workersStopping = false;
+    for (size_t i = 0; i < workerCount; ++i) {
+        Thread* worker = new Thread();
+        if (!worker->start(&RpcServer::workerMain, this)) {
+            delete worker;
+            break;
+        }
+        workers.push_back(worker);
+    }
+    if (workers.empty()) {
+        std::cerr << "Cannot start RPC workers" << std::endl;
+        closeSockets();
+        return false;
+    }
+    
+    signalStop = 0;
+    signalWakeFd = wakeFd;
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigemptyset(&action.sa_mask);
+    struct sigaction previousInt, previousTerm;
+    sigaction(SIGINT, &action, &previousInt);
+    sigaction(SIGTERM, &action, &previousTerm);
+    
+    std::cout << "RPC server listening on " << config.socketPath
+              << " with " << workers.size() << " worker(s)" << std::endl;
+    
+    epoll_event events[MAX_EVENTS];
+    while (!stopRequested && !signalStop) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                deliverCompletions();
+                continue;
+            }
+            
+            std::map<int, Connection>::iterator it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;   // Closed earlier in this batch
+            }
+            Connection& connection = it->second;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                closeConnection(fd);
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) && !readConnection(connection)) {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flushConnection(connection);
+            }
+        }
+    }
+    
+    std::cout << "RPC server stopping" << std::endl;
+    {
+        ScopedLock lock(jobLock);
+        workersStopping = true;
+    }
+    jobReady.notifyAll();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->join();
+        delete workers[i];
+    }
+    
+    sigaction(SIGINT, &previousInt, NULL);
+    sigaction(SIGTERM, &previousTerm, NULL);
+    closeSockets();
+    completions.clear();
+    return true;
+}
+
+void RpcServer::stop() {
+    stopRequested = true;
+    if (wakeFd >= 0) {
+        wake(wakeFd);
+    }
+}
+
+#else
+
+bool RpcServer::run() {
+    std::cerr << "The RPC server needs Linux (epoll and Unix domain sockets)" << std::endl;
+    return false;
+}
+
+void RpcServer::stop() {
+    stopRequested = true;
+}
+
+void RpcServer::closeSockets() {}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include "AccountSystem.h"
+#include "RpcProtocol.h"
+#include "Threading.h"
+
+struct RpcServerConfig {
+    std::string socketPath;
+    size_t workerCount;     // 0: one per processor
+    bool exposeOtp;         // Return OTP codes in responses; for local load tests only
+    
+    RpcServerConfig() : workerCount(0), exposeOtp(false) {}
+};
+
+// Serves AccountSystem over a Unix domain socket (see RpcProtocol.h).
+//
+// One thread runs a non-blocking epoll loop that accepts connections, reads
+// and frames requests and writes responses; a pool of workers executes the
+// requests. Workers hand finished responses back through a queue and wake the
+// loop with an eventfd, so only the loop thread ever touches a socket.
+// Linux only; elsewhere run() reports that the mode is unavailable.
+class RpcServer {
+private:
+    struct Connection {
+        int fd;
+        uint64_t id;
+        std::string input;
+        size_t inputOffset;
+        std::string output;
+        size_t outputOffset;
+        size_t pendingRequests;   // Handed to workers, response not queued yet
+        bool readPaused;          // Too many pending requests: stop reading
+        uint32_t events;          // Registered epoll events
+    };
+    
+    struct Job {
+        uint64_t connectionId;
+        RpcMessage request;
+    };
+    
+    struct Completion {
+        uint64_t connectionId;
+        std::string frame;
+    };
+    
+    // Requests a connection may have in flight before the loop stops reading it
+    static const size_t MAX_PENDING_REQUESTS = 64;
+    
+    AccountSystem& system;
+    RpcServerConfig config;
+    
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    volatile bool stopRequested;
+    
+    std::map<int, Connection> connections;
+    std::map<uint64_t, int> connectionFds;
+    uint64_t nextConnectionId;
+    
+    Mutex jobLock;
+    ConditionVariable jobReady;
+    std::deque<Job> jobs;
+    bool workersStopping;
+    
+    Mutex completionLock;
+    std::vector<Completion> completions;
+    
+    RpcServer(const RpcServer&);
+    RpcServer& operator=(const RpcServer&);
+    
+    bool openSocket();
+    void closeSockets();
+    
+    // These return false once the connection has been closed
+    void acceptConnections();
+    bool readConnection(Connection& connection);
+    bool parseRequests(Connection& connection);
+    bool flushConnection(Connection& connection);
+    bool updateInterest(Connection& connection);
+    void closeConnection(int fd);
+    void deliverCompletions();
+    
+    static void workerMain(void* argument);
+    void runWorker();
+    void execute(const RpcMessage& request, RpcMessage& response);
+
+public:
+    RpcServer(AccountSystem& system, const RpcServerConfig& config);
+    ~RpcServer();
+    
+    // Serve until stop() is called or SIGINT/SIGTERM arrives; false if the socket cannot be set up
+    bool run();
+    void stop();
+};
+
+#endif
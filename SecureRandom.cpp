@@ -0,0 +1,218 @@
+#ifdef _WIN32
+#define _CRT_RAND_S   // rand_s: the system cryptographic generator
+#endif
+#include "SecureRandom.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+static const size_t KEY_WORDS = 8;
+static const size_t BLOCK_SIZE = 64;
+static const size_t BUFFER_BLOCKS = 8;
+static const size_t BUFFER_SIZE = BLOCK_SIZE * BUFFER_BLOCKS;
+static const size_t KEY_SIZE = KEY_WORDS * 4;
+
+// Per-thread generator state; zero-initialized, seeded on first use
+struct GeneratorState {
+    bool seeded;
+    uint32_t key[KEY_WORDS];
+    uint8_t buffer[BUFFER_SIZE];
+    size_t position;           // Next unused byte of buffer
+};
+
+static __thread GeneratorState generatorState;
+
+static inline uint32_t rotateLeft(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline void quarterRound(uint32_t* x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotateLeft(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotateLeft(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotateLeft(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotateLeft(x[b] ^ x[c], 7);
+}
+
+// ChaCha20 block function (RFC 8439, section 2.3)
+static void chachaBlock(const uint32_t key[KEY_WORDS], uint32_t counter, const uint32_t nonce[3],
+                        uint8_t out[BLOCK_SIZE]) {
+    uint32_t input[16];
+    input[0] = 0x61707865;   // "expand 32-byte k"
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (size_t i = 0; i < KEY_WORDS; ++i) {
+        input[4 + i] = key[i];
+    }
+    input[12] = counter;
+    input[13] = nonce[0];
+    input[14] = nonce[1];
+    input[15] = nonce[2];
+    
+    uint32_t x[16];
+    std::memcpy(x, input, sizeof(x));
+    for (int round = 0; round < 10; ++round) {
+        quarterRound(x, 0, 4, 8, 12);
+        quarterRound(x, 1, 5, 9, 13);
+        quarterRound(x, 2, 6, 10, 14);
+        quarterRound(x, 3, 7, 11, 15);
+        quarterRound(x, 0, 5, 10, 15);
+        quarterRound(x, 1, 6, 11, 12);
+        quarterRound(x, 2, 7, 8, 13);
+        quarterRound(x, 3, 4, 9, 14);
+    }
+    
+    for (int i = 0; i < 16; ++i) {
+        uint32_t word = x[i] + input[i];
+        out[i * 4] = static_cast<uint8_t>(word);
+        out[i * 4 + 1] = static_cast<uint8_t>(word >> 8);
+        out[i * 4 + 2] = static_cast<uint8_t>(word >> 16);
+        out[i * 4 + 3] = static_cast<uint8_t>(word >> 24);
+    }
+}
+
+static bool readSystemRandom(uint8_t* bytes, size_t length) {
+#ifdef _WIN32
+    for (size_t i = 0; i < length; i += 4) {
+        unsigned int value;
+        if (rand_s(&value) != 0) {
+            return false;
+        }
+        for (size_t j = 0; j < 4 && i + j < length; ++j) {
+            bytes[i + j] = static_cast<uint8_t>(value >> (j * 8));
+        }
+    }
+    return true;
+#else
+    FILE* source = std::fopen("/dev/urandom", "rb");
+    if (!source) {
+        return false;
+    }
+    bool filled = std::fread(bytes, 1, length, source) == length;
+    std::fclose(source);
+    return filled;
+#endif
+}
+
+static void loadKey(GeneratorState& state, const uint8_t* bytes) {
+    for (size_t i = 0; i < KEY_WORDS; ++i) {
+        state.key[i] = static_cast<uint32_t>(bytes[i * 4]) | (static_cast<uint32_t>(bytes[i * 4 + 1]) << 8) |
+                       (static_cast<uint32_t>(bytes[i * 4 + 2]) << 16) | (static_cast<uint32_t>(bytes[i * 4 + 3]) << 24);
+    }
+}
+
+static void refill(GeneratorState& state) {
+    // Every key is used for one buffer only, so the nonce can stay zero
+    static const uint32_t NONCE[3] = { 0, 0, 0 };
+    for (size_t block = 0; block < BUFFER_BLOCKS; ++block) {
+        chachaBlock(state.key, static_cast<uint32_t>(block), NONCE, state.buffer + block * BLOCK_SIZE);
+    }
+    
+    // Fast key erasure: the first bytes become the next key and are never handed out
+    loadKey(state, state.buffer);
+    std::memset(state.buffer, 0, KEY_SIZE);
+    state.position = KEY_SIZE;
+}
+
+static GeneratorState& threadGenerator() {
+    GeneratorState& state = generatorState;
+    if (!state.seeded) {
+        uint8_t seed[KEY_SIZE];
+        if (!readSystemRandom(seed, sizeof(seed))) {
+            std::cerr << "No system random source available; refusing to continue" << std::endl;
+            std::abort();
+        }
+        loadKey(state, seed);
+        std::memset(seed, 0, sizeof(seed));
+        refill(state);
+        state.seeded = true;
+    }
+    return state;
+}
+
+static inline uint8_t nextByte(GeneratorState& state) {
+    if (state.position == BUFFER_SIZE) {
+        refill(state);
+    }
+    uint8_t value = state.buffer[state.position];
+    state.buffer[state.position++] = 0;
+    return value;
+}
+
+void SecureRandom::fill(void* buffer, size_t length) {
+    GeneratorState& state = threadGenerator();
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    while (length > 0) {
+        if (state.position == BUFFER_SIZE) {
+            refill(state);
+        }
+        size_t take = BUFFER_SIZE - state.position < length ? BUFFER_SIZE - state.position : length;
+        std::memcpy(out, state.buffer + state.position, take);
+        std::memset(state.buffer + state.position, 0, take);
+        state.position += take;
+        out += take;
+        length -= take;
+    }
+}
+
+uint32_t SecureRandom::next32() {
+    uint32_t value;
+    fill(&value, sizeof(value));
+    return value;
+}
+
+uint32_t SecureRandom::uniform(uint32_t bound) {
+    // Values below 2^32 mod bound would make the low results more likely
+    uint32_t threshold = static_cast<uint32_t>(-bound) % bound;
+    for (;;) {
+        uint32_t value = next32();
+        if (value >= threshold) {
+            return value % bound;
+        }
+    }
+}
+
+std::string SecureRandom::digits(size_t count) {
+    static const std::string DECIMAL_DIGITS("0123456789");
+    return fromAlphabet(DECIMAL_DIGITS, count);
+}
+
+std::string SecureRandom::fromAlphabet(const std::string& alphabet, size_t length) {
+    std::string result;
+    if (alphabet.empty()) {
+        return result;
+    }
+    result.reserve(length);
+    
+    if (alphabet.size() > 256) {
+        for (size_t i = 0; i < length; ++i) {
+            result += alphabet[uniform(static_cast<uint32_t>(alphabet.size()))];
+        }
+        return result;
+    }
+    
+    // One byte per character; bytes past the last whole multiple of the size are redrawn
+    GeneratorState& state = threadGenerator();
+    size_t limit = 256 - 256 % alphabet.size();
+    while (result.size() < length) {
+        uint8_t value = nextByte(state);
+        if (value < limit) {
+            result += alphabet[value % alphabet.size()];
+        }
+    }
+    return result;
+}
+
+std::string SecureRandom::hex(size_t byteCount) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    GeneratorState& state = threadGenerator();
+    std::string result;
+    result.reserve(byteCount * 2);
+    for (size_t i = 0; i < byteCount; ++i) {
+        uint8_t value = nextByte(state);
+        result += HEX_DIGITS[value >> 4];
+        result += HEX_DIGITS[value & 0x0F];
+    }
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef SECURE_RANDOM_H
+#define SECURE_RANDOM_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// Cryptographically secure random numbers for codes, secrets, passwords and tokens.
+//
+// Each thread runs its own ChaCha20 generator, keyed once from the operating
+// system (/dev/urandom, rand_s on Windows), so no call takes a lock or reads
+// shared state. Output is produced eight blocks at a time into a per-thread
+// buffer, and each refill rekeys the generator from its own output, so a
+// later compromise of the state does not reveal values already handed out.
+// If the system source cannot be read the process is stopped: there is no
+// weaker fallback.
+class SecureRandom {
+public:
+    static void fill(void* buffer, size_t length);
+    static uint32_t next32();
+    
+    // Uniform in [0, bound), without modulo bias; bound > 0
+    static uint32_t uniform(uint32_t bound);
+    
+    // count decimal digits, leading zeros included (OTP codes)
+    static std::string digits(size_t count);
+    
+    // length characters drawn uniformly from alphabet (secrets, passwords)
+    static std::string fromAlphabet(const std::string& alphabet, size_t length);
+    
+    // 2 * byteCount lowercase hex digits
+    static std::string hex(size_t byteCount);
+};
+
+#endif
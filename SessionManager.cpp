@@ -0,0 +1,142 @@
+#include "SessionManager.h"
+#include "SecureRandom.h"
+
+SessionManager::SessionManager() {}
+
+SessionToken SessionManager::generateToken() {
+    return SecureRandom::hex(16);
+}
+
+SessionManager::Shard& SessionManager::shardFor(const SessionToken& token) const {
+    // FNV-1a: tokens are random, but lookups may come with arbitrary strings
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < token.size(); ++i) {
+        hash ^= static_cast<unsigned char>(token[i]);
+        hash *= 16777619u;
+    }
+    return shards[hash % SHARD_COUNT];
+}
+
+bool SessionManager::isExpired(const Session& session, time_t now) const {
+    return now - session.lastAccessAt >= policy.idleTimeout ||
+           now - session.createdAt >= policy.absoluteTimeout;
+}
+
+size_t SessionManager::purgeShard(Shard& shard, time_t now) {
+    size_t removed = 0;
+    std::map<SessionToken, Session>::iterator it = shard.sessions.begin();
+    while (it != shard.sessions.end()) {
+        if (isExpired(it->second, now)) {
+            shard.sessions.erase(it++);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    shard.insertsSincePurge = 0;
+    return removed;
+}
+
+SessionToken SessionManager::createSession(const std::string& username, UserRole role, const Id128& walletId) {
+    Session session;
+    session.token = generateToken();
+    
+    session.username = username;
+    session.role = role;
+    session.walletId = walletId;
+    session.createdAt = time(NULL);
+    session.lastAccessAt = session.createdAt;
+    
+    Shard& shard = shardFor(session.token);
+    ScopedLock lock(shard.lock);
+    if (++shard.insertsSincePurge >= PURGE_INTERVAL) {
+        purgeShard(shard, session.createdAt);
+    }
+    shard.sessions[session.token] = session;
+    return session.token;
+}
+
+bool SessionManager::getSession(const SessionToken& token, Session& session) {
+    if (token.empty()) {
+        return false;
+    }
+    
+    Shard& shard = shardFor(token);
+    ScopedLock lock(shard.lock);
+    std::map<SessionToken, Session>::iterator it = shard.sessions.find(token);
+    if (it == shard.sessions.end()) {
+        return false;
+    }
+    
+    time_t now = time(NULL);
+    if (isExpired(it->second, now)) {
+        shard.sessions.erase(it);
+        return false;
+    }
+    
+    it->second.lastAccessAt = now;
+    session = it->second;
+    return true;
+}
+
+bool SessionManager::setSessionWallet(const SessionToken& token, const Id128& walletId) {
+    Shard& shard = shardFor(token);
+    ScopedLock lock(shard.lock);
+    std::map<SessionToken, Session>::iterator it = shard.sessions.find(token);
+    if (it == shard.sessions.end()) {
+        return false;
+    }
+    
+    it->second.walletId = walletId;
+    return true;
+}
+
+bool SessionManager::endSession(const SessionToken& token) {
+    Shard& shard = shardFor(token);
+    ScopedLock lock(shard.lock);
+    return shard.sessions.erase(token) > 0;
+}
+
+size_t SessionManager::endUserSessions(const std::string& username) {
+    size_t removed = 0;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        ScopedLock lock(shards[i].lock);
+        std::map<SessionToken, Session>::iterator it = shards[i].sessions.begin();
+        while (it != shards[i].sessions.end()) {
+            if (it->second.username == username) {
+                shards[i].sessions.erase(it++);
+                ++removed;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return removed;
+}
+
+size_t SessionManager::purgeExpired() {
+    size_t removed = 0;
+    time_t now = time(NULL);
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        ScopedLock lock(shards[i].lock);
+        removed += purgeShard(shards[i], now);
+    }
+    return removed;
+}
+
+size_t SessionManager::getSessionCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        ScopedLock lock(shards[i].lock);
+        count += shards[i].sessions.size();
+    }
+    return count;
+}
+
+void SessionManager::setPolicy(const SessionPolicy& sessionPolicy) {
+    policy = sessionPolicy;
+}
+
+SessionPolicy SessionManager::getPolicy() const {
+    return policy;
+}
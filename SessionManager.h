@@ -0,0 +1,89 @@
+#ifndef SESSION_MANAGER_H
+#define SESSION_MANAGER_H
+
+#include <string>
+#include <map>
+#include <ctime>
+#include "User.h"
+#include "Id128.h"
+#include "Threading.h"
+
+// Opaque handle returned at login: 32 random hex digits
+typedef std::string SessionToken;
+
+// What a logged-in client is, cached at login so checks need no user lookup
+struct Session {
+    SessionToken token;
+    std::string username;
+    UserRole role;
+    Id128 walletId;       // Nil until the user has a wallet
+    time_t createdAt;
+    time_t lastAccessAt;
+    
+    Session() : role(REGULAR), createdAt(0), lastAccessAt(0) {}
+    
+    bool isAdmin() const {
+        return role == ADMIN;
+    }
+};
+
+// When sessions end on their own
+struct SessionPolicy {
+    time_t idleTimeout;       // Seconds without use
+    time_t absoluteTimeout;   // Seconds since login, however active
+    
+    SessionPolicy() : idleTimeout(30 * 60), absoluteTimeout(12 * 60 * 60) {}
+};
+
+// Concurrent session table.
+//
+// Sessions are spread over independently locked shards by token, so logins
+// and lookups from many clients only contend when they hit the same shard.
+// Expired sessions are dropped when they are looked up, and each shard is
+// swept every PURGE_INTERVAL inserts so abandoned sessions do not pile up.
+class SessionManager {
+private:
+    static const size_t SHARD_COUNT = 16;
+    static const size_t PURGE_INTERVAL = 64;
+    
+    struct Shard {
+        Mutex lock;
+        std::map<SessionToken, Session> sessions;
+        size_t insertsSincePurge;
+        
+        Shard() : insertsSincePurge(0) {}
+    };
+    
+    mutable Shard shards[SHARD_COUNT];
+    SessionPolicy policy;
+    
+    SessionManager(const SessionManager&);
+    SessionManager& operator=(const SessionManager&);
+    
+    Shard& shardFor(const SessionToken& token) const;
+    bool isExpired(const Session& session, time_t now) const;
+    // Caller holds the shard lock
+    size_t purgeShard(Shard& shard, time_t now);
+    static SessionToken generateToken();
+
+public:
+    SessionManager();
+    
+    SessionToken createSession(const std::string& username, UserRole role, const Id128& walletId);
+    
+    // Copy of a live session; refreshes its idle timer. False if unknown or expired.
+    bool getSession(const SessionToken& token, Session& session);
+    bool setSessionWallet(const SessionToken& token, const Id128& walletId);
+    
+    bool endSession(const SessionToken& token);
+    // Ends every session of a user (e.g. when the account is removed)
+    size_t endUserSessions(const std::string& username);
+    size_t purgeExpired();
+    size_t getSessionCount() const;
+    
+    // Set before sessions are in use
+    void setPolicy(const SessionPolicy& sessionPolicy);
+    SessionPolicy getPolicy() const;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "Sha1.h"
+#include <cstring>
+
+static inline uint32_t rotateLeft(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+Sha1::Sha1() : buffered(0), totalBytes(0) {
+    state[0] = 0x67452301;
+    state[1] = 0xEFCDAB89;
+    state[2] = 0x98BADCFE;
+    state[3] = 0x10325476;
+    state[4] = 0xC3D2E1F0;
+}
+
+void Sha1::processBlock(const uint8_t* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void Sha1::update(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    totalBytes += length;
+    
+    if (buffered > 0) {
+        size_t take = BLOCK_SIZE - buffered < length ? BLOCK_SIZE - buffered : length;
+        std::memcpy(buffer + buffered, bytes, take);
+        buffered += take;
+        bytes += take;
+        length -= take;
+        if (buffered < BLOCK_SIZE) {
+            return;
+        }
+        processBlock(buffer);
+        buffered = 0;
+    }
+    
+    // Whole blocks straight from the input
+    for (; length >= BLOCK_SIZE; bytes += BLOCK_SIZE, length -= BLOCK_SIZE) {
+        processBlock(bytes);
+    }
+    
+    std::memcpy(buffer, bytes, length);
+    buffered = length;
+}
+
+void Sha1::finish(uint8_t digest[DIGEST_SIZE]) {
+    uint64_t totalBits = totalBytes * 8;
+    
+    // 0x80, zeros up to 56 mod 64, then the message length in bits, big-endian
+    buffer[buffered++] = 0x80;
+    if (buffered > BLOCK_SIZE - 8) {
+        std::memset(buffer + buffered, 0, BLOCK_SIZE - buffered);
+        processBlock(buffer);
+        buffered = 0;
+    }
+    std::memset(buffer + buffered, 0, BLOCK_SIZE - 8 - buffered);
+    for (int i = 0; i < 8; ++i) {
+        buffer[BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(totalBits >> (i * 8));
+    }
+    processBlock(buffer);
+    buffered = 0;
+    
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+
+void Sha1::hash(const void* data, size_t length, uint8_t digest[DIGEST_SIZE]) {
+    Sha1 context;
+    context.update(data, length);
+    context.finish(digest);
+}
+
+HmacSha1::HmacSha1() {
+    setKey("", 0);
+}
+
+HmacSha1::HmacSha1(const void* key, size_t keyLength) {
+    setKey(key, keyLength);
+}
+
+void HmacSha1::setKey(const void* key, size_t keyLength) {
+    uint8_t blockKey[Sha1::BLOCK_SIZE];
+    std::memset(blockKey, 0, sizeof(blockKey));
+    
+    // Keys longer than a block are replaced by their hash
+    if (keyLength > Sha1::BLOCK_SIZE) {
+        Sha1::hash(key, keyLength, blockKey);
+    } else if (keyLength > 0) {
+        std::memcpy(blockKey, key, keyLength);
+    }
+    
+    uint8_t pad[Sha1::BLOCK_SIZE];
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; ++i) {
+        pad[i] = blockKey[i] ^ 0x36;
+    }
+    inner.update(pad, sizeof(pad));
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; ++i) {
+        pad[i] = blockKey[i] ^ 0x5C;
+    }
+    outer.update(pad, sizeof(pad));
+}
+
+void HmacSha1::compute(const void* message, size_t length, uint8_t mac[Sha1::DIGEST_SIZE]) const {
+    uint8_t innerDigest[Sha1::DIGEST_SIZE];
+    Sha1 innerHash = inner;
+    innerHash.update(message, length);
+    innerHash.finish(innerDigest);
+    
+    Sha1 outerHash = outer;
+    outerHash.update(innerDigest, sizeof(innerDigest));
+    outerHash.finish(mac);
+}
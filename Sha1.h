@@ -0,0 +1,49 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <cstddef>
+#include <stdint.h>
+
+// SHA-1 (FIPS 180-4). A plain value: copying a context part-way through a
+// message forks the hash, which HmacSha1 uses to keep its padded key state.
+class Sha1 {
+public:
+    static const size_t BLOCK_SIZE = 64;
+    static const size_t DIGEST_SIZE = 20;
+
+private:
+    uint32_t state[5];
+    uint8_t buffer[BLOCK_SIZE];
+    size_t buffered;
+    uint64_t totalBytes;
+    
+    void processBlock(const uint8_t* block);
+
+public:
+    Sha1();
+    
+    void update(const void* data, size_t length);
+    // Pads the message and writes the digest; the context is spent afterwards
+    void finish(uint8_t digest[DIGEST_SIZE]);
+    
+    static void hash(const void* data, size_t length, uint8_t digest[DIGEST_SIZE]);
+};
+
+// HMAC-SHA1 (RFC 2104) with the key already absorbed: the inner and outer
+// contexts have hashed key^ipad and key^opad, so a MAC costs the message
+// blocks plus one outer block instead of re-deriving the key every time.
+class HmacSha1 {
+private:
+    Sha1 inner;
+    Sha1 outer;
+    
+    void setKey(const void* key, size_t keyLength);
+
+public:
+    HmacSha1();
+    HmacSha1(const void* key, size_t keyLength);
+    
+    void compute(const void* message, size_t length, uint8_t mac[Sha1::DIGEST_SIZE]) const;
+};
+
+#endif
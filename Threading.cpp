@@ -0,0 +1,303 @@
+#include "Threading.h"
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600   // SRW locks need Windows Vista or later
+#endif
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+// What a new thread runs; owned by its Thread
+struct ThreadStart {
+    ThreadFunction function;
+    void* argument;
+};
+
+#ifdef _WIN32
+
+// Critical sections are always recursive
+struct Mutex::Impl {
+    CRITICAL_SECTION section;
+};
+
+Mutex::Mutex(bool recursive) : impl(new Impl) {
+    (void)recursive;
+    InitializeCriticalSection(&impl->section);
+}
+
+Mutex::~Mutex() {
+    DeleteCriticalSection(&impl->section);
+    delete impl;
+}
+
+void Mutex::lock() {
+    EnterCriticalSection(&impl->section);
+}
+
+void Mutex::unlock() {
+    LeaveCriticalSection(&impl->section);
+}
+
+bool Mutex::tryLock() {
+    return TryEnterCriticalSection(&impl->section) != 0;
+}
+
+struct ConditionVariable::Impl {
+    CONDITION_VARIABLE condition;
+};
+
+ConditionVariable::ConditionVariable() : impl(new Impl) {
+    InitializeConditionVariable(&impl->condition);
+}
+
+ConditionVariable::~ConditionVariable() {
+    delete impl;
+}
+
+void ConditionVariable::wait(Mutex& mutex) {
+    SleepConditionVariableCS(&impl->condition, &mutex.impl->section, INFINITE);
+}
+
+bool ConditionVariable::waitFor(Mutex& mutex, uint32_t milliseconds) {
+    return SleepConditionVariableCS(&impl->condition, &mutex.impl->section, milliseconds) != 0;
+}
+
+void ConditionVariable::notifyOne() {
+    WakeConditionVariable(&impl->condition);
+}
+
+void ConditionVariable::notifyAll() {
+    WakeAllConditionVariable(&impl->condition);
+}
+
+struct RWLock::Impl {
+    SRWLOCK lock;
+};
+
+RWLock::RWLock() : impl(new Impl) {
+    InitializeSRWLock(&impl->lock);
+}
+
+RWLock::~RWLock() {
+    delete impl;
+}
+
+void RWLock::lockShared() {
+    AcquireSRWLockShared(&impl->lock);
+}
+
+void RWLock::unlockShared() {
+    ReleaseSRWLockShared(&impl->lock);
+}
+
+void RWLock::lockExclusive() {
+    AcquireSRWLockExclusive(&impl->lock);
+}
+
+void RWLock::unlockExclusive() {
+    ReleaseSRWLockExclusive(&impl->lock);
+}
+
+struct Thread::Impl {
+    HANDLE handle;
+    ThreadStart start;
+};
+
+static unsigned __stdcall threadEntry(void* data) {
+    ThreadStart* start = static_cast<ThreadStart*>(data);
+    start->function(start->argument);
+    return 0;
+}
+
+Thread::Thread() : impl(new Impl) {
+    impl->handle = NULL;
+}
+
+bool Thread::start(ThreadFunction function, void* argument) {
+    if (impl->handle != NULL) {
+        return false;
+    }
+    
+    impl->start.function = function;
+    impl->start.argument = argument;
+    impl->handle = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, threadEntry, &impl->start, 0, NULL));
+    return impl->handle != NULL;
+}
+
+void Thread::join() {
+    if (impl->handle == NULL) {
+        return;
+    }
+    
+    WaitForSingleObject(impl->handle, INFINITE);
+    CloseHandle(impl->handle);
+    impl->handle = NULL;
+}
+
+bool Thread::isRunning() const {
+    return impl->handle != NULL;
+}
+
+size_t hardwareConcurrency() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+struct Mutex::Impl {
+    pthread_mutex_t mutex;
+};
+
+Mutex::Mutex(bool recursive) : impl(new Impl) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    if (recursive) {
+        pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    }
+    pthread_mutex_init(&impl->mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+Mutex::~Mutex() {
+    pthread_mutex_destroy(&impl->mutex);
+    delete impl;
+}
+
+void Mutex::lock() {
+    pthread_mutex_lock(&impl->mutex);
+}
+
+void Mutex::unlock() {
+    pthread_mutex_unlock(&impl->mutex);
+}
+
+bool Mutex::tryLock() {
+    return pthread_mutex_trylock(&impl->mutex) == 0;
+}
+
+struct ConditionVariable::Impl {
+    pthread_cond_t condition;
+};
+
+ConditionVariable::ConditionVariable() : impl(new Impl) {
+    pthread_cond_init(&impl->condition, NULL);
+}
+
+ConditionVariable::~ConditionVariable() {
+    pthread_cond_destroy(&impl->condition);
+    delete impl;
+}
+
+void ConditionVariable::wait(Mutex& mutex) {
+    pthread_cond_wait(&impl->condition, &mutex.impl->mutex);
+}
+
+bool ConditionVariable::waitFor(Mutex& mutex, uint32_t milliseconds) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    
+    // pthread_cond_timedwait takes an absolute wall-clock deadline
+    uint64_t deadlineMicros = static_cast<uint64_t>(now.tv_usec) + static_cast<uint64_t>(milliseconds) * 1000;
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + static_cast<time_t>(deadlineMicros / 1000000);
+    deadline.tv_nsec = static_cast<long>(deadlineMicros % 1000000) * 1000;
+    return pthread_cond_timedwait(&impl->condition, &mutex.impl->mutex, &deadline) == 0;
+}
+
+void ConditionVariable::notifyOne() {
+    pthread_cond_signal(&impl->condition);
+}
+
+void ConditionVariable::notifyAll() {
+    pthread_cond_broadcast(&impl->condition);
+}
+
+struct RWLock::Impl {
+    pthread_rwlock_t lock;
+};
+
+RWLock::RWLock() : impl(new Impl) {
+    pthread_rwlock_init(&impl->lock, NULL);
+}
+
+RWLock::~RWLock() {
+    pthread_rwlock_destroy(&impl->lock);
+    delete impl;
+}
+
+void RWLock::lockShared() {
+    pthread_rwlock_rdlock(&impl->lock);
+}
+
+void RWLock::unlockShared() {
+    pthread_rwlock_unlock(&impl->lock);
+}
+
+void RWLock::lockExclusive() {
+    pthread_rwlock_wrlock(&impl->lock);
+}
+
+void RWLock::unlockExclusive() {
+    pthread_rwlock_unlock(&impl->lock);
+}
+
+struct Thread::Impl {
+    pthread_t thread;
+    bool running;
+    ThreadStart start;
+};
+
+extern "C" {
+static void* threadEntry(void* data) {
+    ThreadStart* start = static_cast<ThreadStart*>(data);
+    start->function(start->argument);
+    return NULL;
+}
+}
+
+Thread::Thread() : impl(new Impl) {
+    impl->running = false;
+}
+
+bool Thread::start(ThreadFunction function, void* argument) {
+    if (impl->running) {
+        return false;
+    }
+    
+    impl->start.function = function;
+    impl->start.argument = argument;
+    impl->running = pthread_create(&impl->thread, NULL, threadEntry, &impl->start) == 0;
+    return impl->running;
+}
+
+void Thread::join() {
+    if (!impl->running) {
+        return;
+    }
+    
+    pthread_join(impl->thread, NULL);
+    impl->running = false;
+}
+
+bool Thread::isRunning() const {
+    return impl->running;
+}
+
+size_t hardwareConcurrency() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? static_cast<size_t>(count) : 1;
+}
+
+#endif
+
+Thread::~Thread() {
+    join();
+    delete impl;
+}
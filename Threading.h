@@ -0,0 +1,145 @@
+#ifndef THREADING_H
+#define THREADING_H
+
+#include <cstddef>
+#include <stdint.h>
+
+// Minimal C++98 threading primitives: pthreads on POSIX, Win32 on Windows.
+// The platform handles live in the .cpp so <windows.h> stays out of headers.
+
+class Mutex {
+private:
+    struct Impl;
+    Impl* impl;
+    
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+    
+    friend class ConditionVariable;
+
+public:
+    // A recursive mutex may be locked again by the thread that holds it
+    explicit Mutex(bool recursive = false);
+    ~Mutex();
+    
+    void lock();
+    void unlock();
+    bool tryLock();
+};
+
+// Holds a mutex for the lifetime of the scope
+class ScopedLock {
+private:
+    Mutex& mutex;
+    
+    ScopedLock(const ScopedLock&);
+    ScopedLock& operator=(const ScopedLock&);
+
+public:
+    explicit ScopedLock(Mutex& mutex) : mutex(mutex) {
+        mutex.lock();
+    }
+    
+    ~ScopedLock() {
+        mutex.unlock();
+    }
+};
+
+// Wait for a condition while holding a (non-recursive) Mutex; waits can wake spuriously
+class ConditionVariable {
+private:
+    struct Impl;
+    Impl* impl;
+    
+    ConditionVariable(const ConditionVariable&);
+    ConditionVariable& operator=(const ConditionVariable&);
+
+public:
+    ConditionVariable();
+    ~ConditionVariable();
+    
+    void wait(Mutex& mutex);
+    // False if the time ran out
+    bool waitFor(Mutex& mutex, uint32_t milliseconds);
+    void notifyOne();
+    void notifyAll();
+};
+
+// Many readers or one writer (not recursive)
+class RWLock {
+private:
+    struct Impl;
+    Impl* impl;
+    
+    RWLock(const RWLock&);
+    RWLock& operator=(const RWLock&);
+
+public:
+    RWLock();
+    ~RWLock();
+    
+    void lockShared();
+    void unlockShared();
+    void lockExclusive();
+    void unlockExclusive();
+};
+
+class ReadLock {
+private:
+    RWLock& rwLock;
+    
+    ReadLock(const ReadLock&);
+    ReadLock& operator=(const ReadLock&);
+
+public:
+    explicit ReadLock(RWLock& rwLock) : rwLock(rwLock) {
+        rwLock.lockShared();
+    }
+    
+    ~ReadLock() {
+        rwLock.unlockShared();
+    }
+};
+
+class WriteLock {
+private:
+    RWLock& rwLock;
+    
+    WriteLock(const WriteLock&);
+    WriteLock& operator=(const WriteLock&);
+
+public:
+    explicit WriteLock(RWLock& rwLock) : rwLock(rwLock) {
+        rwLock.lockExclusive();
+    }
+    
+    ~WriteLock() {
+        rwLock.unlockExclusive();
+    }
+};
+
+typedef void (*ThreadFunction)(void* argument);
+
+// A joinable thread running fn(argument)
+class Thread {
+private:
+    struct Impl;
+    Impl* impl;
+    
+    Thread(const Thread&);
+    Thread& operator=(const Thread&);
+
+public:
+    Thread();
+    // Joins the thread if it is still running
+    ~Thread();
+    
+    bool start(ThreadFunction function, void* argument);
+    void join();
+    bool isRunning() const;
+};
+
+// Number of logical processors (at least 1)
+size_t hardwareConcurrency();
+
+#endif
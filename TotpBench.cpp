@@ -0,0 +1,110 @@
+#include "TotpBench.h"
+#include "AuthManager.h"
+#include "Clock.h"
+#include "SecureRandom.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+// Base32 of the RFC 6238 SHA-1 seed "12345678901234567890"
+static const char* RFC_SECRET = "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ";
+static const size_t RFC_DIGITS = 8;
+
+struct TotpVector {
+    time_t timestamp;
+    const char* code;
+};
+
+// RFC 6238 appendix B, SHA-1 column (the 2^32+ timestamp is left out for 32-bit time_t)
+static const TotpVector RFC_VECTORS[] = {
+    { 59, "94287082" },
+    { 1111111109, "07081804" },
+    { 1111111111, "14050471" },
+    { 1234567890, "89005924" },
+    { 2000000000, "69279037" }
+};
+
+static const time_t BENCH_START_TIME = 1700000000;
+
+static bool checkVectors() {
+    OTP totp("bench", "verification", RFC_SECRET, RFC_DIGITS);
+    bool matched = true;
+    for (size_t i = 0; i < sizeof(RFC_VECTORS) / sizeof(RFC_VECTORS[0]); ++i) {
+        std::string code = totp.generateTOTP(RFC_VECTORS[i].timestamp);
+        bool ok = code == RFC_VECTORS[i].code && totp.verifyAt(code, RFC_VECTORS[i].timestamp, 0);
+        std::cout << "  t=" << std::setw(10) << RFC_VECTORS[i].timestamp << "  " << code
+                  << (ok ? "  ok" : "  MISMATCH, expected ") << (ok ? "" : RFC_VECTORS[i].code) << std::endl;
+        matched = matched && ok;
+    }
+    return matched;
+}
+
+static void report(const char* label, size_t verifications, size_t accepted, uint64_t elapsedNanos) {
+    double seconds = elapsedNanos / 1e9;
+    std::cout << "  " << std::left << std::setw(28) << label << std::right
+              << std::setw(12) << static_cast<uint64_t>(verifications / seconds) << " verifications/s  "
+              << std::setw(8) << std::fixed << std::setprecision(3) << elapsedNanos / 1e3 / verifications
+              << " us each  (" << accepted << " accepted)" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+int runTotpBenchmark(size_t verifications) {
+    if (verifications == 0) {
+        verifications = 1;
+    }
+    
+    std::cout << "RFC 6238 test vectors (SHA-1, " << RFC_DIGITS << " digits):" << std::endl;
+    bool matched = checkVectors();
+    
+    std::string secret = OTP::generateSecretKey(32);
+    OTP cached("bench", "verification", secret);
+    
+    // Codes are produced up front so only verification is timed
+    std::vector<std::string> codes(verifications);
+    for (size_t i = 0; i < verifications; ++i) {
+        codes[i] = cached.generateTOTP(BENCH_START_TIME + static_cast<time_t>(i) * 30);
+    }
+    
+    std::cout << std::endl << "TOTP verification, " << verifications << " calls, window +/-1 step:" << std::endl;
+    
+    size_t accepted = 0;
+    uint64_t started = monotonicNanos();
+    for (size_t i = 0; i < verifications; ++i) {
+        accepted += cached.verifyAt(codes[i], BENCH_START_TIME + static_cast<time_t>(i) * 30) ? 1 : 0;
+    }
+    report("cached key, matching code", verifications, accepted, monotonicNanos() - started);
+    
+    // Far from every code's own step, so the whole window is evaluated and rejected
+    size_t rejected = 0;
+    started = monotonicNanos();
+    for (size_t i = 0; i < verifications; ++i) {
+        rejected += cached.verifyAt(codes[i], BENCH_START_TIME - 3600 + static_cast<time_t>(i) * 30) ? 1 : 0;
+    }
+    report("cached key, wrong code", verifications, rejected, monotonicNanos() - started);
+    
+    size_t derived = 0;
+    started = monotonicNanos();
+    for (size_t i = 0; i < verifications; ++i) {
+        OTP perCall("bench", "verification", secret);
+        derived += perCall.verifyAt(codes[i], BENCH_START_TIME - 3600 + static_cast<time_t>(i) * 30) ? 1 : 0;
+    }
+    report("key derived per call", verifications, derived, monotonicNanos() - started);
+    
+    // Codes for emailed OTPs come from the per-thread generator
+    size_t sevens = 0;
+    started = monotonicNanos();
+    for (size_t i = 0; i < verifications; ++i) {
+        sevens += SecureRandom::digits(6)[0] == '7' ? 1 : 0;
+    }
+    uint64_t elapsed = monotonicNanos() - started;
+    std::cout << std::endl << "OTP code generation: " << static_cast<uint64_t>(verifications / (elapsed / 1e9))
+              << " codes/s, " << std::fixed << std::setprecision(1) << elapsed / (verifications * 6.0)
+              << " ns per digit (" << sevens << " codes start with 7)" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    
+    if (!matched) {
+        std::cout << std::endl << "TOTP codes do not match RFC 6238" << std::endl;
+        return 1;
+    }
+    return 0;
+}
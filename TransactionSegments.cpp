@@ -0,0 +1,403 @@
+#include "TransactionSegments.h"
+#include "DataManager.h"
+#include "CsvScanner.h"
+#include "FileUtils.h"
+#include "Lz77.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+static const int64_t MILLIS_PER_DAY = 86400000;
+
+bool TransactionSegments::Reader::open(const std::string& path, bool compressed) {
+    if (!file.open(path)) {
+        return false;
+    }
+    if (!compressed) {
+        data = file.getData();
+        size = file.getSize();
+        return true;
+    }
+    
+    bool inflatedOk = Lz77::decompress(file.getData(), file.getSize(), inflated);
+    file.close();
+    if (!inflatedOk) {
+        std::cerr << "Damaged compressed segment: " << path << std::endl;
+        return false;
+    }
+    data = inflated.data();
+    size = inflated.size();
+    return true;
+}
+
+TransactionSegments::TransactionSegments(const std::string& directory)
+    : directory(directory), useCounter(0) {
+}
+
+std::string TransactionSegments::manifestPath() const {
+    return directory + "manifest.txt";
+}
+
+std::string TransactionSegments::segmentPath(int month, bool compressed) const {
+    return directory + monthName(month) + (compressed ? ".lz77" : ".txt");
+}
+
+std::string TransactionSegments::walletsPath(int month) const {
+    return directory + monthName(month) + ".wallets";
+}
+
+// Reads a month's wallet list; without one (a segment written before the
+// lists were), it is rebuilt from the segment and saved for the next load
+bool TransactionSegments::loadWallets(int month, Segment& segment) {
+    MappedFile file;
+    if (!file.open(walletsPath(month))) {
+        Reader reader;
+        if (!openSegment(month, reader)) {
+            std::cerr << "Cannot read transaction segment " << monthName(month) << std::endl;
+            return false;
+        }
+        const char* end = reader.getData() + reader.getSize();
+        Transaction transaction;
+        for (const char* lineStart = reader.getData(); lineStart < end; ) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            const char* contentEnd = (lineEnd > lineStart && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+            if (parseTransactionRecord(lineStart, contentEnd, transaction)) {
+                segment.wallets.insert(transaction.getSenderWalletId());
+                segment.wallets.insert(transaction.getReceiverWalletId());
+            }
+            lineStart = lineEnd + 1;
+        }
+        size_t systemCalls = 0;
+        writeWallets(month, segment.wallets, systemCalls);
+        return true;
+    }
+    
+    const char* end = file.getData() + file.getSize();
+    Id128 walletId;
+    for (const char* lineStart = file.getData(); lineStart < end; ) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char* contentEnd = (lineEnd > lineStart && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+        if (contentEnd > lineStart) {
+            if (!Id128::fromString(lineStart, contentEnd, walletId)) {
+                std::cerr << "Damaged wallet list of segment " << monthName(month) << std::endl;
+                return false;
+            }
+            segment.wallets.insert(segment.wallets.end(), walletId);
+        }
+        lineStart = lineEnd + 1;
+    }
+    return true;
+}
+
+bool TransactionSegments::load() {
+    clear();
+    
+    std::ifstream manifest(manifestPath().c_str());
+    if (!manifest.is_open()) {
+        return true;
+    }
+    
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        
+        CsvScanner scanner(line.data(), line.data() + line.size());
+        CsvField name, records, encoding;
+        scanner.next(name);
+        scanner.next(records);
+        scanner.next(encoding);
+        
+        int month;
+        int64_t recordCount = 0;
+        if (!parseMonthName(name.toString(), month) ||
+            parseInteger(records.begin, records.end, recordCount) != records.end || recordCount < 0 ||
+            !(encoding.equals("text") || encoding.equals("lz77"))) {
+            std::cerr << "Damaged segment manifest line: " << line << std::endl;
+            return false;
+        }
+        
+        Segment& segment = segments[month];
+        segment.records = static_cast<size_t>(recordCount);
+        segment.compressed = encoding.equals("lz77");
+        if (!loadWallets(month, segment)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TransactionSegments::clear() {
+    segments.clear();
+    coldCache.clear();
+    replacedFiles.clear();
+}
+
+void TransactionSegments::removeAll() {
+    clear();
+    removeDirectoryTree(directory);
+}
+
+const std::map<int, TransactionSegments::Segment>& TransactionSegments::getSegments() const {
+    return segments;
+}
+
+bool TransactionSegments::hasSegment(int month) const {
+    return segments.find(month) != segments.end();
+}
+
+bool TransactionSegments::openSegment(int month, Reader& reader) const {
+    std::map<int, Segment>::const_iterator it = segments.find(month);
+    if (it == segments.end()) {
+        return false;
+    }
+    return reader.open(segmentPath(month, it->second.compressed), it->second.compressed);
+}
+
+std::set<int> TransactionSegments::monthsWithWallet(const Id128& walletId, int beforeMonth) const {
+    std::set<int> months;
+    for (std::map<int, Segment>::const_iterator it = segments.begin();
+         it != segments.end() && it->first < beforeMonth; ++it) {
+        if (it->second.wallets.find(walletId) != it->second.wallets.end()) {
+            months.insert(months.end(), it->first);
+        }
+    }
+    return months;
+}
+
+const TransactionSegments::ColdSegment* TransactionSegments::getColdSegment(int month) {
+    std::map<int, ColdSegment>::iterator cached = coldCache.find(month);
+    if (cached != coldCache.end()) {
+        cached->second.lastUsed = ++useCounter;
+        return &cached->second;
+    }
+    
+    Reader reader;
+    if (!openSegment(month, reader)) {
+        if (hasSegment(month)) {
+            std::cerr << "Cannot read transaction segment " << monthName(month) << std::endl;
+        }
+        return NULL;
+    }
+    
+    if (coldCache.size() >= COLD_CACHE_SEGMENTS) {
+        std::map<int, ColdSegment>::iterator oldest = coldCache.begin();
+        for (std::map<int, ColdSegment>::iterator it = coldCache.begin(); it != coldCache.end(); ++it) {
+            if (it->second.lastUsed < oldest->second.lastUsed) {
+                oldest = it;
+            }
+        }
+        coldCache.erase(oldest);
+    }
+    
+    ColdSegment& segment = coldCache[month];
+    segment.lastUsed = ++useCounter;
+    
+    const char* end = reader.getData() + reader.getSize();
+    Transaction transaction;
+    for (const char* lineStart = reader.getData(); lineStart < end; ) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char* contentEnd = (lineEnd > lineStart && lineEnd[-1] == '\r') ? lineEnd - 1 : lineEnd;
+        if (parseTransactionRecord(lineStart, contentEnd, transaction)) {
+            segment.transactions[transaction.getTransactionId()] = transaction;
+        }
+        lineStart = lineEnd + 1;
+    }
+    
+    // Segments hold time-ordered IDs only, so ID order is time order
+    for (std::map<Id128, Transaction>::const_iterator it = segment.transactions.begin();
+         it != segment.transactions.end(); ++it) {
+        segment.walletTransactions[it->second.getSenderWalletId()].push_back(it->first);
+        if (it->second.getReceiverWalletId() != it->second.getSenderWalletId()) {
+            segment.walletTransactions[it->second.getReceiverWalletId()].push_back(it->first);
+        }
+    }
+    return &segment;
+}
+
+bool TransactionSegments::writeWallets(int month, const std::set<Id128>& wallets, size_t& systemCalls) {
+    std::vector<std::string> buffers(1);
+    buffers[0].reserve(wallets.size() * (Id128::TEXT_LENGTH + 1));
+    for (std::set<Id128>::const_iterator it = wallets.begin(); it != wallets.end(); ++it) {
+        buffers[0] += it->toString();
+        buffers[0] += '\n';
+    }
+    return writeFileSynced(walletsPath(month), buffers, systemCalls);
+}
+
+bool TransactionSegments::writeSegment(int month, const std::vector<std::string>& buffers, size_t records,
+                                       const std::set<Id128>& wallets, size_t& systemCalls) {
+    coldCache.erase(month);
+    std::map<int, Segment>::iterator existing = segments.find(month);
+    
+    if (records == 0) {
+        if (existing != segments.end()) {
+            replacedFiles.push_back(segmentPath(month, existing->second.compressed));
+            replacedFiles.push_back(walletsPath(month));
+            segments.erase(existing);
+        }
+        return true;
+    }
+    
+    if (!createDirectory(directory) || !writeFileSynced(segmentPath(month, false), buffers, systemCalls) ||
+        !writeWallets(month, wallets, systemCalls)) {
+        std::cerr << "Cannot write transaction segment " << monthName(month) << std::endl;
+        return false;
+    }
+    
+    if (existing != segments.end() && existing->second.compressed) {
+        replacedFiles.push_back(segmentPath(month, true));
+    }
+    Segment& segment = segments[month];
+    segment.records = records;
+    segment.compressed = false;
+    segment.wallets = wallets;
+    return true;
+}
+
+bool TransactionSegments::writeManifest(size_t& systemCalls) {
+    std::ostringstream manifest;
+    for (std::map<int, Segment>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        manifest << monthName(it->first) << ',' << it->second.records << ','
+                 << (it->second.compressed ? "lz77" : "text") << '\n';
+    }
+    
+    std::vector<std::string> buffers(1, manifest.str());
+    if (!createDirectory(directory) || !writeFileSynced(manifestPath(), buffers, systemCalls)) {
+        std::cerr << "Cannot write the segment manifest in " << directory << std::endl;
+        return false;
+    }
+    
+    for (size_t i = 0; i < replacedFiles.size(); ++i) {
+        removeFile(replacedFiles[i]);
+    }
+    replacedFiles.clear();
+    return true;
+}
+
+bool TransactionSegments::compact(int month, size_t& textBytes, size_t& compressedBytes) {
+    std::map<int, Segment>::iterator it = segments.find(month);
+    if (it == segments.end() || it->second.compressed) {
+        return false;
+    }
+    
+    std::vector<std::string> buffers(1);
+    {
+        Reader reader;
+        if (!reader.open(segmentPath(month, false), false)) {
+            std::cerr << "Cannot read transaction segment " << monthName(month) << std::endl;
+            return false;
+        }
+        textBytes = reader.getSize();
+        buffers[0] = Lz77::compress(reader.getData(), reader.getSize());
+        compressedBytes = buffers[0].size();
+    }
+    
+    // Nothing to gain: leave it as text
+    if (compressedBytes >= textBytes) {
+        return true;
+    }
+    
+    size_t systemCalls = 0;
+    if (!writeFileSynced(segmentPath(month, true), buffers, systemCalls)) {
+        std::cerr << "Cannot write compressed segment " << monthName(month) << std::endl;
+        return false;
+    }
+    
+    it->second.compressed = true;
+    replacedFiles.push_back(segmentPath(month, false));
+    if (!writeManifest(systemCalls)) {
+        // The manifest still names the text file, which is still there
+        it->second.compressed = false;
+        replacedFiles.pop_back();
+        removeFile(segmentPath(month, true));
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> TransactionSegments::listFiles() const {
+    std::vector<std::string> files;
+    files.push_back(manifestPath());
+    for (std::map<int, Segment>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        files.push_back(segmentPath(it->first, it->second.compressed));
+        files.push_back(walletsPath(it->first));
+    }
+    return files;
+}
+
+// Floor division, so times before 1970 fall in the right day and month
+static int64_t floorDivide(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+}
+
+// Proleptic Gregorian calendar <-> days since 1970-01-01 (H. Hinnant's algorithms)
+static int64_t daysFromCivil(int64_t year, int month, int day) {
+    year -= month <= 2 ? 1 : 0;
+    int64_t era = floorDivide(year, 400);
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static void civilFromDays(int64_t days, int64_t& year, int& month) {
+    days += 719468;
+    int64_t era = floorDivide(days, 146097);
+    int64_t dayOfEra = days - era * 146097;
+    int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int64_t shiftedMonth = (5 * dayOfYear + 2) / 153;
+    month = static_cast<int>(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+    year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+int TransactionSegments::monthOf(int64_t unixMillis) {
+    int64_t year;
+    int month;
+    civilFromDays(floorDivide(unixMillis, MILLIS_PER_DAY), year, month);
+    return static_cast<int>((year - 1970) * 12 + month - 1);
+}
+
+int64_t TransactionSegments::monthStartMillis(int month) {
+    int64_t year = 1970 + floorDivide(month, 12);
+    int monthOfYear = static_cast<int>(month - floorDivide(month, 12) * 12) + 1;
+    return daysFromCivil(year, monthOfYear, 1) * MILLIS_PER_DAY;
+}
+
+std::string TransactionSegments::monthName(int month) {
+    int64_t year = 1970 + floorDivide(month, 12);
+    int monthOfYear = static_cast<int>(month - floorDivide(month, 12) * 12) + 1;
+    std::ostringstream name;
+    name << std::setfill('0') << std::setw(4) << year << '-' << std::setw(2) << monthOfYear;
+    return name.str();
+}
+
+bool TransactionSegments::parseMonthName(const std::string& name, int& month) {
+    int64_t year = 0, monthOfYear = 0;
+    const char* text = name.c_str();
+    const char* end = text + name.size();
+    const char* dash = parseInteger(text, end, year);
+    if (dash == text || dash == end || *dash != '-' ||
+        parseInteger(dash + 1, end, monthOfYear) != end || monthOfYear < 1 || monthOfYear > 12) {
+        return false;
+    }
+    month = static_cast<int>((year - 1970) * 12 + monthOfYear - 1);
+    return true;
+}
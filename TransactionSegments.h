@@ -0,0 +1,120 @@
+#ifndef TRANSACTION_SEGMENTS_H
+#define TRANSACTION_SEGMENTS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include "Wallet.h"
+#include "MappedFile.h"
+
+// Monthly transaction segments.
+//
+// Transactions with time-ordered IDs are stored one file per calendar month
+// (UTC) of their ID, in data-file lines like transactions.txt:
+//
+//   <dir>/manifest.txt    "<YYYY-MM>,<records>,<text|lz77>" per segment, oldest first
+//   <dir>/<YYYY-MM>.txt   segment as text
+//   <dir>/<YYYY-MM>.lz77  segment compressed by compact()
+//   <dir>/<YYYY-MM>.wallets  IDs of the wallets on either side of its transactions, one per line
+//
+// The manifest is the authority: a segment file it does not name is ignored.
+// Months are numbered from January 1970 (0). Not synchronized: DataManager
+// uses it under its persistence lock.
+class TransactionSegments {
+public:
+    struct Segment {
+        size_t records;
+        bool compressed;
+        // Every wallet with a transaction in the month, failed ones included,
+        // so a wallet's cold months are known without reading them
+        std::set<Id128> wallets;
+        
+        Segment() : records(0), compressed(false) {}
+    };
+    
+    // A month read on demand, with its own wallet -> transaction IDs index (oldest first)
+    struct ColdSegment {
+        std::map<Id128, Transaction> transactions;
+        std::map<Id128, std::vector<Id128> > walletTransactions;
+        uint64_t lastUsed;
+    };
+    
+    // Bytes of one segment, mapped as they are or decompressed into memory
+    class Reader {
+    private:
+        MappedFile file;
+        std::string inflated;
+        const char* data;
+        size_t size;
+        
+        Reader(const Reader&);
+        Reader& operator=(const Reader&);
+    
+    public:
+        Reader() : data(0), size(0) {}
+        
+        bool open(const std::string& path, bool compressed);
+        const char* getData() const { return data; }
+        size_t getSize() const { return size; }
+    };
+
+private:
+    // Cold months kept parsed, least recently used dropped first
+    static const size_t COLD_CACHE_SEGMENTS = 2;
+    
+    std::string directory;
+    std::map<int, Segment> segments;
+    std::map<int, ColdSegment> coldCache;
+    uint64_t useCounter;
+    // Files of the previous encoding of rewritten segments, removed once the manifest no longer names them
+    std::vector<std::string> replacedFiles;
+    
+    std::string manifestPath() const;
+    std::string segmentPath(int month, bool compressed) const;
+    std::string walletsPath(int month) const;
+    bool loadWallets(int month, Segment& segment);
+    bool writeWallets(int month, const std::set<Id128>& wallets, size_t& systemCalls);
+
+public:
+    explicit TransactionSegments(const std::string& directory);
+    
+    // Read the manifest; true with no segments if there is none
+    bool load();
+    // Forget the segments without touching the files
+    void clear();
+    // Forget every segment and remove the directory (the data is stored elsewhere)
+    void removeAll();
+    
+    const std::map<int, Segment>& getSegments() const;
+    bool hasSegment(int month) const;
+    bool openSegment(int month, Reader& reader) const;
+    // Months before beforeMonth with transactions of the wallet
+    std::set<int> monthsWithWallet(const Id128& walletId, int beforeMonth) const;
+    
+    // Parsed month for lookups; NULL if there is no such segment or it cannot
+    // be read. Valid until the next call.
+    const ColdSegment* getColdSegment(int month);
+    
+    // Replace a month with the given data-file lines (as text) and the wallets
+    // they name; no lines removes it. Takes effect for readers at once, and on
+    // disk once writeManifest() succeeds.
+    bool writeSegment(int month, const std::vector<std::string>& buffers, size_t records,
+                      const std::set<Id128>& wallets, size_t& systemCalls);
+    bool writeManifest(size_t& systemCalls);
+    
+    // Rewrite a text segment LZ77-compressed; bytes are the file sizes before and after
+    bool compact(int month, size_t& textBytes, size_t& compressedBytes);
+    
+    // The manifest and every segment and wallet-list file it names, for backups
+    std::vector<std::string> listFiles() const;
+    
+    // Calendar months (UTC) of Unix times, and "YYYY-MM"
+    static int monthOf(int64_t unixMillis);
+    static int64_t monthStartMillis(int month);
+    static std::string monthName(int month);
+    static bool parseMonthName(const std::string& name, int& month);
+};
+
+#endif
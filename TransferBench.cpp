@@ -0,0 +1,361 @@
+#include "TransferBench.h"
+#include "DataManager.h"
+#include "AuthManager.h"
+#include "WalletManager.h"
+#include "Threading.h"
+#include "FileUtils.h"
+#include "Clock.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <streambuf>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+static const char* BENCH_DATA_DIR = "data/bench-transfers/";
+static const int64_t INITIAL_POINTS = 10000000;
+static const int64_t MAX_TRANSFER_POINTS = 100;
+static const size_t HISTOGRAM_BUCKETS = 32;     // Bucket k: latencies below 2^k microseconds
+static const size_t HISTOGRAM_BAR_WIDTH = 40;
+
+// Swallows the console output of the OTP workflow while clients run
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) {
+        return traits_type::not_eof(c);
+    }
+};
+
+// xorshift64*: cheap per-client choice of wallets and amounts
+static uint64_t nextRandom(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static double unitRandom(uint64_t& state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+class ReceiverPicker {
+private:
+    ReceiverDistribution distribution;
+    double hotShare;
+    size_t count;
+    std::vector<double> cumulative;   // Zipf: running share of the weights
+
+public:
+    ReceiverPicker(const TransferBenchConfig& config, size_t walletCount)
+        : distribution(config.distribution), hotShare(config.hotShare), count(walletCount) {
+        if (distribution == ZIPF_RECEIVERS) {
+            double total = 0;
+            cumulative.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                total += 1.0 / std::pow(static_cast<double>(i + 1), config.zipfExponent);
+                cumulative.push_back(total);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                cumulative[i] /= total;
+            }
+        }
+    }
+    
+    size_t pick(uint64_t& state) const {
+        if (distribution == ZIPF_RECEIVERS) {
+            size_t index = std::upper_bound(cumulative.begin(), cumulative.end(), unitRandom(state)) - cumulative.begin();
+            return index < count ? index : count - 1;
+        }
+        if (distribution == HOT_RECEIVER && unitRandom(state) < hotShare) {
+            return 0;
+        }
+        return nextRandom(state) % count;
+    }
+};
+
+// One simulated client: sends from the wallets it owns (every clientCount-th one)
+struct BenchClient {
+    WalletManager* walletManager;
+    AuthManager* authManager;
+    const std::vector<Id128>* wallets;
+    const ReceiverPicker* receivers;
+    TransferPath path;
+    size_t clientIndex;
+    size_t clientCount;
+    size_t transfers;
+    std::string username;
+    uint64_t randomState;
+    size_t completed;
+    size_t failed;
+    std::vector<uint64_t> latencies;
+};
+
+static std::string clientName(size_t index) {
+    std::ostringstream name;
+    name << "client" << index;
+    return name.str();
+}
+
+static void runClient(void* argument) {
+    BenchClient& client = *static_cast<BenchClient*>(argument);
+    const std::vector<Id128>& wallets = *client.wallets;
+    size_t ownedWallets = (wallets.size() - client.clientIndex + client.clientCount - 1) / client.clientCount;
+    
+    for (size_t i = 0; i < client.transfers; ++i) {
+        size_t sender = client.clientIndex + (nextRandom(client.randomState) % ownedWallets) * client.clientCount;
+        size_t receiver = client.receivers->pick(client.randomState);
+        if (receiver == sender) {
+            receiver = (receiver + 1) % wallets.size();
+        }
+        Money amount = Money::fromPoints(1 + static_cast<int64_t>(nextRandom(client.randomState) % MAX_TRANSFER_POINTS));
+        
+        // The whole round trip a user would see, OTP delivery included
+        std::string otpCode;
+        bool success;
+        uint64_t start = monotonicMicros();
+        if (client.path == TWO_PHASE_PATH) {
+            success = client.walletManager->initiateTransfer(wallets[sender], wallets[receiver], amount, "bench") &&
+                      client.authManager->peekOTP(client.username, otpCode) &&
+                      client.walletManager->confirmTransfer(wallets[sender], wallets[receiver], amount, otpCode, "bench") == TRANSFER_DONE;
+        } else {
+            success = client.authManager->generateOTP(client.username,
+                          WalletManager::transferPurpose(wallets[sender], wallets[receiver], amount)) &&
+                      client.authManager->peekOTP(client.username, otpCode) &&
+                      client.walletManager->transferPoints(wallets[sender], wallets[receiver], amount, otpCode, "bench") == TRANSFER_DONE;
+        }
+        client.latencies.push_back(monotonicMicros() - start);
+        
+        if (success) {
+            ++client.completed;
+        } else {
+            ++client.failed;
+        }
+    }
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+static void printHistogram(const std::vector<uint64_t>& latencies) {
+    std::vector<size_t> buckets(HISTOGRAM_BUCKETS, 0);
+    for (size_t i = 0; i < latencies.size(); ++i) {
+        size_t bucket = 0;
+        while (bucket + 1 < HISTOGRAM_BUCKETS && latencies[i] >= (1ULL << bucket)) {
+            ++bucket;
+        }
+        ++buckets[bucket];
+    }
+    
+    size_t first = HISTOGRAM_BUCKETS, last = 0, largest = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (buckets[i] > 0) {
+            first = std::min(first, i);
+            last = i;
+            largest = std::max(largest, buckets[i]);
+        }
+    }
+    if (largest == 0) {
+        return;
+    }
+    
+    for (size_t i = first; i <= last; ++i) {
+        std::cout << "  < " << std::setw(9) << (1ULL << i) << " us "
+                  << std::setw(9) << buckets[i] << " "
+                  << std::string(buckets[i] * HISTOGRAM_BAR_WIDTH / largest, '#') << std::endl;
+    }
+}
+
+// Run one round with every client on its own thread; adds to the completed count
+static void runRound(DataManager& dataManager, WalletManager& walletManager, AuthManager& authManager,
+                     const std::vector<Id128>& wallets, const ReceiverPicker& receivers,
+                     const TransferBenchConfig& config, size_t clientCount, TransferPath path,
+                     size_t& completedTotal) {
+    std::vector<BenchClient> clients(clientCount);
+    for (size_t i = 0; i < clientCount; ++i) {
+        BenchClient& client = clients[i];
+        client.walletManager = &walletManager;
+        client.authManager = &authManager;
+        client.wallets = &wallets;
+        client.receivers = &receivers;
+        client.path = path;
+        client.clientIndex = i;
+        client.clientCount = clientCount;
+        client.transfers = config.transfersPerClient;
+        client.username = clientName(i);
+        client.randomState = 0x9E3779B97F4A7C15ULL * (i + 1) + path;
+        client.completed = 0;
+        client.failed = 0;
+        client.latencies.reserve(config.transfersPerClient);
+    }
+    
+    dataManager.getWalletLocks().resetStatistics();
+    
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+    std::streambuf* errors = std::cerr.rdbuf(&nullBuffer);
+    
+    // Thread is not copyable, so the threads live in a plain array
+    Thread* threads = new Thread[clientCount];
+    uint64_t start = monotonicMicros();
+    for (size_t i = 0; i < clientCount; ++i) {
+        threads[i].start(runClient, &clients[i]);
+    }
+    for (size_t i = 0; i < clientCount; ++i) {
+        threads[i].join();
+    }
+    uint64_t elapsed = monotonicMicros() - start;
+    delete[] threads;
+    
+    std::cout.rdbuf(console);
+    std::cerr.rdbuf(errors);
+    
+    std::vector<uint64_t> latencies;
+    size_t completed = 0, failed = 0;
+    for (size_t i = 0; i < clientCount; ++i) {
+        latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+        completed += clients[i].completed;
+        failed += clients[i].failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    completedTotal += completed;
+    
+    double seconds = elapsed / 1000000.0;
+    std::cout << std::endl << (path == TWO_PHASE_PATH ? "initiateTransfer + confirmTransfer" : "transferPoints")
+              << ": " << completed << " completed, " << failed << " failed in "
+              << std::fixed << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(0) << (seconds > 0 ? latencies.size() / seconds : 0) << " transfers/s" << std::endl;
+    std::cout << "  latency (us): p50 " << percentile(latencies, 0.50)
+              << ", p90 " << percentile(latencies, 0.90)
+              << ", p99 " << percentile(latencies, 0.99)
+              << ", p99.9 " << percentile(latencies, 0.999)
+              << ", max " << latencies.back() << std::endl;
+    printHistogram(latencies);
+    
+    StripeStatistics stripes = dataManager.getWalletLocks().getStatistics();
+    double acquisitions = stripes.acquisitions > 0 ? static_cast<double>(stripes.acquisitions) : 1.0;
+    std::cout << "  lock stripes: " << stripes.acquisitions << " acquisitions, "
+              << stripes.contended << " contended (" << std::setprecision(2)
+              << 100.0 * stripes.contended / acquisitions << "%); busiest stripe " << stripes.busiestStripe
+              << " took " << 100.0 * stripes.busiestAcquisitions / acquisitions << "%" << std::endl;
+}
+
+bool parseTransferBenchOption(const std::string& option, TransferBenchConfig& config) {
+    size_t equals = option.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    std::string name = option.substr(0, equals);
+    std::string value = option.substr(equals + 1);
+    long number = atol(value.c_str());
+    
+    if (name == "--bench-wallets") {
+        config.walletCount = static_cast<size_t>(number);
+        return number > 1;
+    }
+    if (name == "--bench-clients") {
+        config.clientCount = static_cast<size_t>(number);
+        return number > 0;
+    }
+    if (name == "--bench-count") {
+        config.transfersPerClient = static_cast<size_t>(number);
+        return number > 0;
+    }
+    if (name == "--bench-path") {
+        if (value == "two-phase") {
+            config.path = TWO_PHASE_PATH;
+        } else if (value == "single") {
+            config.path = SINGLE_STEP_PATH;
+        } else if (value == "both") {
+            config.path = BOTH_PATHS;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (name == "--bench-receivers") {
+        // uniform, zipf[:exponent] or hot[:share]
+        size_t colon = value.find(':');
+        std::string kind = value.substr(0, colon);
+        double parameter = colon == std::string::npos ? 0 : atof(value.c_str() + colon + 1);
+        if (kind == "uniform" && colon == std::string::npos) {
+            config.distribution = UNIFORM_RECEIVERS;
+        } else if (kind == "zipf") {
+            config.distribution = ZIPF_RECEIVERS;
+            if (colon != std::string::npos) {
+                config.zipfExponent = parameter;
+            }
+            return config.zipfExponent > 0;
+        } else if (kind == "hot") {
+            config.distribution = HOT_RECEIVER;
+            if (colon != std::string::npos) {
+                config.hotShare = parameter;
+            }
+            return config.hotShare >= 0 && config.hotShare <= 1;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+int runTransferBenchmark(const TransferBenchConfig& config) {
+    size_t clientCount = config.clientCount > 0 ? config.clientCount : hardwareConcurrency();
+    // Every client needs a wallet of its own to send from
+    size_t walletCount = std::max(config.walletCount, clientCount + 1);
+    
+    size_t completed = 0;
+    bool balanced = false;
+    
+    {
+        DataManager dataManager(BENCH_DATA_DIR);
+        dataManager.setPersistenceMode(IN_MEMORY);
+        AuthManager authManager(dataManager);
+        WalletManager walletManager(dataManager, authManager);
+        
+        std::vector<Id128> wallets;
+        wallets.reserve(walletCount);
+        for (size_t i = 0; i < walletCount; ++i) {
+            Id128 walletId = walletManager.createWallet(clientName(i % clientCount));
+            walletManager.addFundsToWallet(walletId, Money::fromPoints(INITIAL_POINTS));
+            wallets.push_back(walletId);
+        }
+        ReceiverPicker receivers(config, walletCount);
+        
+        std::cout << "Transfer benchmark: " << walletCount << " wallets, " << clientCount << " clients x "
+                  << config.transfersPerClient << " transfers, receivers ";
+        if (config.distribution == ZIPF_RECEIVERS) {
+            std::cout << "zipf (exponent " << config.zipfExponent << ")";
+        } else if (config.distribution == HOT_RECEIVER) {
+            std::cout << "hot (" << config.hotShare * 100 << "% to one wallet)";
+        } else {
+            std::cout << "uniform";
+        }
+        std::cout << ", " << dataManager.getWalletLocks().getStripeCount() << " lock stripes" << std::endl;
+        
+        if (config.path != SINGLE_STEP_PATH) {
+            runRound(dataManager, walletManager, authManager, wallets, receivers,
+                     config, clientCount, TWO_PHASE_PATH, completed);
+        }
+        if (config.path != TWO_PHASE_PATH) {
+            runRound(dataManager, walletManager, authManager, wallets, receivers,
+                     config, clientCount, SINGLE_STEP_PATH, completed);
+        }
+        
+        // Transfers only move points: the total must be what was deposited
+        Money total;
+        for (size_t i = 0; i < wallets.size(); ++i) {
+            total.tryAdd(walletManager.getBalance(wallets[i]));
+        }
+        balanced = total == Money::fromPoints(INITIAL_POINTS * static_cast<int64_t>(walletCount));
+    }
+    
+    removeDirectory(BENCH_DATA_DIR);
+    
+    std::cout << std::endl << completed << " transfers completed; ledger "
+              << (balanced ? "balanced" : "UNBALANCED") << std::endl;
+    return balanced ? 0 : 1;
+}
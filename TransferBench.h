@@ -0,0 +1,51 @@
+#ifndef TRANSFER_BENCH_H
+#define TRANSFER_BENCH_H
+
+#include <cstddef>
+#include <string>
+
+// Who receives each transfer
+enum ReceiverDistribution {
+    UNIFORM_RECEIVERS,   // Any other wallet, equally likely
+    ZIPF_RECEIVERS,      // Wallet k with weight 1 / (k + 1)^zipfExponent
+    HOT_RECEIVER         // hotShare of all transfers go to one wallet, the rest uniform
+};
+
+// Which WalletManager entry point the clients call
+enum TransferPath {
+    TWO_PHASE_PATH,      // initiateTransfer, then confirmTransfer with the OTP
+    SINGLE_STEP_PATH,    // generateOTP, then transferPoints
+    BOTH_PATHS           // One round of each
+};
+
+struct TransferBenchConfig {
+    size_t walletCount;
+    size_t clientCount;          // 0: one per processor
+    size_t transfersPerClient;
+    ReceiverDistribution distribution;
+    double zipfExponent;
+    double hotShare;
+    TransferPath path;
+    
+    TransferBenchConfig()
+        : walletCount(1000), clientCount(0), transfersPerClient(10000),
+          distribution(UNIFORM_RECEIVERS), zipfExponent(1.0), hotShare(0.9), path(BOTH_PATHS) {}
+};
+
+// Reads one of --bench-wallets=N, --bench-clients=N, --bench-count=N (per client),
+// --bench-receivers=uniform|zipf[:exponent]|hot[:share] and
+// --bench-path=two-phase|single|both; false if it is not one or its value is invalid
+bool parseTransferBenchOption(const std::string& option, TransferBenchConfig& config);
+
+// Transfer load generator on a scratch in-memory store (data/ is not touched).
+//
+// Creates the wallets, shares them round-robin among the simulated clients
+// and lets every client send transfers from its own wallets to receivers
+// drawn from the configured distribution, through the real OTP workflow. The
+// OTP that would be delivered to the user is read back through
+// AuthManager::peekOTP. For each round it prints throughput, latency
+// percentiles and histogram, and wallet lock stripe contention, then checks
+// that no points were created or lost. Returns 0 if the ledger balances.
+int runTransferBenchmark(const TransferBenchConfig& config);
+
+#endif
@@ -0,0 +1,202 @@
+#include "TransferStress.h"
+#include "DataManager.h"
+#include "AuthManager.h"
+#include "WalletManager.h"
+#include "Threading.h"
+#include "FileUtils.h"
+#include "Clock.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+
+static const char* STRESS_DATA_DIR = "data/stress/";
+static const size_t WALLETS_PER_THREAD = 64;
+static const int64_t INITIAL_POINTS = 1000000;
+static const int64_t MAX_TRANSFER_POINTS = 100;
+
+// One thread's share of a round
+struct StressWorker {
+    WalletManager* walletManager;
+    const std::vector<Id128>* wallets;
+    size_t firstWallet;
+    size_t walletCount;
+    size_t transfers;
+    uint64_t randomState;
+    size_t completed;
+    size_t failed;
+};
+
+// xorshift64*: cheap per-thread choice of wallets and amounts
+static uint64_t nextRandom(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static void runWorker(void* argument) {
+    StressWorker& worker = *static_cast<StressWorker*>(argument);
+    const std::vector<Id128>& wallets = *worker.wallets;
+    
+    for (size_t i = 0; i < worker.transfers; ++i) {
+        size_t sender = nextRandom(worker.randomState) % worker.walletCount;
+        size_t receiver = nextRandom(worker.randomState) % (worker.walletCount - 1);
+        if (receiver >= sender) {
+            ++receiver;
+        }
+        
+        Money amount = Money::fromPoints(1 + static_cast<int64_t>(nextRandom(worker.randomState) % MAX_TRANSFER_POINTS));
+        if (worker.walletManager->executeTransfer(wallets[worker.firstWallet + sender],
+                                                  wallets[worker.firstWallet + receiver],
+                                                  amount, "stress")) {
+            ++worker.completed;
+        } else {
+            ++worker.failed;
+        }
+    }
+}
+
+// Run one round and return transfers per second
+static double runRound(WalletManager& walletManager, const std::vector<Id128>& wallets,
+                       size_t threadCount, bool disjoint, size_t transfersPerThread,
+                       size_t& completed, size_t& failed) {
+    std::vector<StressWorker> workers(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        StressWorker& worker = workers[i];
+        worker.walletManager = &walletManager;
+        worker.wallets = &wallets;
+        worker.firstWallet = disjoint ? i * WALLETS_PER_THREAD : 0;
+        worker.walletCount = disjoint ? WALLETS_PER_THREAD : wallets.size();
+        worker.transfers = transfersPerThread;
+        worker.randomState = 0x9E3779B97F4A7C15ULL * (i + 1) + threadCount;
+        worker.completed = 0;
+        worker.failed = 0;
+    }
+    
+    // Thread is not copyable, so the threads live in a plain array
+    Thread* threads = new Thread[threadCount];
+    uint64_t start = monotonicMicros();
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads[i].start(runWorker, &workers[i]);
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads[i].join();
+    }
+    uint64_t elapsed = monotonicMicros() - start;
+    delete[] threads;
+    
+    for (size_t i = 0; i < threadCount; ++i) {
+        completed += workers[i].completed;
+        failed += workers[i].failed;
+    }
+    
+    double seconds = elapsed > 0 ? elapsed / 1e6 : 1e-6;
+    return static_cast<double>(threadCount * transfersPerThread) / seconds;
+}
+
+// Every balance must equal its completed history, and points are neither created nor lost
+static bool verifyLedger(DataManager& dataManager, const std::vector<Id128>& wallets, size_t expectedTransfers) {
+    bool consistent = true;
+    Money total;
+    std::set<Id128> seenTransfers;
+    
+    for (size_t i = 0; i < wallets.size(); ++i) {
+        Wallet* wallet = dataManager.getWallet(wallets[i]);
+        std::vector<Transaction> history = dataManager.getTransactionsByWallet(wallets[i]);
+        
+        Money expected;
+        size_t completedCount = 0;
+        for (size_t j = 0; j < history.size(); ++j) {
+            const Transaction& transaction = history[j];
+            if (transaction.getStatus() != COMPLETED) {
+                continue;
+            }
+            
+            ++completedCount;
+            if (transaction.getReceiverWalletId() == wallets[i]) {
+                expected.tryAdd(transaction.getAmount());
+            }
+            if (transaction.getSenderWalletId() == wallets[i]) {
+                expected.trySubtract(transaction.getAmount());
+                seenTransfers.insert(transaction.getTransactionId());
+            }
+        }
+        
+        if (!wallet || wallet->getBalance() != expected || wallet->getBalance().isNegative() ||
+            wallet->getTransactionHistory().size() != completedCount) {
+            std::cout << "Ledger mismatch for wallet " << wallets[i] << std::endl;
+            consistent = false;
+        } else {
+            total.tryAdd(wallet->getBalance());
+        }
+    }
+    
+    Money supply = Money::fromPoints(INITIAL_POINTS * static_cast<int64_t>(wallets.size()));
+    if (total != supply) {
+        std::cout << "Total balance " << total << " differs from the " << supply << " deposited" << std::endl;
+        consistent = false;
+    }
+    if (seenTransfers.size() != expectedTransfers) {
+        std::cout << seenTransfers.size() << " completed transfers recorded, expected " << expectedTransfers << std::endl;
+        consistent = false;
+    }
+    return consistent;
+}
+
+int runTransferStress(size_t maxThreads, size_t transfersPerThread) {
+    if (maxThreads == 0) {
+        maxThreads = hardwareConcurrency();
+    }
+    
+    std::vector<Id128> wallets;
+    size_t completed = 0, failed = 0;
+    bool consistent = false;
+    
+    {
+        DataManager dataManager(STRESS_DATA_DIR);
+        dataManager.setPersistenceMode(IN_MEMORY);
+        AuthManager authManager(dataManager);
+        WalletManager walletManager(dataManager, authManager);
+        
+        for (size_t i = 0; i < maxThreads * WALLETS_PER_THREAD; ++i) {
+            Id128 walletId = walletManager.createWallet("stress");
+            walletManager.addFundsToWallet(walletId, Money::fromPoints(INITIAL_POINTS));
+            wallets.push_back(walletId);
+        }
+        
+        std::cout << "Transfer stress: " << wallets.size() << " wallets, "
+                  << transfersPerThread << " transfers per thread, "
+                  << dataManager.getWalletLocks().getStripeCount() << " lock stripes" << std::endl;
+        std::cout << std::left << std::setw(10) << "threads"
+                  << std::setw(22) << "disjoint (tx/s)"
+                  << std::setw(22) << "shared (tx/s)"
+                  << "disjoint speedup" << std::endl;
+        
+        double baseline = 0;
+        for (size_t threadCount = 1; threadCount <= maxThreads; ) {
+            double disjointRate = runRound(walletManager, wallets, threadCount, true, transfersPerThread, completed, failed);
+            double sharedRate = runRound(walletManager, wallets, threadCount, false, transfersPerThread, completed, failed);
+            if (threadCount == 1) {
+                baseline = disjointRate;
+            }
+            
+            std::cout << std::setw(10) << threadCount
+                      << std::setw(22) << std::fixed << std::setprecision(0) << disjointRate
+                      << std::setw(22) << sharedRate
+                      << std::setprecision(2) << disjointRate / baseline << "x" << std::endl;
+            
+            // 1, 2, 4, ... and finally maxThreads itself
+            threadCount = (threadCount == maxThreads) ? maxThreads + 1 :
+                          (threadCount * 2 > maxThreads ? maxThreads : threadCount * 2);
+        }
+        
+        consistent = verifyLedger(dataManager, wallets, completed);
+    }
+    
+    removeDirectory(STRESS_DATA_DIR);
+    
+    std::cout << completed << " transfers completed, " << failed << " rejected; ledger "
+              << (consistent ? "consistent" : "INCONSISTENT") << std::endl;
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef TRANSFER_STRESS_H
+#define TRANSFER_STRESS_H
+
+#include <cstddef>
+
+// Concurrent transfer stress run on a scratch in-memory store (data/ is not touched).
+//
+// Runs the same number of transfers per thread with 1, 2, 4, ... threads, first
+// over disjoint wallet sets (one per thread) and then over wallets shared by all
+// threads, and prints the throughput of each round. Afterwards every wallet's
+// balance is checked against its transaction history and the total supply.
+// Returns 0 if all checks pass.
+int runTransferStress(size_t maxThreads, size_t transfersPerThread);
+
+#endif
@@ -110,6 +110,10 @@ void User::setLastLoginDate(time_t date) {
     this->lastLoginDate = date;
 }
 
+void User::setCreationDate(time_t date) {
+    this->creationDate = date;
+}
+
 void User::setTOTPSecret(const std::string& secret) {
     this->totpSecret = secret;
     
@@ -54,6 +54,7 @@ public:
     void setIsAutoGeneratedPassword(bool isAuto);
     void setIsFirstLogin(bool isFirst);
     void setLastLoginDate(time_t date);
+    void setCreationDate(time_t date);
     void setTOTPSecret(const std::string& secret); // Set TOTP secret
     void enableTOTP(bool enable = true);           // Enable or disable TOTP
 
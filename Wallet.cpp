@@ -2,19 +2,19 @@
 #include <ctime>
 
 Transaction::Transaction() :
-    transactionId(""),
-    senderWalletId(""),
-    receiverWalletId(""),
-    amount(0.0),
+    transactionId(),
+    senderWalletId(),
+    receiverWalletId(),
+    amount(),
     timestamp(time(NULL)),
     isSuccessful(false),
     description(""),
     status(PENDING) {}
 
-Transaction::Transaction(const std::string& transactionId,
-                       const std::string& senderWalletId,
-                       const std::string& receiverWalletId,
-                       double amount,
+Transaction::Transaction(const Id128& transactionId,
+                       const Id128& senderWalletId,
+                       const Id128& receiverWalletId,
+                       const Money& amount,
                        const std::string& description) :
     transactionId(transactionId),
     senderWalletId(senderWalletId),
@@ -25,19 +25,19 @@ Transaction::Transaction(const std::string& transactionId,
     description(description),
     status(PENDING) {}
 
-std::string Transaction::getTransactionId() const {
+Id128 Transaction::getTransactionId() const {
     return transactionId;
 }
 
-std::string Transaction::getSenderWalletId() const {
+Id128 Transaction::getSenderWalletId() const {
     return senderWalletId;
 }
 
-std::string Transaction::getReceiverWalletId() const {
+Id128 Transaction::getReceiverWalletId() const {
     return receiverWalletId;
 }
 
-double Transaction::getAmount() const {
+Money Transaction::getAmount() const {
     return amount;
 }
 
@@ -84,17 +84,21 @@ void Transaction::setStatus(TransactionStatus status) {
     this->isSuccessful = (status == COMPLETED);
 }
 
+void Transaction::setTimestamp(time_t timestamp) {
+    this->timestamp = timestamp;
+}
+
 Wallet::Wallet() : 
-    walletId(""),
+    walletId(),
     ownerUsername(""),
-    balance(0.0) {}
+    balance() {}
 
-Wallet::Wallet(const std::string& walletId, const std::string& ownerUsername, double initialBalance) :
+Wallet::Wallet(const Id128& walletId, const std::string& ownerUsername, const Money& initialBalance) :
     walletId(walletId),
     ownerUsername(ownerUsername),
     balance(initialBalance) {}
 
-std::string Wallet::getWalletId() const {
+Id128 Wallet::getWalletId() const {
     return walletId;
 }
 
@@ -102,27 +106,30 @@ std::string Wallet::getOwnerUsername() const {
     return ownerUsername;
 }
 
-double Wallet::getBalance() const {
+Money Wallet::getBalance() const {
     return balance;
 }
 
-const std::vector<std::string>& Wallet::getTransactionHistory() const {
+const std::vector<Id128>& Wallet::getTransactionHistory() const {
     return transactionHistory;
 }
 
-bool Wallet::deductPoints(double amount) {
-    if (amount > balance) {
+bool Wallet::deductPoints(const Money& amount) {
+    if (amount.isNegative() || amount > balance) {
         return false;
     }
     
-    balance -= amount;
-    return true;
+    return balance.trySubtract(amount);
 }
 
-void Wallet::addPoints(double amount) {
-    balance += amount;
+bool Wallet::addPoints(const Money& amount) {
+    if (amount.isNegative()) {
+        return false;
+    }
+    
+    return balance.tryAdd(amount);
 }
 
-void Wallet::addTransactionToHistory(const std::string& transactionId) {
+void Wallet::addTransactionToHistory(const Id128& transactionId) {
     transactionHistory.push_back(transactionId);
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include "Id128.h"
+#include "Money.h"
 
 // Enum for transaction status
 enum TransactionStatus {
@@ -15,10 +17,10 @@ enum TransactionStatus {
 
 class Transaction {
 private:
-    std::string transactionId;
-    std::string senderWalletId;
-    std::string receiverWalletId;
-    double amount;
+    Id128 transactionId;
+    Id128 senderWalletId;
+    Id128 receiverWalletId;
+    Money amount;
     time_t timestamp;
     bool isSuccessful;
     std::string description;
@@ -27,16 +29,16 @@ private:
 public:
     Transaction();
     
-    Transaction(const std::string& transactionId,
-                const std::string& senderWalletId,
-                const std::string& receiverWalletId,
-                double amount,
+    Transaction(const Id128& transactionId,
+                const Id128& senderWalletId,
+                const Id128& receiverWalletId,
+                const Money& amount,
                 const std::string& description = "");
 
-    std::string getTransactionId() const;
-    std::string getSenderWalletId() const;
-    std::string getReceiverWalletId() const;
-    double getAmount() const;
+    Id128 getTransactionId() const;
+    Id128 getSenderWalletId() const;
+    Id128 getReceiverWalletId() const;
+    Money getAmount() const;
     time_t getTimestamp() const;
     bool getIsSuccessful() const;
     std::string getDescription() const;
@@ -47,27 +49,29 @@ public:
 
     void setIsSuccessful(bool isSuccessful);
     void setStatus(TransactionStatus status);
+    void setTimestamp(time_t timestamp);
 };
 
 class Wallet {
 private:
-    std::string walletId;
+    Id128 walletId;
     std::string ownerUsername;
-    double balance;
-    std::vector<std::string> transactionHistory;
+    Money balance;
+    std::vector<Id128> transactionHistory;
 
 public:
     Wallet();
-    Wallet(const std::string& walletId, const std::string& ownerUsername, double initialBalance = 0.0);
+    Wallet(const Id128& walletId, const std::string& ownerUsername, const Money& initialBalance = Money());
 
-    std::string getWalletId() const;
+    Id128 getWalletId() const;
     std::string getOwnerUsername() const;
-    double getBalance() const;
-    const std::vector<std::string>& getTransactionHistory() const;
+    Money getBalance() const;
+    const std::vector<Id128>& getTransactionHistory() const;
 
-    bool deductPoints(double amount);
-    void addPoints(double amount);
-    void addTransactionToHistory(const std::string& transactionId);
+    // Both refuse negative amounts; deductPoints also refuses to overdraw, addPoints to overflow
+    bool deductPoints(const Money& amount);
+    bool addPoints(const Money& amount);
+    void addTransactionToHistory(const Id128& transactionId);
 };
 
 #endif 
\ No newline at end of file
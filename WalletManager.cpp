@@ -1,77 +1,82 @@
 #include "WalletManager.h"
 #include <iostream>
-#include <stdexcept>
 #include <sstream>
 
+std::string WalletManager::transferPurpose(const Id128& senderWalletId, const Id128& receiverWalletId, const Money& amount) {
+    return "Transfer points: " + senderWalletId.toString() + " to " + receiverWalletId.toString() +
+           ", Amount: " + amount.toString();
+}
+
 WalletManager::WalletManager(DataManager& dataManager, AuthManager& authManager)
     : dataManager(dataManager), authManager(authManager) {}
 
-std::string WalletManager::createWallet(const std::string& ownerUsername) {
+Id128 WalletManager::createWallet(const std::string& ownerUsername) {
     return dataManager.createWallet(ownerUsername);
 }
 
-double WalletManager::getBalance(const std::string& walletId) {
+Money WalletManager::getBalance(const Id128& walletId) {
     Wallet* wallet = dataManager.getWallet(walletId);
     if (wallet) {
+        StripeLock walletLock(dataManager.getWalletLocks(), walletId);
         return wallet->getBalance();
     }
-    return 0.0;
+    return Money();
 }
 
-bool WalletManager::addFundsToWallet(const std::string& walletId, double amount) {
+TransferResult WalletManager::addFundsToWallet(const Id128& walletId, const Money& amount) {
     // Validate amount
-    if (amount <= 0) {
+    if (!amount.isPositive()) {
         std::cerr << "Invalid amount. Amount must be greater than 0." << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
     // Get the wallet
     Wallet* wallet = dataManager.getWallet(walletId);
     if (!wallet) {
         std::cerr << "Wallet not found" << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    // Add the funds to the wallet
-    wallet->addPoints(amount);
-    
-    // Create a deposit transaction record (system wallet to user wallet)
-    std::string systemWalletId = "SYSTEM"; // Special ID for system transactions
-    std::string transactionId = dataManager.createTransaction(
-        systemWalletId, walletId, amount, "Admin deposit"
-    );
-    
-    Transaction* transaction = dataManager.getTransaction(transactionId);
-    if (transaction) {
-        // Mark as completed immediately
-        transaction->setStatus(COMPLETED);
-        dataManager.saveTransaction(*transaction);
+    {
+        StripeLock walletLock(dataManager.getWalletLocks(), walletId);
+        
+        // Add the funds to the wallet
+        if (!wallet->addPoints(amount)) {
+            std::cerr << "Deposit would overflow the wallet balance" << std::endl;
+            return TRANSFER_REJECTED;
+        }
+        
+        // Deposit record (system wallet to user wallet), completed immediately
+        Id128 systemWalletId = Id128::systemWallet(); // Special ID for system transactions
+        Id128 transactionId = dataManager.createTransaction(
+            systemWalletId, walletId, amount, "Admin deposit", COMPLETED
+        );
         
         // Add to wallet transaction history
         wallet->addTransactionToHistory(transactionId);
-        
-        // Save wallet data
         dataManager.saveWallet(*wallet);
-        return true;
     }
     
-    return false;
+    // Persist outside the wallet lock; a deposit is reported only once it is on disk
+    if (!dataManager.commit(DURABILITY_FSYNC)) {
+        std::cerr << "Deposit applied but not yet written to disk; the next save writes it" << std::endl;
+        return TRANSFER_NOT_DURABLE;
+    }
+    return TRANSFER_DONE;
 }
 
-bool WalletManager::transferPoints(const std::string& senderWalletId, 
-                                 const std::string& receiverWalletId, 
-                                 double amount,
-                                 const std::string& otpCode,
-                                 const std::string& description) {
-    Wallet* senderWallet = dataManager.getWallet(senderWalletId);
-    if (!senderWallet) {
-        std::cerr << "Sender wallet not found" << std::endl;
+bool WalletManager::executeTransfer(const Id128& senderWalletId, 
+                                  const Id128& receiverWalletId, 
+                                  const Money& amount,
+                                  const std::string& description) {
+    if (!amount.isPositive()) {
+        std::cerr << "Invalid amount. Amount must be greater than 0." << std::endl;
         return false;
     }
     
-    std::string ownerUsername = senderWallet->getOwnerUsername();
-    if (!authManager.verifyOTP(ownerUsername, otpCode)) {
-        std::cerr << "Invalid OTP for transfer" << std::endl;
+    Wallet* senderWallet = dataManager.getWallet(senderWalletId);
+    if (!senderWallet) {
+        std::cerr << "Sender wallet not found" << std::endl;
         return false;
     }
     
@@ -81,34 +86,26 @@ bool WalletManager::transferPoints(const std::string& senderWalletId,
         return false;
     }
     
-    std::string transactionId = dataManager.createTransaction(
-        senderWalletId, receiverWalletId, amount, description
-    );
-    
-    Transaction* transaction = dataManager.getTransaction(transactionId);
-    if (!transaction) {
-        std::cerr << "Failed to create transaction" << std::endl;
-        return false;
-    }
-    
-    // Set initial transaction status
-    transaction->setStatus(PENDING);
-    
-    bool success = false;
+    // Both stripes, taken in stripe order, for the whole check-and-move
+    StripePairLock walletLock(dataManager.getWalletLocks(), senderWalletId, receiverWalletId);
     
-    if (senderWallet->deductPoints(amount)) {
-        receiverWallet->addPoints(amount);
-        transaction->setStatus(COMPLETED);
-        success = true;
-    } else {
+    TransactionStatus status = FAILED;
+    if (!senderWallet->deductPoints(amount)) {
         std::cerr << "Insufficient balance for transfer" << std::endl;
-        transaction->setStatus(FAILED);
+    } else if (!receiverWallet->addPoints(amount)) {
+        // Receiver balance would overflow: give the points back
+        senderWallet->addPoints(amount);
+        std::cerr << "Receiver balance would overflow" << std::endl;
+    } else {
+        status = COMPLETED;
     }
     
-    // Save transaction status immediately
-    dataManager.saveTransaction(*transaction);
+    // The record is created with its outcome, so readers never see it half-done
+    Id128 transactionId = dataManager.createTransaction(
+        senderWalletId, receiverWalletId, amount, description, status
+    );
     
-    if (success) {
+    if (status == COMPLETED) {
         senderWallet->addTransactionToHistory(transactionId);
         receiverWallet->addTransactionToHistory(transactionId);
         
@@ -116,13 +113,55 @@ bool WalletManager::transferPoints(const std::string& senderWalletId,
         dataManager.saveWallet(*receiverWallet);
     }
     
-    return success;
+    return status == COMPLETED;
+}
+
+TransferResult WalletManager::transferPoints(const Id128& senderWalletId, 
+                                             const Id128& receiverWalletId, 
+                                             const Money& amount,
+                                             const std::string& otpCode,
+                                             const std::string& description) {
+    if (!amount.isPositive()) {
+        std::cerr << "Invalid amount. Amount must be greater than 0." << std::endl;
+        return TRANSFER_REJECTED;
+    }
+    
+    Wallet* senderWallet = dataManager.getWallet(senderWalletId);
+    if (!senderWallet) {
+        std::cerr << "Sender wallet not found" << std::endl;
+        return TRANSFER_REJECTED;
+    }
+    
+    std::string ownerUsername = senderWallet->getOwnerUsername();
+    if (!authManager.verifyOTP(ownerUsername, transferPurpose(senderWalletId, receiverWalletId, amount), otpCode)) {
+        std::cerr << "Invalid OTP for transfer" << std::endl;
+        return TRANSFER_REJECTED;
+    }
+    
+    bool success = executeTransfer(senderWalletId, receiverWalletId, amount, description);
+    
+    // Persist the transaction and both wallets before the transfer is reported; the flush
+    // and its fsync are shared with concurrent transfers. A failed transfer moved nothing.
+    bool committed = dataManager.commit(DURABILITY_FSYNC);
+    if (!success) {
+        return TRANSFER_REJECTED;
+    }
+    if (!committed) {
+        std::cerr << "Transfer applied but not yet written to disk; the next save writes it" << std::endl;
+        return TRANSFER_NOT_DURABLE;
+    }
+    return TRANSFER_DONE;
 }
 
-bool WalletManager::initiateTransfer(const std::string& senderWalletId, 
-                                  const std::string& receiverWalletId, 
-                                  double amount,
+bool WalletManager::initiateTransfer(const Id128& senderWalletId, 
+                                  const Id128& receiverWalletId, 
+                                  const Money& amount,
                                   const std::string& description) {
+    if (!amount.isPositive()) {
+        std::cerr << "Invalid amount. Amount must be greater than 0." << std::endl;
+        return false;
+    }
+    
     // Step 1: Find, open wallet A (sender)
     Wallet* senderWallet = dataManager.getWallet(senderWalletId);
     if (!senderWallet) {
@@ -138,116 +177,91 @@ bool WalletManager::initiateTransfer(const std::string& senderWalletId,
     }
     
     // Check if sender has enough balance (preliminary check only)
-    if (senderWallet->getBalance() < amount) {
+    if (getBalance(senderWalletId) < amount) {
         std::cerr << "Insufficient balance for transfer. Cannot proceed." << std::endl;
         return false;
     }
     
     // Generate transfer-specific OTP for the wallet owner
     std::string ownerUsername = senderWallet->getOwnerUsername();
-    std::string otpPurpose = "Transfer points: " + senderWalletId + " to " + receiverWalletId + 
-                             ", Amount: " + static_cast<std::ostringstream*>(&(std::ostringstream() << amount))->str();
-    
-    return authManager.generateOTP(ownerUsername, otpPurpose);
+    return authManager.generateOTP(ownerUsername, transferPurpose(senderWalletId, receiverWalletId, amount));
 }
 
-bool WalletManager::confirmTransfer(const std::string& senderWalletId, 
-                                  const std::string& receiverWalletId,
-                                  double amount, 
-                                  const std::string& otpCode,
-                                  const std::string& description) {
+TransferResult WalletManager::confirmTransfer(const Id128& senderWalletId, 
+                                              const Id128& receiverWalletId,
+                                              const Money& amount, 
+                                              const std::string& otpCode,
+                                              const std::string& description) {
+    if (!amount.isPositive()) {
+        std::cerr << "Invalid amount. Amount must be greater than 0." << std::endl;
+        return TRANSFER_REJECTED;
+    }
+    
     // Step 1: Find, open wallet A (sender)
     Wallet* senderWallet = dataManager.getWallet(senderWalletId);
     if (!senderWallet) {
         std::cerr << "Sender wallet not found" << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
     // Step 2: Find, open wallet B (receiver)
-    Wallet* receiverWallet = dataManager.getWallet(receiverWalletId);
-    if (!receiverWallet) {
+    if (!dataManager.getWallet(receiverWalletId)) {
         std::cerr << "Receiver wallet not found" << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    // Verify OTP
+    // Verify OTP: only the one issued for this sender, receiver and amount
     std::string ownerUsername = senderWallet->getOwnerUsername();
-    if (!authManager.verifyOTP(ownerUsername, otpCode)) {
+    if (!authManager.verifyOTP(ownerUsername, transferPurpose(senderWalletId, receiverWalletId, amount), otpCode)) {
         std::cerr << "Invalid OTP for transfer" << std::endl;
-        return false;
+        return TRANSFER_REJECTED;
     }
     
-    // Create transaction record
-    std::string transactionId = dataManager.createTransaction(
-        senderWalletId, receiverWalletId, amount, description
-    );
-    
-    Transaction* transaction = dataManager.getTransaction(transactionId);
-    if (!transaction) {
-        std::cerr << "Failed to create transaction" << std::endl;
-        return false;
+    // Step 3: Balance check, debit, credit and the transaction record, atomically
+    bool success = executeTransfer(senderWalletId, receiverWalletId, amount, description);
+    if (!success) {
+        std::cerr << "Transaction failed" << std::endl;
     }
     
-    // Set initial transaction status
-    transaction->setStatus(PENDING);
-    
-    // Begin atomic transaction process
-    bool success = false;
-    
-    try {
-        // Step 3.1: Check if senderWallet has enough balance
-        if (senderWallet->getBalance() < amount) {
-            std::cerr << "Insufficient balance for transfer. Cannot proceed." << std::endl;
-            transaction->setStatus(FAILED);
-            throw std::runtime_error("Low balance");
-        }
-        
-        // Deduct points from sender
-        if (!senderWallet->deductPoints(amount)) {
-            transaction->setStatus(FAILED);
-            throw std::runtime_error("Failed to deduct points");
-        }
-        
-        // Step 3.2: Add points to receiver
-        receiverWallet->addPoints(amount);
-        
-        // Transaction succeeded
-        transaction->setStatus(COMPLETED);
-        success = true;
-    } 
-    catch (const std::exception& e) {
-        std::cerr << "Transaction failed: " << e.what() << std::endl;
-        // The transaction failed, so we don't need to rollback anything
-        // as deductPoints has built-in validation
-        if (transaction->getStatus() != FAILED) {
-            transaction->setStatus(FAILED);
-        }
+    // Persist the transaction and both wallets before the transfer is reported; the flush
+    // and its fsync are shared with concurrent transfers. A failed transfer moved nothing.
+    bool committed = dataManager.commit(DURABILITY_FSYNC);
+    if (!success) {
+        return TRANSFER_REJECTED;
     }
-    
-    // Update transaction status
-    dataManager.saveTransaction(*transaction);
-    
-    if (success) {
-        // Add transaction to history and save data
-        senderWallet->addTransactionToHistory(transactionId);
-        receiverWallet->addTransactionToHistory(transactionId);
-        
-        dataManager.saveWallet(*senderWallet);
-        dataManager.saveWallet(*receiverWallet);
+    if (!committed) {
+        std::cerr << "Transfer applied but not yet written to disk; the next save writes it" << std::endl;
+        return TRANSFER_NOT_DURABLE;
     }
-    
-    return success;
+    return TRANSFER_DONE;
 }
 
-std::vector<Transaction> WalletManager::getTransactionHistory(const std::string& walletId) const {
+std::vector<Transaction> WalletManager::getTransactionHistory(const Id128& walletId) const {
     return dataManager.getTransactionsByWallet(walletId);
 }
 
 Wallet* WalletManager::getCurrentUserWallet() {
-    std::string username = authManager.getCurrentUser();
-    if (username.empty()) {
+    return getSessionWallet(authManager.getCurrentSession());
+}
+
+Wallet* WalletManager::getSessionWallet(const SessionToken& sessionToken) {
+    Session session;
+    if (!authManager.getSession(sessionToken, session)) {
         return NULL;
     }
     
-    return dataManager.getWalletByOwner(username);
+    // The wallet ID cached at login is a direct lookup, not an owner search
+    if (!session.walletId.isNil()) {
+        Wallet* wallet = dataManager.getWallet(session.walletId);
+        if (wallet) {
+            return wallet;
+        }
+    }
+    
+    // No wallet at login time: find it now and remember it
+    Wallet* wallet = dataManager.getWalletByOwner(session.username);
+    if (wallet) {
+        authManager.getSessionManager().setSessionWallet(sessionToken, wallet->getWalletId());
+    }
+    return wallet;
 } 
@@ -6,6 +6,15 @@
 #include "AuthManager.h"
 #include "DataManager.h"
 
+// Outcome of a deposit or transfer. Only TRANSFER_REJECTED means nothing moved:
+// a TRANSFER_NOT_DURABLE one is applied and queued for the next save, and
+// retrying it would move the points twice.
+enum TransferResult {
+    TRANSFER_DONE,          // Applied and on disk
+    TRANSFER_REJECTED,      // Refused or failed; nothing applied
+    TRANSFER_NOT_DURABLE    // Applied, but its commit did not reach disk
+};
+
 class WalletManager {
 private:
     DataManager& dataManager;
@@ -13,34 +22,47 @@ private:
 
 public:
     WalletManager(DataManager& dataManager, AuthManager& authManager);
-
-    std::string createWallet(const std::string& ownerUsername);
-    double getBalance(const std::string& walletId);
+    
+    Id128 createWallet(const std::string& ownerUsername);
+    Money getBalance(const Id128& walletId);
     
     // Add new method for adding funds to wallet
-    bool addFundsToWallet(const std::string& walletId, double amount);
+    TransferResult addFundsToWallet(const Id128& walletId, const Money& amount);
     
-    bool transferPoints(const std::string& senderWalletId, 
-                       const std::string& receiverWalletId, 
-                       double amount,
-                       const std::string& otpCode,
-                       const std::string& description = "");
+    // Move points between two wallets and record the transaction (COMPLETED or
+    // FAILED). Safe to call from several threads: both wallets are locked in
+    // stripe order. No OTP check and no saveData(); callers do both.
+    bool executeTransfer(const Id128& senderWalletId, 
+                        const Id128& receiverWalletId, 
+                        const Money& amount,
+                        const std::string& description = "");
+    
+    // Purpose a transfer OTP is issued for; transferPoints and confirmTransfer
+    // accept only the OTP of the same sender, receiver and amount
+    static std::string transferPurpose(const Id128& senderWalletId, const Id128& receiverWalletId, const Money& amount);
+    
+    TransferResult transferPoints(const Id128& senderWalletId, 
+                                  const Id128& receiverWalletId, 
+                                  const Money& amount,
+                                  const std::string& otpCode,
+                                  const std::string& description = "");
     
     // New two-phase OTP transfer workflow
-    bool initiateTransfer(const std::string& senderWalletId, 
-                        const std::string& receiverWalletId, 
-                        double amount,
+    bool initiateTransfer(const Id128& senderWalletId, 
+                        const Id128& receiverWalletId, 
+                        const Money& amount,
                         const std::string& description = "");
-                        
-    bool confirmTransfer(const std::string& senderWalletId, 
-                       const std::string& receiverWalletId,
-                       double amount, 
-                       const std::string& otpCode,
-                       const std::string& description = "");
     
-    std::vector<Transaction> getTransactionHistory(const std::string& walletId) const;
+    TransferResult confirmTransfer(const Id128& senderWalletId, 
+                                   const Id128& receiverWalletId,
+                                   const Money& amount, 
+                                   const std::string& otpCode,
+                                   const std::string& description = "");
+    
+    std::vector<Transaction> getTransactionHistory(const Id128& walletId) const;
     
     Wallet* getCurrentUserWallet();
+    Wallet* getSessionWallet(const SessionToken& sessionToken);
 };
 
 #endif 
\ No newline at end of file
@@ -1,9 +1,38 @@
 #include <iostream>
 #include <string>
 #include <limits>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip> // For setw
 #include "AccountSystem.h"
 #include "AuthManager.h" // Add this include for OTP class
+#include "TransferStress.h"
+#include "PersistenceBench.h"
+#include "TransferBench.h"
+#include "TotpBench.h"
+#include "CsvBench.h"
+#include "DurabilityBench.h"
+#include "RpcServer.h"
+#include "BatchRunner.h"
+#include "Metrics.h"
+
+// Transfers each thread makes in --stress-transfers
+static const size_t STRESS_TRANSFERS_PER_THREAD = 100000;
+
+// Generated transactions in --bench-persistence without a count
+static const size_t BENCH_PERSISTENCE_TRANSACTIONS = 10000;
+
+// Verifications per case in --bench-totp without a count
+static const size_t BENCH_TOTP_VERIFICATIONS = 100000;
+
+// Generated transactions in --bench-csv without a count
+static const size_t BENCH_CSV_TRANSACTIONS = 1000000;
+
+// Commits per client at each level in --bench-durability without a count
+static const size_t BENCH_DURABILITY_COMMITS = 500;
+
+// Seconds between metrics dumps in --metrics-file without --metrics-interval
+static const uint32_t METRICS_INTERVAL_SECONDS = 15;
 
 void clearScreen() {
     #ifdef _WIN32
@@ -186,7 +215,7 @@ void login(AccountSystem& system) {
             
             std::string otpCode;
             // Generate OTP for password change
-            if (system.generateOTP(username, "password_change")) {
+            if (system.generateOTP(username, AccountSystem::PASSWORD_CHANGE_PURPOSE)) {
                 std::cout << "\nAn OTP has been sent to you to verify password change.\n";
                 std::cout << "Please enter the OTP to confirm: ";
                 std::cin >> otpCode;
@@ -223,7 +252,7 @@ void changePassword(AccountSystem& system) {
     std::string username = system.getCurrentUser();
     
     // Generate OTP for password change
-    if (system.generateOTP(username, "password_change")) {
+    if (system.generateOTP(username, AccountSystem::PASSWORD_CHANGE_PURPOSE)) {
         std::string otpCode;
         std::cout << "\nAn OTP has been sent to you to verify password change.\n";
         std::cout << "Please enter the OTP to confirm: ";
@@ -315,7 +344,7 @@ void updateUserProfile(AccountSystem& system) {
     }
     
     // Generate OTP for profile update
-    if (system.generateOTP(username, "profile_update")) {
+    if (system.generateOTP(username, AccountSystem::PROFILE_UPDATE_PURPOSE)) {
         std::string otpCode;
         std::cout << "\nAn OTP has been sent to you with the details of the changes.\n";
         std::cout << "Please enter the OTP to confirm: ";
@@ -411,7 +440,7 @@ void updateUserProfileByAdmin(AccountSystem& system) {
     }
     
     // Generate OTP for profile update by admin
-    if (system.generateOTP(username, "admin_profile_update")) {
+    if (system.generateOTP(username, AccountSystem::PROFILE_UPDATE_PURPOSE)) {
         std::string otpCode;
         std::cout << "\nAn OTP has been sent to the user (" << username << ") with the details of the changes.\n";
         std::cout << "Please enter the OTP provided by the user to confirm: ";
@@ -507,7 +536,7 @@ void viewAllUsers(AccountSystem& system) {
                         std::cout << "Username: " << resetUsername << "\n";
                         
                         // Generate OTP for password reset by admin
-                        if (system.generateOTP(resetUsername, "admin_password_reset")) {
+                        if (system.generateOTP(resetUsername, AccountSystem::PASSWORD_RESET_PURPOSE)) {
                             std::string otpCode;
                             std::cout << "\nAn OTP has been sent to the user to verify password reset.\n";
                             std::cout << "Please enter the OTP provided by the user to confirm: ";
@@ -620,7 +649,7 @@ void viewAllUsersExceptAdmin(AccountSystem& system) {
                         std::cout << "Username: " << resetUsername << "\n";
                         
                         // Generate OTP for password reset by admin
-                        if (system.generateOTP(resetUsername, "admin_password_reset")) {
+                        if (system.generateOTP(resetUsername, AccountSystem::PASSWORD_RESET_PURPOSE)) {
                             std::string otpCode;
                             std::cout << "\nAn OTP has been sent to the user to verify password reset.\n";
                             std::cout << "Please enter the OTP provided by the user to confirm: ";
@@ -654,7 +683,7 @@ void resetUserPassword(AccountSystem& system) {
     std::cin >> username;
     
     // Generate OTP for password reset
-    if (system.generateOTP(username, "password_reset")) {
+    if (system.generateOTP(username, AccountSystem::PASSWORD_RESET_PURPOSE)) {
         std::string otpCode;
         std::cout << "\nAn OTP has been sent to the user to verify password reset.\n";
         std::cout << "Please enter the OTP provided by the user to confirm: ";
@@ -713,7 +742,7 @@ void viewTransactionHistory(AccountSystem& system) {
     for (size_t i = 0; i < transactions.size(); ++i) {
         const Transaction& tx = transactions[i];
         std::string direction;
-        double amount = tx.getAmount();
+        Money amount = tx.getAmount();
         
         if (tx.getSenderWalletId() == wallet->getWalletId()) {
             direction = "Sent to";
@@ -785,8 +814,9 @@ void viewTransactionDetails(AccountSystem& system) {
 }
 
 void transferPoints(AccountSystem& system) {
-    std::string receiverWalletId, description, otpCode;
-    double amount;
+    Id128 receiverWalletId;
+    std::string description, otpCode;
+    Money amount;
     
     std::cout << "\n===== Transfer Points with OTP Verification =====\n";
     
@@ -852,9 +882,13 @@ void transferPoints(AccountSystem& system) {
     std::cout << "\nEnter OTP Code: ";
     std::cin >> otpCode;
     
-    if (system.confirmTransfer(receiverWalletId, amount, otpCode, description)) {
+    TransferResult result = system.confirmTransfer(receiverWalletId, amount, otpCode, description);
+    if (result != TRANSFER_REJECTED) {
         std::cout << "\nTransfer Successful!\n";
         std::cout << "Amount: " << amount << " points transferred to wallet: " << receiverWalletId << "\n";
+        if (result == TRANSFER_NOT_DURABLE) {
+            std::cout << "Warning: the transfer is not yet saved to disk. Do not repeat it.\n";
+        }
     } else {
         std::cout << "\nTransfer Failed!\n";
         std::cout << "The OTP code may be invalid, expired, or there might be insufficient funds.\n";
@@ -937,8 +971,8 @@ void addFundsToUserWallet(AccountSystem& system) {
     
     if (!wallet) {
         std::cout << "User does not have a wallet. Creating one..." << std::endl;
-        std::string walletId = system.createWallet(username);
-        if (walletId.empty()) {
+        Id128 walletId = system.createWallet(username);
+        if (walletId.isNil()) {
             std::cout << "Failed to create wallet for user." << std::endl;
             return;
         }
@@ -955,11 +989,11 @@ void addFundsToUserWallet(AccountSystem& system) {
     std::cout << "Current Balance: " << wallet->getBalance() << " points" << std::endl;
     
     // Get amount to add
-    double amount;
+    Money amount;
     std::cout << "\nEnter amount to add: ";
     std::cin >> amount;
     
-    if (amount <= 0) {
+    if (!amount.isPositive()) {
         std::cout << "Invalid amount. Amount must be greater than 0." << std::endl;
         return;
     }
@@ -967,14 +1001,14 @@ void addFundsToUserWallet(AccountSystem& system) {
     std::string adminUsername = system.getCurrentUser();
     
     // Generate OTP for admin to add funds
-    if (system.generateOTP(adminUsername, "admin_add_funds")) {
+    if (system.generateOTP(adminUsername, AccountSystem::ADD_FUNDS_PURPOSE)) {
         std::string otpCode;
         std::cout << "\nAn OTP has been generated to verify this admin action.\n";
         std::cout << "Please enter the OTP to confirm adding " << amount << " points to " << username << "'s wallet: ";
         std::cin >> otpCode;
         
         // Add funds to the wallet with OTP verification
-        if (system.adminAddFundsToWallet(wallet->getWalletId(), amount, otpCode)) {
+        if (system.adminAddFundsToWallet(wallet->getWalletId(), amount, otpCode) != TRANSFER_REJECTED) {
             std::cout << "\nFunds added successfully!" << std::endl;
         } else {
             std::cout << "\nFailed to add funds to wallet. Invalid OTP or system error." << std::endl;
@@ -1002,6 +1036,16 @@ void show2FAMenu(const AccountSystem& system) {
     std::cout << "\nChoice: ";
 }
 
+// Changed on a copy: the stored user may be read by the background writer meanwhile
+void disableTOTPFor(AccountSystem& system, const std::string& username) {
+    User user;
+    if (system.getDataManager().copyUser(username, user)) {
+        user.enableTOTP(false);
+        system.getDataManager().saveUser(user);
+        system.getDataManager().saveData();
+    }
+}
+
 // Function to handle 2FA settings
 void handle2FASettings(AccountSystem& system) {
     int choice;
@@ -1017,7 +1061,7 @@ void handle2FASettings(AccountSystem& system) {
         switch (choice) {
             case 0: 
                 return;
-                
+            
             case 1: { // Enable/Disable 2FA
                 if (user && user->isTOTPEnabled()) {
                     // Disable 2FA
@@ -1026,9 +1070,7 @@ void handle2FASettings(AccountSystem& system) {
                     std::cin >> confirm;
                     
                     if (tolower(confirm) == 'y') {
-                        user->enableTOTP(false);
-                        system.getDataManager().saveUser(*user);
-                        system.getDataManager().saveData();
+                        disableTOTPFor(system, username);
                         std::cout << "\n2FA has been disabled for your account.\n";
                     }
                 } else {
@@ -1042,9 +1084,7 @@ void handle2FASettings(AccountSystem& system) {
                             std::cout << "\n2FA has been successfully enabled for your account.\n";
                             std::cout << "Please keep your secret key in a safe place.\n";
                         } else {
-                            user->enableTOTP(false);
-                            system.getDataManager().saveUser(*user);
-                            system.getDataManager().saveData();
+                            disableTOTPFor(system, username);
                             std::cout << "\nVerification failed. 2FA setup was canceled.\n";
                         }
                     } else {
@@ -1056,7 +1096,7 @@ void handle2FASettings(AccountSystem& system) {
                 std::cin.get();
                 break;
             }
-                
+            
             case 2: { // Test 2FA
                 if (user && user->isTOTPEnabled()) {
                     // Get the user's TOTP secret key
@@ -1086,7 +1126,7 @@ void handle2FASettings(AccountSystem& system) {
                 std::cin.get();
                 break;
             }
-                
+            
             default:
                 std::cout << "\nInvalid choice. Press Enter to continue...";
                 clearInputBuffer();
@@ -1095,10 +1135,118 @@ void handle2FASettings(AccountSystem& system) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Stress runs and benchmarks use their own scratch store, so they start before the real data is loaded
+    TransferBenchConfig transferBench;
+    bool benchTransfers = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stress-transfers") == 0) {
+            return runTransferStress(0, STRESS_TRANSFERS_PER_THREAD);
+        } else if (strncmp(argv[i], "--stress-transfers=", 19) == 0) {
+            return runTransferStress(static_cast<size_t>(atoi(argv[i] + 19)), STRESS_TRANSFERS_PER_THREAD);
+        } else if (strcmp(argv[i], "--bench-persistence") == 0) {
+            return runPersistenceBenchmark(BENCH_PERSISTENCE_TRANSACTIONS);
+        } else if (strncmp(argv[i], "--bench-persistence=", 20) == 0) {
+            return runPersistenceBenchmark(static_cast<size_t>(atol(argv[i] + 20)));
+        } else if (strcmp(argv[i], "--bench-totp") == 0) {
+            return runTotpBenchmark(BENCH_TOTP_VERIFICATIONS);
+        } else if (strncmp(argv[i], "--bench-totp=", 13) == 0) {
+            return runTotpBenchmark(static_cast<size_t>(atol(argv[i] + 13)));
+        } else if (strcmp(argv[i], "--bench-csv") == 0) {
+            return runCsvBenchmark(BENCH_CSV_TRANSACTIONS);
+        } else if (strncmp(argv[i], "--bench-csv=", 12) == 0) {
+            return runCsvBenchmark(static_cast<size_t>(atol(argv[i] + 12)));
+        } else if (strcmp(argv[i], "--bench-durability") == 0) {
+            return runDurabilityBenchmark(BENCH_DURABILITY_COMMITS);
+        } else if (strncmp(argv[i], "--bench-durability=", 19) == 0) {
+            return runDurabilityBenchmark(static_cast<size_t>(atol(argv[i] + 19)));
+        } else if (strcmp(argv[i], "--bench-transfers") == 0) {
+            benchTransfers = true;
+        } else if (strncmp(argv[i], "--bench-", 8) == 0 && !parseTransferBenchOption(argv[i], transferBench)) {
+            std::cout << "Invalid benchmark option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (benchTransfers) {
+        return runTransferBenchmark(transferBench);
+    }
+    
     AccountSystem system;
+    
+    // Storage options: --snapshot-format=text|binary, --convert-snapshot,
+    // --list-backups, --restore-backup=<id>
+    // Server mode: --server=<socket path> [--workers=<n>] [--expose-otp]
+    // Batch mode: --batch=<script> (see BatchRunner.h)
+    // Metrics: --metrics-file=<path|unix:socket path> [--metrics-interval=<seconds>]
+    RpcServerConfig serverConfig;
+    std::string batchScript;
+    std::string metricsTarget;
+    uint32_t metricsInterval = METRICS_INTERVAL_SECONDS;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--snapshot-format=binary") == 0) {
+            system.getDataManager().setSnapshotFormat(BINARY_SNAPSHOT);
+        } else if (strcmp(argv[i], "--snapshot-format=text") == 0) {
+            system.getDataManager().setSnapshotFormat(TEXT_SNAPSHOT);
+        } else if (strcmp(argv[i], "--convert-snapshot") == 0) {
+            if (system.getDataManager().convertTextToBinary()) {
+                std::cout << "Data converted to binary snapshot." << std::endl;
+                return 0;
+            }
+            std::cout << "Snapshot conversion failed." << std::endl;
+            return 1;
+        } else if (strcmp(argv[i], "--list-backups") == 0) {
+            std::vector<std::string> backups = system.getDataManager().listBackups();
+            for (size_t j = 0; j < backups.size(); ++j) {
+                std::cout << backups[j] << std::endl;
+            }
+            return 0;
+        } else if (strncmp(argv[i], "--restore-backup=", 17) == 0) {
+            std::string backupId = argv[i] + 17;
+            if (system.getDataManager().restoreFromBackup(backupId)) {
+                std::cout << "Backup " << backupId << " restored." << std::endl;
+                return 0;
+            }
+            std::cout << "Failed to restore backup " << backupId << "." << std::endl;
+            return 1;
+        } else if (strncmp(argv[i], "--server=", 9) == 0) {
+            serverConfig.socketPath = argv[i] + 9;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            serverConfig.workerCount = static_cast<size_t>(atoi(argv[i] + 10));
+        } else if (strcmp(argv[i], "--expose-otp") == 0) {
+            serverConfig.exposeOtp = true;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batchScript = argv[i] + 8;
+        } else if (strncmp(argv[i], "--metrics-file=", 15) == 0) {
+            metricsTarget = argv[i] + 15;
+        } else if (strncmp(argv[i], "--metrics-interval=", 19) == 0) {
+            metricsInterval = static_cast<uint32_t>(atoi(argv[i] + 19));
+        } else {
+            std::cout << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    
     system.start();
     
+    // Declared before the modes below so its final dump comes after shutdown()
+    MetricsExporter metricsExporter;
+    if (!metricsTarget.empty() && !metricsExporter.start(metricsTarget, metricsInterval * 1000)) {
+        std::cout << "Failed to start metrics export to " << metricsTarget << std::endl;
+    }
+    
+    if (!serverConfig.socketPath.empty()) {
+        RpcServer server(system, serverConfig);
+        bool served = server.run();
+        system.shutdown();
+        return served ? 0 : 1;
+    }
+    
+    if (!batchScript.empty()) {
+        int result = runBatch(system, batchScript);
+        system.shutdown();
+        return result;
+    }
+    
     int choice;
     bool exitProgram = false;
     
@@ -1127,7 +1275,7 @@ int main() {
                 
                 std::string otpCode;
                 // Generate OTP for password change
-                if (system.generateOTP(username, "password_change")) {
+                if (system.generateOTP(username, AccountSystem::PASSWORD_CHANGE_PURPOSE)) {
                     std::cout << "\nAn OTP has been sent to you to verify password change.\n";
                     std::cout << "Please enter the OTP to confirm: ";
                     std::cin >> otpCode;